@@ -0,0 +1,201 @@
+#include "adaptive.h"
+#include "buffer.h"
+#include "command.h"
+#include "pipeline.h"
+#include "query.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ADAPTIVE_BINDING_COUNT 4
+
+// Mirror of the std430 layout in adaptive.comp; tiles[] follows the header
+typedef struct AdaptiveTileHeader {
+    uint32_t count;
+    uint32_t padding[3];
+    VkTraceRaysIndirectCommandKHR traceArgs;
+    uint32_t traceArgsPadding;
+} AdaptiveTileHeader;
+
+static const char* adaptiveShaders[ADAPTIVE_STAGE_COUNT] = {
+    "./adaptive_reduce.comp.spv",
+    "./adaptive_prepare.comp.spv"};
+
+static const VkDescriptorType adaptiveBindingTypes[ADAPTIVE_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+static uint32_t adaptiveTileCount(VKRT* vkrt, uint32_t* tilesX, uint32_t* tilesY) {
+    *tilesX = (vkrt->swapChainExtent.width + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    *tilesY = (vkrt->swapChainExtent.height + ADAPTIVE_TILE_SIZE - 1) / ADAPTIVE_TILE_SIZE;
+    return *tilesX * *tilesY;
+}
+
+void createAdaptivePipeline(VKRT* vkrt) {
+    VkDescriptorSetLayoutBinding bindings[ADAPTIVE_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < ADAPTIVE_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = adaptiveBindingTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->adaptiveDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create adaptive sampling descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->adaptiveDescriptorSetLayout;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->adaptivePipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create adaptive sampling pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < ADAPTIVE_STAGE_COUNT; i++) {
+        vkrt->adaptivePipelines[i] = createComputePipeline(vkrt, adaptiveShaders[i], vkrt->adaptivePipelineLayout, NULL);
+    }
+
+    if (!vkrt->traceRaysIndirect) {
+        printf("INFO: Device lacks indirect trace rays, adaptive sampling launches every tile and skips converged ones.\n");
+    }
+}
+
+void destroyAdaptivePipeline(VKRT* vkrt) {
+    for (uint32_t i = 0; i < ADAPTIVE_STAGE_COUNT; i++) {
+        vkrt->vk.DestroyPipeline(vkrt->device, vkrt->adaptivePipelines[i], NULL);
+    }
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->adaptivePipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->adaptiveDescriptorSetLayout, NULL);
+}
+
+void createAdaptiveResources(VKRT* vkrt) {
+    VkDeviceSize capacity = (VkDeviceSize)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+    uint32_t tilesX, tilesY;
+    uint32_t tileCount = adaptiveTileCount(vkrt, &tilesX, &tilesY);
+
+    createBuffer(vkrt, capacity * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->adaptiveStatsBuffer, &vkrt->adaptiveStatsMemory);
+    createBuffer(vkrt, sizeof(AdaptiveTileHeader) + tileCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->adaptiveTileBuffer, &vkrt->adaptiveTileMemory);
+
+    VkBufferDeviceAddressInfo addressInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = vkrt->adaptiveTileBuffer};
+    vkrt->adaptiveTraceArgsAddress = vkrt->vk.GetBufferDeviceAddressKHR(vkrt->device, &addressInfo) + offsetof(AdaptiveTileHeader, traceArgs);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = 1;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->adaptiveDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create adaptive sampling descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->adaptiveDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = &vkrt->adaptiveDescriptorSetLayout;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->adaptiveDescriptorSet) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate adaptive sampling descriptor set");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorBufferInfo bufferInfos[ADAPTIVE_BINDING_COUNT] = {0};
+    bufferInfos[0] = (VkDescriptorBufferInfo){vkrt->uniformBuffer, 0, sizeof(SceneUniform)};
+    bufferInfos[1] = (VkDescriptorBufferInfo){vkrt->adaptiveStatsBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = (VkDescriptorBufferInfo){vkrt->adaptiveTileBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = (VkDescriptorBufferInfo){vkrt->pathCounterBuffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[ADAPTIVE_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < ADAPTIVE_BINDING_COUNT; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = vkrt->adaptiveDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = adaptiveBindingTypes[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+}
+
+void destroyAdaptiveResources(VKRT* vkrt) {
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->adaptiveDescriptorPool, NULL);
+    vkrt->adaptiveDescriptorPool = VK_NULL_HANDLE;
+
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->adaptiveStatsBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->adaptiveStatsMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->adaptiveTileBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->adaptiveTileMemory, NULL);
+
+    // The ray tracing descriptor set falls back to placeholders for these
+    vkrt->adaptiveStatsBuffer = VK_NULL_HANDLE;
+    vkrt->adaptiveTileBuffer = VK_NULL_HANDLE;
+}
+
+// Variance is only tracked by the accumulating megakernel, so other modes keep tracing every pixel
+VkBool32 adaptiveSamplingActive(VKRT* vkrt) {
+    return vkrt->pathSettings.adaptive && vkrt->outputPrecision == OUTPUT_PRECISION_RGBA32F && vkrt->traceMode == TRACE_MODE_MEGAKERNEL;
+}
+
+// Builds this frame's list of unconverged tiles, then traces one launch row per listed tile.
+// Expects the ray tracing pipeline and descriptor set to be bound already.
+void recordAdaptiveTrace(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot) {
+    uint32_t tilesX, tilesY;
+    uint32_t tileCount = adaptiveTileCount(vkrt, &tilesX, &tilesY);
+
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    // The previous frame's trace still reads the tile list and writes the statistics reduced here
+    VkMemoryBarrier previousFrameBarrier = {0};
+    previousFrameBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    previousFrameBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    previousFrameBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &previousFrameBarrier, 0, NULL, 0, NULL);
+
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_ADAPTIVE);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->adaptiveTileBuffer, 0, sizeof(uint32_t), 0);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->adaptivePipelineLayout, 0, 1, &vkrt->adaptiveDescriptorSet, 0, NULL);
+
+    vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->adaptivePipelines[ADAPTIVE_STAGE_REDUCE]);
+    vkrt->vk.CmdDispatch(commandBuffer, tilesX, tilesY, 1);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+    vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->adaptivePipelines[ADAPTIVE_STAGE_PREPARE]);
+    vkrt->vk.CmdDispatch(commandBuffer, 1, 1, 1);
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+    // Without indirect launches every tile gets a row and rows past the list length exit immediately
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_TRACE);
+    if (vkrt->traceRaysIndirect) {
+        vkrt->vk.CmdTraceRaysIndirectKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], vkrt->adaptiveTraceArgsAddress);
+    } else {
+        vkrt->vk.CmdTraceRaysKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], ADAPTIVE_TILE_SIZE * ADAPTIVE_TILE_SIZE, tileCount, 1);
+    }
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+}
@@ -0,0 +1,12 @@
+#pragma once
+#include "vkrt.h"
+
+// Must match adaptive.comp and main.rgen
+#define ADAPTIVE_TILE_SIZE 16
+
+void createAdaptivePipeline(VKRT* vkrt);
+void createAdaptiveResources(VKRT* vkrt);
+void destroyAdaptiveResources(VKRT* vkrt);
+void destroyAdaptivePipeline(VKRT* vkrt);
+VkBool32 adaptiveSamplingActive(VKRT* vkrt);
+void recordAdaptiveTrace(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot);
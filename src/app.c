@@ -1,17 +1,35 @@
 #include "app.h"
+#include "adaptive.h"
+#include "benchmark.h"
 #include "buffer.h"
 #include "command.h"
+#include "denoise.h"
 #include "descriptor.h"
 #include "device.h"
+#include "environment.h"
 #include "instance.h"
 #include "interface.h"
+#include "loader.h"
+#include "multiview.h"
 #include "object.h"
+#include "offline.h"
 #include "pipeline.h"
+#include "query.h"
+#include "raycast.h"
+#include "recorder.h"
+#include "reference.h"
+#include "restir.h"
+#include "sampler.h"
 #include "structure.h"
 #include "surface.h"
 #include "swapchain.h"
+#include "tonemap.h"
+#include "upload.h"
+#include "upscale.h"
 #include "validation.h"
+#include "wavefront.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 
 static void framebufferResizedCallback(GLFWwindow* window, int width, int height) {
@@ -23,38 +41,74 @@ static void framebufferResizedCallback(GLFWwindow* window, int width, int height
 }
 
 void initWindow(VKRT* vkrt) {
-    glfwInit();
+    // Batch ray casts run without a display server, so they never open a window
+    if (!vkrt->headless) {
+        glfwInit();
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+        // CPU references never present, keep their window out of sight
+        if (vkrt->cpuReference) {
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        }
 
-    vkrt->window = glfwCreateWindow(WIDTH, HEIGHT, "VKRT", 0, 0);
-    glfwSetWindowUserPointer(vkrt->window, vkrt);
-    glfwSetFramebufferSizeCallback(vkrt->window, framebufferResizedCallback);
+        vkrt->window = glfwCreateWindow(WIDTH, HEIGHT, "VKRT", 0, 0);
+        glfwSetWindowUserPointer(vkrt->window, vkrt);
+        glfwSetFramebufferSizeCallback(vkrt->window, framebufferResizedCallback);
+    }
 
     vkrt->vsync = 1;
+    vkrt->outputPrecision = OUTPUT_PRECISION_RGBA16F;
+    vkrt->requestedOutputPrecision = OUTPUT_PRECISION_RGBA16F;
+    vkrt->pathSettings = (PathSettings){.maxDepth = 8, .rouletteDepth = 3, .nextEventEstimation = 1, .environmentSampling = ENVIRONMENT_SAMPLING_IMPORTANCE, .lightSampling = LIGHT_SAMPLING_TREE};
+    vkrt->requestedPathSettings = vkrt->pathSettings;
+    vkrt->renderScale = 1.0f;
+    vkrt->traceBudget = 16.0f;
 }
 
 void initVulkan(VKRT* vkrt) {
     createInstance(vkrt);
     setupDebugMessenger(vkrt);
-    createSurface(vkrt);
+    if (!vkrt->headless) createSurface(vkrt);
     pickPhysicalDevice(vkrt);
+    // Without a ray tracing GPU, or when asked for ground truth, the CPU tracer renders instead
+    if (vkrt->cpuReference) return;
     createLogicalDevice(vkrt);
+    // Batch ray casts need the scene's acceleration structures and the ray cast pipeline, nothing that presents
+    if (vkrt->headless) {
+        createCommandPool(vkrt);
+        startSceneLoad(vkrt, vkrt->scenePath ? vkrt->scenePath : "assets/dragon.glb");
+        createBottomLevelAccelerationStructure(vkrt);
+        createTopLevelAccelerationStructure(vkrt);
+        createRayCastPipeline(vkrt);
+        return;
+    }
     createSwapChain(vkrt);
     createImageViews(vkrt);
     createRenderPass(vkrt);
     createFramebuffers(vkrt);
     createCommandPool(vkrt);
-    loadObject(vkrt, "assets/dragon.glb");
+    startSceneLoad(vkrt, vkrt->scenePath ? vkrt->scenePath : "assets/dragon.glb");
+    createEnvironment(vkrt);
+    createSamplerBuffer(vkrt);
     createBottomLevelAccelerationStructure(vkrt);
     createTopLevelAccelerationStructure(vkrt);
     createDescriptorSetLayout(vkrt);
     createRayTracingPipeline(vkrt);
+    createTonemapPipeline(vkrt);
+    createWavefrontPipeline(vkrt);
+    createRestirPipeline(vkrt);
+    createAdaptivePipeline(vkrt);
+    createDenoisePipeline(vkrt);
+    createUpscalePipeline(vkrt);
+    createRayCastPipeline(vkrt);
     createStorageImage(vkrt);
     createUniformBuffer(vkrt);
+    createPathCounterBuffer(vkrt);
     createDescriptorPool(vkrt);
     createDescriptorSet(vkrt);
+    createTonemapResources(vkrt);
+    createTimestampQueryPool(vkrt);
     createShaderBindingTable(vkrt);
     createCommandBuffers(vkrt);
     createSyncObjects(vkrt);
@@ -63,72 +117,158 @@ void initVulkan(VKRT* vkrt) {
     setupSceneUniform(vkrt);
 }
 
+static void destroyInstance(VKRT* vkrt) {
+    if (enableValidationLayers) {
+        DestroyDebugUtilsMessengerEXT(vkrt->instance, vkrt->debugMessenger, NULL);
+    }
+
+    vkDestroySurfaceKHR(vkrt->instance, vkrt->surface, NULL);
+    vkDestroyInstance(vkrt->instance, NULL);
+
+    if (vkrt->window) {
+        glfwDestroyWindow(vkrt->window);
+        glfwTerminate();
+    }
+}
+
+static void deinitHeadless(VKRT* vkrt) {
+    destroySceneLoader(vkrt);
+    destroyAccelerationStructures(vkrt);
+    destroyObjectBuffers(vkrt);
+    destroyObject(vkrt);
+    destroyRayCastPipeline(vkrt);
+
+    destroyUploadRing(vkrt);
+    destroyRecorder(vkrt);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkrt->vk.DestroyCommandPool(vkrt->device, vkrt->frameCommandPools[i], NULL);
+    }
+    vkrt->vk.DestroyCommandPool(vkrt->device, vkrt->commandPool, NULL);
+
+    vkrt->vk.DestroyDevice(vkrt->device, NULL);
+    destroyInstance(vkrt);
+}
+
 void deinit(VKRT* vkrt) {
+    if (vkrt->headless) {
+        deinitHeadless(vkrt);
+        return;
+    }
+
     deinitImGui(vkrt);
 
     cleanupSwapChain(vkrt);
 
-    vkDestroyRenderPass(vkrt->device, vkrt->renderPass, NULL);
+    vkrt->vk.DestroyRenderPass(vkrt->device, vkrt->renderPass, NULL);
 
-    vkDestroyBuffer(vkrt->device, vkrt->shaderBindingTableBuffer, NULL);
-    vkFreeMemory(vkrt->device, vkrt->shaderBindingTableMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->shaderBindingTableBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->shaderBindingTableMemory, NULL);
 
-    PFN_vkDestroyAccelerationStructureKHR vkDestroyAS = (PFN_vkDestroyAccelerationStructureKHR)vkGetDeviceProcAddr(vkrt->device, "vkDestroyAccelerationStructureKHR");
-    vkDestroyAS(vkrt->device, vkrt->bottomLevelAccelerationStructure, NULL);
-    vkDestroyBuffer(vkrt->device, vkrt->bottomLevelAccelerationStructureBuffer, NULL);
-    vkFreeMemory(vkrt->device, vkrt->bottomLevelAccelerationStructureMemory, NULL);
+    destroySceneLoader(vkrt);
+    destroyAccelerationStructures(vkrt);
+    destroyObjectBuffers(vkrt);
+    destroyEnvironment(vkrt);
+    destroySamplerBuffer(vkrt);
+    destroyObject(vkrt);
 
-    vkDestroyAS(vkrt->device, vkrt->topLevelAccelerationStructure, NULL);
-    vkDestroyBuffer(vkrt->device, vkrt->topLevelAccelerationStructureBuffer, NULL);
-    vkFreeMemory(vkrt->device, vkrt->topLevelAccelerationStructureMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->uniformBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->uniformBufferMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->pathCounterBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->pathCounterMemory, NULL);
 
-    vkDestroyBuffer(vkrt->device, vkrt->vertexBuffer, NULL);
-    vkFreeMemory(vkrt->device, vkrt->vertexBufferMemory, NULL);
-    vkDestroyBuffer(vkrt->device, vkrt->indexBuffer, NULL);
-    vkFreeMemory(vkrt->device, vkrt->indexBufferMemory, NULL);
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->descriptorPool, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->descriptorSetLayout, NULL);
 
-    vkDestroyBuffer(vkrt->device, vkrt->uniformBuffer, NULL);
-    vkFreeMemory(vkrt->device, vkrt->uniformBufferMemory, NULL);
+    vkrt->vk.DestroyPipeline(vkrt->device, vkrt->rayTracingPipeline, NULL);
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->pipelineLayout, NULL);
 
-    vkDestroyDescriptorPool(vkrt->device, vkrt->descriptorPool, NULL);
-    vkDestroyDescriptorSetLayout(vkrt->device, vkrt->descriptorSetLayout, NULL);
+    destroyTonemapPipeline(vkrt);
+    destroyWavefrontPipeline(vkrt);
+    destroyRestirPipeline(vkrt);
+    destroyAdaptivePipeline(vkrt);
+    destroyDenoisePipeline(vkrt);
+    destroyUpscalePipeline(vkrt);
+    destroyRayCastPipeline(vkrt);
+    vkrt->vk.DestroyQueryPool(vkrt->device, vkrt->timestampQueryPool, NULL);
 
-    vkDestroyPipeline(vkrt->device, vkrt->rayTracingPipeline, NULL);
-    vkDestroyPipelineLayout(vkrt->device, vkrt->pipelineLayout, NULL);
+    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkrt->vk.DestroySemaphore(vkrt->device, vkrt->imageAvailableSemaphores[i], NULL);
+        vkrt->vk.DestroySemaphore(vkrt->device, vkrt->renderFinishedSemaphores[i], NULL);
+        vkrt->vk.DestroyFence(vkrt->device, vkrt->inFlightFences[i], NULL);
+    }
 
+    destroyUploadRing(vkrt);
+    destroyRecorder(vkrt);
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(vkrt->device, vkrt->imageAvailableSemaphores[i], NULL);
-        vkDestroySemaphore(vkrt->device, vkrt->renderFinishedSemaphores[i], NULL);
-        vkDestroyFence(vkrt->device, vkrt->inFlightFences[i], NULL);
+        vkrt->vk.DestroyCommandPool(vkrt->device, vkrt->frameCommandPools[i], NULL);
     }
+    vkrt->vk.DestroyCommandPool(vkrt->device, vkrt->commandPool, NULL);
 
-    vkFreeCommandBuffers(vkrt->device, vkrt->commandPool, COUNT_OF(vkrt->commandBuffers), vkrt->commandBuffers);
+    vkrt->vk.DestroyDevice(vkrt->device, NULL);
+    destroyInstance(vkrt);
+}
 
-    vkDestroyCommandPool(vkrt->device, vkrt->commandPool, NULL);
+void run(VKRT* vkrt) {
+    const Benchmark* benchmark = NULL;
+    if (vkrt->benchmarkName) {
+        benchmark = findBenchmark(vkrt->benchmarkName);
+        if (!benchmark) {
+            fprintf(stderr, "ERROR: Unknown benchmark '%s', available:\n", vkrt->benchmarkName);
+            listBenchmarks();
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    vkDestroyDevice(vkrt->device, NULL);
+    vkrt->headless = vkrt->castRayPath != NULL;
+    initWindow(vkrt);
+    initVulkan(vkrt);
 
-    if (enableValidationLayers) {
-        DestroyDebugUtilsMessengerEXT(vkrt->instance, vkrt->debugMessenger, NULL);
+    if (vkrt->cpuReference) {
+        renderReference(vkrt);
+        destroyObject(vkrt);
+        destroyInstance(vkrt);
+        return;
     }
 
-    vkDestroySurfaceKHR(vkrt->instance, vkrt->surface, NULL);
-    vkDestroyInstance(vkrt->instance, NULL);
+    // Only the interactive loop renders the proxy, everything else needs the real scene
+    if (benchmark || vkrt->offlinePath || vkrt->multiViewPath || vkrt->castRayPath) {
+        finishSceneLoad(vkrt);
+    }
 
-    glfwDestroyWindow(vkrt->window);
-    glfwTerminate();
-}
+    if (benchmark) {
+        benchmark->run(vkrt);
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        deinit(vkrt);
+        return;
+    }
 
-void run(VKRT* vkrt) {
-    initWindow(vkrt);
-    initVulkan(vkrt);
+    if (vkrt->offlinePath) {
+        renderOffline(vkrt);
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        deinit(vkrt);
+        return;
+    }
+
+    if (vkrt->multiViewPath) {
+        renderViews(vkrt);
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        deinit(vkrt);
+        return;
+    }
+
+    if (vkrt->castRayPath) {
+        castRayFile(vkrt);
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        deinit(vkrt);
+        return;
+    }
 
     while (!glfwWindowShouldClose(vkrt->window)) {
         glfwPollEvents();
         drawFrame(vkrt);
     }
 
-    vkDeviceWaitIdle(vkrt->device);
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
 
     deinit(vkrt);
 }
\ No newline at end of file
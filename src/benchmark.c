@@ -0,0 +1,504 @@
+#include "benchmark.h"
+#include "command.h"
+#include "device.h"
+#include "interface.h"
+#include "multiview.h"
+#include "query.h"
+#include "raycast.h"
+#include "widebvh.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DISPATCH_BENCHMARK_CALLS 100000
+#define TRACE_BENCHMARK_WARMUP_FRAMES 120
+#define TRACE_BENCHMARK_FRAMES 240
+#define NOISE_BENCHMARK_REFERENCE_FRAMES 2048
+#define NOISE_BENCHMARK_SECONDS 2.0
+#define ADAPTIVE_BENCHMARK_TARGET_FRAMES 256
+#define ADAPTIVE_BENCHMARK_CHUNK_FRAMES 16
+#define ADAPTIVE_BENCHMARK_MAX_FRAMES 4096
+#define MULTIVIEW_BENCHMARK_VIEWS 24
+#define MULTIVIEW_BENCHMARK_SAMPLES 32
+#define RAYCAST_BENCHMARK_BATCHES 32
+#define QUERY_BENCHMARK_GRID 1024
+#define QUERY_BENCHMARK_POINTS (1u << 16)
+
+static double timeCalls(uint64_t start, uint64_t end) {
+    return (double)(end - start) / DISPATCH_BENCHMARK_CALLS;
+}
+
+static void benchmarkDispatch(VKRT* vkrt) {
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    VkPipelineBindPoint bindPoint = VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR;
+    VkPipeline pipeline = vkrt->rayTracingPipeline;
+
+    uint64_t start = getTimeNanoSeconds();
+    for (uint32_t i = 0; i < DISPATCH_BENCHMARK_CALLS; i++) {
+        vkCmdBindPipeline(commandBuffer, bindPoint, pipeline);
+    }
+    uint64_t loader = getTimeNanoSeconds();
+
+    for (uint32_t i = 0; i < DISPATCH_BENCHMARK_CALLS; i++) {
+        vkrt->vk.CmdBindPipeline(commandBuffer, bindPoint, pipeline);
+    }
+    uint64_t table = getTimeNanoSeconds();
+
+    for (uint32_t i = 0; i < DISPATCH_BENCHMARK_CALLS; i++) {
+        PFN_vkCmdBindPipeline cmdBindPipeline = (PFN_vkCmdBindPipeline)vkGetDeviceProcAddr(vkrt->device, "vkCmdBindPipeline");
+        cmdBindPipeline(commandBuffer, bindPoint, pipeline);
+    }
+    uint64_t lookup = getTimeNanoSeconds();
+
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    printf("INFO: vkCmdBindPipeline x%d\n", DISPATCH_BENCHMARK_CALLS);
+    printf("    loader trampoline %8.2f ns/call\n", timeCalls(start, loader));
+    printf("    dispatch table    %8.2f ns/call\n", timeCalls(loader, table));
+    printf("    per-call lookup   %8.2f ns/call\n", timeCalls(table, lookup));
+}
+
+typedef struct TraceMeasurement {
+    float gpuTimes[GPU_TIMER_COUNT];
+    float traceTime;
+    float raysPerSecond;
+    float pathLength;
+    float shadowRaysPerPixel;
+    float frameTime;
+    float submitTime;
+} TraceMeasurement;
+
+// Renders warmup frames so pending setting changes settle, then averages the smoothed statistics
+static TraceMeasurement measureTrace(VKRT* vkrt) {
+    for (uint32_t i = 0; i < TRACE_BENCHMARK_WARMUP_FRAMES; i++) {
+        glfwPollEvents();
+        drawFrame(vkrt);
+    }
+
+    TraceMeasurement measurement = {0};
+    uint64_t start = getTimeNanoSeconds();
+    for (uint32_t i = 0; i < TRACE_BENCHMARK_FRAMES; i++) {
+        glfwPollEvents();
+        drawFrame(vkrt);
+
+        for (uint32_t timer = 0; timer < GPU_TIMER_COUNT; timer++) {
+            measurement.gpuTimes[timer] += vkrt->gpuTimes[timer] / TRACE_BENCHMARK_FRAMES;
+        }
+        measurement.traceTime += traceGpuTime(vkrt) / TRACE_BENCHMARK_FRAMES;
+        measurement.raysPerSecond += vkrt->raysPerSecond / TRACE_BENCHMARK_FRAMES;
+        measurement.pathLength += vkrt->averagePathLength / TRACE_BENCHMARK_FRAMES;
+        measurement.shadowRaysPerPixel += vkrt->shadowRaysPerPixel / TRACE_BENCHMARK_FRAMES;
+        measurement.submitTime += vkrt->averageSubmitTime / TRACE_BENCHMARK_FRAMES;
+    }
+    measurement.frameTime = (float)(getTimeNanoSeconds() - start) / 1e6f / TRACE_BENCHMARK_FRAMES;
+    return measurement;
+}
+
+static void benchmarkWavefront(VKRT* vkrt) {
+    static const char* modeNames[TRACE_MODE_COUNT] = {"megakernel", "wavefront"};
+
+    printf("INFO: %u materials, %ux%u, max depth %u\n", vkrt->materialCount, vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, vkrt->pathSettings.maxDepth);
+
+    for (uint32_t mode = 0; mode < TRACE_MODE_COUNT; mode++) {
+        if (mode == TRACE_MODE_WAVEFRONT && !vkrt->wavefrontSupported) {
+            printf("INFO: Skipping %s, not supported on this device\n", modeNames[mode]);
+            continue;
+        }
+
+        vkrt->requestedTraceMode = (TraceMode)mode;
+        TraceMeasurement measurement = measureTrace(vkrt);
+
+        printf("INFO: %s\n", modeNames[mode]);
+        for (uint32_t timer = 0; timer < GPU_TIMER_COUNT; timer++) {
+            printf("    GPU %-10s%9.3f ms\n", gpuTimerNames[timer], measurement.gpuTimes[timer]);
+        }
+        printf("    rays          %9.1f M/s\n", measurement.raysPerSecond / 1e6f);
+        printf("    path length   %9.2f\n", measurement.pathLength);
+    }
+}
+
+// Frame, CPU record and submit, and GPU present cost of the tonemap pass on the present path in use.
+// Traffic is per pixel: the RGBA32F blit this pass replaced read and wrote 16 bytes, the intermediate adds an RGBA8 copy
+static void benchmarkPresent(VKRT* vkrt) {
+    vkrt->vsync = 0;
+    vkrt->framebufferResized = VK_TRUE;
+    TraceMeasurement measurement = measureTrace(vkrt);
+
+    uint32_t trafficBytes = vkrt->swapChainStorage ? 16 + 4 : 16 + 4 + 4 + 4;
+    printf("INFO: %ux%u, %s present path\n", vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, vkrt->swapChainStorage ? "direct" : "intermediate");
+    printf("    frame         %9.3f ms\n", measurement.frameTime);
+    printf("    CPU submit    %9.3f ms\n", measurement.submitTime);
+    printf("    GPU %-10s%9.3f ms\n", gpuTimerNames[GPU_TIMER_PRESENT], measurement.gpuTimes[GPU_TIMER_PRESENT]);
+    printf("    traffic       %9u B/px (RGBA32F blit: 32 B/px)\n", trafficBytes);
+}
+
+// Shadow rays share the trace dispatch with path rays, so their cost is the difference
+// between rendering with and without light sampling, after scaling for the path rays traced
+static void benchmarkShadow(VKRT* vkrt) {
+    float pixelCount = (float)vkrt->swapChainExtent.width * (float)vkrt->swapChainExtent.height;
+
+    printf("INFO: %u emissive triangles, %ux%u, max depth %u\n", vkrt->lightCount, vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, vkrt->pathSettings.maxDepth);
+    if (vkrt->lightCount == 0) {
+        printf("INFO: Scene has no emissive triangles, no shadow rays will be traced\n");
+        return;
+    }
+
+    vkrt->requestedPathSettings.nextEventEstimation = 0;
+    TraceMeasurement paths = measureTrace(vkrt);
+
+    vkrt->requestedPathSettings.nextEventEstimation = 1;
+    TraceMeasurement connected = measureTrace(vkrt);
+
+    float pathRays = paths.pathLength * pixelCount;
+    float pathSeconds = paths.traceTime / 1000.0f;
+    float shadowRays = connected.shadowRaysPerPixel * pixelCount;
+    float shadowSeconds = (connected.traceTime - paths.traceTime * connected.pathLength / paths.pathLength) / 1000.0f;
+
+    printf("    path rays     %9.1f M/s (%.2f per pixel, %.3f ms)\n", pathRays / pathSeconds / 1e6f, paths.pathLength, paths.traceTime);
+    if (shadowSeconds > 0.0f) {
+        printf("    shadow rays   %9.1f M/s (%.2f per pixel, %.3f ms)\n", shadowRays / shadowSeconds / 1e6f, connected.shadowRaysPerPixel, shadowSeconds * 1000.0f);
+    } else {
+        printf("    shadow rays   below timer resolution (%.2f per pixel)\n", connected.shadowRaysPerPixel);
+    }
+}
+
+// Accumulates for a fixed wall-clock budget and returns the frame count; pixels receives the RGBA32F result
+static uint32_t accumulateFor(VKRT* vkrt, double seconds, uint32_t maxFrames, float* pixels) {
+    // One frame applies any pending setting change, which restarts accumulation
+    glfwPollEvents();
+    drawFrame(vkrt);
+    vkrt->accumulatedFrames = 0;
+
+    uint64_t start = getTimeNanoSeconds();
+    uint32_t frames = 0;
+    while (frames < maxFrames && (double)(getTimeNanoSeconds() - start) < seconds * 1e9) {
+        glfwPollEvents();
+        drawFrame(vkrt);
+        frames++;
+    }
+
+    readStorageImage(vkrt, pixels);
+    return frames;
+}
+
+static double meanSquaredError(const float* pixels, const float* reference, size_t pixelCount) {
+    double sum = 0.0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        for (uint32_t c = 0; c < 3; c++) {
+            double difference = (double)pixels[i * 4 + c] - (double)reference[i * 4 + c];
+            sum += difference * difference;
+        }
+    }
+    return sum / (double)(pixelCount * 3);
+}
+
+// Equal-time noise of every value of one path setting against a long reference rendered with the last value.
+// setting points into requestedPathSettings.
+static void compareSamplingNoise(VKRT* vkrt, uint32_t* setting, const char* const* names, uint32_t count) {
+    // Uncapped frame rate so every strategy gets as many frames as it can trace
+    vkrt->vsync = 0;
+    vkrt->framebufferResized = VK_TRUE;
+    vkrt->requestedOutputPrecision = OUTPUT_PRECISION_RGBA32F;
+    vkrt->requestedPathSettings.nextEventEstimation = 1;
+    *setting = count - 1;
+    glfwPollEvents();
+    drawFrame(vkrt);
+
+    if (vkrt->outputPrecision != OUTPUT_PRECISION_RGBA32F) {
+        fprintf(stderr, "ERROR: Noise benchmarks need RGBA32F accumulation\n");
+        return;
+    }
+
+    size_t pixelCount = (size_t)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+    float* reference = malloc(pixelCount * 4 * sizeof(float));
+    float* pixels = malloc(pixelCount * 4 * sizeof(float));
+
+    printf("INFO: %ux%u, reference of %d frames\n", vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, NOISE_BENCHMARK_REFERENCE_FRAMES);
+    accumulateFor(vkrt, 1e9, NOISE_BENCHMARK_REFERENCE_FRAMES, reference);
+
+    for (uint32_t value = 0; value < count; value++) {
+        *setting = value;
+        uint32_t frames = accumulateFor(vkrt, NOISE_BENCHMARK_SECONDS, UINT32_MAX, pixels);
+        printf("    %-10s %6u frames in %.1f s, MSE %.6e\n", names[value], frames, NOISE_BENCHMARK_SECONDS, meanSquaredError(pixels, reference, pixelCount));
+    }
+
+    free(reference);
+    free(pixels);
+}
+
+static void benchmarkEnvironment(VKRT* vkrt) {
+    static const char* samplingNames[ENVIRONMENT_SAMPLING_COUNT] = {"uniform", "importance"};
+
+    printf("INFO: Environment %ux%u\n", vkrt->environmentWidth, vkrt->environmentHeight);
+    compareSamplingNoise(vkrt, &vkrt->requestedPathSettings.environmentSampling, samplingNames, ENVIRONMENT_SAMPLING_COUNT);
+}
+
+// Uniform, power-proportional and light tree selection of emissive triangles for next event estimation
+static void benchmarkLights(VKRT* vkrt) {
+    static const char* samplingNames[LIGHT_SAMPLING_COUNT] = {"uniform", "power", "tree"};
+
+    printf("INFO: %u emissive triangles\n", vkrt->lightCount);
+    if (vkrt->lightCount == 0) {
+        printf("INFO: Scene has no emissive triangles, nothing to compare\n");
+        return;
+    }
+
+    compareSamplingNoise(vkrt, &vkrt->requestedPathSettings.lightSampling, samplingNames, LIGHT_SAMPLING_COUNT);
+}
+
+// PCG hash, tiled blue noise and Owen-scrambled Sobol at equal time, against a Sobol reference
+static void benchmarkSampler(VKRT* vkrt) {
+    static const char* samplerNames[SAMPLER_COUNT] = {"pcg", "blue noise", "sobol"};
+    compareSamplingNoise(vkrt, &vkrt->requestedPathSettings.sampler, samplerNames, SAMPLER_COUNT);
+}
+
+// Accumulates in chunks until the error against reference reaches targetError, timing only the frames themselves
+static uint32_t accumulateToError(VKRT* vkrt, const float* reference, double targetError, float* pixels, double* seconds, double* error) {
+    size_t pixelCount = (size_t)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+
+    glfwPollEvents();
+    drawFrame(vkrt);
+    vkrt->accumulatedFrames = 0;
+
+    uint64_t elapsed = 0;
+    uint32_t frames = 0;
+    while (frames < ADAPTIVE_BENCHMARK_MAX_FRAMES) {
+        uint64_t start = getTimeNanoSeconds();
+        for (uint32_t i = 0; i < ADAPTIVE_BENCHMARK_CHUNK_FRAMES; i++) {
+            glfwPollEvents();
+            drawFrame(vkrt);
+        }
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        elapsed += getTimeNanoSeconds() - start;
+        frames += ADAPTIVE_BENCHMARK_CHUNK_FRAMES;
+
+        readStorageImage(vkrt, pixels);
+        *error = meanSquaredError(pixels, reference, pixelCount);
+        if (*error <= targetError) break;
+    }
+
+    *seconds = (double)elapsed / 1e9;
+    return frames;
+}
+
+// Time for uniform and adaptive sampling to reach the error uniform sampling has after a fixed frame count
+static void benchmarkAdaptive(VKRT* vkrt) {
+    static const char* modeNames[] = {"uniform", "adaptive"};
+
+    vkrt->vsync = 0;
+    vkrt->framebufferResized = VK_TRUE;
+    vkrt->requestedOutputPrecision = OUTPUT_PRECISION_RGBA32F;
+    vkrt->requestedTraceMode = TRACE_MODE_MEGAKERNEL;
+    vkrt->requestedPathSettings.restir = 0;
+    vkrt->requestedPathSettings.adaptive = 0;
+    glfwPollEvents();
+    drawFrame(vkrt);
+
+    if (vkrt->outputPrecision != OUTPUT_PRECISION_RGBA32F) {
+        fprintf(stderr, "ERROR: Adaptive sampling needs RGBA32F accumulation\n");
+        return;
+    }
+
+    size_t pixelCount = (size_t)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+    float* reference = malloc(pixelCount * 4 * sizeof(float));
+    float* pixels = malloc(pixelCount * 4 * sizeof(float));
+
+    printf("INFO: %ux%u, reference of %d frames, error target %.3f\n", vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, NOISE_BENCHMARK_REFERENCE_FRAMES, vkrt->uniformBufferMapped->adaptiveThreshold);
+    accumulateFor(vkrt, 1e9, NOISE_BENCHMARK_REFERENCE_FRAMES, reference);
+    accumulateFor(vkrt, 1e9, ADAPTIVE_BENCHMARK_TARGET_FRAMES, pixels);
+    double targetError = meanSquaredError(pixels, reference, pixelCount);
+    printf("INFO: Target MSE %.6e (uniform after %d frames)\n", targetError, ADAPTIVE_BENCHMARK_TARGET_FRAMES);
+
+    for (uint32_t adaptive = 0; adaptive < COUNT_OF(modeNames); adaptive++) {
+        vkrt->requestedPathSettings.adaptive = adaptive;
+
+        double seconds, error;
+        uint32_t frames = accumulateToError(vkrt, reference, targetError, pixels, &seconds, &error);
+        printf("    %-10s %6u frames in %.3f s, MSE %.6e, %5.1f%% pixels active at the end\n", modeNames[adaptive], frames, seconds, error, vkrt->activePixelFraction * 100.0f);
+    }
+
+    free(reference);
+    free(pixels);
+}
+
+// Turntable of product shots around the current target, traced as one launch with a view per launch depth
+// against one launch per view. Each sample of every view is one submission either way.
+static void benchmarkMultiView(VKRT* vkrt) {
+    static const char* modeNames[2] = {"sequential", "batched"};
+
+    Camera cameras[MULTIVIEW_BENCHMARK_VIEWS];
+    turntableCameras(&vkrt->camera, MULTIVIEW_BENCHMARK_VIEWS, cameras);
+
+    beginMultiView(vkrt, cameras, MULTIVIEW_BENCHMARK_VIEWS);
+    printf("INFO: %u views, %ux%u, %u samples\n", MULTIVIEW_BENCHMARK_VIEWS, vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, MULTIVIEW_BENCHMARK_SAMPLES);
+
+    double seconds[2] = {0};
+    for (uint32_t batched = 0; batched < 2; batched++) {
+        traceViews(vkrt, batched);
+
+        uint64_t start = getTimeNanoSeconds();
+        for (uint32_t i = 0; i < MULTIVIEW_BENCHMARK_SAMPLES; i++) {
+            traceViews(vkrt, batched);
+        }
+        seconds[batched] = (double)(getTimeNanoSeconds() - start) / 1e9;
+
+        double viewsPerSecond = (double)MULTIVIEW_BENCHMARK_VIEWS * MULTIVIEW_BENCHMARK_SAMPLES / seconds[batched];
+        printf("    %-10s %9.3f ms per sample of all views, %8.1f views/s\n", modeNames[batched], seconds[batched] * 1000.0 / MULTIVIEW_BENCHMARK_SAMPLES, viewsPerSecond);
+    }
+    printf("    speedup    %9.2fx\n", seconds[0] / seconds[1]);
+
+    endMultiView(vkrt);
+}
+
+// Sensor-style rays from a sphere around the target aimed at points near it, cast one drained batch at a time
+// against streamed through both slots
+static void benchmarkRayCast(VKRT* vkrt) {
+    static const char* modeNames[2] = {"serial", "streamed"};
+
+    uint64_t count = (uint64_t)RAYCAST_BENCHMARK_BATCHES * RAYCAST_BATCH_SIZE;
+    CastRay* rays = malloc(count * sizeof(CastRay));
+    CastHit* hits = malloc(count * sizeof(CastHit));
+    if (!rays || !hits) {
+        perror("ERROR: Failed to allocate ray cast benchmark rays");
+        exit(EXIT_FAILURE);
+    }
+
+    float radius = glm_vec3_distance(vkrt->camera.pos, vkrt->camera.target);
+    srand(1);
+    for (uint64_t i = 0; i < count; i++) {
+        vec3 direction, aim;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            direction[axis] = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            aim[axis] = vkrt->camera.target[axis] + ((float)rand() / RAND_MAX - 0.5f) * radius;
+        }
+        glm_vec3_normalize(direction);
+
+        vec3 origin;
+        glm_vec3_copy(vkrt->camera.target, origin);
+        glm_vec3_muladds(direction, radius, origin);
+        glm_vec3_sub(aim, origin, direction);
+        glm_vec3_normalize(direction);
+
+        rays[i] = (CastRay){{origin[0], origin[1], origin[2]}, 0.0f, {direction[0], direction[1], direction[2]}, 2.0f * radius};
+    }
+
+    beginRayCasts(vkrt);
+    printf("INFO: %llu rays in batches of %u\n", (unsigned long long)count, RAYCAST_BATCH_SIZE);
+
+    for (uint32_t streamed = 0; streamed < 2; streamed++) {
+        uint64_t start = getTimeNanoSeconds();
+        if (streamed) {
+            castRays(vkrt, rays, hits, count);
+        } else {
+            for (uint64_t first = 0; first < count; first += RAYCAST_BATCH_SIZE) {
+                castRays(vkrt, rays + first, hits + first, RAYCAST_BATCH_SIZE);
+            }
+        }
+        double seconds = (double)(getTimeNanoSeconds() - start) / 1e9;
+
+        uint64_t hitCount = 0;
+        for (uint64_t i = 0; i < count; i++) {
+            hitCount += hits[i].hitT >= 0.0f;
+        }
+        printf("    %-8s %9.2f ms, %8.1f Mrays/s, %5.1f%% hit\n", modeNames[streamed], seconds * 1000.0, count / seconds / 1e6, 100.0 * hitCount / count);
+    }
+
+    endRayCasts(vkrt);
+    free(rays);
+    free(hits);
+}
+
+// CPU scene queries on one core: primary rays of the current view through the binary BVH, the wide one a
+// ray at a time and the wide one in packets, then closest points to random positions around the target
+static void benchmarkQuery(VKRT* vkrt) {
+    static const char* modeNames[3] = {"binary", "wide", "packet"};
+
+    uint32_t count = QUERY_BENCHMARK_GRID * QUERY_BENCHMARK_GRID;
+    CastRay* rays = malloc(count * sizeof(CastRay));
+    CastHit* hits = malloc(count * sizeof(CastHit));
+    if (!rays || !hits) {
+        perror("ERROR: Failed to allocate query benchmark rays");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        float x = ((float)(i % QUERY_BENCHMARK_GRID) + 0.5f) / QUERY_BENCHMARK_GRID;
+        float y = ((float)(i / QUERY_BENCHMARK_GRID) + 0.5f) / QUERY_BENCHMARK_GRID;
+        vec3 direction;
+        cameraRayDirection(&vkrt->camera, x, y, direction);
+
+        float* origin = vkrt->camera.pos;
+        rays[i] = (CastRay){{origin[0], origin[1], origin[2]}, vkrt->camera.nearZ, {direction[0], direction[1], direction[2]}, vkrt->camera.farZ};
+    }
+
+    BVH bvh;
+    buildBVH(&bvh, vkrt->vertices, vkrt->indices, vkrt->indexCount / 3);
+    printf("INFO: %u primary rays on one core, %u-wide nodes\n", count, WIDE_BVH_WIDTH);
+
+    for (uint32_t mode = 0; mode < 3; mode++) {
+        uint64_t start = getTimeNanoSeconds();
+        if (mode == 2) {
+            intersectWideBVHPacket(vkrt->sceneBVH, rays, hits, count);
+        } else {
+            for (uint32_t i = 0; i < count; i++) {
+                BVHHit hit;
+                VkBool32 found = mode == 0 ? intersectBVH(&bvh, rays[i].origin, rays[i].direction, rays[i].tMin, rays[i].tMax, &hit)
+                                           : intersectWideBVH(vkrt->sceneBVH, rays[i].origin, rays[i].direction, rays[i].tMin, rays[i].tMax, &hit);
+                hits[i].hitT = found ? hit.t : -1.0f;
+            }
+        }
+        double seconds = (double)(getTimeNanoSeconds() - start) / 1e9;
+
+        uint32_t hitCount = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            hitCount += hits[i].hitT >= 0.0f;
+        }
+        printf("    %-8s %9.2f ms, %8.2f Mrays/s, %5.1f%% hit\n", modeNames[mode], seconds * 1000.0, count / seconds / 1e6, 100.0 * hitCount / count);
+    }
+
+    float radius = glm_vec3_distance(vkrt->camera.pos, vkrt->camera.target);
+    srand(1);
+    uint64_t start = getTimeNanoSeconds();
+    for (uint32_t i = 0; i < QUERY_BENCHMARK_POINTS; i++) {
+        vec3 point;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            point[axis] = vkrt->camera.target[axis] + ((float)rand() / RAND_MAX - 0.5f) * radius;
+        }
+        BVHHit hit;
+        closestPointWideBVH(vkrt->sceneBVH, point, INFINITY, &hit);
+    }
+    double seconds = (double)(getTimeNanoSeconds() - start) / 1e9;
+    printf("    %-8s %9.2f ms, %8.2f Mqueries/s\n", "closest", seconds * 1000.0, QUERY_BENCHMARK_POINTS / seconds / 1e6);
+
+    destroyBVH(&bvh);
+    free(rays);
+    free(hits);
+}
+
+static const Benchmark benchmarks[] = {
+    {"dispatch", benchmarkDispatch},
+    {"wavefront", benchmarkWavefront},
+    {"present", benchmarkPresent},
+    {"shadow", benchmarkShadow},
+    {"environment", benchmarkEnvironment},
+    {"lights", benchmarkLights},
+    {"sampler", benchmarkSampler},
+    {"adaptive", benchmarkAdaptive},
+    {"multiview", benchmarkMultiView},
+    {"raycast", benchmarkRayCast},
+    {"query", benchmarkQuery},
+};
+
+const Benchmark* findBenchmark(const char* name) {
+    for (size_t i = 0; i < COUNT_OF(benchmarks); i++) {
+        if (strcmp(benchmarks[i].name, name) == 0) return &benchmarks[i];
+    }
+    return NULL;
+}
+
+void listBenchmarks(void) {
+    for (size_t i = 0; i < COUNT_OF(benchmarks); i++) {
+        fprintf(stderr, "    %s\n", benchmarks[i].name);
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "vkrt.h"
+
+typedef struct Benchmark {
+    const char* name;
+    void (*run)(VKRT* vkrt);
+} Benchmark;
+
+const Benchmark* findBenchmark(const char* name);
+void listBenchmarks(void);
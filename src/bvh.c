@@ -0,0 +1,349 @@
+#include "bvh.h"
+#include "device.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_BINS 16
+#define BVH_MAX_LEAF_SIZE 8
+// Cost of visiting a node relative to one triangle test
+#define BVH_TRAVERSAL_COST 1.0f
+#define BVH_PARALLEL_DEPTH 4
+#define BVH_PARALLEL_TRIANGLES 16384
+
+typedef struct BVHPrimitive {
+    vec3 min;
+    vec3 max;
+    vec3 centroid;
+    uint32_t triangle;
+} BVHPrimitive;
+
+typedef struct BVHBin {
+    vec3 min;
+    vec3 max;
+    uint32_t count;
+} BVHBin;
+
+typedef struct BVHBuild {
+    pthread_t thread;
+    BVHPrimitive* primitives;
+    BVHNode* nodes;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t nodeIndex;
+    uint32_t depth;
+} BVHBuild;
+
+static float surfaceArea(vec3 min, vec3 max) {
+    vec3 extent;
+    glm_vec3_sub(max, min, extent);
+    if (extent[0] < 0.0f || extent[1] < 0.0f || extent[2] < 0.0f) return 0.0f;
+    return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+static void growBin(BVHBin* bin, vec3 min, vec3 max, uint32_t count) {
+    if (!count) return;
+    if (!bin->count) {
+        glm_vec3_copy(min, bin->min);
+        glm_vec3_copy(max, bin->max);
+    } else {
+        glm_vec3_minv(bin->min, min, bin->min);
+        glm_vec3_maxv(bin->max, max, bin->max);
+    }
+    bin->count += count;
+}
+
+static uint32_t binIndex(const BVHPrimitive* primitive, uint32_t axis, float centroidMin, float width) {
+    uint32_t bin = (uint32_t)((primitive->centroid[axis] - centroidMin) / width * BVH_BINS);
+    return bin < BVH_BINS ? bin : BVH_BINS - 1;
+}
+
+// Binned SAH split over all three axes; returns the first primitive of the right child,
+// or end when the triangles are cheaper to test as one leaf
+static uint32_t partitionTriangles(BVHPrimitive* primitives, uint32_t begin, uint32_t end, float area) {
+    vec3 centroidMin, centroidMax;
+    glm_vec3_copy(primitives[begin].centroid, centroidMin);
+    glm_vec3_copy(primitives[begin].centroid, centroidMax);
+    for (uint32_t i = begin + 1; i < end; i++) {
+        glm_vec3_minv(centroidMin, primitives[i].centroid, centroidMin);
+        glm_vec3_maxv(centroidMax, primitives[i].centroid, centroidMax);
+    }
+
+    float bestCost = INFINITY;
+    uint32_t bestAxis = 0, bestSplit = 0;
+    float inverseArea = 1.0f / fmaxf(area, 1e-20f);
+
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        float width = centroidMax[axis] - centroidMin[axis];
+        if (width <= 0.0f) continue;
+
+        BVHBin bins[BVH_BINS] = {0};
+        for (uint32_t i = begin; i < end; i++) {
+            growBin(&bins[binIndex(&primitives[i], axis, centroidMin[axis], width)], primitives[i].min, primitives[i].max, 1);
+        }
+
+        // Sweep from the right once to get every right-side cost, then from the left to evaluate the splits
+        float rightCosts[BVH_BINS] = {0};
+        BVHBin right = {0};
+        for (uint32_t split = BVH_BINS - 1; split > 0; split--) {
+            growBin(&right, bins[split].min, bins[split].max, bins[split].count);
+            rightCosts[split] = surfaceArea(right.min, right.max) * right.count;
+        }
+
+        BVHBin left = {0};
+        for (uint32_t split = 1; split < BVH_BINS; split++) {
+            growBin(&left, bins[split - 1].min, bins[split - 1].max, bins[split - 1].count);
+            if (!left.count || left.count == end - begin) continue;
+
+            float cost = BVH_TRAVERSAL_COST + (surfaceArea(left.min, left.max) * left.count + rightCosts[split]) * inverseArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    uint32_t count = end - begin;
+
+    // Every centroid coincides, so any split is as good as another
+    if (bestCost == INFINITY) return count <= BVH_MAX_LEAF_SIZE ? end : begin + count / 2;
+    if (count <= BVH_MAX_LEAF_SIZE && (float)count <= bestCost) return end;
+
+    float width = centroidMax[bestAxis] - centroidMin[bestAxis];
+    uint32_t middle = begin;
+    for (uint32_t i = begin; i < end; i++) {
+        if (binIndex(&primitives[i], bestAxis, centroidMin[bestAxis], width) < bestSplit) {
+            BVHPrimitive swap = primitives[middle];
+            primitives[middle++] = primitives[i];
+            primitives[i] = swap;
+        }
+    }
+    return middle;
+}
+
+// As for the light tree, n triangles need at most 2n - 1 nodes, so each subtree reserves a depth-first
+// range before it is built and the top levels are built concurrently
+static void* buildTree(void* argument) {
+    BVHBuild* build = (BVHBuild*)argument;
+    BVHPrimitive* primitives = build->primitives;
+    BVHNode* node = &build->nodes[build->nodeIndex];
+
+    vec3 min, max;
+    glm_vec3_copy(primitives[build->begin].min, min);
+    glm_vec3_copy(primitives[build->begin].max, max);
+    for (uint32_t i = build->begin + 1; i < build->end; i++) {
+        glm_vec3_minv(min, primitives[i].min, min);
+        glm_vec3_maxv(max, primitives[i].max, max);
+    }
+    memcpy(node->min, min, sizeof(node->min));
+    memcpy(node->max, max, sizeof(node->max));
+
+    uint32_t middle = build->depth + 1 < BVH_MAX_DEPTH ? partitionTriangles(primitives, build->begin, build->end, surfaceArea(min, max)) : build->end;
+    if (middle == build->end) {
+        node->offset = build->begin;
+        node->count = build->end - build->begin;
+        return NULL;
+    }
+
+    BVHBuild left = {
+        .primitives = primitives,
+        .nodes = build->nodes,
+        .begin = build->begin,
+        .end = middle,
+        .nodeIndex = build->nodeIndex + 1,
+        .depth = build->depth + 1};
+    BVHBuild right = left;
+    right.begin = middle;
+    right.end = build->end;
+    right.nodeIndex = build->nodeIndex + 2 * (middle - build->begin);
+
+    node->offset = right.nodeIndex;
+    node->count = 0;
+
+    int parallel = build->depth < BVH_PARALLEL_DEPTH && build->end - build->begin >= BVH_PARALLEL_TRIANGLES;
+    if (parallel && pthread_create(&left.thread, NULL, buildTree, &left) != 0) {
+        perror("ERROR: Failed to create BVH build thread");
+        exit(EXIT_FAILURE);
+    }
+    if (!parallel) buildTree(&left);
+    buildTree(&right);
+    if (parallel) pthread_join(left.thread, NULL);
+
+    return NULL;
+}
+
+// Leaves of several triangles leave gaps in the reserved ranges; copying depth-first closes them
+static uint32_t compactNodes(const BVHNode* sparse, uint32_t index, BVHNode* dense, uint32_t* count) {
+    uint32_t denseIndex = (*count)++;
+    dense[denseIndex] = sparse[index];
+    if (!sparse[index].count) {
+        compactNodes(sparse, index + 1, dense, count);
+        dense[denseIndex].offset = compactNodes(sparse, sparse[index].offset, dense, count);
+    }
+    return denseIndex;
+}
+
+void buildBVH(BVH* bvh, const Vertex* vertices, const uint32_t* indices, uint32_t triangleCount) {
+    *bvh = (BVH){0};
+    if (!triangleCount) return;
+
+    uint64_t start = getTimeNanoSeconds();
+
+    BVHPrimitive* primitives = malloc(triangleCount * sizeof(BVHPrimitive));
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        float* v0 = (float*)vertices[indices[t * 3 + 0]].position;
+        float* v1 = (float*)vertices[indices[t * 3 + 1]].position;
+        float* v2 = (float*)vertices[indices[t * 3 + 2]].position;
+
+        BVHPrimitive* primitive = &primitives[t];
+        glm_vec3_minv(v0, v1, primitive->min);
+        glm_vec3_minv(primitive->min, v2, primitive->min);
+        glm_vec3_maxv(v0, v1, primitive->max);
+        glm_vec3_maxv(primitive->max, v2, primitive->max);
+        glm_vec3_center(primitive->min, primitive->max, primitive->centroid);
+        primitive->triangle = t;
+    }
+
+    uint32_t sparseCount = 2 * triangleCount - 1;
+    BVHNode* sparse = malloc(sparseCount * sizeof(BVHNode));
+    BVHBuild root = {.primitives = primitives, .nodes = sparse, .begin = 0, .end = triangleCount};
+    buildTree(&root);
+
+    bvh->nodes = malloc(sparseCount * sizeof(BVHNode));
+    compactNodes(sparse, 0, bvh->nodes, &bvh->nodeCount);
+    bvh->nodes = realloc(bvh->nodes, bvh->nodeCount * sizeof(BVHNode));
+    free(sparse);
+
+    // Leaf ranges index the partitioned primitives, so triangles are stored in that order
+    bvh->triangles = malloc(triangleCount * sizeof(BVHTriangle));
+    bvh->triangleCount = triangleCount;
+    for (uint32_t i = 0; i < triangleCount; i++) {
+        uint32_t t = primitives[i].triangle;
+        float* v0 = (float*)vertices[indices[t * 3 + 0]].position;
+        float* v1 = (float*)vertices[indices[t * 3 + 1]].position;
+        float* v2 = (float*)vertices[indices[t * 3 + 2]].position;
+
+        BVHTriangle* triangle = &bvh->triangles[i];
+        *triangle = (BVHTriangle){0};
+        glm_vec3_copy(v0, triangle->v0);
+        glm_vec3_sub(v1, v0, triangle->edge1);
+        glm_vec3_sub(v2, v0, triangle->edge2);
+        triangle->primitive = t;
+    }
+    free(primitives);
+
+    printf("INFO: BVH of %u nodes over %u triangles built in %.2f ms\n", bvh->nodeCount, triangleCount, (double)(getTimeNanoSeconds() - start) / 1e6);
+}
+
+void destroyBVH(BVH* bvh) {
+    free(bvh->nodes);
+    free(bvh->triangles);
+    *bvh = (BVH){0};
+}
+
+// Reciprocal for the slab test. Zero components get a huge finite inverse rather than infinity, so a ray
+// lying in a slab plane gets 0 there instead of the NaN of 0 * inf and counts as touching the box.
+float slabInverse(float direction) {
+    return 1.0f / (fabsf(direction) > 1e-30f ? direction : copysignf(1e-30f, direction));
+}
+
+// Slab test; returns the entry distance or infinity on a miss
+static float intersectBox(const BVHNode* node, const float* origin, const float* inverseDirection, float tMin, float tMax) {
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        float t0 = (node->min[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (node->max[axis] - origin[axis]) * inverseDirection[axis];
+        float entry = t0 < t1 ? t0 : t1;
+        float exit = t0 < t1 ? t1 : t0;
+        tMin = entry > tMin ? entry : tMin;
+        tMax = exit < tMax ? exit : tMax;
+    }
+    return tMin <= tMax ? tMin : INFINITY;
+}
+
+// Möller-Trumbore, u and v weight the second and third vertex
+VkBool32 intersectBVHTriangle(const BVHTriangle* triangle, const float* origin, const float* direction, float tMin, float tMax, float* t, float* u, float* v) {
+    vec3 p, q, s;
+    glm_vec3_cross((float*)direction, (float*)triangle->edge2, p);
+    float determinant = glm_vec3_dot((float*)triangle->edge1, p);
+    if (fabsf(determinant) < 1e-12f) return VK_FALSE;
+
+    float inverseDeterminant = 1.0f / determinant;
+    glm_vec3_sub((float*)origin, (float*)triangle->v0, s);
+    *u = glm_vec3_dot(s, p) * inverseDeterminant;
+    if (*u < 0.0f || *u > 1.0f) return VK_FALSE;
+
+    glm_vec3_cross(s, (float*)triangle->edge1, q);
+    *v = glm_vec3_dot((float*)direction, q) * inverseDeterminant;
+    if (*v < 0.0f || *u + *v > 1.0f) return VK_FALSE;
+
+    *t = glm_vec3_dot((float*)triangle->edge2, q) * inverseDeterminant;
+    return *t > tMin && *t < tMax;
+}
+
+VkBool32 intersectBVH(const BVH* bvh, const vec3 origin, const vec3 direction, float tMin, float tMax, BVHHit* hit) {
+    if (!bvh->nodeCount) return VK_FALSE;
+
+    vec3 rayOrigin, rayDirection, inverseDirection;
+    glm_vec3_copy((float*)origin, rayOrigin);
+    glm_vec3_copy((float*)direction, rayDirection);
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        inverseDirection[axis] = slabInverse(rayDirection[axis]);
+    }
+
+    // Children are visited nearest first; deferred ones keep their entry distance to be culled on pop
+    uint32_t stack[BVH_MAX_DEPTH];
+    float stackDistances[BVH_MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+    VkBool32 found = VK_FALSE;
+
+    if (intersectBox(&bvh->nodes[0], rayOrigin, inverseDirection, tMin, tMax) == INFINITY) return VK_FALSE;
+
+    for (;;) {
+        const BVHNode* node = &bvh->nodes[nodeIndex];
+        if (node->count) {
+            for (uint32_t i = node->offset; i < node->offset + node->count; i++) {
+                float t, u, v;
+                if (intersectBVHTriangle(&bvh->triangles[i], rayOrigin, rayDirection, tMin, tMax, &t, &u, &v)) {
+                    tMax = t;
+                    hit->t = t;
+                    hit->primitive = bvh->triangles[i].primitive;
+                    hit->barycentrics[0] = u;
+                    hit->barycentrics[1] = v;
+                    found = VK_TRUE;
+                }
+            }
+        } else {
+            uint32_t nearIndex = nodeIndex + 1;
+            uint32_t farIndex = node->offset;
+            float nearDistance = intersectBox(&bvh->nodes[nearIndex], rayOrigin, inverseDirection, tMin, tMax);
+            float farDistance = intersectBox(&bvh->nodes[farIndex], rayOrigin, inverseDirection, tMin, tMax);
+            if (farDistance < nearDistance) {
+                uint32_t swapIndex = nearIndex;
+                nearIndex = farIndex;
+                farIndex = swapIndex;
+                float swapDistance = nearDistance;
+                nearDistance = farDistance;
+                farDistance = swapDistance;
+            }
+
+            if (nearDistance != INFINITY) {
+                if (farDistance != INFINITY) {
+                    stack[stackSize] = farIndex;
+                    stackDistances[stackSize++] = farDistance;
+                }
+                nodeIndex = nearIndex;
+                continue;
+            }
+        }
+
+        do {
+            if (!stackSize) return found;
+            stackSize--;
+        } while (stackDistances[stackSize] > tMax);
+        nodeIndex = stack[stackSize];
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "vkrt.h"
+
+// Deepest tree the traversal stack can walk; the builder makes leaves at this depth
+#define BVH_MAX_DEPTH 64
+
+// Flattened node in depth-first order: an interior node's first child follows it and `offset` holds the
+// second, a leaf has a nonzero `count` and `offset` holds its first triangle. Two nodes per cache line.
+typedef struct BVHNode {
+    float min[3];
+    uint32_t offset;
+    float max[3];
+    uint32_t count;
+} BVHNode;
+
+// Leaf triangle in node order, stored as a vertex and two edges for the intersection test
+typedef struct BVHTriangle {
+    float v0[3];
+    uint32_t primitive;
+    float edge1[3];
+    float padding0;
+    float edge2[3];
+    float padding1;
+} BVHTriangle;
+
+typedef struct BVH {
+    BVHNode* nodes;
+    uint32_t nodeCount;
+    BVHTriangle* triangles;
+    uint32_t triangleCount;
+} BVH;
+
+// Closest hit with the same barycentrics as the hardware: weights of the second and third vertex
+typedef struct BVHHit {
+    float t;
+    uint32_t primitive;
+    float barycentrics[2];
+} BVHHit;
+
+void buildBVH(BVH* bvh, const Vertex* vertices, const uint32_t* indices, uint32_t triangleCount);
+void destroyBVH(BVH* bvh);
+float slabInverse(float direction);
+VkBool32 intersectBVHTriangle(const BVHTriangle* triangle, const float* origin, const float* direction, float tMin, float tMax, float* t, float* u, float* v);
+VkBool32 intersectBVH(const BVH* bvh, const vec3 origin, const vec3 direction, float tMin, float tMax, BVHHit* hit);
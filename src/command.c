@@ -1,8 +1,23 @@
 #include "command.h"
+#include "adaptive.h"
 #include "buffer.h"
+#include "denoise.h"
+#include "descriptor.h"
 #include "device.h"
+#include "image.h"
 #include "interface.h"
+#include "loader.h"
+#include "object.h"
+#include "pipeline.h"
+#include "query.h"
+#include "recorder.h"
+#include "resolution.h"
+#include "restir.h"
 #include "swapchain.h"
+#include "tonemap.h"
+#include "upload.h"
+#include "upscale.h"
+#include "wavefront.h"
 
 #include "dcimgui.h"
 #include "dcimgui_impl_glfw.h"
@@ -11,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 void createCommandPool(VKRT* vkrt) {
     QueueFamily indices = findQueueFamilies(vkrt);
@@ -20,87 +36,279 @@ void createCommandPool(VKRT* vkrt) {
     commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
     commandPoolCreateInfo.queueFamilyIndex = indices.graphics;
 
-    if (vkCreateCommandPool(vkrt->device, &commandPoolCreateInfo, NULL, &vkrt->commandPool) != VK_SUCCESS) {
+    if (vkrt->vk.CreateCommandPool(vkrt->device, &commandPoolCreateInfo, NULL, &vkrt->commandPool) != VK_SUCCESS) {
         perror("ERROR: Failed to create command pool");
         exit(EXIT_FAILURE);
     }
+
+    // The interface is recorded each frame into a one-time buffer whose pool is reset as a whole
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        if (vkrt->vk.CreateCommandPool(vkrt->device, &commandPoolCreateInfo, NULL, &vkrt->frameCommandPools[i]) != VK_SUCCESS) {
+            perror("ERROR: Failed to create frame command pool");
+            exit(EXIT_FAILURE);
+        }
+
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandPool = vkrt->frameCommandPools[i];
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandBufferCount = 1;
+
+        if (vkrt->vk.AllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, &vkrt->frameCommandBuffers[i]) != VK_SUCCESS) {
+            perror("ERROR: Failed to allocate frame command buffer");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    createRecorder(vkrt);
+    createUploadRing(vkrt);
 }
 
 void createCommandBuffers(VKRT* vkrt) {
-    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
-    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocateInfo.commandPool = vkrt->commandPool;
-    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocateInfo.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+        vkrt->frameImageIndices[i] = UINT32_MAX;
+    }
 
-    if (vkAllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, vkrt->commandBuffers) != VK_SUCCESS) {
-        perror("ERROR: Failed to allocate command buffers");
-        exit(EXIT_FAILURE);
+    createTraceCommandBuffers(vkrt);
+}
+
+// One pool per swapchain image, so the recorder threads can re-record the buffers side by side
+void createTraceCommandBuffers(VKRT* vkrt) {
+    QueueFamily indices = findQueueFamilies(vkrt);
+
+    vkrt->traceCommandPools = (VkCommandPool*)malloc(vkrt->swapChainImageCount * sizeof(VkCommandPool));
+    vkrt->traceCommandBuffers = (VkCommandBuffer*)malloc(vkrt->swapChainImageCount * sizeof(VkCommandBuffer));
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {0};
+    commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    commandPoolCreateInfo.queueFamilyIndex = indices.graphics;
+
+    for (uint32_t i = 0; i < vkrt->swapChainImageCount; i++) {
+        if (vkrt->vk.CreateCommandPool(vkrt->device, &commandPoolCreateInfo, NULL, &vkrt->traceCommandPools[i]) != VK_SUCCESS) {
+            perror("ERROR: Failed to create trace command pool");
+            exit(EXIT_FAILURE);
+        }
+
+        VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+        commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        commandBufferAllocateInfo.commandPool = vkrt->traceCommandPools[i];
+        commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        commandBufferAllocateInfo.commandBufferCount = 1;
+
+        if (vkrt->vk.AllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, &vkrt->traceCommandBuffers[i]) != VK_SUCCESS) {
+            perror("ERROR: Failed to allocate trace command buffers");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    vkrt->traceCommandBuffersDirty = VK_TRUE;
+}
+
+void freeTraceCommandBuffers(VKRT* vkrt) {
+    for (uint32_t i = 0; i < vkrt->swapChainImageCount; i++) {
+        vkrt->vk.DestroyCommandPool(vkrt->device, vkrt->traceCommandPools[i], NULL);
     }
+    free(vkrt->traceCommandBuffers);
+    free(vkrt->traceCommandPools);
+    vkrt->traceCommandBuffers = NULL;
+    vkrt->traceCommandPools = NULL;
 }
 
-void recordCommandBuffer(VKRT* vkrt, uint32_t imageIndex) {
-    VkCommandBuffer commandBuffer = vkrt->commandBuffers[vkrt->currentFrame];
+void invalidateTraceCommandBuffers(VKRT* vkrt) {
+    vkrt->traceCommandBuffersDirty = VK_TRUE;
+}
+
+// Timer slots are per swapchain image, so each job only touches host state its own image owns
+static void recordTrace(VKRT* vkrt, VkCommandBuffer commandBuffer, void* data) {
     VkExtent2D extent = vkrt->swapChainExtent;
-    VkImage sourceImage = vkrt->storageImage;
-    VkImage destImage = vkrt->swapChainImages[imageIndex];
+    uint32_t imageIndex = (uint32_t)(uintptr_t)data;
+    uint32_t timerSlot = imageIndex;
 
-    VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
-    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    resetGpuTimers(vkrt, commandBuffer, timerSlot);
 
-    if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS) {
-        perror("ERROR: Failed to begin command buffer");
-        exit(EXIT_FAILURE);
+    VkMemoryBarrier counterResetBarrier = {0};
+    counterResetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    counterResetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    counterResetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->pathCounterBuffer, 0, VK_WHOLE_SIZE, 0);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &counterResetBarrier, 0, NULL, 0, NULL);
+
+    if (vkrt->traceMode == TRACE_MODE_WAVEFRONT) {
+        recordWavefront(vkrt, commandBuffer, timerSlot);
+    } else {
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->rayTracingPipeline);
+        vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->pipelineLayout, 0, 1, &vkrt->descriptorSet, 0, NULL);
+
+        TracePushConstants pushConstants = {0};
+        vkrt->vk.CmdPushConstants(commandBuffer, vkrt->pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(pushConstants), &pushConstants);
+
+        if (adaptiveSamplingActive(vkrt)) {
+            recordAdaptiveTrace(vkrt, commandBuffer, timerSlot);
+        } else {
+            beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_TRACE);
+            vkrt->vk.CmdTraceRaysKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], extent.width, extent.height, 1);
+            endGpuTimer(vkrt, commandBuffer, timerSlot);
+        }
+
+        if (vkrt->pathSettings.restir) {
+            recordRestir(vkrt, commandBuffer, timerSlot);
+        }
+        if (denoiseActive(vkrt)) {
+            recordDenoise(vkrt, commandBuffer, timerSlot);
+        }
+        if (upscaleActive(vkrt)) {
+            recordUpscale(vkrt, commandBuffer, timerSlot);
+        }
+    }
+
+    VkMemoryBarrier counterReadBarrier = {0};
+    counterReadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    counterReadBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    counterReadBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &counterReadBarrier, 0, NULL, 0, NULL);
+
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_PRESENT);
+    recordTonemap(vkrt, commandBuffer, imageIndex);
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+}
+
+void recordTraceCommandBuffers(VKRT* vkrt) {
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    RecordJob* jobs = (RecordJob*)calloc(vkrt->swapChainImageCount, sizeof(RecordJob));
+    for (uint32_t imageIndex = 0; imageIndex < vkrt->swapChainImageCount; imageIndex++) {
+        jobs[imageIndex].record = recordTrace;
+        jobs[imageIndex].data = (void*)(uintptr_t)imageIndex;
+        jobs[imageIndex].commandBuffer = vkrt->traceCommandBuffers[imageIndex];
     }
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->rayTracingPipeline);
-    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->pipelineLayout, 0, 1, &vkrt->descriptorSet, 0, NULL);
+    recordJobs(vkrt, jobs, vkrt->swapChainImageCount);
+    free(jobs);
 
-    PFN_vkCmdTraceRaysKHR pvkCmdTraceRaysKHR = (PFN_vkCmdTraceRaysKHR)vkGetDeviceProcAddr(vkrt->device, "vkCmdTraceRaysKHR");
-    pvkCmdTraceRaysKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], extent.width, extent.height, 1);
+    vkrt->traceCommandBuffersDirty = VK_FALSE;
+}
 
-    transitionImageLayout(commandBuffer, destImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    transitionImageLayout(commandBuffer, sourceImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+VkCommandBuffer recordCommandBuffer(VKRT* vkrt, uint32_t imageIndex) {
+    drawInterface(vkrt);
+
+    VkCommandBuffer commandBuffer = vkrt->frameCommandBuffers[vkrt->currentFrame];
 
-    VkImageBlit blit = {0};
-    blit.srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-    blit.srcOffsets[0] = (VkOffset3D){0, 0, 0};
-    blit.srcOffsets[1] = (VkOffset3D){(int32_t)extent.width, (int32_t)extent.height, 1};
-    blit.dstSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-    blit.dstOffsets[0] = (VkOffset3D){0, 0, 0};
-    blit.dstOffsets[1] = (VkOffset3D){(int32_t)extent.width, (int32_t)extent.height, 1};
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    vkCmdBlitImage(commandBuffer, sourceImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, destImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+    if (vkrt->vk.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS) {
+        perror("ERROR: Failed to begin command buffer");
+        exit(EXIT_FAILURE);
+    }
 
     VkRenderPassBeginInfo renderPassBeginInfo = {0};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassBeginInfo.renderPass = vkrt->renderPass;
     renderPassBeginInfo.framebuffer = vkrt->framebuffers[imageIndex];
     renderPassBeginInfo.renderArea.offset = (VkOffset2D){0, 0};
-    renderPassBeginInfo.renderArea.extent = extent;
+    renderPassBeginInfo.renderArea.extent = vkrt->swapChainExtent;
     renderPassBeginInfo.clearValueCount = 0;
     renderPassBeginInfo.pClearValues = NULL;
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkrt->vk.CmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    cImGui_ImplVulkan_RenderDrawData(ImGui_GetDrawData(), commandBuffer);
+    vkrt->vk.CmdEndRenderPass(commandBuffer);
 
-    drawInterface(vkrt);
+    if (vkrt->vk.EndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        perror("ERROR: Failed to end command buffer");
+        exit(EXIT_FAILURE);
+    }
 
-    cImGui_ImplVulkan_RenderDrawData(ImGui_GetDrawData(), commandBuffer);
-    vkCmdEndRenderPass(commandBuffer);
+    return commandBuffer;
+}
 
-    transitionImageLayout(commandBuffer, sourceImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+static void submitFrame(VKRT* vkrt, VkCommandBuffer* commandBuffers, uint32_t commandBufferCount) {
+    VkSemaphore waitSemaphore = vkrt->imageAvailableSemaphores[vkrt->currentFrame];
+    VkSemaphore signalSemaphore = vkrt->renderFinishedSemaphores[vkrt->currentFrame];
+    VkFence fence = vkrt->inFlightFences[vkrt->currentFrame];
+
+    submitUploads(vkrt);
+
+    if (vkrt->synchronization2) {
+        VkSemaphoreSubmitInfo waitSemaphoreInfo = {0};
+        waitSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        waitSemaphoreInfo.semaphore = waitSemaphore;
+        waitSemaphoreInfo.stageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_TRANSFER_BIT;
+
+        VkSemaphoreSubmitInfo signalSemaphoreInfo = {0};
+        signalSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+        signalSemaphoreInfo.semaphore = signalSemaphore;
+        signalSemaphoreInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+        VkCommandBufferSubmitInfo commandBufferInfos[4] = {0};
+        for (uint32_t i = 0; i < commandBufferCount; i++) {
+            commandBufferInfos[i].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+            commandBufferInfos[i].commandBuffer = commandBuffers[i];
+        }
+
+        VkSubmitInfo2 submitInfo = {0};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+        submitInfo.waitSemaphoreInfoCount = 1;
+        submitInfo.pWaitSemaphoreInfos = &waitSemaphoreInfo;
+        submitInfo.commandBufferInfoCount = commandBufferCount;
+        submitInfo.pCommandBufferInfos = commandBufferInfos;
+        submitInfo.signalSemaphoreInfoCount = 1;
+        submitInfo.pSignalSemaphoreInfos = &signalSemaphoreInfo;
+
+        if (vkrt->vk.QueueSubmit2(vkrt->graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+            perror("ERROR: Failed to submit draw queue");
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
 
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-        perror("ERROR: Failed to end command buffer");
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &waitSemaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = commandBufferCount;
+    submitInfo.pCommandBuffers = commandBuffers;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+
+    if (vkrt->vk.QueueSubmit(vkrt->graphicsQueue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        perror("ERROR: Failed to submit draw queue");
         exit(EXIT_FAILURE);
     }
 }
 
 void drawFrame(VKRT* vkrt) {
-    vkWaitForFences(vkrt->device, 1, &vkrt->inFlightFences[vkrt->currentFrame], VK_TRUE, UINT64_MAX);
+    vkrt->vk.WaitForFences(vkrt->device, 1, &vkrt->inFlightFences[vkrt->currentFrame], VK_TRUE, UINT64_MAX);
+    if (vkrt->frameImageIndices[vkrt->currentFrame] != UINT32_MAX) {
+        collectGpuTimers(vkrt, vkrt->frameImageIndices[vkrt->currentFrame]);
+        collectPathCounters(vkrt);
+    }
+    updateRenderScale(vkrt);
+
+    if (vkrt->requestedOutputPrecision != vkrt->outputPrecision) {
+        setOutputPrecision(vkrt, vkrt->requestedOutputPrecision);
+    }
+
+    if (memcmp(&vkrt->requestedPathSettings, &vkrt->pathSettings, sizeof(PathSettings)) != 0) {
+        setPathSettings(vkrt, vkrt->requestedPathSettings);
+    }
+
+    if (vkrt->requestedTraceMode != vkrt->traceMode) {
+        setTraceMode(vkrt, vkrt->requestedTraceMode);
+    }
+
+    updateSceneLoad(vkrt);
 
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(vkrt->device, vkrt->swapChain, UINT64_MAX, vkrt->imageAvailableSemaphores[vkrt->currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result = vkrt->vk.AcquireNextImageKHR(vkrt->device, vkrt->swapChain, UINT64_MAX, vkrt->imageAvailableSemaphores[vkrt->currentFrame], VK_NULL_HANDLE, &imageIndex);
 
     if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         recreateSwapChain(vkrt);
@@ -110,39 +318,37 @@ void drawFrame(VKRT* vkrt) {
         exit(EXIT_FAILURE);
     }
 
-    vkResetFences(vkrt->device, 1, &vkrt->inFlightFences[vkrt->currentFrame]);
+    if (vkrt->traceCommandBuffersDirty) {
+        recordTraceCommandBuffers(vkrt);
+    }
 
-    vkResetCommandBuffer(vkrt->commandBuffers[vkrt->currentFrame], 0);
-    recordCommandBuffer(vkrt, imageIndex);
+    uint64_t submitStart = getTimeNanoSeconds();
 
-    VkSemaphore waitSemaphores[] = {vkrt->imageAvailableSemaphores[vkrt->currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_TRANSFER_BIT};
-    VkSemaphore signalSemaphores[] = {vkrt->renderFinishedSemaphores[vkrt->currentFrame]};
+    vkrt->vk.ResetFences(vkrt->device, 1, &vkrt->inFlightFences[vkrt->currentFrame]);
 
-    VkSubmitInfo submitInfo = {0};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &vkrt->commandBuffers[vkrt->currentFrame];
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
+    vkrt->vk.ResetCommandPool(vkrt->device, vkrt->frameCommandPools[vkrt->currentFrame], 0);
+    VkCommandBuffer commandBuffer = recordCommandBuffer(vkrt, imageIndex);
+    updateUpscaleJitter(vkrt);
+    vkrt->uniformBufferMapped->accumulatedFrames = vkrt->accumulatedFrames;
+    vkrt->uniformBufferMapped->frameIndex = vkrt->frameIndex++;
+    glm_mat4_copy(vkrt->previousViewProjection, vkrt->uniformBufferMapped->previousViewProjection);
+    glm_mat4_copy(vkrt->viewProjection, vkrt->previousViewProjection);
 
-    if (vkQueueSubmit(vkrt->graphicsQueue, 1, &submitInfo, vkrt->inFlightFences[vkrt->currentFrame]) != VK_SUCCESS) {
-        perror("ERROR: Failed to submit draw queue");
-        exit(EXIT_FAILURE);
-    }
+    VkCommandBuffer submitCommandBuffers[] = {vkrt->traceCommandBuffers[imageIndex], commandBuffer};
+    submitFrame(vkrt, submitCommandBuffers, COUNT_OF(submitCommandBuffers));
+    vkrt->accumulatedFrames++;
+    vkrt->frameImageIndices[vkrt->currentFrame] = imageIndex;
+    vkrt->tempSubmitTime += getTimeNanoSeconds() - submitStart;
 
     VkPresentInfoKHR presentInfo = {0};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    presentInfo.pWaitSemaphores = &vkrt->renderFinishedSemaphores[vkrt->currentFrame];
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &vkrt->swapChain;
     presentInfo.pImageIndices = &imageIndex;
 
-    result = vkQueuePresentKHR(vkrt->presentQueue, &presentInfo);
+    result = vkrt->vk.QueuePresentKHR(vkrt->presentQueue, &presentInfo);
     if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || vkrt->framebufferResized) {
         vkrt->framebufferResized = VK_FALSE;
         recreateSwapChain(vkrt);
@@ -153,7 +359,12 @@ void drawFrame(VKRT* vkrt) {
 
     recordFrameTime(vkrt);
 
-    vkQueueWaitIdle(vkrt->presentQueue);
+    if (!vkrt->sceneLoader.firstPixelTime) {
+        vkrt->sceneLoader.firstPixelTime = getTimeNanoSeconds();
+        printf("INFO: First frame presented %.2f s after start\n", (double)(vkrt->sceneLoader.firstPixelTime - vkrt->sceneLoader.startTime) / 1e9);
+    }
+
+    vkrt->vk.QueueWaitIdle(vkrt->presentQueue);
     vkrt->currentFrame = (vkrt->currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
@@ -165,32 +376,33 @@ VkCommandBuffer beginSingleTimeCommands(VKRT* vkrt) {
     commandBufferAllocateInfo.commandBufferCount = 1;
 
     VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, &commandBuffer);
+    vkrt->vk.AllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, &commandBuffer);
 
     VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
     commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-    vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+    vkrt->vk.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
 
     return commandBuffer;
 }
 
 void endSingleTimeCommands(VKRT* vkrt, VkCommandBuffer commandBuffer) {
-    vkEndCommandBuffer(commandBuffer);
+    vkrt->vk.EndCommandBuffer(commandBuffer);
+    submitUploads(vkrt);
 
     VkSubmitInfo submitInfo = {0};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffer;
 
-    vkQueueSubmit(vkrt->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(vkrt->graphicsQueue);
+    vkrt->vk.QueueSubmit(vkrt->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkrt->vk.QueueWaitIdle(vkrt->graphicsQueue);
 
-    vkFreeCommandBuffers(vkrt->device, vkrt->commandPool, 1, &commandBuffer);
+    vkrt->vk.FreeCommandBuffers(vkrt->device, vkrt->commandPool, 1, &commandBuffer);
 }
 
-void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout) {
+void transitionImageLayout(VKRT* vkrt, VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout) {
     VkImageMemoryBarrier barrier = {0};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -249,6 +461,18 @@ void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImage
         srcStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
         dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
 
+    } else if (oldLayout == VK_IMAGE_LAYOUT_GENERAL && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        srcStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+        dstStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+
+    } else if (oldLayout == VK_IMAGE_LAYOUT_GENERAL && newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        srcStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        dstStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
     } else if (oldLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
         barrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
         barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
@@ -276,14 +500,16 @@ void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImage
         exit(EXIT_FAILURE);
     }
 
-    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
 }
 
 void createStorageImage(VKRT* vkrt) {
+    VkFormat format = outputPrecisionInfos[vkrt->outputPrecision].format;
+
     VkImageCreateInfo imageCreateInfo = {0};
     imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageCreateInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    imageCreateInfo.format = format;
     imageCreateInfo.extent.width = vkrt->swapChainExtent.width;
     imageCreateInfo.extent.height = vkrt->swapChainExtent.height;
     imageCreateInfo.extent.depth = 1;
@@ -291,28 +517,29 @@ void createStorageImage(VKRT* vkrt) {
     imageCreateInfo.arrayLayers = 1;
     imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-    imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    if (vkCreateImage(vkrt->device, &imageCreateInfo, NULL, &vkrt->storageImage) != VK_SUCCESS) {
+    if (vkrt->vk.CreateImage(vkrt->device, &imageCreateInfo, NULL, &vkrt->storageImage) != VK_SUCCESS) {
         perror("ERROR: Failed to create storage image");
         exit(EXIT_FAILURE);
     }
 
     VkMemoryRequirements memoryRequirements;
-    vkGetImageMemoryRequirements(vkrt->device, vkrt->storageImage, &memoryRequirements);
+    vkrt->vk.GetImageMemoryRequirements(vkrt->device, vkrt->storageImage, &memoryRequirements);
+    vkrt->storageImageSize = memoryRequirements.size;
 
     VkMemoryAllocateInfo memoryAllocateInfo = {0};
     memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     memoryAllocateInfo.allocationSize = memoryRequirements.size;
     memoryAllocateInfo.memoryTypeIndex = findMemoryType(vkrt, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-    if (vkAllocateMemory(vkrt->device, &memoryAllocateInfo, NULL, &vkrt->storageImageMemory) != VK_SUCCESS) {
+    if (vkrt->vk.AllocateMemory(vkrt->device, &memoryAllocateInfo, NULL, &vkrt->storageImageMemory) != VK_SUCCESS) {
         perror("ERROR: Failed to allocate storage image memory");
         exit(EXIT_FAILURE);
     }
 
-    if (vkBindImageMemory(vkrt->device, vkrt->storageImage, vkrt->storageImageMemory, 0) != VK_SUCCESS) {
+    if (vkrt->vk.BindImageMemory(vkrt->device, vkrt->storageImage, vkrt->storageImageMemory, 0) != VK_SUCCESS) {
         perror("ERROR: Failed to bind storage image memory");
         exit(EXIT_FAILURE);
     }
@@ -320,7 +547,7 @@ void createStorageImage(VKRT* vkrt) {
     VkImageViewCreateInfo imageViewCreateInfo = {0};
     imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     imageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    imageViewCreateInfo.format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    imageViewCreateInfo.format = format;
     imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
     imageViewCreateInfo.subresourceRange.levelCount = 1;
@@ -328,12 +555,178 @@ void createStorageImage(VKRT* vkrt) {
     imageViewCreateInfo.subresourceRange.layerCount = 1;
     imageViewCreateInfo.image = vkrt->storageImage;
 
-    if (vkCreateImageView(vkrt->device, &imageViewCreateInfo, NULL, &vkrt->storageImageView) != VK_SUCCESS) {
+    if (vkrt->vk.CreateImageView(vkrt->device, &imageViewCreateInfo, NULL, &vkrt->storageImageView) != VK_SUCCESS) {
         perror("ERROR: Failed to create storage image view");
         exit(EXIT_FAILURE);
     }
 
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
-    transitionImageLayout(commandBuffer, vkrt->storageImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    transitionImageLayout(vkrt, commandBuffer, vkrt->storageImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
     endSingleTimeCommands(vkrt, commandBuffer);
-}
\ No newline at end of file
+}
+
+void destroyStorageImage(VKRT* vkrt) {
+    vkrt->vk.DestroyImageView(vkrt->device, vkrt->storageImageView, NULL);
+    vkrt->vk.DestroyImage(vkrt->device, vkrt->storageImage, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->storageImageMemory, NULL);
+}
+
+// Copies the raw trace output to host memory in the current output precision's format
+void readStorageImage(VKRT* vkrt, void* pixels) {
+    VkExtent2D extent = vkrt->swapChainExtent;
+    VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * outputPrecisionInfos[vkrt->outputPrecision].bytesPerPixel;
+
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    createBuffer(vkrt, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, &readbackMemory);
+
+    VkBufferImageCopy region = {0};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = (VkExtent3D){extent.width, extent.height, 1};
+
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    transitionImageLayout(vkrt, commandBuffer, vkrt->storageImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    vkrt->vk.CmdCopyImageToBuffer(commandBuffer, vkrt->storageImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+    transitionImageLayout(vkrt, commandBuffer, vkrt->storageImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    void* mapped;
+    vkrt->vk.MapMemory(vkrt->device, readbackMemory, 0, size, 0, &mapped);
+    memcpy(pixels, mapped, (size_t)size);
+    vkrt->vk.UnmapMemory(vkrt->device, readbackMemory);
+
+    vkrt->vk.DestroyBuffer(vkrt->device, readbackBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, readbackMemory, NULL);
+}
+
+void setOutputPrecision(VKRT* vkrt, OutputPrecision precision) {
+    if (!outputPrecisionSupported(vkrt, precision)) {
+        fprintf(stderr, "ERROR: Output precision %s is not supported on this device\n", outputPrecisionInfos[precision].name);
+        vkrt->requestedOutputPrecision = vkrt->outputPrecision;
+        return;
+    }
+
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    vkrt->precisionTraceTimes[vkrt->outputPrecision] = traceGpuTime(vkrt);
+    vkrt->gpuTimes[GPU_TIMER_TRACE] = vkrt->precisionTraceTimes[precision];
+    vkrt->outputPrecision = precision;
+    vkrt->requestedOutputPrecision = precision;
+
+    destroyTonemapResources(vkrt);
+    destroyStorageImage(vkrt);
+
+    createStorageImage(vkrt);
+    if (vkrt->pathSettings.restir) {
+        destroyRestirResources(vkrt);
+        createRestirResources(vkrt);
+    }
+    if (vkrt->pathSettings.denoiser) {
+        destroyDenoiseResources(vkrt);
+        createDenoiseResources(vkrt);
+    }
+    if (vkrt->pathSettings.upscaler) {
+        destroyUpscaleResources(vkrt);
+        createUpscaleResources(vkrt);
+    }
+    updateDescriptorSet(vkrt);
+    createTonemapResources(vkrt);
+    if (vkrt->traceMode == TRACE_MODE_WAVEFRONT) {
+        destroyWavefrontResources(vkrt);
+        createWavefrontResources(vkrt);
+    }
+    recreateRayTracingPipeline(vkrt);
+    invalidateTraceCommandBuffers(vkrt);
+
+    vkrt->accumulatedFrames = 0;
+}
+
+void setPathSettings(VKRT* vkrt, PathSettings settings) {
+    if (settings.maxDepth < 1) settings.maxDepth = 1;
+    if (settings.rouletteDepth > settings.maxDepth) settings.rouletteDepth = settings.maxDepth;
+    if (!vkrt->restirSupported) settings.restir = 0;
+    // ReSTIR resolves every pixel each frame, so it can't skip converged tiles
+    if (settings.restir) settings.adaptive = 0;
+    // Its resolve stands in for the primary light sample, so without light sampling bounce rays would count emitters twice
+    if (settings.restir) settings.nextEventEstimation = 1;
+    if (!vkrt->denoiseSupported) settings.denoiser = DENOISER_OFF;
+    if (!vkrt->upscaleSupported) settings.upscaler = 0;
+
+    // Reservoirs and surfaces scale with the swapchain, so only hold them while ReSTIR is on
+    if (settings.restir != vkrt->pathSettings.restir) {
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        if (vkrt->pathSettings.restir) {
+            destroyRestirResources(vkrt);
+        } else {
+            createRestirResources(vkrt);
+        }
+        updateDescriptorSet(vkrt);
+    }
+
+    // Per-pixel statistics and the tile list likewise only exist while adaptive sampling is on
+    if (settings.adaptive != vkrt->pathSettings.adaptive) {
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        if (vkrt->pathSettings.adaptive) {
+            destroyAdaptiveResources(vkrt);
+        } else {
+            createAdaptiveResources(vkrt);
+        }
+        updateDescriptorSet(vkrt);
+    }
+
+    // Guides and filter history too, for either denoiser mode
+    if ((settings.denoiser != DENOISER_OFF) != (vkrt->pathSettings.denoiser != DENOISER_OFF)) {
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        if (vkrt->pathSettings.denoiser) {
+            destroyDenoiseResources(vkrt);
+        } else {
+            createDenoiseResources(vkrt);
+        }
+        updateDescriptorSet(vkrt);
+    }
+
+    // Motion vectors and output history as well, while the upscaler is on
+    if (settings.upscaler != vkrt->pathSettings.upscaler) {
+        vkrt->vk.DeviceWaitIdle(vkrt->device);
+        if (vkrt->pathSettings.upscaler) {
+            destroyUpscaleResources(vkrt);
+        } else {
+            createUpscaleResources(vkrt);
+        }
+        updateDescriptorSet(vkrt);
+    }
+
+    vkrt->pathSettings = settings;
+    vkrt->requestedPathSettings = settings;
+
+    recreateRayTracingPipeline(vkrt);
+    invalidateTraceCommandBuffers(vkrt);
+    vkrt->accumulatedFrames = 0;
+}
+
+void setTraceMode(VKRT* vkrt, TraceMode mode) {
+    if (mode == TRACE_MODE_WAVEFRONT && !vkrt->wavefrontSupported) {
+        fprintf(stderr, "ERROR: Wavefront mode is not supported on this device\n");
+        vkrt->requestedTraceMode = vkrt->traceMode;
+        return;
+    }
+
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    // Queue buffers scale with the swapchain, so only hold them while wavefront mode is active
+    if (vkrt->traceMode == TRACE_MODE_WAVEFRONT) {
+        destroyWavefrontResources(vkrt);
+    }
+    if (mode == TRACE_MODE_WAVEFRONT) {
+        createWavefrontResources(vkrt);
+    }
+
+    vkrt->traceMode = mode;
+    vkrt->requestedTraceMode = mode;
+
+    invalidateTraceCommandBuffers(vkrt);
+    vkrt->accumulatedFrames = 0;
+}
@@ -3,9 +3,18 @@
 
 void createCommandPool(VKRT* vkrt);
 void createCommandBuffers(VKRT* vkrt);
-void recordCommandBuffer(VKRT* vkrt, uint32_t imageIndex);
+void createTraceCommandBuffers(VKRT* vkrt);
+void freeTraceCommandBuffers(VKRT* vkrt);
+void invalidateTraceCommandBuffers(VKRT* vkrt);
+void recordTraceCommandBuffers(VKRT* vkrt);
+VkCommandBuffer recordCommandBuffer(VKRT* vkrt, uint32_t imageIndex);
 void drawFrame(VKRT* vkrt);
 VkCommandBuffer beginSingleTimeCommands(VKRT* vkrt);
 void endSingleTimeCommands(VKRT* vkrt, VkCommandBuffer commandBuffer);
-void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
-void createStorageImage(VKRT* vkrt);
\ No newline at end of file
+void transitionImageLayout(VKRT* vkrt, VkCommandBuffer commandBuffer, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout);
+void createStorageImage(VKRT* vkrt);
+void destroyStorageImage(VKRT* vkrt);
+void readStorageImage(VKRT* vkrt, void* pixels);
+void setOutputPrecision(VKRT* vkrt, OutputPrecision precision);
+void setPathSettings(VKRT* vkrt, PathSettings settings);
+void setTraceMode(VKRT* vkrt, TraceMode mode);
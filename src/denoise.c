@@ -0,0 +1,236 @@
+#include "denoise.h"
+#include "buffer.h"
+#include "command.h"
+#include "pipeline.h"
+#include "query.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DENOISE_WORKGROUP_SIZE 8
+#define DENOISE_BINDING_COUNT 6
+
+// Mirrors of the std430 layouts in denoise.comp
+typedef struct DenoiseGuide {
+    float position[3];
+    float hitT;
+    float normal[3];
+    uint32_t albedo;
+} DenoiseGuide;
+
+typedef struct DenoiseHistory {
+    float color[3];
+    float frames;
+    float moments[2];
+    float padding[2];
+} DenoiseHistory;
+
+typedef struct DenoisePushConstants {
+    uint32_t iteration;
+    uint32_t iterationCount;
+} DenoisePushConstants;
+
+static const char* denoiseShaders[DENOISE_STAGE_COUNT] = {
+    "./denoise_history.comp.spv",
+    "./denoise_moments.comp.spv",
+    "./denoise_filter.comp.spv"};
+
+// A-trous iterations per mode: fast spans 29 pixels, quality 125
+static const uint32_t denoiseIterations[DENOISER_COUNT] = {0, 3, 5};
+
+static const VkDescriptorType denoiseBindingTypes[DENOISE_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+void createDenoisePipeline(VKRT* vkrt) {
+    // The last filter pass writes the storage image without a format qualifier
+    vkrt->denoiseSupported = vkrt->storageWriteWithoutFormat;
+    if (!vkrt->denoiseSupported) {
+        printf("INFO: Device lacks formatless storage writes, denoiser disabled.\n");
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[DENOISE_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < DENOISE_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = denoiseBindingTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->denoiseDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create denoiser descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPushConstantRange pushConstantRange = {0};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DenoisePushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->denoiseDescriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->denoisePipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create denoiser pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < DENOISE_STAGE_COUNT; i++) {
+        vkrt->denoisePipelines[i] = createComputePipeline(vkrt, denoiseShaders[i], vkrt->denoisePipelineLayout, NULL);
+    }
+}
+
+void destroyDenoisePipeline(VKRT* vkrt) {
+    if (!vkrt->denoiseSupported) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < DENOISE_STAGE_COUNT; i++) {
+        vkrt->vk.DestroyPipeline(vkrt->device, vkrt->denoisePipelines[i], NULL);
+    }
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->denoisePipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->denoiseDescriptorSetLayout, NULL);
+}
+
+void createDenoiseResources(VKRT* vkrt) {
+    VkDeviceSize capacity = (VkDeviceSize)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+
+    createBuffer(vkrt, 2 * capacity * sizeof(DenoiseGuide), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->denoiseGuideBuffer, &vkrt->denoiseGuideMemory);
+    createBuffer(vkrt, 2 * capacity * sizeof(DenoiseHistory), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->denoiseHistoryBuffer, &vkrt->denoiseHistoryMemory);
+    createBuffer(vkrt, 2 * capacity * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->denoiseIlluminationBuffer, &vkrt->denoiseIlluminationMemory);
+
+    // Zeroed guides and history read as invalid for the first reprojection
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->denoiseGuideBuffer, 0, VK_WHOLE_SIZE, 0);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->denoiseHistoryBuffer, 0, VK_WHOLE_SIZE, 0);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = 1;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->denoiseDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create denoiser descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->denoiseDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = &vkrt->denoiseDescriptorSetLayout;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->denoiseDescriptorSet) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate denoiser descriptor set");
+        exit(EXIT_FAILURE);
+    }
+
+    // The noisy frame is read through a sampler, the filtered result goes back into the same image
+    VkDescriptorImageInfo imageInfos[DENOISE_BINDING_COUNT] = {0};
+    imageInfos[1] = (VkDescriptorImageInfo){vkrt->storageImageSampler, vkrt->storageImageView, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[2] = (VkDescriptorImageInfo){VK_NULL_HANDLE, vkrt->storageImageView, VK_IMAGE_LAYOUT_GENERAL};
+
+    VkDescriptorBufferInfo bufferInfos[DENOISE_BINDING_COUNT] = {0};
+    bufferInfos[0] = (VkDescriptorBufferInfo){vkrt->uniformBuffer, 0, sizeof(SceneUniform)};
+    bufferInfos[3] = (VkDescriptorBufferInfo){vkrt->denoiseGuideBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = (VkDescriptorBufferInfo){vkrt->denoiseHistoryBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[5] = (VkDescriptorBufferInfo){vkrt->denoiseIlluminationBuffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[DENOISE_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < DENOISE_BINDING_COUNT; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = vkrt->denoiseDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = denoiseBindingTypes[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    for (uint32_t i = 1; i <= 2; i++) {
+        writes[i].pImageInfo = &imageInfos[i];
+        writes[i].pBufferInfo = NULL;
+    }
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+}
+
+void destroyDenoiseResources(VKRT* vkrt) {
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->denoiseDescriptorPool, NULL);
+    vkrt->denoiseDescriptorPool = VK_NULL_HANDLE;
+
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->denoiseGuideBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->denoiseGuideMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->denoiseHistoryBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->denoiseHistoryMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->denoiseIlluminationBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->denoiseIlluminationMemory, NULL);
+
+    // The ray tracing descriptor set falls back to a placeholder for the guide buffer
+    vkrt->denoiseGuideBuffer = VK_NULL_HANDLE;
+}
+
+// Accumulating output converges on its own, and only the megakernel raygen writes the guide buffer
+VkBool32 denoiseActive(VKRT* vkrt) {
+    return vkrt->pathSettings.denoiser != DENOISER_OFF && vkrt->outputPrecision != OUTPUT_PRECISION_RGBA32F && vkrt->traceMode == TRACE_MODE_MEGAKERNEL;
+}
+
+// Temporal accumulation, variance estimation and the a-trous iterations, the last of which writes the storage image.
+// Runs after the trace and ReSTIR, before tone mapping.
+void recordDenoise(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot) {
+    uint32_t groupsX = (vkrt->swapChainExtent.width + DENOISE_WORKGROUP_SIZE - 1) / DENOISE_WORKGROUP_SIZE;
+    uint32_t groupsY = (vkrt->swapChainExtent.height + DENOISE_WORKGROUP_SIZE - 1) / DENOISE_WORKGROUP_SIZE;
+
+    DenoisePushConstants pushConstants = {0};
+    pushConstants.iterationCount = denoiseIterations[vkrt->pathSettings.denoiser];
+
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->denoisePipelineLayout, 0, 1, &vkrt->denoiseDescriptorSet, 0, NULL);
+
+    for (uint32_t stage = 0; stage < DENOISE_STAGE_FILTER; stage++) {
+        beginGpuTimer(vkrt, commandBuffer, timerSlot, stage == DENOISE_STAGE_HISTORY ? GPU_TIMER_HISTORY : GPU_TIMER_MOMENTS);
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->denoisePipelines[stage]);
+        vkrt->vk.CmdPushConstants(commandBuffer, vkrt->denoisePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkrt->vk.CmdDispatch(commandBuffer, groupsX, groupsY, 1);
+        endGpuTimer(vkrt, commandBuffer, timerSlot);
+        vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+
+    // Each iteration doubles the tap spacing and ping-pongs between the two illumination halves
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_FILTER);
+    vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->denoisePipelines[DENOISE_STAGE_FILTER]);
+    for (uint32_t iteration = 0; iteration < pushConstants.iterationCount; iteration++) {
+        pushConstants.iteration = iteration;
+        vkrt->vk.CmdPushConstants(commandBuffer, vkrt->denoisePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkrt->vk.CmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+        // The last barrier also keeps the next frame's raygen from overwriting guides still being read
+        vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+}
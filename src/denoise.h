@@ -0,0 +1,9 @@
+#pragma once
+#include "vkrt.h"
+
+void createDenoisePipeline(VKRT* vkrt);
+void createDenoiseResources(VKRT* vkrt);
+void destroyDenoiseResources(VKRT* vkrt);
+void destroyDenoisePipeline(VKRT* vkrt);
+VkBool32 denoiseActive(VKRT* vkrt);
+void recordDenoise(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot);
@@ -34,19 +34,110 @@ void createDescriptorSetLayout(VKRT* vkrt) {
     uniformBufferLayoutBinding.descriptorCount = 1;
     uniformBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
 
+    VkDescriptorSetLayoutBinding materialBufferLayoutBinding = {0};
+    materialBufferLayoutBinding.binding = 5;
+    materialBufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    materialBufferLayoutBinding.descriptorCount = 1;
+    materialBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding pathCounterLayoutBinding = {0};
+    pathCounterLayoutBinding.binding = 6;
+    pathCounterLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pathCounterLayoutBinding.descriptorCount = 1;
+    pathCounterLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding lightBufferLayoutBinding = {0};
+    lightBufferLayoutBinding.binding = 7;
+    lightBufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lightBufferLayoutBinding.descriptorCount = 1;
+    lightBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding environmentBufferLayoutBinding = {0};
+    environmentBufferLayoutBinding.binding = 8;
+    environmentBufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    environmentBufferLayoutBinding.descriptorCount = 1;
+    environmentBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding lightTreeBufferLayoutBinding = {0};
+    lightTreeBufferLayoutBinding.binding = 9;
+    lightTreeBufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lightTreeBufferLayoutBinding.descriptorCount = 1;
+    lightTreeBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding restirSurfaceLayoutBinding = {0};
+    restirSurfaceLayoutBinding.binding = 10;
+    restirSurfaceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    restirSurfaceLayoutBinding.descriptorCount = 1;
+    restirSurfaceLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding restirRadianceLayoutBinding = {0};
+    restirRadianceLayoutBinding.binding = 11;
+    restirRadianceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    restirRadianceLayoutBinding.descriptorCount = 1;
+    restirRadianceLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding samplerBufferLayoutBinding = {0};
+    samplerBufferLayoutBinding.binding = 12;
+    samplerBufferLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    samplerBufferLayoutBinding.descriptorCount = 1;
+    samplerBufferLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding adaptiveStatsLayoutBinding = {0};
+    adaptiveStatsLayoutBinding.binding = 13;
+    adaptiveStatsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    adaptiveStatsLayoutBinding.descriptorCount = 1;
+    adaptiveStatsLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding adaptiveTileLayoutBinding = {0};
+    adaptiveTileLayoutBinding.binding = 14;
+    adaptiveTileLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    adaptiveTileLayoutBinding.descriptorCount = 1;
+    adaptiveTileLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding denoiseGuideLayoutBinding = {0};
+    denoiseGuideLayoutBinding.binding = 15;
+    denoiseGuideLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    denoiseGuideLayoutBinding.descriptorCount = 1;
+    denoiseGuideLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding upscaleMotionLayoutBinding = {0};
+    upscaleMotionLayoutBinding.binding = 16;
+    upscaleMotionLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    upscaleMotionLayoutBinding.descriptorCount = 1;
+    upscaleMotionLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+    VkDescriptorSetLayoutBinding viewCameraLayoutBinding = {0};
+    viewCameraLayoutBinding.binding = 17;
+    viewCameraLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    viewCameraLayoutBinding.descriptorCount = 1;
+    viewCameraLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
     VkDescriptorSetLayoutBinding bindings[] = {
         accelerationStructureLayoutBinding,
         storageImageLayoutBinding,
         vertexBufferLayoutBinding,
         indexBufferLayoutBinding,
-        uniformBufferLayoutBinding};
+        uniformBufferLayoutBinding,
+        materialBufferLayoutBinding,
+        pathCounterLayoutBinding,
+        lightBufferLayoutBinding,
+        environmentBufferLayoutBinding,
+        lightTreeBufferLayoutBinding,
+        restirSurfaceLayoutBinding,
+        restirRadianceLayoutBinding,
+        samplerBufferLayoutBinding,
+        adaptiveStatsLayoutBinding,
+        adaptiveTileLayoutBinding,
+        denoiseGuideLayoutBinding,
+        upscaleMotionLayoutBinding,
+        viewCameraLayoutBinding};
 
     VkDescriptorSetLayoutCreateInfo descriptorSetlayoutCreateInfo = {0};
     descriptorSetlayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
     descriptorSetlayoutCreateInfo.bindingCount = COUNT_OF(bindings);
     descriptorSetlayoutCreateInfo.pBindings = bindings;
 
-    if (vkCreateDescriptorSetLayout(vkrt->device, &descriptorSetlayoutCreateInfo, NULL, &vkrt->descriptorSetLayout) != VK_SUCCESS) {
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetlayoutCreateInfo, NULL, &vkrt->descriptorSetLayout) != VK_SUCCESS) {
         perror("ERROR: Failed to create descriptor set layout");
         exit(EXIT_FAILURE);
     }
@@ -56,7 +147,7 @@ void createDescriptorPool(VKRT* vkrt) {
     VkDescriptorPoolSize poolSizes[] = {
         {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1},
         {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 15},
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}};
 
@@ -67,7 +158,7 @@ void createDescriptorPool(VKRT* vkrt) {
     descriptorPoolCreateInfo.maxSets = MAX_FRAMES_IN_FLIGHT;
     descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
-    if (vkCreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->descriptorPool) != VK_SUCCESS) {
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->descriptorPool) != VK_SUCCESS) {
         perror("ERROR: Failed to create descriptor pool");
         exit(EXIT_FAILURE);
     }
@@ -80,7 +171,7 @@ void createDescriptorSet(VKRT* vkrt) {
     descriptorSetAllocateInfo.descriptorSetCount = 1;
     descriptorSetAllocateInfo.pSetLayouts = &vkrt->descriptorSetLayout;
 
-    if (vkAllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->descriptorSet) != VK_SUCCESS) {
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->descriptorSet) != VK_SUCCESS) {
         perror("ERROR: Failed to allocate descriptor sets");
         exit(EXIT_FAILURE);
     }
@@ -104,7 +195,8 @@ void updateDescriptorSet(VKRT* vkrt) {
     accelerationStructureWrite.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
 
     VkDescriptorImageInfo storageImageInfo = {0};
-    storageImageInfo.imageView = vkrt->storageImageView;
+    // Multi-view rendering traces into its layered image instead, see multiview.c
+    storageImageInfo.imageView = vkrt->viewCount ? vkrt->viewImage.view : vkrt->storageImageView;
     storageImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
     VkWriteDescriptorSet storageImageWrite = {0};
@@ -158,12 +250,208 @@ void updateDescriptorSet(VKRT* vkrt) {
     sceneUniformWrite.descriptorCount = 1;
     sceneUniformWrite.pBufferInfo = &sceneUniformInfo;
 
+    VkDescriptorBufferInfo materialBufferInfo = {0};
+    materialBufferInfo.buffer = vkrt->materialBuffer;
+    materialBufferInfo.offset = 0;
+    materialBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet materialBufferWrite = {0};
+    materialBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    materialBufferWrite.dstSet = vkrt->descriptorSet;
+    materialBufferWrite.dstBinding = 5;
+    materialBufferWrite.dstArrayElement = 0;
+    materialBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    materialBufferWrite.descriptorCount = 1;
+    materialBufferWrite.pBufferInfo = &materialBufferInfo;
+
+    VkDescriptorBufferInfo pathCounterInfo = {0};
+    pathCounterInfo.buffer = vkrt->pathCounterBuffer;
+    pathCounterInfo.offset = 0;
+    pathCounterInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet pathCounterWrite = {0};
+    pathCounterWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    pathCounterWrite.dstSet = vkrt->descriptorSet;
+    pathCounterWrite.dstBinding = 6;
+    pathCounterWrite.dstArrayElement = 0;
+    pathCounterWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pathCounterWrite.descriptorCount = 1;
+    pathCounterWrite.pBufferInfo = &pathCounterInfo;
+
+    VkDescriptorBufferInfo lightBufferInfo = {0};
+    lightBufferInfo.buffer = vkrt->lightBuffer;
+    lightBufferInfo.offset = 0;
+    lightBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet lightBufferWrite = {0};
+    lightBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightBufferWrite.dstSet = vkrt->descriptorSet;
+    lightBufferWrite.dstBinding = 7;
+    lightBufferWrite.dstArrayElement = 0;
+    lightBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lightBufferWrite.descriptorCount = 1;
+    lightBufferWrite.pBufferInfo = &lightBufferInfo;
+
+    VkDescriptorBufferInfo environmentBufferInfo = {0};
+    environmentBufferInfo.buffer = vkrt->environmentBuffer;
+    environmentBufferInfo.offset = 0;
+    environmentBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet environmentBufferWrite = {0};
+    environmentBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    environmentBufferWrite.dstSet = vkrt->descriptorSet;
+    environmentBufferWrite.dstBinding = 8;
+    environmentBufferWrite.dstArrayElement = 0;
+    environmentBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    environmentBufferWrite.descriptorCount = 1;
+    environmentBufferWrite.pBufferInfo = &environmentBufferInfo;
+
+    VkDescriptorBufferInfo lightTreeBufferInfo = {0};
+    lightTreeBufferInfo.buffer = vkrt->lightTreeBuffer;
+    lightTreeBufferInfo.offset = 0;
+    lightTreeBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet lightTreeBufferWrite = {0};
+    lightTreeBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    lightTreeBufferWrite.dstSet = vkrt->descriptorSet;
+    lightTreeBufferWrite.dstBinding = 9;
+    lightTreeBufferWrite.dstArrayElement = 0;
+    lightTreeBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    lightTreeBufferWrite.descriptorCount = 1;
+    lightTreeBufferWrite.pBufferInfo = &lightTreeBufferInfo;
+
+    // Only the ReSTIR raygen variant touches these, so any storage buffer stands in while ReSTIR is off
+    VkDescriptorBufferInfo restirSurfaceInfo = {0};
+    restirSurfaceInfo.buffer = vkrt->restirSurfaceBuffer ? vkrt->restirSurfaceBuffer : vkrt->pathCounterBuffer;
+    restirSurfaceInfo.offset = 0;
+    restirSurfaceInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet restirSurfaceWrite = {0};
+    restirSurfaceWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    restirSurfaceWrite.dstSet = vkrt->descriptorSet;
+    restirSurfaceWrite.dstBinding = 10;
+    restirSurfaceWrite.dstArrayElement = 0;
+    restirSurfaceWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    restirSurfaceWrite.descriptorCount = 1;
+    restirSurfaceWrite.pBufferInfo = &restirSurfaceInfo;
+
+    VkDescriptorBufferInfo restirRadianceInfo = {0};
+    restirRadianceInfo.buffer = vkrt->restirRadianceBuffer ? vkrt->restirRadianceBuffer : vkrt->pathCounterBuffer;
+    restirRadianceInfo.offset = 0;
+    restirRadianceInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet restirRadianceWrite = {0};
+    restirRadianceWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    restirRadianceWrite.dstSet = vkrt->descriptorSet;
+    restirRadianceWrite.dstBinding = 11;
+    restirRadianceWrite.dstArrayElement = 0;
+    restirRadianceWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    restirRadianceWrite.descriptorCount = 1;
+    restirRadianceWrite.pBufferInfo = &restirRadianceInfo;
+
+    VkDescriptorBufferInfo samplerBufferInfo = {0};
+    samplerBufferInfo.buffer = vkrt->samplerBuffer;
+    samplerBufferInfo.offset = 0;
+    samplerBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet samplerBufferWrite = {0};
+    samplerBufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    samplerBufferWrite.dstSet = vkrt->descriptorSet;
+    samplerBufferWrite.dstBinding = 12;
+    samplerBufferWrite.dstArrayElement = 0;
+    samplerBufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    samplerBufferWrite.descriptorCount = 1;
+    samplerBufferWrite.pBufferInfo = &samplerBufferInfo;
+
+    VkDescriptorBufferInfo adaptiveStatsInfo = {0};
+    adaptiveStatsInfo.buffer = vkrt->adaptiveStatsBuffer ? vkrt->adaptiveStatsBuffer : vkrt->pathCounterBuffer;
+    adaptiveStatsInfo.offset = 0;
+    adaptiveStatsInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet adaptiveStatsWrite = {0};
+    adaptiveStatsWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    adaptiveStatsWrite.dstSet = vkrt->descriptorSet;
+    adaptiveStatsWrite.dstBinding = 13;
+    adaptiveStatsWrite.dstArrayElement = 0;
+    adaptiveStatsWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    adaptiveStatsWrite.descriptorCount = 1;
+    adaptiveStatsWrite.pBufferInfo = &adaptiveStatsInfo;
+
+    VkDescriptorBufferInfo adaptiveTileInfo = {0};
+    adaptiveTileInfo.buffer = vkrt->adaptiveTileBuffer ? vkrt->adaptiveTileBuffer : vkrt->pathCounterBuffer;
+    adaptiveTileInfo.offset = 0;
+    adaptiveTileInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet adaptiveTileWrite = {0};
+    adaptiveTileWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    adaptiveTileWrite.dstSet = vkrt->descriptorSet;
+    adaptiveTileWrite.dstBinding = 14;
+    adaptiveTileWrite.dstArrayElement = 0;
+    adaptiveTileWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    adaptiveTileWrite.descriptorCount = 1;
+    adaptiveTileWrite.pBufferInfo = &adaptiveTileInfo;
+
+    VkDescriptorBufferInfo denoiseGuideInfo = {0};
+    denoiseGuideInfo.buffer = vkrt->denoiseGuideBuffer ? vkrt->denoiseGuideBuffer : vkrt->pathCounterBuffer;
+    denoiseGuideInfo.offset = 0;
+    denoiseGuideInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet denoiseGuideWrite = {0};
+    denoiseGuideWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    denoiseGuideWrite.dstSet = vkrt->descriptorSet;
+    denoiseGuideWrite.dstBinding = 15;
+    denoiseGuideWrite.dstArrayElement = 0;
+    denoiseGuideWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    denoiseGuideWrite.descriptorCount = 1;
+    denoiseGuideWrite.pBufferInfo = &denoiseGuideInfo;
+
+    VkDescriptorBufferInfo upscaleMotionInfo = {0};
+    upscaleMotionInfo.buffer = vkrt->upscaleMotionBuffer ? vkrt->upscaleMotionBuffer : vkrt->pathCounterBuffer;
+    upscaleMotionInfo.offset = 0;
+    upscaleMotionInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet upscaleMotionWrite = {0};
+    upscaleMotionWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    upscaleMotionWrite.dstSet = vkrt->descriptorSet;
+    upscaleMotionWrite.dstBinding = 16;
+    upscaleMotionWrite.dstArrayElement = 0;
+    upscaleMotionWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    upscaleMotionWrite.descriptorCount = 1;
+    upscaleMotionWrite.pBufferInfo = &upscaleMotionInfo;
+
+    VkDescriptorBufferInfo viewCameraInfo = {0};
+    viewCameraInfo.buffer = vkrt->viewCameraBuffer ? vkrt->viewCameraBuffer : vkrt->pathCounterBuffer;
+    viewCameraInfo.offset = 0;
+    viewCameraInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet viewCameraWrite = {0};
+    viewCameraWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    viewCameraWrite.dstSet = vkrt->descriptorSet;
+    viewCameraWrite.dstBinding = 17;
+    viewCameraWrite.dstArrayElement = 0;
+    viewCameraWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    viewCameraWrite.descriptorCount = 1;
+    viewCameraWrite.pBufferInfo = &viewCameraInfo;
+
     VkWriteDescriptorSet writeDescriptorSets[] = {
         accelerationStructureWrite,
         storageImageWrite,
         vertexBufferWrite,
         indexBufferWrite,
-        sceneUniformWrite};
+        sceneUniformWrite,
+        materialBufferWrite,
+        pathCounterWrite,
+        lightBufferWrite,
+        environmentBufferWrite,
+        lightTreeBufferWrite,
+        restirSurfaceWrite,
+        restirRadianceWrite,
+        samplerBufferWrite,
+        adaptiveStatsWrite,
+        adaptiveTileWrite,
+        denoiseGuideWrite,
+        upscaleMotionWrite,
+        viewCameraWrite};
 
-    vkUpdateDescriptorSets(vkrt->device, COUNT_OF(writeDescriptorSets), writeDescriptorSets, 0, VK_NULL_HANDLE);
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writeDescriptorSets), writeDescriptorSets, 0, VK_NULL_HANDLE);
 }
\ No newline at end of file
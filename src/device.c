@@ -27,8 +27,9 @@ void pickPhysicalDevice(VKRT* vkrt) {
     vkEnumeratePhysicalDevices(vkrt->instance, &deviceCount, NULL);
 
     if (deviceCount == 0) {
-        perror("ERROR: Failed to find a GPU with Vulkan support");
-        exit(EXIT_FAILURE);
+        printf("INFO: No Vulkan device found, falling back to the CPU reference tracer.\n");
+        vkrt->cpuReference = VK_TRUE;
+        return;
     }
 
     VkPhysicalDevice* devices = (VkPhysicalDevice*)malloc(deviceCount * sizeof(VkPhysicalDevice));
@@ -49,9 +50,11 @@ void pickPhysicalDevice(VKRT* vkrt) {
     }
 
     if (bestDevice < 0) {
-        perror("ERROR: Failed to find a suitable GPU");
+        printf("INFO: No GPU supports ray tracing, falling back to the CPU reference tracer.\n");
+        vkrt->cpuReference = VK_TRUE;
+        vkrt->physicalDevice = VK_NULL_HANDLE;
         free(devices);
-        exit(EXIT_FAILURE);
+        return;
     }
 
     vkrt->physicalDevice = devices[bestDevice];
@@ -117,16 +120,86 @@ void createLogicalDevice(VKRT* vkrt) {
     deviceRayTracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect = VK_FALSE;
     deviceRayTracingPipelineFeatures.rayTraversalPrimitiveCulling = VK_FALSE;
 
+    VkPhysicalDeviceFeatures supportedFeatures = {0};
+    vkGetPhysicalDeviceFeatures(vkrt->physicalDevice, &supportedFeatures);
+    vkrt->storageWriteWithoutFormat = supportedFeatures.shaderStorageImageWriteWithoutFormat;
+    vkrt->storageExtendedFormats = supportedFeatures.shaderStorageImageExtendedFormats;
+
+    VkPhysicalDeviceProperties deviceProperties = {0};
+    vkGetPhysicalDeviceProperties(vkrt->physicalDevice, &deviceProperties);
+
+    VkPhysicalDeviceVulkan13Features supportedVulkan13Features = {0};
+    supportedVulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    if (deviceProperties.apiVersion >= VK_API_VERSION_1_3) {
+        VkPhysicalDeviceFeatures2 supportedFeatures2 = {0};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supportedVulkan13Features;
+        vkGetPhysicalDeviceFeatures2(vkrt->physicalDevice, &supportedFeatures2);
+    }
+    vkrt->synchronization2 = supportedVulkan13Features.synchronization2;
+
+    VkPhysicalDeviceRayQueryFeaturesKHR supportedRayQueryFeatures = {0};
+    supportedRayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+
+    if (extensionSupported(vkrt->physicalDevice, VK_KHR_RAY_QUERY_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 supportedFeatures2 = {0};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supportedRayQueryFeatures;
+        vkGetPhysicalDeviceFeatures2(vkrt->physicalDevice, &supportedFeatures2);
+    }
+    vkrt->rayQuery = supportedRayQueryFeatures.rayQuery;
+
+    VkPhysicalDeviceRayTracingPipelineFeaturesKHR supportedRayTracingPipelineFeatures = {0};
+    supportedRayTracingPipelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 supportedRayTracingFeatures2 = {0};
+    supportedRayTracingFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supportedRayTracingFeatures2.pNext = &supportedRayTracingPipelineFeatures;
+    vkGetPhysicalDeviceFeatures2(vkrt->physicalDevice, &supportedRayTracingFeatures2);
+    vkrt->traceRaysIndirect = supportedRayTracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect;
+    deviceRayTracingPipelineFeatures.rayTracingPipelineTraceRaysIndirect = vkrt->traceRaysIndirect;
+
+    void* featureChain = &deviceRayTracingPipelineFeatures;
+
+    VkPhysicalDeviceVulkan13Features deviceVulkan13Features = {0};
+    deviceVulkan13Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    deviceVulkan13Features.synchronization2 = vkrt->synchronization2;
+    if (vkrt->synchronization2) {
+        deviceVulkan13Features.pNext = featureChain;
+        featureChain = &deviceVulkan13Features;
+    }
+
+    VkPhysicalDeviceRayQueryFeaturesKHR deviceRayQueryFeatures = {0};
+    deviceRayQueryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR;
+    deviceRayQueryFeatures.rayQuery = vkrt->rayQuery;
+    if (vkrt->rayQuery) {
+        deviceRayQueryFeatures.pNext = featureChain;
+        featureChain = &deviceRayQueryFeatures;
+    }
+
+    const char* enabledExtensions[NUM_EXTENSIONS + 1];
+    uint32_t enabledExtensionCount = 0;
+    for (uint32_t i = 0; i < NUM_EXTENSIONS; i++) {
+        if (vkrt->headless && !strcmp(deviceExtensions[i], VK_KHR_SWAPCHAIN_EXTENSION_NAME)) continue;
+        enabledExtensions[enabledExtensionCount++] = deviceExtensions[i];
+    }
+    if (vkrt->rayQuery) {
+        enabledExtensions[enabledExtensionCount++] = VK_KHR_RAY_QUERY_EXTENSION_NAME;
+    }
+
     VkPhysicalDeviceFeatures deviceFeatures = {0};
+    deviceFeatures.shaderStorageImageWriteWithoutFormat = vkrt->storageWriteWithoutFormat;
+    deviceFeatures.shaderStorageImageExtendedFormats = vkrt->storageExtendedFormats;
 
     VkDeviceCreateInfo createInfo = {0};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.pQueueCreateInfos = queueCreateInfos;
     createInfo.queueCreateInfoCount = queueCreateInfoCount;
     createInfo.pEnabledFeatures = &deviceFeatures;
-    createInfo.pNext = &deviceRayTracingPipelineFeatures;
-    createInfo.enabledExtensionCount = NUM_EXTENSIONS;
-    createInfo.ppEnabledExtensionNames = deviceExtensions;
+    createInfo.pNext = featureChain;
+    createInfo.enabledExtensionCount = enabledExtensionCount;
+    createInfo.ppEnabledExtensionNames = enabledExtensions;
 
     if (enableValidationLayers) {
         createInfo.enabledLayerCount = numValidationLayers;
@@ -140,8 +213,12 @@ void createLogicalDevice(VKRT* vkrt) {
         exit(EXIT_FAILURE);
     }
 
-    vkGetDeviceQueue(vkrt->device, indices.graphics, 0, &vkrt->graphicsQueue);
-    vkGetDeviceQueue(vkrt->device, indices.present, 0, &vkrt->presentQueue);
+    loadDeviceDispatch(vkrt->device, &vkrt->vk);
+    vkrt->synchronization2 = vkrt->synchronization2 && vkrt->vk.QueueSubmit2;
+    vkrt->traceRaysIndirect = vkrt->traceRaysIndirect && vkrt->vk.CmdTraceRaysIndirectKHR;
+
+    vkrt->vk.GetDeviceQueue(vkrt->device, indices.graphics, 0, &vkrt->graphicsQueue);
+    vkrt->vk.GetDeviceQueue(vkrt->device, indices.present, 0, &vkrt->presentQueue);
 
     free(queueCreateInfos);
 }
@@ -162,11 +239,16 @@ QueueFamily findQueueFamilies(VKRT* vkrt) {
             indices.graphics = i;
         }
 
-        VkBool32 presentSupport = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR(vkrt->physicalDevice, i, vkrt->surface, &presentSupport);
+        // Headless runs have no surface and never present, so the graphics queue stands in
+        if (vkrt->headless) {
+            indices.present = indices.graphics;
+        } else {
+            VkBool32 presentSupport = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(vkrt->physicalDevice, i, vkrt->surface, &presentSupport);
 
-        if (presentSupport) {
-            indices.present = i;
+            if (presentSupport) {
+                indices.present = i;
+            }
         }
 
         if (isQueueFamilyComplete(indices)) {
@@ -189,10 +271,10 @@ int32_t isDeviceSuitable(VKRT* vkrt) {
     QueueFamily indices = findQueueFamilies(vkrt);
     VkBool32 queueFamilyComplete = isQueueFamilyComplete(indices);
 
-    VkBool32 extensionSupport = extensionsSupported(vkrt->physicalDevice);
+    VkBool32 extensionSupport = extensionsSupported(vkrt->physicalDevice, !vkrt->headless);
 
-    VkBool32 swapChainAdequate = VK_FALSE;
-    if (extensionSupport) {
+    VkBool32 swapChainAdequate = vkrt->headless;
+    if (extensionSupport && !vkrt->headless) {
         SwapChainSupportDetails supportDetails = querySwapChainSupport(vkrt);
         swapChainAdequate = supportDetails.formatCount && supportDetails.presentModeCount;
 
@@ -215,7 +297,7 @@ VkBool32 isQueueFamilyComplete(QueueFamily indices) {
     return indices.graphics >= 0 && indices.present >= 0;
 }
 
-VkBool32 extensionsSupported(VkPhysicalDevice device) {
+VkBool32 extensionsSupported(VkPhysicalDevice device, VkBool32 presentation) {
     uint32_t extensionCount;
     vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
 
@@ -223,6 +305,8 @@ VkBool32 extensionsSupported(VkPhysicalDevice device) {
     vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, availableExtensions);
 
     for (uint32_t i = 0; i < NUM_EXTENSIONS; i++) {
+        if (!presentation && !strcmp(deviceExtensions[i], VK_KHR_SWAPCHAIN_EXTENSION_NAME)) continue;
+
         VkBool32 extensionAvailable = VK_FALSE;
         for (uint32_t j = 0; j < extensionCount; j++) {
             if (!strcmp(deviceExtensions[i], availableExtensions[j].extensionName)) {
@@ -238,6 +322,25 @@ VkBool32 extensionsSupported(VkPhysicalDevice device) {
     return VK_TRUE;
 }
 
+VkBool32 extensionSupported(VkPhysicalDevice device, const char* extensionName) {
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, NULL);
+
+    VkExtensionProperties* availableExtensions = (VkExtensionProperties*)malloc(extensionCount * sizeof(VkExtensionProperties));
+    vkEnumerateDeviceExtensionProperties(device, NULL, &extensionCount, availableExtensions);
+
+    VkBool32 extensionAvailable = VK_FALSE;
+    for (uint32_t i = 0; i < extensionCount; i++) {
+        if (!strcmp(extensionName, availableExtensions[i].extensionName)) {
+            extensionAvailable = VK_TRUE;
+            break;
+        }
+    }
+
+    free(availableExtensions);
+    return extensionAvailable;
+}
+
 uint32_t findMemoryType(VKRT* vkrt, uint32_t typeFilter, VkMemoryPropertyFlags properties) {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(vkrt->physicalDevice, &memProperties);
@@ -264,6 +367,7 @@ void initializeFrameTimers(VKRT* vkrt) {
     vkrt->currentTime = currentTime;
     vkrt->lastFrameTimeReported = currentTime;
     vkrt->tempFrameCount = 0;
+    vkrt->tempSubmitTime = 0;
 }
 
 void recordFrameTime(VKRT* vkrt) {
@@ -281,7 +385,9 @@ void recordFrameTime(VKRT* vkrt) {
 
         vkrt->averageFPS = fps;
         vkrt->averageFrametime = avgFrameMs;
+        vkrt->averageSubmitTime = (float)vkrt->tempSubmitTime / 1e6f / vkrt->tempFrameCount;
         vkrt->tempFrameCount = 0;
+        vkrt->tempSubmitTime = 0;
         vkrt->lastFrameTimeReported = vkrt->currentTime;
     }
 }
@@ -14,7 +14,9 @@ void createLogicalDevice(VKRT* vkrt);
 int32_t isDeviceSuitable(VKRT* vkrt);
 VkBool32 isQueueFamilyComplete(QueueFamily indices);
 QueueFamily findQueueFamilies(VKRT* vkrt);
-VkBool32 extensionsSupported(VkPhysicalDevice device);
+VkBool32 extensionsSupported(VkPhysicalDevice device, VkBool32 presentation);
+VkBool32 extensionSupported(VkPhysicalDevice device, const char* extensionName);
 uint32_t findMemoryType(VKRT* vkrt, uint32_t typeFilter, VkMemoryPropertyFlags properties);
+uint64_t getTimeNanoSeconds();
 void initializeFrameTimers(VKRT* vkrt);
 void recordFrameTime(VKRT* vkrt);
\ No newline at end of file
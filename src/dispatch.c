@@ -0,0 +1,23 @@
+#include "dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void loadDeviceDispatch(VkDevice device, DeviceDispatch* dispatch) {
+    uint32_t missingRequired = 0;
+
+#define LOAD_DEVICE_FUNCTION(name, required)                                          \
+    dispatch->name = (PFN_vk##name)vkGetDeviceProcAddr(device, "vk" #name);          \
+    if (!dispatch->name && required) {                                                \
+        fprintf(stderr, "ERROR: Missing required device function 'vk%s'\n", #name);  \
+        missingRequired++;                                                            \
+    } else if (!dispatch->name) {                                                     \
+        printf("INFO: Optional device function 'vk%s' is not available.\n", #name);   \
+    }
+    DEVICE_FUNCTIONS(LOAD_DEVICE_FUNCTION)
+#undef LOAD_DEVICE_FUNCTION
+
+    if (missingRequired) {
+        exit(EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+// Device-level entry points, loaded once with vkGetDeviceProcAddr after the logical device is created.
+// X(name, required): missing required functions abort device creation, missing optional ones are left NULL.
+#define DEVICE_FUNCTIONS(X)                              \
+    X(AcquireNextImageKHR, 1)                            \
+    X(AllocateCommandBuffers, 1)                         \
+    X(AllocateDescriptorSets, 1)                         \
+    X(AllocateMemory, 1)                                 \
+    X(BeginCommandBuffer, 1)                             \
+    X(BindBufferMemory, 1)                               \
+    X(BindImageMemory, 1)                                \
+    X(CmdBeginRenderPass, 1)                             \
+    X(CmdBindDescriptorSets, 1)                          \
+    X(CmdBindPipeline, 1)                                \
+    X(CmdBlitImage, 1)                                   \
+    X(CmdBuildAccelerationStructuresKHR, 1)              \
+    X(CmdCopyBuffer, 1)                                  \
+    X(CmdCopyImageToBuffer, 1)                           \
+    X(CmdDispatch, 1)                                    \
+    X(CmdDispatchIndirect, 1)                            \
+    X(CmdEndRenderPass, 1)                               \
+    X(CmdExecuteCommands, 1)                             \
+    X(CmdFillBuffer, 1)                                  \
+    X(CmdPipelineBarrier, 1)                             \
+    X(CmdPushConstants, 1)                               \
+    X(CmdResetQueryPool, 1)                              \
+    X(CmdTraceRaysIndirectKHR, 0)                        \
+    X(CmdTraceRaysKHR, 1)                                \
+    X(CmdWriteTimestamp, 1)                              \
+    X(CreateAccelerationStructureKHR, 1)                 \
+    X(CreateBuffer, 1)                                   \
+    X(CreateCommandPool, 1)                              \
+    X(CreateComputePipelines, 1)                         \
+    X(CreateDescriptorPool, 1)                           \
+    X(CreateDescriptorSetLayout, 1)                      \
+    X(CreateFence, 1)                                    \
+    X(CreateFramebuffer, 1)                              \
+    X(CreateImage, 1)                                    \
+    X(CreateImageView, 1)                                \
+    X(CreatePipelineLayout, 1)                           \
+    X(CreateQueryPool, 1)                                \
+    X(CreateRayTracingPipelinesKHR, 1)                   \
+    X(CreateRenderPass, 1)                               \
+    X(CreateSampler, 1)                                  \
+    X(CreateSemaphore, 1)                                \
+    X(CreateShaderModule, 1)                             \
+    X(CreateSwapchainKHR, 1)                             \
+    X(DestroyAccelerationStructureKHR, 1)                \
+    X(DestroyBuffer, 1)                                  \
+    X(DestroyCommandPool, 1)                             \
+    X(DestroyDescriptorPool, 1)                          \
+    X(DestroyDescriptorSetLayout, 1)                     \
+    X(DestroyDevice, 1)                                  \
+    X(DestroyFence, 1)                                   \
+    X(DestroyFramebuffer, 1)                             \
+    X(DestroyImage, 1)                                   \
+    X(DestroyImageView, 1)                               \
+    X(DestroyPipeline, 1)                                \
+    X(DestroyPipelineLayout, 1)                          \
+    X(DestroyQueryPool, 1)                               \
+    X(DestroyRenderPass, 1)                              \
+    X(DestroySampler, 1)                                 \
+    X(DestroySemaphore, 1)                               \
+    X(DestroyShaderModule, 1)                            \
+    X(DestroySwapchainKHR, 1)                            \
+    X(DeviceWaitIdle, 1)                                 \
+    X(EndCommandBuffer, 1)                               \
+    X(FreeCommandBuffers, 1)                             \
+    X(FreeMemory, 1)                                     \
+    X(GetAccelerationStructureBuildSizesKHR, 1)          \
+    X(GetAccelerationStructureDeviceAddressKHR, 1)       \
+    X(GetBufferDeviceAddressKHR, 1)                      \
+    X(GetBufferMemoryRequirements, 1)                    \
+    X(GetDeviceQueue, 1)                                 \
+    X(GetImageMemoryRequirements, 1)                     \
+    X(GetQueryPoolResults, 1)                            \
+    X(GetRayTracingShaderGroupHandlesKHR, 1)             \
+    X(GetSwapchainImagesKHR, 1)                          \
+    X(MapMemory, 1)                                      \
+    X(QueuePresentKHR, 1)                                \
+    X(QueueSubmit, 1)                                    \
+    X(QueueSubmit2, 0)                                   \
+    X(QueueWaitIdle, 1)                                  \
+    X(ResetCommandPool, 1)                               \
+    X(ResetFences, 1)                                    \
+    X(UnmapMemory, 1)                                    \
+    X(UpdateDescriptorSets, 1)                           \
+    X(WaitForFences, 1)
+
+typedef struct DeviceDispatch {
+#define DEVICE_FUNCTION_MEMBER(name, required) PFN_vk##name name;
+    DEVICE_FUNCTIONS(DEVICE_FUNCTION_MEMBER)
+#undef DEVICE_FUNCTION_MEMBER
+} DeviceDispatch;
+
+void loadDeviceDispatch(VkDevice device, DeviceDispatch* dispatch);
@@ -0,0 +1,313 @@
+#include "environment.h"
+#include "buffer.h"
+#include "device.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_ENVIRONMENT_WIDTH 512
+#define DEFAULT_ENVIRONMENT_HEIGHT 256
+
+typedef struct AliasBuildThread {
+    pthread_t thread;
+    const float* radiance;
+    EnvironmentEntry* entries;
+    float* rowWeights;
+    uint32_t width;
+    uint32_t height;
+    uint32_t firstRow;
+    uint32_t lastRow;
+} AliasBuildThread;
+
+static int readRunLengthChannel(FILE* file, uint8_t* scanline, uint32_t width) {
+    uint32_t x = 0;
+    while (x < width) {
+        int count = fgetc(file);
+        if (count == EOF) return 0;
+
+        if (count > 128) {
+            count -= 128;
+            int value = fgetc(file);
+            if (value == EOF || x + (uint32_t)count > width) return 0;
+            memset(scanline + x, value, (size_t)count);
+        } else {
+            if (count == 0 || x + (uint32_t)count > width) return 0;
+            if (fread(scanline + x, 1, (size_t)count, file) != (size_t)count) return 0;
+        }
+        x += (uint32_t)count;
+    }
+    return 1;
+}
+
+// Minimal Radiance RGBE reader: flat or new-style run-length scanlines, -Y H +X W orientation only
+static float* loadRadianceHDR(const char* path, uint32_t* width, uint32_t* height) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "ERROR: Failed to open environment '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    char line[256];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, "#?", 2) != 0) {
+        fprintf(stderr, "ERROR: '%s' is not a Radiance HDR file\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), file) && line[0] != '\n') {
+        if (strncmp(line, "FORMAT=", 7) == 0 && strncmp(line + 7, "32-bit_rle_rgbe", 15) != 0) {
+            fprintf(stderr, "ERROR: Unsupported HDR format in '%s'\n", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!fgets(line, sizeof(line), file) || sscanf(line, "-Y %u +X %u", height, width) != 2 || *width == 0 || *height == 0) {
+        fprintf(stderr, "ERROR: Unsupported HDR orientation in '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    float* radiance = malloc((size_t)*width * *height * 3 * sizeof(float));
+    uint8_t* scanline = malloc((size_t)*width * 4);
+    uint8_t* channels = malloc((size_t)*width * 4);
+
+    for (uint32_t y = 0; y < *height; y++) {
+        uint8_t header[4];
+        if (fread(header, 1, 4, file) != 4) {
+            fprintf(stderr, "ERROR: Truncated HDR data in '%s'\n", path);
+            exit(EXIT_FAILURE);
+        }
+
+        uint32_t encodedWidth = ((uint32_t)header[2] << 8) | header[3];
+        if (header[0] == 2 && header[1] == 2 && !(header[2] & 0x80) && encodedWidth == *width) {
+            for (uint32_t c = 0; c < 4; c++) {
+                if (!readRunLengthChannel(file, channels + c * *width, *width)) {
+                    fprintf(stderr, "ERROR: Corrupt HDR scanline in '%s'\n", path);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            for (uint32_t x = 0; x < *width; x++) {
+                for (uint32_t c = 0; c < 4; c++) {
+                    scanline[x * 4 + c] = channels[c * *width + x];
+                }
+            }
+        } else {
+            memcpy(scanline, header, 4);
+            if (fread(scanline + 4, 4, *width - 1, file) != *width - 1) {
+                fprintf(stderr, "ERROR: Truncated HDR data in '%s'\n", path);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        for (uint32_t x = 0; x < *width; x++) {
+            const uint8_t* rgbe = scanline + x * 4;
+            float scale = rgbe[3] ? ldexpf(1.0f, (int)rgbe[3] - (128 + 8)) : 0.0f;
+            float* texel = radiance + ((size_t)y * *width + x) * 3;
+            texel[0] = rgbe[0] * scale;
+            texel[1] = rgbe[1] * scale;
+            texel[2] = rgbe[2] * scale;
+        }
+    }
+
+    free(scanline);
+    free(channels);
+    fclose(file);
+
+    return radiance;
+}
+
+// Bakes the procedural sky gradient so scenes without an HDR still go through the same sampling path
+static float* createDefaultEnvironment(uint32_t width, uint32_t height) {
+    const float horizon[3] = {0.05f, 0.05f, 0.05f};
+    const float zenith[3] = {0.6f, 0.7f, 0.9f};
+
+    float* radiance = malloc((size_t)width * height * 3 * sizeof(float));
+    for (uint32_t y = 0; y < height; y++) {
+        float t = cosf(((float)y + 0.5f) / (float)height * (float)M_PI) * 0.5f + 0.5f;
+        for (uint32_t x = 0; x < width; x++) {
+            float* texel = radiance + ((size_t)y * width + x) * 3;
+            for (uint32_t c = 0; c < 3; c++) {
+                texel[c] = horizon[c] + (zenith[c] - horizon[c]) * t;
+            }
+        }
+    }
+    return radiance;
+}
+
+// Vose's alias method: fills threshold and alias of `count` entries from unnormalized weights
+static void buildAliasTable(const float* weights, uint32_t count, EnvironmentEntry* entries, uint32_t* small, uint32_t* large, float* scaled) {
+    float total = 0.0f;
+    for (uint32_t i = 0; i < count; i++) total += weights[i];
+
+    uint32_t smallCount = 0, largeCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        scaled[i] = total > 0.0f ? weights[i] * (float)count / total : 1.0f;
+        if (scaled[i] < 1.0f) {
+            small[smallCount++] = i;
+        } else {
+            large[largeCount++] = i;
+        }
+    }
+
+    while (smallCount && largeCount) {
+        uint32_t less = small[--smallCount];
+        uint32_t more = large[--largeCount];
+
+        entries[less].threshold = scaled[less];
+        entries[less].alias = more;
+
+        scaled[more] = (scaled[more] + scaled[less]) - 1.0f;
+        if (scaled[more] < 1.0f) {
+            small[smallCount++] = more;
+        } else {
+            large[largeCount++] = more;
+        }
+    }
+
+    // Leftovers are 1 up to rounding error
+    while (largeCount) {
+        uint32_t index = large[--largeCount];
+        entries[index].threshold = 1.0f;
+        entries[index].alias = index;
+    }
+    while (smallCount) {
+        uint32_t index = small[--smallCount];
+        entries[index].threshold = 1.0f;
+        entries[index].alias = index;
+    }
+}
+
+static float texelWeight(const float* radiance, uint32_t height, uint32_t y) {
+    // Equirectangular texels shrink toward the poles, so weight by sin(theta) to sample by solid angle
+    float sinTheta = sinf(((float)y + 0.5f) / (float)height * (float)M_PI);
+    return (0.2126f * radiance[0] + 0.7152f * radiance[1] + 0.0722f * radiance[2]) * sinTheta;
+}
+
+static void* buildConditionalRows(void* argument) {
+    AliasBuildThread* job = (AliasBuildThread*)argument;
+    uint32_t width = job->width;
+
+    float* weights = malloc(width * sizeof(float));
+    float* scaled = malloc(width * sizeof(float));
+    uint32_t* small = malloc(width * sizeof(uint32_t));
+    uint32_t* large = malloc(width * sizeof(uint32_t));
+
+    for (uint32_t y = job->firstRow; y < job->lastRow; y++) {
+        EnvironmentEntry* row = job->entries + (size_t)y * width;
+        float rowWeight = 0.0f;
+
+        for (uint32_t x = 0; x < width; x++) {
+            const float* texel = job->radiance + ((size_t)y * width + x) * 3;
+            weights[x] = texelWeight(texel, job->height, y);
+            rowWeight += weights[x];
+
+            memcpy(row[x].radiance, texel, sizeof(row[x].radiance));
+            row[x].probability = weights[x];
+        }
+
+        buildAliasTable(weights, width, row, small, large, scaled);
+        job->rowWeights[y] = rowWeight;
+    }
+
+    free(weights);
+    free(scaled);
+    free(small);
+    free(large);
+    return NULL;
+}
+
+static EnvironmentEntry* buildEnvironmentTable(const float* radiance, uint32_t width, uint32_t height) {
+    size_t texelCount = (size_t)width * height;
+    EnvironmentEntry* entries = calloc(texelCount + height, sizeof(EnvironmentEntry));
+    float* rowWeights = malloc(height * sizeof(float));
+
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threadCount = processors > 0 ? (uint32_t)processors : 1;
+    if (threadCount > MAX_RECORD_THREADS) threadCount = MAX_RECORD_THREADS;
+    if (threadCount > height) threadCount = height;
+
+    // Each row's conditional table is independent, so rows are split evenly across threads
+    AliasBuildThread threads[MAX_RECORD_THREADS];
+    for (uint32_t i = 0; i < threadCount; i++) {
+        threads[i] = (AliasBuildThread){
+            .radiance = radiance,
+            .entries = entries,
+            .rowWeights = rowWeights,
+            .width = width,
+            .height = height,
+            .firstRow = height * i / threadCount,
+            .lastRow = height * (i + 1) / threadCount};
+
+        if (i > 0 && pthread_create(&threads[i].thread, NULL, buildConditionalRows, &threads[i]) != 0) {
+            perror("ERROR: Failed to create environment build thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    buildConditionalRows(&threads[0]);
+    for (uint32_t i = 1; i < threadCount; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    float total = 0.0f;
+    for (uint32_t y = 0; y < height; y++) total += rowWeights[y];
+
+    EnvironmentEntry* marginal = entries + texelCount;
+    for (uint32_t y = 0; y < height; y++) {
+        marginal[y].probability = total > 0.0f ? rowWeights[y] / total : 1.0f / (float)height;
+    }
+    for (size_t i = 0; i < texelCount; i++) {
+        entries[i].probability = total > 0.0f ? entries[i].probability / total : 1.0f / (float)texelCount;
+    }
+
+    float* scaled = malloc(height * sizeof(float));
+    uint32_t* small = malloc(height * sizeof(uint32_t));
+    uint32_t* large = malloc(height * sizeof(uint32_t));
+    buildAliasTable(rowWeights, height, marginal, small, large, scaled);
+
+    free(scaled);
+    free(small);
+    free(large);
+    free(rowWeights);
+
+    return entries;
+}
+
+// RGB radiance of the environment in row-major equirectangular texels, the HDR or the default sky
+float* loadEnvironmentRadiance(VKRT* vkrt, uint32_t* width, uint32_t* height) {
+    if (vkrt->environmentPath) {
+        return loadRadianceHDR(vkrt->environmentPath, width, height);
+    }
+
+    *width = DEFAULT_ENVIRONMENT_WIDTH;
+    *height = DEFAULT_ENVIRONMENT_HEIGHT;
+    return createDefaultEnvironment(*width, *height);
+}
+
+void createEnvironment(VKRT* vkrt) {
+    uint32_t width, height;
+    float* radiance = loadEnvironmentRadiance(vkrt, &width, &height);
+
+    uint64_t start = getTimeNanoSeconds();
+    EnvironmentEntry* entries = buildEnvironmentTable(radiance, width, height);
+    printf("INFO: Environment %ux%u, alias table built in %.2f ms\n", width, height, (double)(getTimeNanoSeconds() - start) / 1e6);
+
+    vkrt->environmentWidth = width;
+    vkrt->environmentHeight = height;
+
+    createBufferFromHostData(
+        vkrt,
+        entries, ((size_t)width * height + height) * sizeof(EnvironmentEntry),
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        &vkrt->environmentBuffer,
+        &vkrt->environmentBufferMemory);
+
+    free(entries);
+    free(radiance);
+}
+
+void destroyEnvironment(VKRT* vkrt) {
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->environmentBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->environmentBufferMemory, NULL);
+}
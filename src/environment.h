@@ -0,0 +1,6 @@
+#pragma once
+#include "vkrt.h"
+
+float* loadEnvironmentRadiance(VKRT* vkrt, uint32_t* width, uint32_t* height);
+void createEnvironment(VKRT* vkrt);
+void destroyEnvironment(VKRT* vkrt);
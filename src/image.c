@@ -0,0 +1,102 @@
+#include "image.h"
+#include "device.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+const OutputPrecisionInfo outputPrecisionInfos[OUTPUT_PRECISION_COUNT] = {
+    {"RGBA16F", VK_FORMAT_R16G16B16A16_SFLOAT, 8, "./main_rgba16f.rgen.spv"},
+    {"R11G11B10F", VK_FORMAT_B10G11R11_UFLOAT_PACK32, 4, "./main_r11g11b10f.rgen.spv"},
+    {"RGBA32F", VK_FORMAT_R32G32B32A32_SFLOAT, 16, "./main_rgba32f.rgen.spv"}};
+
+static void createImageWithLayers(VKRT* vkrt, VkExtent2D extent, uint32_t layers, VkImageViewType viewType, VkFormat format, VkImageUsageFlags usage, Image* image) {
+    image->format = format;
+    image->extent = extent;
+
+    VkImageCreateInfo imageCreateInfo = {0};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = format;
+    imageCreateInfo.extent.width = extent.width;
+    imageCreateInfo.extent.height = extent.height;
+    imageCreateInfo.extent.depth = 1;
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = layers;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = usage;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkrt->vk.CreateImage(vkrt->device, &imageCreateInfo, NULL, &image->image) != VK_SUCCESS) {
+        perror("ERROR: Failed to create image");
+        exit(EXIT_FAILURE);
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkrt->vk.GetImageMemoryRequirements(vkrt->device, image->image, &memoryRequirements);
+
+    VkMemoryAllocateInfo memoryAllocateInfo = {0};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.allocationSize = memoryRequirements.size;
+    memoryAllocateInfo.memoryTypeIndex = findMemoryType(vkrt, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    if (vkrt->vk.AllocateMemory(vkrt->device, &memoryAllocateInfo, NULL, &image->memory) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate image memory");
+        exit(EXIT_FAILURE);
+    }
+
+    if (vkrt->vk.BindImageMemory(vkrt->device, image->image, image->memory, 0) != VK_SUCCESS) {
+        perror("ERROR: Failed to bind image memory");
+        exit(EXIT_FAILURE);
+    }
+
+    VkImageViewCreateInfo imageViewCreateInfo = {0};
+    imageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    imageViewCreateInfo.viewType = viewType;
+    imageViewCreateInfo.format = format;
+    imageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    imageViewCreateInfo.subresourceRange.baseMipLevel = 0;
+    imageViewCreateInfo.subresourceRange.levelCount = 1;
+    imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+    imageViewCreateInfo.subresourceRange.layerCount = layers;
+    imageViewCreateInfo.image = image->image;
+
+    if (vkrt->vk.CreateImageView(vkrt->device, &imageViewCreateInfo, NULL, &image->view) != VK_SUCCESS) {
+        perror("ERROR: Failed to create image view");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void createImage(VKRT* vkrt, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, Image* image) {
+    createImageWithLayers(vkrt, extent, 1, VK_IMAGE_VIEW_TYPE_2D, format, usage, image);
+}
+
+// Viewed as a 2D array even with a single layer, for shaders that declare image2DArray
+void createImageArray(VKRT* vkrt, VkExtent2D extent, uint32_t layers, VkFormat format, VkImageUsageFlags usage, Image* image) {
+    createImageWithLayers(vkrt, extent, layers, VK_IMAGE_VIEW_TYPE_2D_ARRAY, format, usage, image);
+}
+
+void destroyImage(VKRT* vkrt, Image* image) {
+    if (image->image == VK_NULL_HANDLE) {
+        return;
+    }
+
+    vkrt->vk.DestroyImageView(vkrt->device, image->view, NULL);
+    vkrt->vk.DestroyImage(vkrt->device, image->image, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, image->memory, NULL);
+    *image = (Image){0};
+}
+
+VkBool32 formatSupportsFeatures(VKRT* vkrt, VkFormat format, VkFormatFeatureFlags features) {
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(vkrt->physicalDevice, format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & features) == features;
+}
+
+VkBool32 outputPrecisionSupported(VKRT* vkrt, OutputPrecision precision) {
+    if (precision == OUTPUT_PRECISION_R11G11B10F && !vkrt->storageExtendedFormats) {
+        return VK_FALSE;
+    }
+
+    return formatSupportsFeatures(vkrt, outputPrecisionInfos[precision].format, VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "vkrt.h"
+
+extern const OutputPrecisionInfo outputPrecisionInfos[OUTPUT_PRECISION_COUNT];
+
+void createImage(VKRT* vkrt, VkExtent2D extent, VkFormat format, VkImageUsageFlags usage, Image* image);
+void createImageArray(VKRT* vkrt, VkExtent2D extent, uint32_t layers, VkFormat format, VkImageUsageFlags usage, Image* image);
+void destroyImage(VKRT* vkrt, Image* image);
+VkBool32 formatSupportsFeatures(VKRT* vkrt, VkFormat format, VkFormatFeatureFlags features);
+VkBool32 outputPrecisionSupported(VKRT* vkrt, OutputPrecision precision);
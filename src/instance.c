@@ -24,7 +24,7 @@ void createInstance(VKRT* vkrt) {
     instanceCreateInfo.pApplicationInfo = &applicationInfo;
 
     uint32_t extensionCount;
-    const char** extensions = getRequiredExtensions(&extensionCount);
+    const char** extensions = getRequiredExtensions(!vkrt->headless, &extensionCount);
 
     instanceCreateInfo.enabledExtensionCount = extensionCount;
     instanceCreateInfo.ppEnabledExtensionNames = extensions;
@@ -1,11 +1,17 @@
 #include "interface.h"
 #include "device.h"
+#include "image.h"
+#include "loader.h"
+#include "query.h"
+#include "widebvh.h"
 
 #include "dcimgui.h"
 #include "dcimgui_impl_glfw.h"
 #include "dcimgui_impl_vulkan.h"
 #include "dcimgui_internal.h"
 
+#include <float.h>
+
 void setupImGui(VKRT* vkrt) {
     vkrt->imguiContext = ImGui_CreateContext(NULL);
 
@@ -64,10 +70,114 @@ void drawInterface(VKRT* vkrt) {
     ImGui_Text("Device: %s", vkrt->deviceName);
     ImGui_Text("Frame rate:%10d FPS", vkrt->averageFPS);
     ImGui_Text("Frame time:%10.3f ms", vkrt->averageFrametime);
+    ImGui_Text("CPU submit:%10.3f ms", vkrt->averageSubmitTime);
+
+    for (uint32_t i = 0; i < GPU_TIMER_COUNT; i++) {
+        ImGui_Text("GPU %-7s%9.3f ms", gpuTimerNames[i], vkrt->gpuTimes[i]);
+    }
+    ImGui_Text("Present path: %s", vkrt->swapChainStorage ? "direct" : "intermediate");
+    ImGui_Text("Rays:%16.1f M/s", vkrt->raysPerSecond / 1e6f);
+    ImGui_Text("Path length:%9.2f", vkrt->averagePathLength);
+    ImGui_Text("Shadow rays:%9.2f /px", vkrt->shadowRaysPerPixel);
+    ImGui_Text("Active:%14.1f %%", vkrt->activePixelFraction * 100.0f);
+    ImGui_Text("Render scale:%8.0f %% (%ux%u)", vkrt->renderScale * 100.0f, vkrt->uniformBufferMapped->renderSize[0], vkrt->uniformBufferMapped->renderSize[1]);
+
+    SceneLoadStage loadStage = sceneLoadStage(vkrt);
+    if (loadStage != SCENE_LOAD_DONE) {
+        ImGui_ProgressBar((float)loadStage / SCENE_LOAD_DONE, (ImVec2){-FLT_MIN, 0}, sceneLoadStageNames[loadStage]);
+    } else {
+        ImGui_Text("Scene load:%10.3f s", (double)(vkrt->sceneLoader.loadedTime - vkrt->sceneLoader.startTime) / 1e9);
+        ImGui_Text("First pixel:%9.3f s", (double)(vkrt->sceneLoader.firstPixelTime - vkrt->sceneLoader.startTime) / 1e9);
+    }
+
+    int maxDepth = (int)vkrt->requestedPathSettings.maxDepth;
+    if (ImGui_SliderInt("Max depth", &maxDepth, 1, 32)) {
+        vkrt->requestedPathSettings.maxDepth = (uint32_t)maxDepth;
+    }
+    int rouletteDepth = (int)vkrt->requestedPathSettings.rouletteDepth;
+    if (ImGui_SliderInt("RR start", &rouletteDepth, 0, maxDepth)) {
+        vkrt->requestedPathSettings.rouletteDepth = (uint32_t)rouletteDepth;
+    }
+    ImGui_BeginDisabled(vkrt->requestedPathSettings.restir != 0);
+    bool nextEventEstimation = vkrt->requestedPathSettings.nextEventEstimation != 0;
+    if (ImGui_Checkbox("Light sampling", &nextEventEstimation)) {
+        vkrt->requestedPathSettings.nextEventEstimation = nextEventEstimation;
+    }
+    ImGui_EndDisabled();
+    int lightSampling = (int)vkrt->requestedPathSettings.lightSampling;
+    if (ImGui_Combo("Light pick", &lightSampling, "Uniform\0Power\0Tree\0")) {
+        vkrt->requestedPathSettings.lightSampling = (uint32_t)lightSampling;
+    }
+    if (vkrt->restirSupported) {
+        bool restir = vkrt->requestedPathSettings.restir != 0;
+        if (ImGui_Checkbox("ReSTIR", &restir)) {
+            vkrt->requestedPathSettings.restir = restir;
+        }
+    }
+    int environmentSampling = (int)vkrt->requestedPathSettings.environmentSampling;
+    if (ImGui_Combo("Environment", &environmentSampling, "Uniform\0Importance\0")) {
+        vkrt->requestedPathSettings.environmentSampling = (uint32_t)environmentSampling;
+    }
+    int sampler = (int)vkrt->requestedPathSettings.sampler;
+    if (ImGui_Combo("Sampler", &sampler, "PCG\0Blue noise\0Sobol\0")) {
+        vkrt->requestedPathSettings.sampler = (uint32_t)sampler;
+    }
+    if (!vkrt->requestedPathSettings.restir) {
+        bool adaptive = vkrt->requestedPathSettings.adaptive != 0;
+        if (ImGui_Checkbox("Adaptive", &adaptive)) {
+            vkrt->requestedPathSettings.adaptive = adaptive;
+        }
+        if (adaptive) {
+            ImGui_SliderFloatEx("Error target", &vkrt->uniformBufferMapped->adaptiveThreshold, 0.001f, 0.1f, "%.3f", ImGuiSliderFlags_Logarithmic);
+        }
+    }
+    if (vkrt->denoiseSupported) {
+        int denoiser = (int)vkrt->requestedPathSettings.denoiser;
+        if (ImGui_Combo("Denoiser", &denoiser, "Off\0Fast\0Quality\0")) {
+            vkrt->requestedPathSettings.denoiser = (uint32_t)denoiser;
+        }
+    }
+    if (vkrt->upscaleSupported) {
+        bool upscaler = vkrt->requestedPathSettings.upscaler != 0;
+        if (ImGui_Checkbox("Temporal upscaler", &upscaler)) {
+            vkrt->requestedPathSettings.upscaler = upscaler;
+        }
+    }
+
+    if (vkrt->wavefrontSupported) {
+        int traceMode = (int)vkrt->requestedTraceMode;
+        if (ImGui_Combo("Mode", &traceMode, "Megakernel\0Wavefront\0")) {
+            vkrt->requestedTraceMode = (TraceMode)traceMode;
+        }
+    }
+
+    int precision = (int)vkrt->requestedOutputPrecision;
+    if (ImGui_Combo("Precision", &precision, "RGBA16F\0R11G11B10F\0RGBA32F (accumulate)\0")) {
+        if (outputPrecisionSupported(vkrt, (OutputPrecision)precision)) {
+            vkrt->requestedOutputPrecision = (OutputPrecision)precision;
+        }
+    }
+
+    uint64_t pixelCount = (uint64_t)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+    for (uint32_t i = 0; i < OUTPUT_PRECISION_COUNT; i++) {
+        VkDeviceSize size = i == vkrt->outputPrecision ? vkrt->storageImageSize : pixelCount * outputPrecisionInfos[i].bytesPerPixel;
+        float traceTime = i == vkrt->outputPrecision ? traceGpuTime(vkrt) : vkrt->precisionTraceTimes[i];
+        ImGui_Text("%c %-10s%7.2f MiB%9.3f ms", i == vkrt->outputPrecision ? '>' : ' ', outputPrecisionInfos[i].name, (double)size / (1024.0 * 1024.0), traceTime);
+    }
+
+    ImGui_SliderFloat("Exposure", &vkrt->uniformBufferMapped->exposure, -8.0f, 8.0f);
+    int tonemapper = (int)vkrt->uniformBufferMapped->tonemapper;
+    if (ImGui_Combo("Tonemap", &tonemapper, "Clamp\0Reinhard\0ACES\0")) {
+        vkrt->uniformBufferMapped->tonemapper = (uint32_t)tonemapper;
+    }
 
     if (ImGui_Checkbox("V-Sync", (bool*)&vkrt->vsync)) {
         vkrt->framebufferResized = VK_TRUE;
     }
+    ImGui_Checkbox("Dynamic resolution", (bool*)&vkrt->dynamicResolution);
+    if (vkrt->dynamicResolution) {
+        ImGui_SliderFloat("Trace budget", &vkrt->traceBudget, 1.0f, 50.0f);
+    }
 
     handleCameraMovement(vkrt);
 
@@ -76,6 +186,22 @@ void drawInterface(VKRT* vkrt) {
     ImGui_Render();
 }
 
+// Casts the camera ray through a window position and turns the camera in place to orbit around the
+// surface it hits
+static void focusCursor(VKRT* vkrt, float x, float y) {
+    if (!vkrt->sceneBVH) return;
+
+    vec3 direction;
+    cameraRayDirection(&vkrt->camera, x, y, direction);
+
+    BVHHit hit;
+    if (!intersectWideBVH(vkrt->sceneBVH, vkrt->camera.pos, direction, vkrt->camera.nearZ, vkrt->camera.farZ, &hit)) return;
+
+    glm_vec3_copy(vkrt->camera.pos, vkrt->camera.target);
+    glm_vec3_muladds(direction, hit.t, vkrt->camera.target);
+    updateMatricesFromCamera(vkrt);
+}
+
 void handleCameraMovement(VKRT* vkrt) {
     const float panSpeed = -0.00145f;
     const float orbitSpeed = -0.004f;
@@ -124,6 +250,10 @@ void handleCameraMovement(VKRT* vkrt) {
         updateMatricesFromCamera(vkrt);
     }
 
+    if (ImGui_IsMouseDoubleClicked(ImGuiMouseButton_Left) && !io->WantCaptureMouse) {
+        focusCursor(vkrt, io->MousePos.x / io->DisplaySize.x, io->MousePos.y / io->DisplaySize.y);
+    }
+
     if (newDist != dist) {
         glm_vec3_scale(viewDir, scroll * zoomSpeed, viewDir);
         glm_vec3_add(vkrt->camera.pos, viewDir, vkrt->camera.pos);
@@ -131,7 +261,7 @@ void handleCameraMovement(VKRT* vkrt) {
     }
 }
 
-void setupSceneUniform(VKRT* vkrt) {
+void setupCamera(VKRT* vkrt) {
     vkrt->camera = (Camera){
         .width = WIDTH, .height = HEIGHT,
         .nearZ = 0.001, .farZ = 10000.0,
@@ -139,18 +269,70 @@ void setupSceneUniform(VKRT* vkrt) {
         .pos = {0, 0, 0.5},
         .target = {0, 0, 0},
         .up = {0, 1, 0}};
+}
+
+void setupSceneUniform(VKRT* vkrt) {
+    setupCamera(vkrt);
+
+    vkrt->uniformBufferMapped->exposure = 0.0f;
+    vkrt->uniformBufferMapped->tonemapper = TONEMAPPER_ACES;
+    vkrt->uniformBufferMapped->adaptiveThreshold = 0.02f;
+    vkrt->uniformBufferMapped->lightCount = vkrt->lightCount;
+    vkrt->uniformBufferMapped->environmentWidth = vkrt->environmentWidth;
+    vkrt->uniformBufferMapped->environmentHeight = vkrt->environmentHeight;
 
     updateMatricesFromCamera(vkrt);
 }
 
-void updateMatricesFromCamera(VKRT* vkrt) {
-    mat4 view, proj;
-    Camera cam = vkrt->camera;
+// Unjittered view and projection of a camera, also used by the CPU reference tracer
+void cameraMatrices(const Camera* camera, mat4 view, mat4 proj) {
+    Camera cam = *camera;
 
     glm_lookat(cam.pos, cam.target, cam.up, view);
     glm_perspective(glm_rad(cam.vfov), (float)cam.width / cam.height, cam.nearZ, cam.farZ, proj);
+}
+
+// Unit direction of the camera ray through an image position in [0, 1], y down, mapped as in main.rgen
+void cameraRayDirection(const Camera* camera, float x, float y, vec3 direction) {
+    mat4 view, proj, viewInverse, projInverse;
+    cameraMatrices(camera, view, proj);
+    glm_mat4_inv(view, viewInverse);
+    glm_mat4_inv(proj, projInverse);
+
+    vec4 viewDirection;
+    glm_mat4_mulv(projInverse, (vec4){x * 2.0f - 1.0f, y * 2.0f - 1.0f, 1.0f, 1.0f}, viewDirection);
+    glm_mat4_mulv3(viewInverse, viewDirection, 0.0f, direction);
+    glm_vec3_normalize(direction);
+}
+
+void updateMatricesFromCamera(VKRT* vkrt) {
+    mat4 view, proj;
+    cameraMatrices(&vkrt->camera, view, proj);
 
+    // Reprojection works on the unjittered matrices, only the rays see the jitter
+    glm_mat4_copy(proj, vkrt->projection);
+    glm_mat4_mul(proj, view, vkrt->viewProjection);
     glm_mat4_inv(view, vkrt->uniformBufferMapped->viewInverse);
+    jitterProjection(vkrt);
+
+    vkrt->accumulatedFrames = 0;
+}
+
+// Shifts the projection by the uniform's jitter in traced pixels, so that traced pixel i samples i + 0.5 + jitter
+void jitterProjection(VKRT* vkrt) {
+    mat4 proj;
+    glm_mat4_copy(vkrt->projection, proj);
+
+    const uint32_t* renderSize = vkrt->uniformBufferMapped->renderSize;
+    if (renderSize[0] > 0 && renderSize[1] > 0) {
+        float offsetX = -2.0f * vkrt->uniformBufferMapped->jitter[0] / renderSize[0];
+        float offsetY = -2.0f * vkrt->uniformBufferMapped->jitter[1] / renderSize[1];
+        for (uint32_t i = 0; i < 4; i++) {
+            proj[i][0] += offsetX * proj[i][3];
+            proj[i][1] += offsetY * proj[i][3];
+        }
+    }
+
     glm_mat4_inv(proj, vkrt->uniformBufferMapped->projInverse);
 }
 
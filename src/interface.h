@@ -5,6 +5,10 @@ void setupImGui(VKRT* vkrt);
 void deinitImGui(VKRT* vkrt);
 void drawInterface(VKRT* vkrt);
 void handleCameraMovement(VKRT* vkrt);
+void setupCamera(VKRT* vkrt);
 void setupSceneUniform(VKRT* vkrt);
+void cameraMatrices(const Camera* camera, mat4 view, mat4 proj);
+void cameraRayDirection(const Camera* camera, float x, float y, vec3 direction);
 void updateMatricesFromCamera(VKRT* vkrt);
+void jitterProjection(VKRT* vkrt);
 void setDarkTheme();
\ No newline at end of file
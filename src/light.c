@@ -0,0 +1,320 @@
+#include "light.h"
+#include "buffer.h"
+#include "device.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LIGHT_TREE_BUCKETS 12
+#define LIGHT_TREE_PARALLEL_DEPTH 3
+#define LIGHT_TREE_PARALLEL_LIGHTS 4096
+
+// Spatial bounds, normal cone and power of a set of emitters. Emitters are diffuse,
+// so the emission cone around each normal is always a hemisphere.
+typedef struct LightBounds {
+    vec3 min;
+    vec3 max;
+    vec3 axis;
+    float cosTheta;
+    float power;
+    uint32_t count;
+} LightBounds;
+
+typedef struct LightPrimitive {
+    LightBounds bounds;
+    vec3 centroid;
+    uint32_t light;
+} LightPrimitive;
+
+typedef struct LightTreeBuild {
+    pthread_t thread;
+    LightPrimitive* primitives;
+    LightNode* nodes;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t nodeIndex;
+    uint32_t depth;
+    LightBounds bounds;
+} LightTreeBuild;
+
+static float triangleArea(const float* a, const float* b, const float* c) {
+    vec3 ab, ac, normal;
+    glm_vec3_sub((float*)b, (float*)a, ab);
+    glm_vec3_sub((float*)c, (float*)a, ac);
+    glm_vec3_cross(ab, ac, normal);
+    return 0.5f * glm_vec3_norm(normal);
+}
+
+// Smallest cone containing both cones, following the bounding-cone union of Conty & Kulla
+static void mergeCone(vec3 axis, float* cosTheta, vec3 otherAxis, float otherCosTheta) {
+    float theta = acosf(glm_clamp(*cosTheta, -1.0f, 1.0f));
+    float otherTheta = acosf(glm_clamp(otherCosTheta, -1.0f, 1.0f));
+    float between = acosf(glm_clamp(glm_vec3_dot(axis, otherAxis), -1.0f, 1.0f));
+
+    if (fminf(between + otherTheta, (float)M_PI) <= theta) return;
+    if (fminf(between + theta, (float)M_PI) <= otherTheta) {
+        glm_vec3_copy(otherAxis, axis);
+        *cosTheta = otherCosTheta;
+        return;
+    }
+
+    float merged = 0.5f * (theta + between + otherTheta);
+    vec3 rotationAxis;
+    glm_vec3_cross(axis, otherAxis, rotationAxis);
+    if (merged >= (float)M_PI || glm_vec3_norm2(rotationAxis) < 1e-12f) {
+        *cosTheta = -1.0f;
+        return;
+    }
+
+    glm_vec3_rotate(axis, merged - theta, rotationAxis);
+    *cosTheta = cosf(merged);
+}
+
+static void mergeBounds(LightBounds* bounds, LightBounds* other) {
+    if (!other->count) return;
+    if (!bounds->count) {
+        *bounds = *other;
+        return;
+    }
+
+    glm_vec3_minv(bounds->min, other->min, bounds->min);
+    glm_vec3_maxv(bounds->max, other->max, bounds->max);
+    mergeCone(bounds->axis, &bounds->cosTheta, other->axis, other->cosTheta);
+    bounds->power += other->power;
+    bounds->count += other->count;
+}
+
+// Surface area orientation heuristic: power times the solid angle measure of the
+// normal cone widened by the hemispherical emission, times the surface area
+static float lightBoundsCost(const LightBounds* bounds) {
+    float theta = acosf(glm_clamp(bounds->cosTheta, -1.0f, 1.0f));
+    float thetaW = fminf(theta + (float)M_PI_2, (float)M_PI);
+    float sinTheta = sinf(theta);
+    float orientation = 2.0f * (float)M_PI * (1.0f - bounds->cosTheta) +
+                        (float)M_PI_2 * (2.0f * thetaW * sinTheta - cosf(theta - 2.0f * thetaW) - 2.0f * theta * sinTheta + bounds->cosTheta);
+
+    vec3 extent;
+    glm_vec3_sub((float*)bounds->max, (float*)bounds->min, extent);
+    float area = 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+
+    return bounds->power * orientation * area;
+}
+
+// Binned SAOH split over all three axes; returns the first primitive of the right child
+static uint32_t partitionLights(LightPrimitive* primitives, uint32_t begin, uint32_t end, const LightBounds* bounds) {
+    vec3 centroidMin, centroidMax;
+    glm_vec3_copy(primitives[begin].centroid, centroidMin);
+    glm_vec3_copy(primitives[begin].centroid, centroidMax);
+    for (uint32_t i = begin + 1; i < end; i++) {
+        glm_vec3_minv(centroidMin, primitives[i].centroid, centroidMin);
+        glm_vec3_maxv(centroidMax, primitives[i].centroid, centroidMax);
+    }
+
+    vec3 extent;
+    glm_vec3_sub((float*)bounds->max, (float*)bounds->min, extent);
+    float maxExtent = glm_vec3_max(extent);
+
+    float bestCost = INFINITY;
+    uint32_t bestAxis = 0, bestSplit = 0;
+
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        float width = centroidMax[axis] - centroidMin[axis];
+        if (width <= 0.0f) continue;
+
+        LightBounds buckets[LIGHT_TREE_BUCKETS] = {0};
+        for (uint32_t i = begin; i < end; i++) {
+            uint32_t bucket = (uint32_t)((primitives[i].centroid[axis] - centroidMin[axis]) / width * LIGHT_TREE_BUCKETS);
+            if (bucket >= LIGHT_TREE_BUCKETS) bucket = LIGHT_TREE_BUCKETS - 1;
+            mergeBounds(&buckets[bucket], &primitives[i].bounds);
+        }
+
+        // Long thin boxes are otherwise favoured by the surface area term
+        float regularization = maxExtent / fmaxf(extent[axis], 1e-12f);
+
+        for (uint32_t split = 1; split < LIGHT_TREE_BUCKETS; split++) {
+            LightBounds left = {0}, right = {0};
+            for (uint32_t i = 0; i < split; i++) mergeBounds(&left, &buckets[i]);
+            for (uint32_t i = split; i < LIGHT_TREE_BUCKETS; i++) mergeBounds(&right, &buckets[i]);
+            if (!left.count || !right.count) continue;
+
+            float cost = regularization * (lightBoundsCost(&left) + lightBoundsCost(&right));
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    // Every centroid coincides, so any split is as good as another
+    if (bestCost == INFINITY) return begin + (end - begin) / 2;
+
+    float width = centroidMax[bestAxis] - centroidMin[bestAxis];
+    uint32_t middle = begin;
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t bucket = (uint32_t)((primitives[i].centroid[bestAxis] - centroidMin[bestAxis]) / width * LIGHT_TREE_BUCKETS);
+        if (bucket >= LIGHT_TREE_BUCKETS) bucket = LIGHT_TREE_BUCKETS - 1;
+        if (bucket < bestSplit) {
+            LightPrimitive swap = primitives[middle];
+            primitives[middle++] = primitives[i];
+            primitives[i] = swap;
+        }
+    }
+    return middle;
+}
+
+static void writeLightNode(LightNode* node, const LightBounds* bounds, uint32_t child) {
+    memcpy(node->boundsMin, bounds->min, sizeof(node->boundsMin));
+    memcpy(node->boundsMax, bounds->max, sizeof(node->boundsMax));
+    memcpy(node->axis, bounds->axis, sizeof(node->axis));
+    node->cosTheta = bounds->cosTheta;
+    node->power = bounds->power;
+    node->child = child;
+}
+
+// A tree over n lights always has 2n - 1 nodes, so subtrees are laid out depth-first into
+// disjoint ranges known before they are built and the top levels can be built concurrently
+static void* buildLightTree(void* argument) {
+    LightTreeBuild* build = (LightTreeBuild*)argument;
+    LightPrimitive* primitives = build->primitives;
+
+    if (build->end - build->begin == 1) {
+        build->bounds = primitives[build->begin].bounds;
+        writeLightNode(&build->nodes[build->nodeIndex], &build->bounds, primitives[build->begin].light | LIGHT_LEAF_BIT);
+        return NULL;
+    }
+
+    LightBounds bounds = {0};
+    for (uint32_t i = build->begin; i < build->end; i++) {
+        mergeBounds(&bounds, &primitives[i].bounds);
+    }
+
+    uint32_t middle = partitionLights(primitives, build->begin, build->end, &bounds);
+    LightTreeBuild left = {
+        .primitives = primitives,
+        .nodes = build->nodes,
+        .begin = build->begin,
+        .end = middle,
+        .nodeIndex = build->nodeIndex + 1,
+        .depth = build->depth + 1};
+    LightTreeBuild right = left;
+    right.begin = middle;
+    right.end = build->end;
+    right.nodeIndex = build->nodeIndex + 2 * (middle - build->begin);
+
+    int parallel = build->depth < LIGHT_TREE_PARALLEL_DEPTH && build->end - build->begin >= LIGHT_TREE_PARALLEL_LIGHTS;
+    if (parallel && pthread_create(&left.thread, NULL, buildLightTree, &left) != 0) {
+        perror("ERROR: Failed to create light tree build thread");
+        exit(EXIT_FAILURE);
+    }
+    if (!parallel) buildLightTree(&left);
+    buildLightTree(&right);
+    if (parallel) pthread_join(left.thread, NULL);
+
+    build->bounds = left.bounds;
+    mergeBounds(&build->bounds, &right.bounds);
+    writeLightNode(&build->nodes[build->nodeIndex], &build->bounds, right.nodeIndex);
+    return NULL;
+}
+
+static void createLightTree(VKRT* vkrt, const Light* lights, uint32_t lightCount) {
+    uint32_t nodeCount = lightCount ? 2 * lightCount - 1 : 1;
+    LightNode* nodes = calloc(nodeCount, sizeof(LightNode));
+
+    if (lightCount) {
+        uint64_t start = getTimeNanoSeconds();
+
+        LightPrimitive* primitives = malloc(lightCount * sizeof(LightPrimitive));
+        for (uint32_t i = 0; i < lightCount; i++) {
+            const Light* light = &lights[i];
+            LightPrimitive* primitive = &primitives[i];
+            *primitive = (LightPrimitive){0};
+
+            glm_vec3_minv((float*)light->v0, (float*)light->v1, primitive->bounds.min);
+            glm_vec3_minv(primitive->bounds.min, (float*)light->v2, primitive->bounds.min);
+            glm_vec3_maxv((float*)light->v0, (float*)light->v1, primitive->bounds.max);
+            glm_vec3_maxv(primitive->bounds.max, (float*)light->v2, primitive->bounds.max);
+
+            vec3 edge1, edge2;
+            glm_vec3_sub((float*)light->v1, (float*)light->v0, edge1);
+            glm_vec3_sub((float*)light->v2, (float*)light->v0, edge2);
+            glm_vec3_crossn(edge1, edge2, primitive->bounds.axis);
+            primitive->bounds.cosTheta = 1.0f;
+            primitive->bounds.power = light->pdf;
+            primitive->bounds.count = 1;
+
+            glm_vec3_center(primitive->bounds.min, primitive->bounds.max, primitive->centroid);
+            primitive->light = i;
+        }
+
+        LightTreeBuild root = {.primitives = primitives, .nodes = nodes, .begin = 0, .end = lightCount};
+        buildLightTree(&root);
+        free(primitives);
+
+        printf("INFO: Light tree of %u nodes built in %.2f ms\n", nodeCount, (double)(getTimeNanoSeconds() - start) / 1e6);
+    }
+
+    createBufferFromHostData(
+        vkrt,
+        nodes, nodeCount * sizeof(LightNode),
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        &vkrt->lightTreeBuffer,
+        &vkrt->lightTreeBufferMemory);
+
+    free(nodes);
+}
+
+void createLightBuffer(VKRT* vkrt, const Vertex* vertices, const uint32_t* indices, uint32_t indexCount, const Material* materials) {
+    uint32_t triangleCount = indexCount / 3;
+    Light* lights = calloc(triangleCount + 1, sizeof(Light));
+    uint32_t lightCount = 0;
+    float totalPower = 0.0f;
+
+    for (uint32_t t = 0; t < triangleCount; t++) {
+        const Vertex* v0 = &vertices[indices[t * 3 + 0]];
+        const Vertex* v1 = &vertices[indices[t * 3 + 1]];
+        const Vertex* v2 = &vertices[indices[t * 3 + 2]];
+        // Emissive textures are not loaded (see parseObject), so power matches the uniform emission that is shaded
+        const float* emission = materials[v0->materialIndex].emission;
+
+        float luminance = 0.2126f * emission[0] + 0.7152f * emission[1] + 0.0722f * emission[2];
+        float area = triangleArea(v0->position, v1->position, v2->position);
+        if (luminance <= 0.0f || area <= 0.0f)
+            continue;
+
+        Light* light = &lights[lightCount++];
+        *light = (Light){0};
+        memcpy(light->v0, v0->position, sizeof(light->v0));
+        memcpy(light->v1, v1->position, sizeof(light->v1));
+        memcpy(light->v2, v2->position, sizeof(light->v2));
+        memcpy(light->emission, emission, sizeof(light->emission));
+        light->area = area;
+        light->pdf = luminance * area;
+        totalPower += light->pdf;
+    }
+
+    float cdf = 0.0f;
+    for (uint32_t i = 0; i < lightCount; i++) {
+        lights[i].pdf /= totalPower;
+        cdf += lights[i].pdf;
+        lights[i].cdf = cdf;
+    }
+    if (lightCount)
+        lights[lightCount - 1].cdf = 1.0f;
+
+    vkrt->lightCount = lightCount;
+    printf("INFO: %u emissive triangles\n", lightCount);
+
+    // Storage buffers can't be empty, so scenes without emitters still upload one unused entry
+    createBufferFromHostData(
+        vkrt,
+        lights, (lightCount ? lightCount : 1) * sizeof(Light),
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        &vkrt->lightBuffer,
+        &vkrt->lightBufferMemory);
+
+    createLightTree(vkrt, lights, lightCount);
+    free(lights);
+}
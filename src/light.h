@@ -0,0 +1,4 @@
+#pragma once
+#include "vkrt.h"
+
+void createLightBuffer(VKRT* vkrt, const Vertex* vertices, const uint32_t* indices, uint32_t indexCount, const Material* materials);
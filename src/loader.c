@@ -0,0 +1,186 @@
+#include "loader.h"
+#include "command.h"
+#include "descriptor.h"
+#include "device.h"
+#include "object.h"
+#include "restir.h"
+#include "structure.h"
+#include "wavefront.h"
+#include "widebvh.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+const char* sceneLoadStageNames[SCENE_LOAD_STAGE_COUNT] = {
+    "Parsing",
+    "Building BVH",
+    "Staging",
+    "Uploading",
+    "Done"};
+
+static void setStage(SceneLoader* loader, SceneLoadStage stage) {
+    pthread_mutex_lock(&loader->mutex);
+    loader->stage = stage;
+    pthread_mutex_unlock(&loader->mutex);
+}
+
+SceneLoadStage sceneLoadStage(VKRT* vkrt) {
+    SceneLoader* loader = &vkrt->sceneLoader;
+    pthread_mutex_lock(&loader->mutex);
+    SceneLoadStage stage = loader->stage;
+    pthread_mutex_unlock(&loader->mutex);
+    return stage;
+}
+
+static double peakResidentMegabytes(void) {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters = {0};
+    K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return (double)counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return (double)usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return (double)usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+// Everything but the device copies and acceleration structure builds, which need the graphics queue
+static void* loadScene(void* argument) {
+    VKRT* vkrt = (VKRT*)argument;
+    SceneLoader* loader = &vkrt->sceneLoader;
+
+    uint64_t parseStart = getTimeNanoSeconds();
+    parseObject(loader->path, &loader->scene);
+    printf("INFO: Parsed %u triangles in %.2f s, peak RSS %.0f MB\n", loader->scene.indexCount / 3, (double)(getTimeNanoSeconds() - parseStart) / 1e9, peakResidentMegabytes());
+
+    setStage(loader, SCENE_LOAD_BUILDING);
+    loader->scene.bvh = malloc(sizeof(WideBVH));
+    buildWideBVH(loader->scene.bvh, loader->scene.vertices, loader->scene.indices, loader->scene.indexCount / 3);
+
+    setStage(loader, SCENE_LOAD_STAGING);
+    stageObject(vkrt, &loader->scene, &loader->staging);
+
+    setStage(loader, SCENE_LOAD_READY);
+    return NULL;
+}
+
+// One triangle with a NaN coordinate, which acceleration structure builds treat as inactive, so the
+// proxy renders the environment alone
+static void loadProxy(VKRT* vkrt) {
+    SceneData proxy = {0};
+    proxy.vertexCount = 3;
+    proxy.indexCount = 3;
+    proxy.materialCount = 1;
+    proxy.vertices = calloc(proxy.vertexCount, sizeof(Vertex));
+    proxy.indices = malloc(proxy.indexCount * sizeof(uint32_t));
+    proxy.materials = calloc(proxy.materialCount, sizeof(Material));
+    for (uint32_t i = 0; i < proxy.vertexCount; i++) {
+        proxy.vertices[i].position[0] = NAN;
+        proxy.indices[i] = i;
+    }
+
+    SceneStaging staging;
+    stageObject(vkrt, &proxy, &staging);
+    adoptObject(vkrt, &proxy);
+    uploadObject(vkrt, &staging);
+    destroyStaging(vkrt, &staging);
+}
+
+void startSceneLoad(VKRT* vkrt, const char* path) {
+    SceneLoader* loader = &vkrt->sceneLoader;
+    loader->path = path;
+    loader->startTime = getTimeNanoSeconds();
+    loader->stage = SCENE_LOAD_PARSING;
+    pthread_mutex_init(&loader->mutex, NULL);
+
+    loadProxy(vkrt);
+
+    if (pthread_create(&loader->thread, NULL, loadScene, vkrt) != 0) {
+        perror("ERROR: Failed to create scene loader thread");
+        exit(EXIT_FAILURE);
+    }
+    loader->started = VK_TRUE;
+}
+
+// Replaces the proxy with the staged scene. Everything that refers to the old geometry, light buffers or
+// TLAS is rewritten, as for a trace mode change.
+static void swapScene(VKRT* vkrt) {
+    SceneLoader* loader = &vkrt->sceneLoader;
+    pthread_join(loader->thread, NULL);
+    loader->started = VK_FALSE;
+
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    destroyAccelerationStructures(vkrt);
+    destroyObjectBuffers(vkrt);
+    destroyObject(vkrt);
+
+    adoptObject(vkrt, &loader->scene);
+    uploadObject(vkrt, &loader->staging);
+    destroyStaging(vkrt, &loader->staging);
+    createBottomLevelAccelerationStructure(vkrt);
+    createTopLevelAccelerationStructure(vkrt);
+
+    loader->loadedTime = getTimeNanoSeconds();
+    setStage(loader, SCENE_LOAD_DONE);
+    printf("INFO: Scene '%s' swapped in %.2f s after start\n", loader->path, (double)(loader->loadedTime - loader->startTime) / 1e9);
+
+    // Headless runs have no descriptor set, frame resources or trace command buffers to rewrite
+    if (vkrt->headless) return;
+
+    updateDescriptorSet(vkrt);
+    if (vkrt->pathSettings.restir) {
+        destroyRestirResources(vkrt);
+        createRestirResources(vkrt);
+    }
+    if (vkrt->traceMode == TRACE_MODE_WAVEFRONT) {
+        destroyWavefrontResources(vkrt);
+        createWavefrontResources(vkrt);
+    }
+
+    vkrt->uniformBufferMapped->lightCount = vkrt->lightCount;
+    invalidateTraceCommandBuffers(vkrt);
+    vkrt->accumulatedFrames = 0;
+}
+
+// Called at the top of a frame, before anything is recorded against the current scene
+void updateSceneLoad(VKRT* vkrt) {
+    if (vkrt->sceneLoader.started && sceneLoadStage(vkrt) == SCENE_LOAD_READY) {
+        swapScene(vkrt);
+    }
+}
+
+void finishSceneLoad(VKRT* vkrt) {
+    if (vkrt->sceneLoader.started) swapScene(vkrt);
+}
+
+// Waits out a load still in flight, so the loader thread never outlives the device it stages on
+void destroySceneLoader(VKRT* vkrt) {
+    SceneLoader* loader = &vkrt->sceneLoader;
+    if (loader->started) {
+        pthread_join(loader->thread, NULL);
+        loader->started = VK_FALSE;
+        destroyStaging(vkrt, &loader->staging);
+
+        SceneData* scene = &loader->scene;
+        destroyWideBVH(scene->bvh);
+        free(scene->bvh);
+        free(scene->vertices);
+        free(scene->indices);
+        free(scene->materials);
+        *scene = (SceneData){0};
+    }
+    pthread_mutex_destroy(&loader->mutex);
+}
\ No newline at end of file
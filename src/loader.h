@@ -0,0 +1,10 @@
+#pragma once
+#include "vkrt.h"
+
+extern const char* sceneLoadStageNames[SCENE_LOAD_STAGE_COUNT];
+
+void startSceneLoad(VKRT* vkrt, const char* path);
+SceneLoadStage sceneLoadStage(VKRT* vkrt);
+void updateSceneLoad(VKRT* vkrt);
+void finishSceneLoad(VKRT* vkrt);
+void destroySceneLoader(VKRT* vkrt);
\ No newline at end of file
@@ -1,10 +1,49 @@
 #include "app.h"
 #include "vkrt.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-int main() {
+int main(int argc, char** argv) {
     VKRT vkrt = {0};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            vkrt.benchmarkName = argv[++i];
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            vkrt.scenePath = argv[++i];
+        } else if (strcmp(argv[i], "--environment") == 0 && i + 1 < argc) {
+            vkrt.environmentPath = argv[++i];
+        } else if (strcmp(argv[i], "--render") == 0 && i + 2 < argc) {
+            vkrt.offlinePath = argv[++i];
+            if (sscanf(argv[++i], "%ux%u", &vkrt.offlineWidth, &vkrt.offlineHeight) != 2 || vkrt.offlineWidth == 0 || vkrt.offlineHeight == 0) {
+                fprintf(stderr, "ERROR: Render size must be <width>x<height>\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--views") == 0 && i + 2 < argc) {
+            vkrt.multiViewPath = argv[++i];
+            vkrt.multiViewCount = (uint32_t)strtoul(argv[++i], NULL, 10);
+            if (vkrt.multiViewCount == 0) {
+                fprintf(stderr, "ERROR: View count must be at least 1\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--reference") == 0) {
+            vkrt.cpuReference = VK_TRUE;
+        } else if (strcmp(argv[i], "--cast") == 0 && i + 2 < argc) {
+            vkrt.castRayPath = argv[++i];
+            vkrt.castHitPath = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            vkrt.offlineSamples = (uint32_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--benchmark <name>] [--scene <path.glb>] [--environment <path.hdr>] [--render <path.pfm> <width>x<height> [--samples <n>]] [--views <path.pfm> <count> [--samples <n>]] [--reference] [--cast <rays.bin> <hits.bin>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (vkrt.offlineSamples == 0) {
+        vkrt.offlineSamples = 256;
+    }
+
     run(&vkrt);
 
     return EXIT_SUCCESS;
@@ -0,0 +1,452 @@
+#include "meshopt.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Limits of the EXT_meshopt_compression bitstreams, as in the reference decoder
+#define VERTEX_HEADER 0xa0
+#define INDEX_HEADER 0xe0
+#define SEQUENCE_HEADER 0xd0
+#define BYTE_GROUP_SIZE 16
+#define BYTE_GROUP_DECODE_LIMIT 24
+#define VERTEX_BLOCK_SIZE_BYTES 8192
+#define VERTEX_BLOCK_MAX_SIZE 256
+#define TAIL_MAX_SIZE 32
+
+typedef struct MeshoptDecodeJob {
+    cgltf_buffer_view** views;
+    const char** errors;
+    uint32_t viewCount;
+    uint32_t nextView;
+    pthread_mutex_t mutex;
+} MeshoptDecodeJob;
+
+// Packed 2 or 4 bit values, most significant first, where an all-ones value escapes to a full byte stored
+// after the packed ones. Called with a constant width so each one unrolls.
+static inline const uint8_t* decodePackedGroup(const uint8_t* data, uint8_t* buffer, uint32_t bits) {
+    uint32_t escape = (1u << bits) - 1;
+    uint32_t perByte = 8 / bits;
+    const uint8_t* escaped = data + BYTE_GROUP_SIZE / perByte;
+    for (uint32_t i = 0; i < BYTE_GROUP_SIZE; i++) {
+        uint8_t value = (data[i / perByte] >> (8 - bits - (i % perByte) * bits)) & escape;
+        buffer[i] = value == escape ? *escaped : value;
+        escaped += value == escape;
+    }
+    return escaped;
+}
+
+static const uint8_t* decodeBytesGroup(const uint8_t* data, uint8_t* buffer, int bitsLog2) {
+    switch (bitsLog2) {
+    case 0:
+        memset(buffer, 0, BYTE_GROUP_SIZE);
+        return data;
+    case 1:
+        return decodePackedGroup(data, buffer, 2);
+    case 2:
+        return decodePackedGroup(data, buffer, 4);
+    default:
+        memcpy(buffer, data, BYTE_GROUP_SIZE);
+        return data + BYTE_GROUP_SIZE;
+    }
+}
+
+static const uint8_t* decodeBytes(const uint8_t* data, const uint8_t* end, uint8_t* buffer, size_t size) {
+    const uint8_t* header = data;
+    size_t headerSize = (size / BYTE_GROUP_SIZE + 3) / 4;
+    if ((size_t)(end - data) < headerSize) return NULL;
+    data += headerSize;
+
+    for (size_t i = 0; i < size; i += BYTE_GROUP_SIZE) {
+        if ((size_t)(end - data) < BYTE_GROUP_DECODE_LIMIT) return NULL;
+        size_t group = i / BYTE_GROUP_SIZE;
+        int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+        data = decodeBytesGroup(data, buffer + i, bitsLog2);
+    }
+    return data;
+}
+
+// Attribute mode: blocks of vertices, each byte of the stride stored as zigzag deltas against the previous
+// vertex in byte groups
+static const char* decodeVertexBuffer(uint8_t* destination, size_t count, size_t stride, const uint8_t* buffer, size_t size) {
+    if (stride == 0 || stride > 256 || stride % 4 != 0) return "invalid vertex stride";
+    if (size < 1 + stride) return "truncated vertex data";
+    if ((buffer[0] & 0xf0) != VERTEX_HEADER || (buffer[0] & 0x0f) > 0) return "unsupported vertex codec version";
+
+    const uint8_t* data = buffer + 1;
+    const uint8_t* end = buffer + size;
+
+    uint8_t lastVertex[256];
+    memcpy(lastVertex, end - stride, stride);
+
+    size_t blockSize = (VERTEX_BLOCK_SIZE_BYTES / stride) & ~(size_t)(BYTE_GROUP_SIZE - 1);
+    if (blockSize > VERTEX_BLOCK_MAX_SIZE) blockSize = VERTEX_BLOCK_MAX_SIZE;
+
+    uint8_t deltas[VERTEX_BLOCK_MAX_SIZE];
+    for (size_t first = 0; first < count; first += blockSize) {
+        size_t blockCount = count - first < blockSize ? count - first : blockSize;
+        size_t alignedCount = (blockCount + BYTE_GROUP_SIZE - 1) & ~(size_t)(BYTE_GROUP_SIZE - 1);
+        uint8_t* block = destination + first * stride;
+
+        for (size_t k = 0; k < stride; k++) {
+            data = decodeBytes(data, end, deltas, alignedCount);
+            if (!data) return "truncated vertex data";
+
+            uint8_t previous = lastVertex[k];
+            for (size_t i = 0; i < blockCount; i++) {
+                uint8_t delta = deltas[i];
+                previous += (uint8_t)(-(delta & 1) ^ (delta >> 1));
+                block[i * stride + k] = previous;
+            }
+        }
+        memcpy(lastVertex, block + (blockCount - 1) * stride, stride);
+    }
+
+    size_t tailSize = stride < TAIL_MAX_SIZE ? TAIL_MAX_SIZE : stride;
+    if ((size_t)(end - data) != tailSize) return "malformed vertex data";
+    return NULL;
+}
+
+static uint32_t decodeVByte(const uint8_t** data) {
+    uint8_t lead = *(*data)++;
+    if (lead < 128) return lead;
+
+    uint32_t result = lead & 127;
+    uint32_t shift = 7;
+    for (int i = 0; i < 4; i++) {
+        uint8_t group = *(*data)++;
+        result |= (uint32_t)(group & 127) << shift;
+        shift += 7;
+        if (group < 128) break;
+    }
+    return result;
+}
+
+static uint32_t decodeIndex(const uint8_t** data, uint32_t last) {
+    uint32_t v = decodeVByte(data);
+    return last + ((v >> 1) ^ (uint32_t)-(int32_t)(v & 1));
+}
+
+static void writeIndex(void* destination, size_t index, size_t indexSize, uint32_t value) {
+    if (indexSize == 2) {
+        ((uint16_t*)destination)[index] = (uint16_t)value;
+    } else {
+        ((uint32_t*)destination)[index] = value;
+    }
+}
+
+static void pushVertex(uint32_t fifo[16], size_t* offset, uint32_t v, int advance) {
+    fifo[*offset] = v;
+    *offset = (*offset + advance) & 15;
+}
+
+static void pushEdge(uint32_t fifo[16][2], size_t* offset, uint32_t a, uint32_t b) {
+    fifo[*offset][0] = a;
+    fifo[*offset][1] = b;
+    *offset = (*offset + 1) & 15;
+}
+
+// Triangle mode: one code byte per triangle that reuses an edge and vertex from small FIFOs of recent ones,
+// with free indices delta coded after the codes and a 16 entry table for common vertex pairs at the end
+static const char* decodeIndexBuffer(void* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size) {
+    if (count % 3 != 0) return "triangle count is not a multiple of three";
+    if (size < 1 + count / 3 + 16) return "truncated index data";
+    if ((buffer[0] & 0xf0) != INDEX_HEADER || (buffer[0] & 0x0f) > 1) return "unsupported index codec version";
+
+    int version = buffer[0] & 0x0f;
+    int fecMax = version >= 1 ? 13 : 15;
+
+    uint32_t edgeFifo[16][2];
+    uint32_t vertexFifo[16];
+    memset(edgeFifo, 0xff, sizeof(edgeFifo));
+    memset(vertexFifo, 0xff, sizeof(vertexFifo));
+    size_t edgeOffset = 0;
+    size_t vertexOffset = 0;
+    uint32_t next = 0;
+    uint32_t last = 0;
+
+    const uint8_t* code = buffer + 1;
+    const uint8_t* data = code + count / 3;
+    const uint8_t* dataSafeEnd = buffer + size - 16;
+    const uint8_t* codeAuxTable = dataSafeEnd;
+
+    for (size_t i = 0; i < count; i += 3) {
+        // A triangle reads at most 16 bytes past data, which the table guarantees are there
+        if (data > dataSafeEnd) return "truncated index data";
+        uint8_t codeTri = *code++;
+
+        if (codeTri < 0xf0) {
+            int fe = codeTri >> 4;
+            uint32_t a = edgeFifo[(edgeOffset - 1 - fe) & 15][0];
+            uint32_t b = edgeFifo[(edgeOffset - 1 - fe) & 15][1];
+            int fec = codeTri & 15;
+            uint32_t c;
+
+            if (fec < fecMax) {
+                c = fec == 0 ? next++ : vertexFifo[(vertexOffset - 1 - fec) & 15];
+                pushVertex(vertexFifo, &vertexOffset, c, fec == 0);
+            } else {
+                // Version 1 codes 13 and 14 step the last free index by -1 and +1
+                last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(&data, last);
+                pushVertex(vertexFifo, &vertexOffset, c, 1);
+            }
+
+            writeIndex(destination, i + 0, indexSize, a);
+            writeIndex(destination, i + 1, indexSize, b);
+            writeIndex(destination, i + 2, indexSize, c);
+            pushEdge(edgeFifo, &edgeOffset, c, b);
+            pushEdge(edgeFifo, &edgeOffset, a, c);
+        } else {
+            int fea, feb, fec;
+            if (codeTri < 0xfe) {
+                uint8_t codeAux = codeAuxTable[codeTri & 15];
+                fea = 0;
+                feb = codeAux >> 4;
+                fec = codeAux & 15;
+            } else {
+                uint8_t codeAux = *data++;
+                fea = codeTri == 0xfe ? 0 : 15;
+                feb = codeAux >> 4;
+                fec = codeAux & 15;
+                if (codeAux == 0) next = 0;
+            }
+
+            uint32_t a = fea == 0 ? next++ : 0;
+            uint32_t b = feb == 0 ? next++ : vertexFifo[(vertexOffset - feb) & 15];
+            uint32_t c = fec == 0 ? next++ : vertexFifo[(vertexOffset - fec) & 15];
+
+            if (fea == 15) last = a = decodeIndex(&data, last);
+            if (feb == 15) last = b = decodeIndex(&data, last);
+            if (fec == 15) last = c = decodeIndex(&data, last);
+
+            writeIndex(destination, i + 0, indexSize, a);
+            writeIndex(destination, i + 1, indexSize, b);
+            writeIndex(destination, i + 2, indexSize, c);
+            pushVertex(vertexFifo, &vertexOffset, a, 1);
+            pushVertex(vertexFifo, &vertexOffset, b, feb == 0 || feb == 15);
+            pushVertex(vertexFifo, &vertexOffset, c, fec == 0 || fec == 15);
+            pushEdge(edgeFifo, &edgeOffset, b, a);
+            pushEdge(edgeFifo, &edgeOffset, c, b);
+            pushEdge(edgeFifo, &edgeOffset, a, c);
+        }
+    }
+
+    if (data != dataSafeEnd) return "malformed index data";
+    return NULL;
+}
+
+// Index mode: every index is a zigzag delta against one of two running baselines, chosen by its low bit
+static const char* decodeIndexSequence(void* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size) {
+    if (size < 1 + count + 4) return "truncated index data";
+    if ((buffer[0] & 0xf0) != SEQUENCE_HEADER || (buffer[0] & 0x0f) > 1) return "unsupported index codec version";
+
+    const uint8_t* data = buffer + 1;
+    const uint8_t* dataSafeEnd = buffer + size - 4;
+    uint32_t last[2] = {0, 0};
+
+    for (size_t i = 0; i < count; i++) {
+        if (data >= dataSafeEnd) return "truncated index data";
+        uint32_t v = decodeVByte(&data);
+        uint32_t baseline = v & 1;
+        v >>= 1;
+        last[baseline] += (v >> 1) ^ (uint32_t)-(int32_t)(v & 1);
+        writeIndex(destination, i, indexSize, last[baseline]);
+    }
+
+    if (data != dataSafeEnd) return "malformed index data";
+    return NULL;
+}
+
+static float roundAwayFromZero(float x) {
+    return x + (x >= 0.0f ? 0.5f : -0.5f);
+}
+
+// Octahedral unit vectors in 8 or 16 bit snorm, with z carrying the encoding's 1.0 so the result is
+// renormalized in the same scale. The fourth component passes through.
+static void decodeOctahedral(uint8_t* data, size_t count, size_t stride) {
+    float one = stride == 4 ? 127.0f : 32767.0f;
+    for (size_t i = 0; i < count; i++) {
+        float v[3];
+        for (int c = 0; c < 3; c++) {
+            v[c] = stride == 4 ? (float)((int8_t*)data)[i * 4 + c] : (float)((int16_t*)data)[i * 4 + c];
+        }
+
+        float z = v[2] - fabsf(v[0]) - fabsf(v[1]);
+        float t = z >= 0.0f ? 0.0f : z;
+        float x = v[0] + (v[0] >= 0.0f ? t : -t);
+        float y = v[1] + (v[1] >= 0.0f ? t : -t);
+        float scale = one / sqrtf(x * x + y * y + z * z);
+
+        float out[3] = {x * scale, y * scale, z * scale};
+        for (int c = 0; c < 3; c++) {
+            int value = (int)roundAwayFromZero(out[c]);
+            if (stride == 4) {
+                ((int8_t*)data)[i * 4 + c] = (int8_t)value;
+            } else {
+                ((int16_t*)data)[i * 4 + c] = (int16_t)value;
+            }
+        }
+    }
+}
+
+// Three 16 bit components of a unit quaternion with the index of the dropped largest one and its scale
+// in the fourth, which is rebuilt from the unit length
+static void decodeQuaternion(int16_t* data, size_t count) {
+    const float scale = 1.0f / sqrtf(2.0f);
+    for (size_t i = 0; i < count; i++) {
+        int16_t* q = data + i * 4;
+        float s = scale / (float)(q[3] | 3);
+
+        float x = (float)q[0] * s;
+        float y = (float)q[1] * s;
+        float z = (float)q[2] * s;
+        float ww = 1.0f - x * x - y * y - z * z;
+        float w = sqrtf(ww >= 0.0f ? ww : 0.0f);
+
+        int largest = q[3] & 3;
+        q[(largest + 1) & 3] = (int16_t)roundAwayFromZero(x * 32767.0f);
+        q[(largest + 2) & 3] = (int16_t)roundAwayFromZero(y * 32767.0f);
+        q[(largest + 3) & 3] = (int16_t)roundAwayFromZero(z * 32767.0f);
+        q[(largest + 0) & 3] = (int16_t)(w * 32767.0f + 0.5f);
+    }
+}
+
+// 24 bit mantissa and 8 bit exponent per 32 bit value, expanded to floats
+static void decodeExponential(uint32_t* data, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        int32_t mantissa = (int32_t)(data[i] << 8) >> 8;
+        int32_t exponent = (int32_t)data[i] >> 24;
+        float value = ldexpf((float)mantissa, exponent);
+        memcpy(&data[i], &value, sizeof(value));
+    }
+}
+
+static const char* decodeView(cgltf_buffer_view* view) {
+    const cgltf_meshopt_compression* compression = &view->meshopt_compression;
+    if (!compression->buffer->data) return "compressed buffer is not loaded";
+    if (compression->offset + compression->size > compression->buffer->size) return "compressed range is out of bounds";
+    if (compression->count * compression->stride != view->size) return "decoded size does not match the buffer view";
+
+    const uint8_t* source = (const uint8_t*)compression->buffer->data + compression->offset;
+    uint8_t* decoded = malloc(view->size);
+    const char* error = NULL;
+
+    switch (compression->mode) {
+    case cgltf_meshopt_compression_mode_attributes:
+        error = decodeVertexBuffer(decoded, compression->count, compression->stride, source, compression->size);
+        break;
+    case cgltf_meshopt_compression_mode_triangles:
+        if (compression->stride != 2 && compression->stride != 4) error = "invalid index stride";
+        else error = decodeIndexBuffer(decoded, compression->count, compression->stride, source, compression->size);
+        break;
+    case cgltf_meshopt_compression_mode_indices:
+        if (compression->stride != 2 && compression->stride != 4) error = "invalid index stride";
+        else error = decodeIndexSequence(decoded, compression->count, compression->stride, source, compression->size);
+        break;
+    default:
+        error = "unknown compression mode";
+        break;
+    }
+
+    if (!error) {
+        switch (compression->filter) {
+        case cgltf_meshopt_compression_filter_none:
+            break;
+        case cgltf_meshopt_compression_filter_octahedral:
+            if (compression->stride != 4 && compression->stride != 8) error = "invalid octahedral filter stride";
+            else decodeOctahedral(decoded, compression->count, compression->stride);
+            break;
+        case cgltf_meshopt_compression_filter_quaternion:
+            if (compression->stride != 8) error = "invalid quaternion filter stride";
+            else decodeQuaternion((int16_t*)decoded, compression->count);
+            break;
+        case cgltf_meshopt_compression_filter_exponential:
+            if (compression->stride % 4 != 0) error = "invalid exponential filter stride";
+            else decodeExponential((uint32_t*)decoded, compression->count * compression->stride / 4);
+            break;
+        default:
+            error = "unknown compression filter";
+            break;
+        }
+    }
+
+    if (error) {
+        free(decoded);
+        return error;
+    }
+
+    // cgltf reads the view from here from now on and frees it with the rest of the data
+    view->data = decoded;
+    return NULL;
+}
+
+static void* decodeViews(void* argument) {
+    MeshoptDecodeJob* job = (MeshoptDecodeJob*)argument;
+    for (;;) {
+        pthread_mutex_lock(&job->mutex);
+        uint32_t index = job->nextView++;
+        pthread_mutex_unlock(&job->mutex);
+        if (index >= job->viewCount) return NULL;
+
+        job->errors[index] = decodeView(job->views[index]);
+    }
+}
+
+// Decodes every EXT_meshopt_compression buffer view in place of its fallback, one view at a time per
+// worker, so accessors read them like plain views. Draco is only detected, to fail with a clear message.
+void decodeCompressedViews(cgltf_data* data, const char* filename) {
+    for (size_t m = 0; m < data->meshes_count; m++) {
+        for (size_t p = 0; p < data->meshes[m].primitives_count; p++) {
+            if (data->meshes[m].primitives[p].has_draco_mesh_compression) {
+                fprintf(stderr, "ERROR: '%s' uses KHR_draco_mesh_compression, which is not supported, re-export it with EXT_meshopt_compression\n", filename);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    MeshoptDecodeJob job = {0};
+    job.views = malloc((data->buffer_views_count + 1) * sizeof(cgltf_buffer_view*));
+    for (size_t i = 0; i < data->buffer_views_count; i++) {
+        if (data->buffer_views[i].has_meshopt_compression && !data->buffer_views[i].data) {
+            job.views[job.viewCount++] = &data->buffer_views[i];
+        }
+    }
+    if (job.viewCount == 0) {
+        free(job.views);
+        return;
+    }
+
+    job.errors = calloc(job.viewCount, sizeof(const char*));
+    pthread_mutex_init(&job.mutex, NULL);
+
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threadCount = processors > 0 ? (uint32_t)processors : 1;
+    if (threadCount > MAX_RECORD_THREADS) threadCount = MAX_RECORD_THREADS;
+    if (threadCount > job.viewCount) threadCount = job.viewCount;
+
+    pthread_t threads[MAX_RECORD_THREADS];
+    for (uint32_t i = 1; i < threadCount; i++) {
+        if (pthread_create(&threads[i], NULL, decodeViews, &job) != 0) {
+            perror("ERROR: Failed to create meshopt decode thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    decodeViews(&job);
+    for (uint32_t i = 1; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (uint32_t i = 0; i < job.viewCount; i++) {
+        if (job.errors[i]) {
+            fprintf(stderr, "ERROR: Failed to decode meshopt buffer view %zu of '%s': %s\n", (size_t)(job.views[i] - data->buffer_views), filename, job.errors[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_mutex_destroy(&job.mutex);
+    free(job.errors);
+    free(job.views);
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#pragma once
+#include "vkrt.h"
+
+#include "cgltf.h"
+
+void decodeCompressedViews(cgltf_data* data, const char* filename);
\ No newline at end of file
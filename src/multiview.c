@@ -0,0 +1,207 @@
+#include "multiview.h"
+#include "buffer.h"
+#include "command.h"
+#include "descriptor.h"
+#include "device.h"
+#include "image.h"
+#include "pipeline.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mirror of ViewCamera in main.rgen
+typedef struct ViewCamera {
+    mat4 viewInverse;
+    mat4 projInverse;
+} ViewCamera;
+
+// Evenly spaced views around the camera's target, rotated about its up axis
+void turntableCameras(const Camera* camera, uint32_t viewCount, Camera* cameras) {
+    for (uint32_t i = 0; i < viewCount; i++) {
+        cameras[i] = *camera;
+        vec3 offset;
+        glm_vec3_sub((float*)camera->pos, (float*)camera->target, offset);
+        glm_vec3_rotate(offset, 2.0f * GLM_PIf * i / viewCount, (float*)camera->up);
+        glm_vec3_add((float*)camera->target, offset, cameras[i].pos);
+    }
+}
+
+// Switches the ray tracing pipeline to the multi-view raygen, which writes layer z of a swapchain-sized
+// RGBA32F array image with the camera at index z of the view buffer.
+// Screen-space passes keep per-pixel state for a single view, so they are turned off.
+void beginMultiView(VKRT* vkrt, const Camera* cameras, uint32_t viewCount) {
+    PathSettings settings = vkrt->pathSettings;
+    settings.restir = 0;
+    settings.adaptive = 0;
+    settings.denoiser = DENOISER_OFF;
+    settings.upscaler = 0;
+    setPathSettings(vkrt, settings);
+
+    VkDeviceSize cameraBytes = viewCount * sizeof(ViewCamera);
+    createBuffer(vkrt, cameraBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vkrt->viewCameraBuffer, &vkrt->viewCameraMemory);
+
+    ViewCamera* mapped;
+    vkrt->vk.MapMemory(vkrt->device, vkrt->viewCameraMemory, 0, cameraBytes, 0, (void**)&mapped);
+    for (uint32_t i = 0; i < viewCount; i++) {
+        Camera camera = cameras[i];
+        mat4 view, proj;
+        glm_lookat(camera.pos, camera.target, camera.up, view);
+        glm_perspective(glm_rad(camera.vfov), (float)vkrt->swapChainExtent.width / vkrt->swapChainExtent.height, camera.nearZ, camera.farZ, proj);
+        glm_mat4_inv(view, mapped[i].viewInverse);
+        glm_mat4_inv(proj, mapped[i].projInverse);
+    }
+    vkrt->vk.UnmapMemory(vkrt->device, vkrt->viewCameraMemory);
+
+    createImageArray(vkrt, vkrt->swapChainExtent, viewCount, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &vkrt->viewImage);
+
+    VkImageMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = vkrt->viewImage.image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = viewCount;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, NULL, 0, NULL, 1, &barrier);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    vkrt->viewCount = viewCount;
+    vkrt->accumulatedFrames = 0;
+    updateDescriptorSet(vkrt);
+    recreateRayTracingPipeline(vkrt);
+}
+
+void endMultiView(VKRT* vkrt) {
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    vkrt->viewCount = 0;
+    destroyImage(vkrt, &vkrt->viewImage);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->viewCameraBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->viewCameraMemory, NULL);
+    vkrt->viewCameraBuffer = VK_NULL_HANDLE;
+
+    updateDescriptorSet(vkrt);
+    recreateRayTracingPipeline(vkrt);
+    invalidateTraceCommandBuffers(vkrt);
+    vkrt->accumulatedFrames = 0;
+}
+
+// Accumulates one sample into every view. Batched is a single launch with one view per launch depth,
+// otherwise each view gets its own depth-1 launch as sequential per-view rendering would.
+void traceViews(VKRT* vkrt, VkBool32 batched) {
+    VkExtent2D extent = vkrt->swapChainExtent;
+
+    vkrt->uniformBufferMapped->renderSize[0] = extent.width;
+    vkrt->uniformBufferMapped->renderSize[1] = extent.height;
+    vkrt->uniformBufferMapped->accumulatedFrames = vkrt->accumulatedFrames++;
+    vkrt->uniformBufferMapped->frameIndex = vkrt->frameIndex++;
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->rayTracingPipeline);
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->pipelineLayout, 0, 1, &vkrt->descriptorSet, 0, NULL);
+
+    TracePushConstants pushConstants = {0};
+    if (batched) {
+        vkrt->vk.CmdPushConstants(commandBuffer, vkrt->pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(pushConstants), &pushConstants);
+        vkrt->vk.CmdTraceRaysKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], extent.width, extent.height, vkrt->viewCount);
+    } else {
+        for (uint32_t view = 0; view < vkrt->viewCount; view++) {
+            pushConstants.viewIndex = view;
+            vkrt->vk.CmdPushConstants(commandBuffer, vkrt->pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(pushConstants), &pushConstants);
+            vkrt->vk.CmdTraceRaysKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], extent.width, extent.height, 1);
+        }
+    }
+    endSingleTimeCommands(vkrt, commandBuffer);
+}
+
+// Writes every layer of the view image as its own PFM, with the view index inserted before the extension
+// of path. Layers are copied back one at a time, so only one view is held on the host.
+void writeViews(VKRT* vkrt, const char* path) {
+    VkExtent2D extent = vkrt->swapChainExtent;
+    VkDeviceSize layerBytes = (VkDeviceSize)extent.width * extent.height * 4 * sizeof(float);
+
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    createBuffer(vkrt, layerBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, &readbackMemory);
+
+    float* mapped;
+    vkrt->vk.MapMemory(vkrt->device, readbackMemory, 0, layerBytes, 0, (void**)&mapped);
+    float* row = malloc((size_t)extent.width * 3 * sizeof(float));
+
+    const char* extension = strrchr(path, '.');
+    if (!extension || strchr(extension, '/')) extension = path + strlen(path);
+    int stemLength = (int)(extension - path);
+    size_t viewPathSize = strlen(path) + 16;
+    char* viewPath = malloc(viewPathSize);
+
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    for (uint32_t view = 0; view < vkrt->viewCount; view++) {
+        VkBufferImageCopy region = {0};
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.baseArrayLayer = view;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = (VkExtent3D){extent.width, extent.height, 1};
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+        vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+        vkrt->vk.CmdCopyImageToBuffer(commandBuffer, vkrt->viewImage.image, VK_IMAGE_LAYOUT_GENERAL, readbackBuffer, 1, &region);
+        endSingleTimeCommands(vkrt, commandBuffer);
+
+        snprintf(viewPath, viewPathSize, "%.*s_%u%s", stemLength, path, view, extension);
+        FILE* file = fopen(viewPath, "wb");
+        if (!file) {
+            perror("ERROR: Failed to open view output");
+            exit(EXIT_FAILURE);
+        }
+        // Negative scale marks little-endian floats, rows go bottom to top
+        fprintf(file, "PF\n%u %u\n-1.0\n", extent.width, extent.height);
+        for (uint32_t y = extent.height; y-- > 0;) {
+            for (uint32_t x = 0; x < extent.width; x++) {
+                memcpy(row + (size_t)x * 3, mapped + ((size_t)y * extent.width + x) * 4, 3 * sizeof(float));
+            }
+            if (fwrite(row, sizeof(float) * 3, extent.width, file) != extent.width) {
+                perror("ERROR: Failed to write view output");
+                exit(EXIT_FAILURE);
+            }
+        }
+        fclose(file);
+        printf("INFO: Wrote %s\n", viewPath);
+    }
+
+    free(viewPath);
+    free(row);
+    vkrt->vk.UnmapMemory(vkrt->device, readbackMemory);
+    vkrt->vk.DestroyBuffer(vkrt->device, readbackBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, readbackMemory, NULL);
+}
+
+// Renders multiViewCount turntable views around the current camera at swapchain size, offlineSamples each,
+// and writes them to multiViewPath
+void renderViews(VKRT* vkrt) {
+    uint32_t viewCount = vkrt->multiViewCount;
+    Camera* cameras = malloc(viewCount * sizeof(Camera));
+    turntableCameras(&vkrt->camera, viewCount, cameras);
+
+    beginMultiView(vkrt, cameras, viewCount);
+    free(cameras);
+
+    printf("INFO: Rendering %u views at %ux%u, %u samples\n", viewCount, vkrt->swapChainExtent.width, vkrt->swapChainExtent.height, vkrt->offlineSamples);
+    uint64_t start = getTimeNanoSeconds();
+    for (uint32_t sample = 0; sample < vkrt->offlineSamples; sample++) {
+        traceViews(vkrt, VK_TRUE);
+    }
+    printf("INFO: Traced %u views in %.1f s\n", viewCount, (double)(getTimeNanoSeconds() - start) / 1e9);
+
+    writeViews(vkrt, vkrt->multiViewPath);
+    endMultiView(vkrt);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#pragma once
+#include "vkrt.h"
+
+#define MULTIVIEW_RAYGEN_SHADER "./main_multiview.rgen.spv"
+
+void turntableCameras(const Camera* camera, uint32_t viewCount, Camera* cameras);
+void beginMultiView(VKRT* vkrt, const Camera* cameras, uint32_t viewCount);
+void endMultiView(VKRT* vkrt);
+void traceViews(VKRT* vkrt, VkBool32 batched);
+void writeViews(VKRT* vkrt, const char* path);
+void renderViews(VKRT* vkrt);
@@ -1,5 +1,9 @@
 #include "object.h"
 #include "buffer.h"
+#include "command.h"
+#include "light.h"
+#include "meshopt.h"
+#include "widebvh.h"
 
 #define CGLTF_IMPLEMENTATION
 #include "cgltf.h"
@@ -14,8 +18,142 @@
 #include <unistd.h>
 #endif
 
-void loadObject(VKRT* vkrt, const char* filename) {
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MAX_MAPPED_FILES 64
+#define MAPPED_RELEASE_INTERVAL 65536
+
+// Sizes of the files cgltf has mapped, since its release callback only passes the pointer back
+typedef struct MappedFiles {
+    void* data[MAX_MAPPED_FILES];
+    size_t size[MAX_MAPPED_FILES];
+    uint32_t count;
+} MappedFiles;
+
+// Maps the glTF and its buffers privately instead of reading them onto the heap, so accessors are read
+// in place and untouched pages never become resident
+static cgltf_result mapFile(const cgltf_memory_options* memoryOptions, const cgltf_file_options* fileOptions, const char* path, cgltf_size* size, void** data) {
+    (void)memoryOptions;
+    MappedFiles* mapped = (MappedFiles*)fileOptions->user_data;
+    if (mapped->count == MAX_MAPPED_FILES) return cgltf_result_out_of_memory;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return cgltf_result_file_not_found;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return cgltf_result_io_error;
+    }
+    size_t length = size && *size ? (size_t)*size : (size_t)fileSize.QuadPart;
+    if (length == 0 || length > (size_t)fileSize.QuadPart) {
+        CloseHandle(file);
+        return cgltf_result_io_error;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return cgltf_result_io_error;
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, length);
+    CloseHandle(mapping);
+    if (!view) return cgltf_result_io_error;
+#else
+    int file = open(path, O_RDONLY);
+    if (file < 0) return cgltf_result_file_not_found;
+
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0) {
+        close(file);
+        return cgltf_result_io_error;
+    }
+    size_t length = size && *size ? (size_t)*size : (size_t)fileStat.st_size;
+    if (length == 0 || length > (size_t)fileStat.st_size) {
+        close(file);
+        return cgltf_result_io_error;
+    }
+
+    void* view = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED) return cgltf_result_io_error;
+    // Vertices and indices are converted in file order, so read ahead and drop pages once passed
+    madvise(view, length, MADV_SEQUENTIAL);
+#endif
+
+    mapped->data[mapped->count] = view;
+    mapped->size[mapped->count] = length;
+    mapped->count++;
+
+    if (size) *size = length;
+    *data = view;
+    return cgltf_result_success;
+}
+
+static void unmapFile(const cgltf_memory_options* memoryOptions, const cgltf_file_options* fileOptions, void* data) {
+    (void)memoryOptions;
+    MappedFiles* mapped = (MappedFiles*)fileOptions->user_data;
+    for (uint32_t i = 0; i < mapped->count; i++) {
+        if (mapped->data[i] != data) continue;
+#if defined(_WIN32)
+        UnmapViewOfFile(data);
+#else
+        munmap(data, mapped->size[i]);
+#endif
+        mapped->data[i] = mapped->data[--mapped->count];
+        mapped->size[i] = mapped->size[mapped->count];
+        return;
+    }
+}
+
+// Drops the pages behind converted accessor elements from their mapping, so only a window of the file is
+// resident at a time. They are clean, so anything reading the same view again faults them back in.
+static void releaseAccessor(const MappedFiles* mapped, const cgltf_accessor* accessor, size_t first, size_t count) {
+#if defined(_WIN32)
+    (void)mapped;
+    (void)accessor;
+    (void)first;
+    (void)count;
+#else
+    if (accessor->is_sparse || !accessor->buffer_view) return;
+    const uint8_t* view = cgltf_buffer_view_data(accessor->buffer_view);
+    if (!view) return;
+    const uint8_t* begin = view + accessor->offset + first * accessor->stride;
+    const uint8_t* end = begin + count * accessor->stride;
+
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    for (uint32_t i = 0; i < mapped->count; i++) {
+        const uint8_t* data = (const uint8_t*)mapped->data[i];
+        if (begin < data || end > data + mapped->size[i]) continue;
+
+        uintptr_t first = ((uintptr_t)begin + pageSize - 1) & ~(pageSize - 1);
+        uintptr_t last = (uintptr_t)end & ~(pageSize - 1);
+        if (last > first) madvise((void*)first, last - first, MADV_DONTNEED);
+        return;
+    }
+#endif
+}
+
+// Start of a float vec3 accessor, the usual layout of positions and normals, so it can be read without
+// per-component conversion. NULL when it needs cgltf_accessor_read_float.
+static const uint8_t* accessorVec3Data(const cgltf_accessor* accessor) {
+    if (accessor->is_sparse || !accessor->buffer_view) return NULL;
+    if (accessor->component_type != cgltf_component_type_r_32f || accessor->type != cgltf_type_vec3) return NULL;
+    const uint8_t* view = cgltf_buffer_view_data(accessor->buffer_view);
+    return view ? view + accessor->offset : NULL;
+}
+
+// Reads the triangles and materials of a glTF into host arrays, without touching the device or the VKRT,
+// so it can run on the scene loader thread
+void parseObject(const char* filename, SceneData* scene) {
+    MappedFiles mapped = {0};
     cgltf_options options = {0};
+    options.file.read = mapFile;
+    options.file.release = unmapFile;
+    options.file.user_data = &mapped;
     cgltf_data* data = NULL;
 
     if (cgltf_parse_file(&options, filename, &data) != cgltf_result_success) {
@@ -27,6 +165,7 @@ void loadObject(VKRT* vkrt, const char* filename) {
         fprintf(stderr, "ERROR: Failed to load buffers for '%s'\n", filename);
         exit(EXIT_FAILURE);
     }
+    decodeCompressedViews(data, filename);
 
     size_t numVertices = 0, numIndices = 0;
     for (size_t m = 0; m < data->meshes_count; m++) {
@@ -72,22 +211,42 @@ void loadObject(VKRT* vkrt, const char* filename) {
             if (!posAcc || !normAcc)
                 continue;
 
+            uint32_t materialIndex = prim->material ? (uint32_t)cgltf_material_index(data, prim->material) : (uint32_t)data->materials_count;
+            const uint8_t* posData = accessorVec3Data(posAcc);
+            const uint8_t* normData = accessorVec3Data(normAcc);
+
             for (size_t i = 0; i < posAcc->count; i++) {
                 float pos[3], norm[3];
-                cgltf_accessor_read_float(posAcc, i, pos, 3);
-                cgltf_accessor_read_float(normAcc, i, norm, 3);
+                if (posData) {
+                    memcpy(pos, posData + i * posAcc->stride, sizeof(pos));
+                } else {
+                    cgltf_accessor_read_float(posAcc, i, pos, 3);
+                }
+                if (normData) {
+                    memcpy(norm, normData + i * normAcc->stride, sizeof(norm));
+                } else {
+                    cgltf_accessor_read_float(normAcc, i, norm, 3);
+                }
                 Vertex* V = &vertices[vertexBase + i];
                 V->position[0] = pos[0];
                 V->position[1] = pos[1];
                 V->position[2] = -pos[2];
+                V->materialIndex = materialIndex;
                 V->normal[0] = -norm[0];
                 V->normal[1] = -norm[1];
                 V->normal[2] = -norm[2];
+
+                if ((i + 1) % MAPPED_RELEASE_INTERVAL == 0) {
+                    releaseAccessor(&mapped, posAcc, i + 1 - MAPPED_RELEASE_INTERVAL, MAPPED_RELEASE_INTERVAL);
+                    releaseAccessor(&mapped, normAcc, i + 1 - MAPPED_RELEASE_INTERVAL, MAPPED_RELEASE_INTERVAL);
+                }
             }
+            releaseAccessor(&mapped, posAcc, 0, posAcc->count);
+            releaseAccessor(&mapped, normAcc, 0, normAcc->count);
 
             cgltf_accessor* idxAcc = prim->indices;
             size_t idxCount = idxAcc->count;
-            uint8_t* raw = (uint8_t*)idxAcc->buffer_view->buffer->data + idxAcc->buffer_view->offset + idxAcc->offset;
+            const uint8_t* raw = cgltf_buffer_view_data(idxAcc->buffer_view) + idxAcc->offset;
             size_t stride = idxAcc->stride;
             for (size_t i = 0; i < idxCount; i++) {
                 uint32_t idxValue;
@@ -106,39 +265,146 @@ void loadObject(VKRT* vkrt, const char* filename) {
                     exit(EXIT_FAILURE);
                 }
                 indices[indexBase + i] = idxValue + (uint32_t)vertexBase;
+
+                if ((i + 1) % MAPPED_RELEASE_INTERVAL == 0) {
+                    releaseAccessor(&mapped, idxAcc, i + 1 - MAPPED_RELEASE_INTERVAL, MAPPED_RELEASE_INTERVAL);
+                }
             }
+            releaseAccessor(&mapped, idxAcc, 0, idxCount);
 
             indexBase += idxCount;
             vertexBase += posAcc->count;
         }
     }
 
-    vkrt->vertexCount = (uint32_t)numVertices;
-    vkrt->indexCount = (uint32_t)numIndices;
-
-    vkrt->vertexBufferDeviceAddress = createBufferFromHostData(
-        vkrt,
-        vertices, numVertices * sizeof(Vertex),
-        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        &vkrt->vertexBuffer,
-        &vkrt->vertexBufferMemory);
-
-    vkrt->indexBufferDeviceAddress = createBufferFromHostData(
-        vkrt,
-        indices, numIndices * sizeof(uint32_t),
-        VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        &vkrt->indexBuffer,
-        &vkrt->indexBufferMemory);
-
-    free(vertices);
-    free(indices);
+    *scene = (SceneData){0};
+    scene->vertexCount = (uint32_t)numVertices;
+    scene->indexCount = (uint32_t)numIndices;
+
+    // One extra slot holds the default material for primitives without one
+    size_t numMaterials = data->materials_count + 1;
+    Material* materials = malloc(numMaterials * sizeof(Material));
+
+    for (size_t m = 0; m < numMaterials; m++) {
+        Material* M = &materials[m];
+        *M = (Material){.baseColor = {0.8f, 0.8f, 0.8f, 1.0f}};
+        if (m == data->materials_count)
+            continue;
+
+        cgltf_material* material = &data->materials[m];
+        if (material->has_pbr_metallic_roughness)
+            memcpy(M->baseColor, material->pbr_metallic_roughness.base_color_factor, sizeof(M->baseColor));
+
+        float strength = material->has_emissive_strength ? material->emissive_strength.emissive_strength : 1.0f;
+        for (int c = 0; c < 3; c++)
+            M->emission[c] = material->emissive_factor[c] * strength;
+
+        // No image decoder is built in, so emission is the factor alone, for shading and light sampling alike
+        if (material->emissive_texture.texture) {
+            printf("INFO: Emissive texture of material '%s' is ignored, it emits its factor uniformly\n", material->name ? material->name : "unnamed");
+        }
+    }
+
+    scene->materialCount = (uint32_t)numMaterials;
+    scene->vertices = vertices;
+    scene->indices = indices;
+    scene->materials = materials;
     cgltf_free(data);
 }
 
+// Hands the host arrays and BVH of a parsed scene over to the VKRT, which frees them in destroyObject
+void adoptObject(VKRT* vkrt, SceneData* scene) {
+    vkrt->vertices = scene->vertices;
+    vkrt->vertexCount = scene->vertexCount;
+    vkrt->indices = scene->indices;
+    vkrt->indexCount = scene->indexCount;
+    vkrt->materials = scene->materials;
+    vkrt->materialCount = scene->materialCount;
+    vkrt->sceneBVH = scene->bvh;
+    *scene = (SceneData){0};
+}
+
+// Only creates and maps objects of its own, so the loader thread can stage while the render loop runs
+void stageObject(VKRT* vkrt, const SceneData* scene, SceneStaging* staging) {
+    staging->vertexSize = scene->vertexCount * sizeof(Vertex);
+    staging->indexSize = scene->indexCount * sizeof(uint32_t);
+    staging->materialSize = scene->materialCount * sizeof(Material);
+    VkDeviceSize size = staging->vertexSize + staging->indexSize + staging->materialSize;
+    createBuffer(vkrt, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &staging->buffer, &staging->memory);
+
+    uint8_t* mapped;
+    vkrt->vk.MapMemory(vkrt->device, staging->memory, 0, size, 0, (void**)&mapped);
+    memcpy(mapped, scene->vertices, (size_t)staging->vertexSize);
+    memcpy(mapped + staging->vertexSize, scene->indices, (size_t)staging->indexSize);
+    memcpy(mapped + staging->vertexSize + staging->indexSize, scene->materials, (size_t)staging->materialSize);
+    vkrt->vk.UnmapMemory(vkrt->device, staging->memory);
+}
+
+void destroyStaging(VKRT* vkrt, SceneStaging* staging) {
+    vkrt->vk.DestroyBuffer(vkrt->device, staging->buffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, staging->memory, NULL);
+    *staging = (SceneStaging){0};
+}
+
+static VkDeviceAddress bufferAddress(VKRT* vkrt, VkBuffer buffer) {
+    VkBufferDeviceAddressInfo addressInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer};
+    return vkrt->vk.GetBufferDeviceAddressKHR(vkrt->device, &addressInfo);
+}
+
+// Copies the staged geometry of the adopted scene into device-local buffers with one submission, then
+// builds its lights
+void uploadObject(VKRT* vkrt, const SceneStaging* staging) {
+    VkBufferUsageFlags geometryUsage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    createBuffer(vkrt, staging->vertexSize, geometryUsage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->vertexBuffer, &vkrt->vertexBufferMemory);
+    createBuffer(vkrt, staging->indexSize, geometryUsage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->indexBuffer, &vkrt->indexBufferMemory);
+    createBuffer(vkrt, staging->materialSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->materialBuffer, &vkrt->materialBufferMemory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    VkBufferCopy vertexCopy = {0, 0, staging->vertexSize};
+    VkBufferCopy indexCopy = {staging->vertexSize, 0, staging->indexSize};
+    VkBufferCopy materialCopy = {staging->vertexSize + staging->indexSize, 0, staging->materialSize};
+    vkrt->vk.CmdCopyBuffer(commandBuffer, staging->buffer, vkrt->vertexBuffer, 1, &vertexCopy);
+    vkrt->vk.CmdCopyBuffer(commandBuffer, staging->buffer, vkrt->indexBuffer, 1, &indexCopy);
+    vkrt->vk.CmdCopyBuffer(commandBuffer, staging->buffer, vkrt->materialBuffer, 1, &materialCopy);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    vkrt->vertexBufferDeviceAddress = bufferAddress(vkrt, vkrt->vertexBuffer);
+    vkrt->indexBufferDeviceAddress = bufferAddress(vkrt, vkrt->indexBuffer);
+
+    createLightBuffer(vkrt, vkrt->vertices, vkrt->indices, vkrt->indexCount, vkrt->materials);
+}
+
+void destroyObjectBuffers(VKRT* vkrt) {
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->vertexBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->vertexBufferMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->indexBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->indexBufferMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->materialBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->materialBufferMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->lightBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->lightBufferMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->lightTreeBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->lightTreeBufferMemory, NULL);
+}
+
+void destroyObject(VKRT* vkrt) {
+    if (vkrt->sceneBVH) {
+        destroyWideBVH(vkrt->sceneBVH);
+        free(vkrt->sceneBVH);
+        vkrt->sceneBVH = NULL;
+    }
+    free(vkrt->vertices);
+    free(vkrt->indices);
+    free(vkrt->materials);
+    vkrt->vertices = NULL;
+    vkrt->indices = NULL;
+    vkrt->materials = NULL;
+}
+
 void createUniformBuffer(VKRT* vkrt) {
     VkDeviceSize uniformBufferSize = sizeof(SceneUniform);
     createBuffer(vkrt, uniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vkrt->uniformBuffer, &vkrt->uniformBufferMemory);
-    vkMapMemory(vkrt->device, vkrt->uniformBufferMemory, 0, uniformBufferSize, 0, (void**)&vkrt->uniformBufferMapped);
+    vkrt->vk.MapMemory(vkrt->device, vkrt->uniformBufferMemory, 0, uniformBufferSize, 0, (void**)&vkrt->uniformBufferMapped);
     memset(vkrt->uniformBufferMapped, 0, uniformBufferSize);
 }
 
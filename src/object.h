@@ -1,6 +1,12 @@
 #pragma once
 #include "vkrt.h"
 
-void loadObject(VKRT* vkrt, const char* filename);
+void parseObject(const char* filename, SceneData* scene);
+void adoptObject(VKRT* vkrt, SceneData* scene);
+void stageObject(VKRT* vkrt, const SceneData* scene, SceneStaging* staging);
+void destroyStaging(VKRT* vkrt, SceneStaging* staging);
+void uploadObject(VKRT* vkrt, const SceneStaging* staging);
+void destroyObjectBuffers(VKRT* vkrt);
+void destroyObject(VKRT* vkrt);
 void createUniformBuffer(VKRT* vkrt);
 const char* readFile(const char* filename, size_t* fileSize);
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "offline.h"
+#include "buffer.h"
+#include "command.h"
+#include "descriptor.h"
+#include "device.h"
+#include "image.h"
+#include "interface.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounds the tile image, the readback buffer and the length of a single trace dispatch
+#define OFFLINE_TILE_SIZE 512
+
+static void bindTileImage(VKRT* vkrt, VkImageView view) {
+    VkDescriptorImageInfo imageInfo = {0};
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet write = {0};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = vkrt->descriptorSet;
+    write.dstBinding = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    write.descriptorCount = 1;
+    write.pImageInfo = &imageInfo;
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, 1, &write, 0, NULL);
+}
+
+// Accumulates every sample of one tile, one submission per sample since each reads its index from the scene uniform
+static void traceTile(VKRT* vkrt, TracePushConstants pushConstants, VkExtent2D extent) {
+    for (uint32_t sample = 0; sample < vkrt->offlineSamples; sample++) {
+        vkrt->uniformBufferMapped->accumulatedFrames = sample;
+        vkrt->uniformBufferMapped->frameIndex = vkrt->frameIndex++;
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->rayTracingPipeline);
+        vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, vkrt->pipelineLayout, 0, 1, &vkrt->descriptorSet, 0, NULL);
+        vkrt->vk.CmdPushConstants(commandBuffer, vkrt->pipelineLayout, VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(pushConstants), &pushConstants);
+        vkrt->vk.CmdTraceRaysKHR(commandBuffer, &vkrt->shaderBindingTables[0], &vkrt->shaderBindingTables[1], &vkrt->shaderBindingTables[2], &vkrt->shaderBindingTables[3], extent.width, extent.height, 1);
+        endSingleTimeCommands(vkrt, commandBuffer);
+    }
+}
+
+static void readTile(VKRT* vkrt, Image* tile, VkBuffer readbackBuffer, VkExtent2D extent) {
+    VkBufferImageCopy region = {0};
+    region.bufferRowLength = OFFLINE_TILE_SIZE;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = (VkExtent3D){extent.width, extent.height, 1};
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    transitionImageLayout(vkrt, commandBuffer, tile->image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    vkrt->vk.CmdCopyImageToBuffer(commandBuffer, tile->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+    transitionImageLayout(vkrt, commandBuffer, tile->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+    endSingleTimeCommands(vkrt, commandBuffer);
+}
+
+// Renders the camera at offlineWidth x offlineHeight into offlinePath as a PFM, one tile at a time.
+// Only a tile-sized RGBA32F image lives on the device and one row of tiles on the host; PFM stores rows
+// bottom to top, so tile rows are rendered from the bottom and the file is written front to back.
+void renderOffline(VKRT* vkrt) {
+    uint32_t width = vkrt->offlineWidth;
+    uint32_t height = vkrt->offlineHeight;
+
+    // Accumulating megakernel only; screen-space passes would need full-size buffers
+    PathSettings settings = vkrt->pathSettings;
+    settings.restir = 0;
+    settings.adaptive = 0;
+    settings.denoiser = DENOISER_OFF;
+    settings.upscaler = 0;
+    setPathSettings(vkrt, settings);
+    if (vkrt->traceMode != TRACE_MODE_MEGAKERNEL) {
+        setTraceMode(vkrt, TRACE_MODE_MEGAKERNEL);
+    }
+    if (vkrt->outputPrecision != OUTPUT_PRECISION_RGBA32F) {
+        setOutputPrecision(vkrt, OUTPUT_PRECISION_RGBA32F);
+    }
+    if (vkrt->outputPrecision != OUTPUT_PRECISION_RGBA32F) {
+        fprintf(stderr, "ERROR: Offline rendering needs RGBA32F accumulation\n");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE* file = fopen(vkrt->offlinePath, "wb");
+    if (!file) {
+        perror("ERROR: Failed to open offline render output");
+        exit(EXIT_FAILURE);
+    }
+    // Negative scale marks little-endian floats
+    fprintf(file, "PF\n%u %u\n-1.0\n", width, height);
+
+    Image tile = {0};
+    createImage(vkrt, (VkExtent2D){OFFLINE_TILE_SIZE, OFFLINE_TILE_SIZE}, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &tile);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    transitionImageLayout(vkrt, commandBuffer, tile.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    VkDeviceSize tileBytes = (VkDeviceSize)OFFLINE_TILE_SIZE * OFFLINE_TILE_SIZE * 4 * sizeof(float);
+    VkBuffer readbackBuffer;
+    VkDeviceMemory readbackMemory;
+    createBuffer(vkrt, tileBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &readbackBuffer, &readbackMemory);
+
+    float* mapped;
+    vkrt->vk.MapMemory(vkrt->device, readbackMemory, 0, tileBytes, 0, (void**)&mapped);
+    float* band = malloc((size_t)width * OFFLINE_TILE_SIZE * 3 * sizeof(float));
+
+    // The whole output is one camera; tiles only change which part of it is launched
+    Camera camera = vkrt->camera;
+    vkrt->camera.width = width;
+    vkrt->camera.height = height;
+    vkrt->uniformBufferMapped->renderSize[0] = width;
+    vkrt->uniformBufferMapped->renderSize[1] = height;
+    vkrt->uniformBufferMapped->jitter[0] = 0.0f;
+    vkrt->uniformBufferMapped->jitter[1] = 0.0f;
+    updateMatricesFromCamera(vkrt);
+    bindTileImage(vkrt, tile.view);
+
+    uint32_t tilesX = (width + OFFLINE_TILE_SIZE - 1) / OFFLINE_TILE_SIZE;
+    uint32_t tilesY = (height + OFFLINE_TILE_SIZE - 1) / OFFLINE_TILE_SIZE;
+    uint32_t tileCount = tilesX * tilesY;
+    uint32_t finished = 0;
+    uint64_t start = getTimeNanoSeconds();
+
+    printf("INFO: Rendering %ux%u in %u tiles of %u, %u samples\n", width, height, tileCount, OFFLINE_TILE_SIZE, vkrt->offlineSamples);
+
+    for (uint32_t tileY = tilesY; tileY-- > 0;) {
+        uint32_t y0 = tileY * OFFLINE_TILE_SIZE;
+        uint32_t bandHeight = height - y0 < OFFLINE_TILE_SIZE ? height - y0 : OFFLINE_TILE_SIZE;
+
+        for (uint32_t tileX = 0; tileX < tilesX; tileX++) {
+            uint32_t x0 = tileX * OFFLINE_TILE_SIZE;
+            VkExtent2D extent = {width - x0 < OFFLINE_TILE_SIZE ? width - x0 : OFFLINE_TILE_SIZE, bandHeight};
+
+            TracePushConstants pushConstants = {{x0, y0}, 0};
+            traceTile(vkrt, pushConstants, extent);
+            readTile(vkrt, &tile, readbackBuffer, extent);
+
+            for (uint32_t y = 0; y < extent.height; y++) {
+                for (uint32_t x = 0; x < extent.width; x++) {
+                    const float* source = mapped + ((size_t)y * OFFLINE_TILE_SIZE + x) * 4;
+                    float* destination = band + ((size_t)y * width + x0 + x) * 3;
+                    memcpy(destination, source, 3 * sizeof(float));
+                }
+            }
+
+            finished++;
+            double elapsed = (double)(getTimeNanoSeconds() - start) / 1e9;
+            printf("INFO: Tile %u/%u (%u, %u) done, %.1f s elapsed, %.1f s remaining\n", finished, tileCount, tileX, tileY, elapsed, elapsed / finished * (tileCount - finished));
+        }
+
+        for (uint32_t y = bandHeight; y-- > 0;) {
+            if (fwrite(band + (size_t)y * width * 3, sizeof(float) * 3, width, file) != width) {
+                perror("ERROR: Failed to write offline render output");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    fclose(file);
+    printf("INFO: Wrote %s in %.1f s\n", vkrt->offlinePath, (double)(getTimeNanoSeconds() - start) / 1e9);
+
+    free(band);
+    vkrt->vk.UnmapMemory(vkrt->device, readbackMemory);
+    vkrt->vk.DestroyBuffer(vkrt->device, readbackBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, readbackMemory, NULL);
+
+    // Hand the swapchain-sized storage image and camera back to interactive rendering
+    updateDescriptorSet(vkrt);
+    destroyImage(vkrt, &tile);
+    vkrt->camera = camera;
+    updateMatricesFromCamera(vkrt);
+}
@@ -0,0 +1,4 @@
+#pragma once
+#include "vkrt.h"
+
+void renderOffline(VKRT* vkrt);
@@ -1,6 +1,11 @@
 #include "pipeline.h"
+#include "image.h"
+#include "multiview.h"
 #include "object.h"
+#include "structure.h"
+#include "upload.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -9,94 +14,159 @@ void createRayTracingPipeline(VKRT* vkrt) {
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
     pipelineLayoutInfo.pSetLayouts = &vkrt->descriptorSetLayout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
 
-    if (vkCreatePipelineLayout(vkrt->device, &pipelineLayoutInfo, NULL, &vkrt->pipelineLayout) != VK_SUCCESS) {
+    VkPushConstantRange pushConstantRange = {0};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(TracePushConstants);
+
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutInfo, NULL, &vkrt->pipelineLayout) != VK_SUCCESS) {
         perror("ERROR: Failed to create pipeline layout");
         exit(EXIT_FAILURE);
     }
 
-    size_t rayGenLen, closestHitLen, missLen;
-
-    const char* rayGenCode = readFile("./rgen.spv", &rayGenLen);
-    const char* closestHitCode = readFile("./rchit.spv", &closestHitLen);
-    const char* missCode = readFile("./rmiss.spv", &missLen);
-
-    VkShaderModule rayGenModule = createShaderModule(vkrt, rayGenCode, rayGenLen);
-    VkShaderModule closestHitModule = createShaderModule(vkrt, closestHitCode, closestHitLen);
-    VkShaderModule missModule = createShaderModule(vkrt, missCode, missLen);
-
-    VkPipelineShaderStageCreateInfo rayGenStageInfo = {0};
-    rayGenStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    rayGenStageInfo.stage = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
-    rayGenStageInfo.module = rayGenModule;
-    rayGenStageInfo.pName = "main";
-
-    VkRayTracingShaderGroupCreateInfoKHR rayGenShaderGroup = {0};
-    rayGenShaderGroup.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    rayGenShaderGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-    rayGenShaderGroup.generalShader = 0;
-    rayGenShaderGroup.closestHitShader = VK_SHADER_UNUSED_KHR;
-    rayGenShaderGroup.anyHitShader = VK_SHADER_UNUSED_KHR;
-    rayGenShaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
-
-    VkPipelineShaderStageCreateInfo missStageInfo = {0};
-    missStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    missStageInfo.stage = VK_SHADER_STAGE_MISS_BIT_KHR;
-    missStageInfo.module = missModule;
-    missStageInfo.pName = "main";
-
-    VkRayTracingShaderGroupCreateInfoKHR missShaderGroup = {0};
-    missShaderGroup.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    missShaderGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-    missShaderGroup.generalShader = 1;
-    missShaderGroup.closestHitShader = VK_SHADER_UNUSED_KHR;
-    missShaderGroup.anyHitShader = VK_SHADER_UNUSED_KHR;
-    missShaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
-
-    VkPipelineShaderStageCreateInfo closestHitStageInfo = {0};
-    closestHitStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    closestHitStageInfo.stage = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-    closestHitStageInfo.module = closestHitModule;
-    closestHitStageInfo.pName = "main";
-
-    VkRayTracingShaderGroupCreateInfoKHR closestHitShaderGroup = {0};
-    closestHitShaderGroup.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
-    closestHitShaderGroup.type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-    closestHitShaderGroup.generalShader = VK_SHADER_UNUSED_KHR;
-    closestHitShaderGroup.closestHitShader = 2;
-    closestHitShaderGroup.anyHitShader = VK_SHADER_UNUSED_KHR;
-    closestHitShaderGroup.intersectionShader = VK_SHADER_UNUSED_KHR;
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {
-        rayGenStageInfo,
-        missStageInfo,
-        closestHitStageInfo};
-
-    VkRayTracingShaderGroupCreateInfoKHR shaderGroups[] = {
-        rayGenShaderGroup,
-        missShaderGroup,
-        closestHitShaderGroup};
+    buildRayTracingPipeline(vkrt);
+}
+
+// Miss group i is selected with missIndex i in traceRayEXT
+static const char* missShaders[] = {
+    "./main.rmiss.spv",
+    "./shadow.rmiss.spv"};
+
+// Hit group i is selected with sbtRecordOffset i in traceRayEXT
+static const char* closestHitShaders[] = {
+    "./main.rchit.spv"};
+
+static VkPipelineShaderStageCreateInfo loadShaderStage(VKRT* vkrt, const char* path, VkShaderStageFlagBits stage) {
+    size_t codeLen;
+    const char* code = readFile(path, &codeLen);
+
+    VkPipelineShaderStageCreateInfo stageInfo = {0};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = stage;
+    stageInfo.module = createShaderModule(vkrt, code, codeLen);
+    stageInfo.pName = "main";
+
+    free((void*)code);
+    return stageInfo;
+}
+
+void buildRayTracingPipeline(VKRT* vkrt) {
+    VkPipelineShaderStageCreateInfo shaderStages[1 + COUNT_OF(missShaders) + COUNT_OF(closestHitShaders)];
+    VkRayTracingShaderGroupCreateInfoKHR shaderGroups[COUNT_OF(shaderStages)];
+    uint32_t stageCount = 0;
+
+    const char* rayGenShader = vkrt->viewCount ? MULTIVIEW_RAYGEN_SHADER : outputPrecisionInfos[vkrt->outputPrecision].rayGenShader;
+    shaderStages[stageCount++] = loadShaderStage(vkrt, rayGenShader, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+    for (uint32_t i = 0; i < COUNT_OF(missShaders); i++) {
+        shaderStages[stageCount++] = loadShaderStage(vkrt, missShaders[i], VK_SHADER_STAGE_MISS_BIT_KHR);
+    }
+    for (uint32_t i = 0; i < COUNT_OF(closestHitShaders); i++) {
+        shaderStages[stageCount++] = loadShaderStage(vkrt, closestHitShaders[i], VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+    }
+
+    VkSpecializationMapEntry pathSpecializationEntries[] = {
+        {0, offsetof(PathSettings, maxDepth), sizeof(uint32_t)},
+        {1, offsetof(PathSettings, rouletteDepth), sizeof(uint32_t)},
+        {2, offsetof(PathSettings, nextEventEstimation), sizeof(uint32_t)},
+        {3, offsetof(PathSettings, environmentSampling), sizeof(uint32_t)},
+        {4, offsetof(PathSettings, lightSampling), sizeof(uint32_t)},
+        {5, offsetof(PathSettings, restir), sizeof(uint32_t)},
+        {6, offsetof(PathSettings, sampler), sizeof(uint32_t)},
+        {7, offsetof(PathSettings, adaptive), sizeof(uint32_t)},
+        {8, offsetof(PathSettings, denoiser), sizeof(uint32_t)},
+        {9, offsetof(PathSettings, upscaler), sizeof(uint32_t)}};
+
+    VkSpecializationInfo pathSpecializationInfo = {0};
+    pathSpecializationInfo.mapEntryCount = COUNT_OF(pathSpecializationEntries);
+    pathSpecializationInfo.pMapEntries = pathSpecializationEntries;
+    pathSpecializationInfo.dataSize = sizeof(PathSettings);
+    pathSpecializationInfo.pData = &vkrt->pathSettings;
+    shaderStages[0].pSpecializationInfo = &pathSpecializationInfo;
+
+    // One group per stage, laid out as raygen, miss groups, hit groups to match the shader binding table
+    for (uint32_t i = 0; i < stageCount; i++) {
+        VkRayTracingShaderGroupCreateInfoKHR* group = &shaderGroups[i];
+        *group = (VkRayTracingShaderGroupCreateInfoKHR){0};
+        group->sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR;
+        group->generalShader = VK_SHADER_UNUSED_KHR;
+        group->closestHitShader = VK_SHADER_UNUSED_KHR;
+        group->anyHitShader = VK_SHADER_UNUSED_KHR;
+        group->intersectionShader = VK_SHADER_UNUSED_KHR;
+
+        if (shaderStages[i].stage == VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR) {
+            group->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+            group->closestHitShader = i;
+        } else {
+            group->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+            group->generalShader = i;
+        }
+    }
+
+    vkrt->missGroupCount = COUNT_OF(missShaders);
+    vkrt->hitGroupCount = COUNT_OF(closestHitShaders);
 
     VkRayTracingPipelineCreateInfoKHR pipelineCreateInfo = {0};
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
-    pipelineCreateInfo.stageCount = COUNT_OF(shaderStages);
+    pipelineCreateInfo.stageCount = stageCount;
     pipelineCreateInfo.pStages = shaderStages;
-    pipelineCreateInfo.groupCount = COUNT_OF(shaderGroups);
+    pipelineCreateInfo.groupCount = stageCount;
     pipelineCreateInfo.pGroups = shaderGroups;
     pipelineCreateInfo.maxPipelineRayRecursionDepth = 1;
     pipelineCreateInfo.layout = vkrt->pipelineLayout;
 
-    PFN_vkCreateRayTracingPipelinesKHR pvkCreateRayTracingPipelinesKHR = (PFN_vkCreateRayTracingPipelinesKHR)vkGetDeviceProcAddr(vkrt->device, "vkCreateRayTracingPipelinesKHR");
-
-    if (pvkCreateRayTracingPipelinesKHR(vkrt->device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &vkrt->rayTracingPipeline) != VK_SUCCESS) {
+    if (vkrt->vk.CreateRayTracingPipelinesKHR(vkrt->device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &vkrt->rayTracingPipeline) != VK_SUCCESS) {
         perror("ERROR: Failed to create ray tracing pipeline");
         exit(EXIT_FAILURE);
     }
 
-    vkDestroyShaderModule(vkrt->device, rayGenModule, NULL);
-    vkDestroyShaderModule(vkrt->device, closestHitModule, NULL);
-    vkDestroyShaderModule(vkrt->device, missModule, NULL);
+    for (uint32_t i = 0; i < stageCount; i++) {
+        vkrt->vk.DestroyShaderModule(vkrt->device, shaderStages[i].module, NULL);
+    }
+}
+
+void recreateRayTracingPipeline(VKRT* vkrt) {
+    // The previous table may still have its upload queued in the ring
+    flushUploads(vkrt);
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
+
+    vkrt->vk.DestroyPipeline(vkrt->device, vkrt->rayTracingPipeline, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->shaderBindingTableBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->shaderBindingTableMemory, NULL);
+
+    buildRayTracingPipeline(vkrt);
+    createShaderBindingTable(vkrt);
+}
+
+VkPipeline createComputePipeline(VKRT* vkrt, const char* shaderPath, VkPipelineLayout layout, const VkSpecializationInfo* specializationInfo) {
+    size_t codeLen;
+    const char* code = readFile(shaderPath, &codeLen);
+    VkShaderModule module = createShaderModule(vkrt, code, codeLen);
+    free((void*)code);
+
+    VkPipelineShaderStageCreateInfo stageInfo = {0};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    stageInfo.module = module;
+    stageInfo.pName = "main";
+    stageInfo.pSpecializationInfo = specializationInfo;
+
+    VkComputePipelineCreateInfo pipelineCreateInfo = {0};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage = stageInfo;
+    pipelineCreateInfo.layout = layout;
+
+    VkPipeline pipeline;
+    if (vkrt->vk.CreateComputePipelines(vkrt->device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &pipeline) != VK_SUCCESS) {
+        fprintf(stderr, "ERROR: Failed to create compute pipeline '%s'\n", shaderPath);
+        exit(EXIT_FAILURE);
+    }
+
+    vkrt->vk.DestroyShaderModule(vkrt->device, module, NULL);
+    return pipeline;
 }
 
 void createSyncObjects(VKRT* vkrt) {
@@ -108,9 +178,9 @@ void createSyncObjects(VKRT* vkrt) {
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
     for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-        VkResult imageAvailableSemaphoreResult = vkCreateSemaphore(vkrt->device, &semaphoreCreateInfo, NULL, &vkrt->imageAvailableSemaphores[i]);
-        VkResult renderFinishedSemaphoreResult = vkCreateSemaphore(vkrt->device, &semaphoreCreateInfo, NULL, &vkrt->renderFinishedSemaphores[i]);
-        VkResult inFlightFenceResult = vkCreateFence(vkrt->device, &fenceInfo, NULL, &vkrt->inFlightFences[i]);
+        VkResult imageAvailableSemaphoreResult = vkrt->vk.CreateSemaphore(vkrt->device, &semaphoreCreateInfo, NULL, &vkrt->imageAvailableSemaphores[i]);
+        VkResult renderFinishedSemaphoreResult = vkrt->vk.CreateSemaphore(vkrt->device, &semaphoreCreateInfo, NULL, &vkrt->renderFinishedSemaphores[i]);
+        VkResult inFlightFenceResult = vkrt->vk.CreateFence(vkrt->device, &fenceInfo, NULL, &vkrt->inFlightFences[i]);
 
         if (imageAvailableSemaphoreResult != VK_SUCCESS || renderFinishedSemaphoreResult != VK_SUCCESS || inFlightFenceResult != VK_SUCCESS) {
             perror("ERROR: Failed to create sync objects");
@@ -126,7 +196,7 @@ VkShaderModule createShaderModule(VKRT* vkrt, const char* spirv, size_t length)
     shaderModuleCreateInfo.pCode = (const uint32_t*)spirv;
 
     VkShaderModule shaderModule;
-    if (vkCreateShaderModule(vkrt->device, &shaderModuleCreateInfo, NULL, &shaderModule) != VK_SUCCESS) {
+    if (vkrt->vk.CreateShaderModule(vkrt->device, &shaderModuleCreateInfo, NULL, &shaderModule) != VK_SUCCESS) {
         perror("ERROR: Failed to create shader module");
         exit(EXIT_FAILURE);
     }
@@ -142,12 +212,12 @@ void createRenderPass(VKRT* vkrt) {
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorRef = {0};
     colorRef.attachment = 0;
-    colorRef.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    colorRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkSubpassDescription subpass = {0};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -171,7 +241,7 @@ void createRenderPass(VKRT* vkrt) {
     renderPassCreateInfo.dependencyCount = 1;
     renderPassCreateInfo.pDependencies = &dependency;
 
-    if (vkCreateRenderPass(vkrt->device, &renderPassCreateInfo, NULL, &vkrt->renderPass) != VK_SUCCESS) {
+    if (vkrt->vk.CreateRenderPass(vkrt->device, &renderPassCreateInfo, NULL, &vkrt->renderPass) != VK_SUCCESS) {
         perror("ERROR: Failed to create UI render pass");
         exit(EXIT_FAILURE);
     }
@@ -2,6 +2,9 @@
 #include "vkrt.h"
 
 void createRayTracingPipeline(VKRT* vkrt);
+void buildRayTracingPipeline(VKRT* vkrt);
+void recreateRayTracingPipeline(VKRT* vkrt);
+VkPipeline createComputePipeline(VKRT* vkrt, const char* shaderPath, VkPipelineLayout layout, const VkSpecializationInfo* specializationInfo);
 void createSyncObjects(VKRT* vkrt);
 VkShaderModule createShaderModule(VKRT* vkrt, const char* spirv, size_t length);
 void createRenderPass(VKRT* vkrt);
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "query.h"
+#include "adaptive.h"
+#include "buffer.h"
+#include "device.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char* gpuTimerNames[GPU_TIMER_COUNT] = {
+    "Trace",
+    "Generate",
+    "Extend",
+    "Shade",
+    "Connect",
+    "Initial",
+    "Temporal",
+    "Spatial",
+    "Resolve",
+    "Adaptive",
+    "History",
+    "Moments",
+    "Filter",
+    "Upscale",
+    "Present"};
+
+void createTimestampQueryPool(VKRT* vkrt) {
+    VkPhysicalDeviceProperties deviceProperties = {0};
+    vkGetPhysicalDeviceProperties(vkrt->physicalDevice, &deviceProperties);
+
+    if (!deviceProperties.limits.timestampComputeAndGraphics) {
+        printf("INFO: Device does not support timestamps, GPU timings disabled.\n");
+        vkrt->timestampQueryPool = VK_NULL_HANDLE;
+        return;
+    }
+
+    vkrt->timestampPeriod = deviceProperties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {0};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = MAX_TIMESTAMP_SLOTS * MAX_TIMESTAMPS_PER_SLOT;
+
+    if (vkrt->vk.CreateQueryPool(vkrt->device, &queryPoolCreateInfo, NULL, &vkrt->timestampQueryPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create timestamp query pool");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void resetGpuTimers(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t slot) {
+    if (vkrt->timestampQueryPool == VK_NULL_HANDLE || slot >= MAX_TIMESTAMP_SLOTS) {
+        return;
+    }
+
+    vkrt->vk.CmdResetQueryPool(commandBuffer, vkrt->timestampQueryPool, slot * MAX_TIMESTAMPS_PER_SLOT, MAX_TIMESTAMPS_PER_SLOT);
+    vkrt->timestampCounts[slot] = 0;
+}
+
+void beginGpuTimer(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t slot, GpuTimer timer) {
+    if (vkrt->timestampQueryPool == VK_NULL_HANDLE || slot >= MAX_TIMESTAMP_SLOTS) {
+        return;
+    }
+
+    uint32_t count = vkrt->timestampCounts[slot];
+    if (count + 2 > MAX_TIMESTAMPS_PER_SLOT) {
+        return;
+    }
+
+    vkrt->timestampTimers[slot][count / 2] = (uint8_t)timer;
+    vkrt->vk.CmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vkrt->timestampQueryPool, slot * MAX_TIMESTAMPS_PER_SLOT + count);
+    vkrt->timestampCounts[slot] = count + 1;
+}
+
+void endGpuTimer(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t slot) {
+    if (vkrt->timestampQueryPool == VK_NULL_HANDLE || slot >= MAX_TIMESTAMP_SLOTS) {
+        return;
+    }
+
+    uint32_t count = vkrt->timestampCounts[slot];
+    if (count % 2 == 0) {
+        return;
+    }
+
+    vkrt->vk.CmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, vkrt->timestampQueryPool, slot * MAX_TIMESTAMPS_PER_SLOT + count);
+    vkrt->timestampCounts[slot] = count + 1;
+}
+
+void collectGpuTimers(VKRT* vkrt, uint32_t slot) {
+    if (vkrt->timestampQueryPool == VK_NULL_HANDLE || slot >= MAX_TIMESTAMP_SLOTS) {
+        return;
+    }
+
+    uint32_t count = vkrt->timestampCounts[slot] & ~1u;
+    if (count == 0) {
+        return;
+    }
+
+    uint64_t timestamps[MAX_TIMESTAMPS_PER_SLOT];
+    VkResult result = vkrt->vk.GetQueryPoolResults(vkrt->device, vkrt->timestampQueryPool, slot * MAX_TIMESTAMPS_PER_SLOT, count, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+        return;
+    }
+
+    float frameTimes[GPU_TIMER_COUNT] = {0};
+    for (uint32_t i = 0; i < count; i += 2) {
+        uint64_t elapsed = timestamps[i + 1] - timestamps[i];
+        frameTimes[vkrt->timestampTimers[slot][i / 2]] += (float)((double)elapsed * vkrt->timestampPeriod * 1e-6);
+    }
+
+    const float smoothing = 0.05f;
+    for (uint32_t i = 0; i < GPU_TIMER_COUNT; i++) {
+        vkrt->gpuTimes[i] += (frameTimes[i] - vkrt->gpuTimes[i]) * smoothing;
+    }
+}
+
+// Timers before the denoiser cover path tracing work, whichever trace mode recorded them
+float traceGpuTime(VKRT* vkrt) {
+    float total = 0.0f;
+    for (uint32_t i = GPU_TIMER_TRACE; i < GPU_TIMER_HISTORY; i++) {
+        total += vkrt->gpuTimes[i];
+    }
+    return total;
+}
+
+void createPathCounterBuffer(VKRT* vkrt) {
+    VkDeviceSize pathCounterSize = sizeof(PathCounters);
+    createBuffer(vkrt, pathCounterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vkrt->pathCounterBuffer, &vkrt->pathCounterMemory);
+    vkrt->vk.MapMemory(vkrt->device, vkrt->pathCounterMemory, 0, pathCounterSize, 0, (void**)&vkrt->pathCounterMapped);
+    memset(vkrt->pathCounterMapped, 0, sizeof(PathCounters));
+}
+
+void collectPathCounters(VKRT* vkrt) {
+    uint64_t pixelCount = (uint64_t)vkrt->uniformBufferMapped->renderSize[0] * vkrt->uniformBufferMapped->renderSize[1];
+    uint32_t rays = vkrt->pathCounterMapped->rays;
+    uint32_t shadowRays = vkrt->pathCounterMapped->shadowRays;
+    float traceSeconds = traceGpuTime(vkrt) / 1000.0f;
+
+    // Adaptive sampling only traces the pixels of unconverged tiles
+    if (adaptiveSamplingActive(vkrt)) {
+        uint64_t activePixels = vkrt->pathCounterMapped->activePixels;
+        vkrt->activePixelFraction = pixelCount ? (float)activePixels / (float)pixelCount : 0.0f;
+        pixelCount = activePixels;
+    } else {
+        vkrt->activePixelFraction = 1.0f;
+    }
+
+    vkrt->averagePathLength = pixelCount ? (float)rays / (float)pixelCount : 0.0f;
+    vkrt->shadowRaysPerPixel = pixelCount ? (float)shadowRays / (float)pixelCount : 0.0f;
+    vkrt->raysPerSecond = traceSeconds > 0.0f ? (float)(rays + shadowRays) / traceSeconds : 0.0f;
+}
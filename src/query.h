@@ -0,0 +1,13 @@
+#pragma once
+#include "vkrt.h"
+
+extern const char* gpuTimerNames[GPU_TIMER_COUNT];
+
+void createTimestampQueryPool(VKRT* vkrt);
+void resetGpuTimers(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t slot);
+void beginGpuTimer(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t slot, GpuTimer timer);
+void endGpuTimer(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t slot);
+void collectGpuTimers(VKRT* vkrt, uint32_t slot);
+float traceGpuTime(VKRT* vkrt);
+void createPathCounterBuffer(VKRT* vkrt);
+void collectPathCounters(VKRT* vkrt);
@@ -0,0 +1,380 @@
+#include "raycast.h"
+#include "buffer.h"
+#include "device.h"
+#include "pipeline.h"
+#include "upload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RAYCAST_WORKGROUP_SIZE 64
+#define RAYCAST_BINDING_COUNT 3
+
+typedef struct RayCastPushConstants {
+    uint32_t rayOffset;
+    uint32_t rayCount;
+} RayCastPushConstants;
+
+static const VkDescriptorType rayCastBindingTypes[RAYCAST_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+void createRayCastPipeline(VKRT* vkrt) {
+    vkrt->rayCastSupported = vkrt->rayQuery;
+    if (!vkrt->rayCastSupported) {
+        printf("INFO: Device lacks ray queries, batch ray casts disabled.\n");
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[RAYCAST_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < RAYCAST_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = rayCastBindingTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->rayCastDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create ray cast descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPushConstantRange pushConstantRange = {0};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.size = sizeof(RayCastPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->rayCastDescriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->rayCastPipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create ray cast pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    vkrt->rayCastPipeline = createComputePipeline(vkrt, "./raycast.comp.spv", vkrt->rayCastPipelineLayout, NULL);
+}
+
+void destroyRayCastPipeline(VKRT* vkrt) {
+    if (!vkrt->rayCastSupported) {
+        return;
+    }
+
+    vkrt->vk.DestroyPipeline(vkrt->device, vkrt->rayCastPipeline, NULL);
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->rayCastPipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->rayCastDescriptorSetLayout, NULL);
+}
+
+// Allocates both submission slots: host staging for rays and hits, device copies the shader reads and writes,
+// a command buffer, a fence and a descriptor set each. Needs only the device and the TLAS, never the swapchain.
+void beginRayCasts(VKRT* vkrt) {
+    if (!vkrt->rayCastSupported) {
+        fprintf(stderr, "ERROR: Batch ray casts need ray query support\n");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDeviceSize rayBytes = (VkDeviceSize)RAYCAST_BATCH_SIZE * sizeof(CastRay);
+    VkDeviceSize hitBytes = (VkDeviceSize)RAYCAST_BATCH_SIZE * sizeof(CastHit);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, RAYCAST_SLOT_COUNT},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 * RAYCAST_SLOT_COUNT}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = RAYCAST_SLOT_COUNT;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->rayCastDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create ray cast descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetLayout layouts[RAYCAST_SLOT_COUNT];
+    VkDescriptorSet descriptorSets[RAYCAST_SLOT_COUNT];
+    VkCommandBuffer commandBuffers[RAYCAST_SLOT_COUNT];
+    for (uint32_t i = 0; i < RAYCAST_SLOT_COUNT; i++) {
+        layouts[i] = vkrt->rayCastDescriptorSetLayout;
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->rayCastDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = RAYCAST_SLOT_COUNT;
+    descriptorSetAllocateInfo.pSetLayouts = layouts;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, descriptorSets) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate ray cast descriptor sets");
+        exit(EXIT_FAILURE);
+    }
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = vkrt->commandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = RAYCAST_SLOT_COUNT;
+
+    if (vkrt->vk.AllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, commandBuffers) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate ray cast command buffers");
+        exit(EXIT_FAILURE);
+    }
+
+    VkFenceCreateInfo fenceCreateInfo = {0};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < RAYCAST_SLOT_COUNT; i++) {
+        RayCastSlot* slot = &vkrt->rayCastSlots[i];
+        *slot = (RayCastSlot){0};
+        slot->descriptorSet = descriptorSets[i];
+        slot->commandBuffer = commandBuffers[i];
+
+        if (vkrt->vk.CreateFence(vkrt->device, &fenceCreateInfo, NULL, &slot->fence) != VK_SUCCESS) {
+            perror("ERROR: Failed to create ray cast fence");
+            exit(EXIT_FAILURE);
+        }
+
+        createBuffer(vkrt, rayBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &slot->stagingRayBuffer, &slot->stagingRayMemory);
+        createBuffer(vkrt, hitBytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &slot->stagingHitBuffer, &slot->stagingHitMemory);
+        createBuffer(vkrt, rayBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &slot->rayBuffer, &slot->rayMemory);
+        createBuffer(vkrt, hitBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &slot->hitBuffer, &slot->hitMemory);
+
+        vkrt->vk.MapMemory(vkrt->device, slot->stagingRayMemory, 0, rayBytes, 0, (void**)&slot->stagingRays);
+        vkrt->vk.MapMemory(vkrt->device, slot->stagingHitMemory, 0, hitBytes, 0, (void**)&slot->stagingHits);
+    }
+
+    vkrt->rayCastSlot = 0;
+}
+
+void endRayCasts(VKRT* vkrt) {
+    finishRayCasts(vkrt);
+
+    for (uint32_t i = 0; i < RAYCAST_SLOT_COUNT; i++) {
+        RayCastSlot* slot = &vkrt->rayCastSlots[i];
+        vkrt->vk.UnmapMemory(vkrt->device, slot->stagingRayMemory);
+        vkrt->vk.UnmapMemory(vkrt->device, slot->stagingHitMemory);
+        vkrt->vk.DestroyBuffer(vkrt->device, slot->stagingRayBuffer, NULL);
+        vkrt->vk.FreeMemory(vkrt->device, slot->stagingRayMemory, NULL);
+        vkrt->vk.DestroyBuffer(vkrt->device, slot->stagingHitBuffer, NULL);
+        vkrt->vk.FreeMemory(vkrt->device, slot->stagingHitMemory, NULL);
+        vkrt->vk.DestroyBuffer(vkrt->device, slot->rayBuffer, NULL);
+        vkrt->vk.FreeMemory(vkrt->device, slot->rayMemory, NULL);
+        vkrt->vk.DestroyBuffer(vkrt->device, slot->hitBuffer, NULL);
+        vkrt->vk.FreeMemory(vkrt->device, slot->hitMemory, NULL);
+        vkrt->vk.DestroyFence(vkrt->device, slot->fence, NULL);
+        vkrt->vk.FreeCommandBuffers(vkrt->device, vkrt->commandPool, 1, &slot->commandBuffer);
+        *slot = (RayCastSlot){0};
+    }
+
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->rayCastDescriptorPool, NULL);
+    vkrt->rayCastDescriptorPool = VK_NULL_HANDLE;
+}
+
+// Waits for the slot's batch and hands host hits back to the caller
+static void retireSlot(VKRT* vkrt, RayCastSlot* slot) {
+    if (!slot->pending) {
+        return;
+    }
+
+    vkrt->vk.WaitForFences(vkrt->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+    vkrt->vk.ResetFences(vkrt->device, 1, &slot->fence);
+    if (slot->destination) {
+        memcpy(slot->destination, slot->stagingHits, (size_t)slot->count * sizeof(CastHit));
+    }
+    slot->destination = NULL;
+    slot->pending = VK_FALSE;
+}
+
+// Takes the older of the two slots, so the host fills one batch while the device traces the other
+static RayCastSlot* acquireSlot(VKRT* vkrt) {
+    RayCastSlot* slot = &vkrt->rayCastSlots[vkrt->rayCastSlot];
+    vkrt->rayCastSlot = (vkrt->rayCastSlot + 1) % RAYCAST_SLOT_COUNT;
+    retireSlot(vkrt, slot);
+    return slot;
+}
+
+// The TLAS is rewritten too, it changes whenever the scene is rebuilt
+static void bindSlotBuffers(VKRT* vkrt, RayCastSlot* slot, VkBuffer rayBuffer, VkBuffer hitBuffer) {
+    VkWriteDescriptorSetAccelerationStructureKHR accelerationStructureInfo = {0};
+    accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+    accelerationStructureInfo.accelerationStructureCount = 1;
+    accelerationStructureInfo.pAccelerationStructures = &vkrt->topLevelAccelerationStructure;
+
+    VkDescriptorBufferInfo bufferInfos[RAYCAST_BINDING_COUNT] = {0};
+    bufferInfos[1] = (VkDescriptorBufferInfo){rayBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[2] = (VkDescriptorBufferInfo){hitBuffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[RAYCAST_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < RAYCAST_BINDING_COUNT; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = slot->descriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = rayCastBindingTypes[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    writes[0].pBufferInfo = NULL;
+    writes[0].pNext = &accelerationStructureInfo;
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+}
+
+static void recordBarrier(VKRT* vkrt, VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStage, VkAccessFlags srcAccess, VkPipelineStageFlags dstStage, VkAccessFlags dstAccess) {
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// Records and submits count rays of the bound buffers. Staged batches copy rays in from and hits out to the
+// slot's host buffers around the dispatch; device batches trace the caller's buffers in place.
+static void submitSlot(VKRT* vkrt, RayCastSlot* slot, uint32_t count, VkBool32 staged) {
+    // The pool allows resetting single command buffers, so beginning again resets it
+    VkCommandBuffer commandBuffer = slot->commandBuffer;
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkrt->vk.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+
+    if (staged) {
+        VkBufferCopy rayCopy = {0, 0, (VkDeviceSize)count * sizeof(CastRay)};
+        vkrt->vk.CmdCopyBuffer(commandBuffer, slot->stagingRayBuffer, slot->rayBuffer, 1, &rayCopy);
+        recordBarrier(vkrt, commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    } else {
+        // Caller buffers may have been written by any earlier submission
+        recordBarrier(vkrt, commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+    }
+
+    vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->rayCastPipeline);
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->rayCastPipelineLayout, 0, 1, &slot->descriptorSet, 0, NULL);
+
+    // Device batches can exceed one dispatch; staged ones are always a single batch at offset zero
+    for (uint32_t first = 0; first < count; first += RAYCAST_BATCH_SIZE) {
+        RayCastPushConstants pushConstants = {first, count - first < RAYCAST_BATCH_SIZE ? count - first : RAYCAST_BATCH_SIZE};
+        vkrt->vk.CmdPushConstants(commandBuffer, vkrt->rayCastPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+        vkrt->vk.CmdDispatch(commandBuffer, (pushConstants.rayCount + RAYCAST_WORKGROUP_SIZE - 1) / RAYCAST_WORKGROUP_SIZE, 1, 1);
+    }
+
+    if (staged) {
+        VkBufferCopy hitCopy = {0, 0, (VkDeviceSize)count * sizeof(CastHit)};
+        recordBarrier(vkrt, commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        vkrt->vk.CmdCopyBuffer(commandBuffer, slot->hitBuffer, slot->stagingHitBuffer, 1, &hitCopy);
+        recordBarrier(vkrt, commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    } else {
+        recordBarrier(vkrt, commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+    }
+
+    vkrt->vk.EndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    submitUploads(vkrt);
+    if (vkrt->vk.QueueSubmit(vkrt->graphicsQueue, 1, &submitInfo, slot->fence) != VK_SUCCESS) {
+        perror("ERROR: Failed to submit ray cast batch");
+        exit(EXIT_FAILURE);
+    }
+
+    slot->count = count;
+    slot->pending = VK_TRUE;
+}
+
+// Traces count host rays into hits, streaming RAYCAST_BATCH_SIZE batches through the two slots.
+// Returns once every hit has been written.
+void castRays(VKRT* vkrt, const CastRay* rays, CastHit* hits, uint64_t count) {
+    for (uint64_t first = 0; first < count; first += RAYCAST_BATCH_SIZE) {
+        uint32_t batch = count - first < RAYCAST_BATCH_SIZE ? (uint32_t)(count - first) : RAYCAST_BATCH_SIZE;
+
+        RayCastSlot* slot = acquireSlot(vkrt);
+        memcpy(slot->stagingRays, rays + first, (size_t)batch * sizeof(CastRay));
+        bindSlotBuffers(vkrt, slot, slot->rayBuffer, slot->hitBuffer);
+        submitSlot(vkrt, slot, batch, VK_TRUE);
+        slot->destination = hits + first;
+    }
+
+    finishRayCasts(vkrt);
+}
+
+// Traces count rays already on the device. Both buffers need storage usage and the call returns right after
+// submission; the hits are ready after finishRayCasts or once two more batches have been submitted.
+void castRaysDevice(VKRT* vkrt, VkBuffer rayBuffer, VkBuffer hitBuffer, uint32_t count) {
+    RayCastSlot* slot = acquireSlot(vkrt);
+    bindSlotBuffers(vkrt, slot, rayBuffer, hitBuffer);
+    submitSlot(vkrt, slot, count, VK_FALSE);
+}
+
+void finishRayCasts(VKRT* vkrt) {
+    for (uint32_t i = 0; i < RAYCAST_SLOT_COUNT; i++) {
+        retireSlot(vkrt, &vkrt->rayCastSlots[i]);
+    }
+}
+
+// Headless query mode: reads packed CastRay records from castRayPath and writes packed CastHit records
+// to castHitPath without ever presenting a frame
+void castRayFile(VKRT* vkrt) {
+    FILE* input = fopen(vkrt->castRayPath, "rb");
+    if (!input) {
+        perror("ERROR: Failed to open ray cast input");
+        exit(EXIT_FAILURE);
+    }
+    fseek(input, 0, SEEK_END);
+    size_t length = (size_t)ftell(input);
+    fseek(input, 0, SEEK_SET);
+
+    if (length % sizeof(CastRay) != 0) {
+        fprintf(stderr, "ERROR: Ray cast input is not a whole number of %zu byte rays\n", sizeof(CastRay));
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t count = length / sizeof(CastRay);
+    CastRay* rays = malloc(length);
+    CastHit* hits = malloc(count * sizeof(CastHit));
+    if ((!rays || !hits) && count) {
+        perror("ERROR: Failed to allocate ray cast batch");
+        exit(EXIT_FAILURE);
+    }
+    if (fread(rays, sizeof(CastRay), count, input) != count) {
+        perror("ERROR: Failed to read ray cast input");
+        exit(EXIT_FAILURE);
+    }
+    fclose(input);
+
+    beginRayCasts(vkrt);
+    uint64_t start = getTimeNanoSeconds();
+    castRays(vkrt, rays, hits, count);
+    double seconds = (double)(getTimeNanoSeconds() - start) / 1e9;
+    endRayCasts(vkrt);
+
+    uint64_t hitCount = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        hitCount += hits[i].hitT >= 0.0f;
+    }
+    printf("INFO: Cast %llu rays in %.2f ms, %.1f Mrays/s, %llu hits\n", (unsigned long long)count, seconds * 1000.0, count / seconds / 1e6, (unsigned long long)hitCount);
+
+    FILE* output = fopen(vkrt->castHitPath, "wb");
+    if (!output) {
+        perror("ERROR: Failed to open ray cast output");
+        exit(EXIT_FAILURE);
+    }
+    if (fwrite(hits, sizeof(CastHit), count, output) != count) {
+        perror("ERROR: Failed to write ray cast output");
+        exit(EXIT_FAILURE);
+    }
+    fclose(output);
+
+    free(rays);
+    free(hits);
+}
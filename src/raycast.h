@@ -0,0 +1,15 @@
+#pragma once
+#include "vkrt.h"
+
+// Rays per submission, the unit of double buffering; longer requests are split into batches
+#define RAYCAST_BATCH_SIZE (1u << 18)
+#define RAYCAST_MISS 0xFFFFFFFFu
+
+void createRayCastPipeline(VKRT* vkrt);
+void destroyRayCastPipeline(VKRT* vkrt);
+void beginRayCasts(VKRT* vkrt);
+void endRayCasts(VKRT* vkrt);
+void castRays(VKRT* vkrt, const CastRay* rays, CastHit* hits, uint64_t count);
+void castRaysDevice(VKRT* vkrt, VkBuffer rayBuffer, VkBuffer hitBuffer, uint32_t count);
+void finishRayCasts(VKRT* vkrt);
+void castRayFile(VKRT* vkrt);
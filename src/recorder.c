@@ -0,0 +1,121 @@
+#include "recorder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void runRecordJob(VKRT* vkrt, RecordJob* job) {
+    VkCommandBuffer commandBuffer = job->commandBuffer;
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    if (vkrt->vk.BeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS) {
+        perror("ERROR: Failed to begin recorded command buffer");
+        exit(EXIT_FAILURE);
+    }
+
+    job->record(vkrt, commandBuffer, job->data);
+
+    if (vkrt->vk.EndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        perror("ERROR: Failed to end recorded command buffer");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Pulls jobs until the published batch is exhausted. Called with the mutex held, returns with it held.
+static void drainJobs(Recorder* recorder, uint32_t threadIndex) {
+    while (recorder->nextJob < recorder->jobCount) {
+        RecordJob* job = &recorder->jobs[recorder->nextJob++];
+
+        pthread_mutex_unlock(&recorder->mutex);
+        runRecordJob(recorder->threads[threadIndex].vkrt, job);
+        pthread_mutex_lock(&recorder->mutex);
+
+        if (++recorder->finishedJobs == recorder->jobCount) {
+            pthread_cond_broadcast(&recorder->jobsFinished);
+        }
+    }
+}
+
+static void* recordThreadMain(void* arg) {
+    RecordThread* thread = (RecordThread*)arg;
+    Recorder* recorder = &thread->vkrt->recorder;
+
+    pthread_mutex_lock(&recorder->mutex);
+    while (!recorder->shutdown) {
+        if (recorder->nextJob < recorder->jobCount) {
+            drainJobs(recorder, thread->index);
+        } else {
+            pthread_cond_wait(&recorder->jobsReady, &recorder->mutex);
+        }
+    }
+    pthread_mutex_unlock(&recorder->mutex);
+
+    return NULL;
+}
+
+void createRecorder(VKRT* vkrt) {
+    Recorder* recorder = &vkrt->recorder;
+
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    recorder->threadCount = cpuCount < 1 ? 1 : (uint32_t)cpuCount;
+    if (recorder->threadCount > MAX_RECORD_THREADS) recorder->threadCount = MAX_RECORD_THREADS;
+
+    pthread_mutex_init(&recorder->mutex, NULL);
+    pthread_cond_init(&recorder->jobsReady, NULL);
+    pthread_cond_init(&recorder->jobsFinished, NULL);
+
+    for (uint32_t i = 0; i < recorder->threadCount; i++) {
+        RecordThread* thread = &recorder->threads[i];
+        thread->vkrt = vkrt;
+        thread->index = i;
+
+        // Thread 0 is the main thread, which records alongside the workers
+        if (i > 0 && pthread_create(&thread->thread, NULL, recordThreadMain, thread) != 0) {
+            perror("ERROR: Failed to create recorder thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("INFO: Recording command buffers on %u threads\n", recorder->threadCount);
+}
+
+void destroyRecorder(VKRT* vkrt) {
+    Recorder* recorder = &vkrt->recorder;
+
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->shutdown = VK_TRUE;
+    pthread_cond_broadcast(&recorder->jobsReady);
+    pthread_mutex_unlock(&recorder->mutex);
+
+    for (uint32_t i = 1; i < recorder->threadCount; i++) {
+        pthread_join(recorder->threads[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&recorder->jobsFinished);
+    pthread_cond_destroy(&recorder->jobsReady);
+    pthread_mutex_destroy(&recorder->mutex);
+}
+
+void recordJobs(VKRT* vkrt, RecordJob* jobs, uint32_t jobCount) {
+    Recorder* recorder = &vkrt->recorder;
+    if (jobCount == 0) return;
+
+    pthread_mutex_lock(&recorder->mutex);
+    recorder->jobs = jobs;
+    recorder->jobCount = jobCount;
+    recorder->nextJob = 0;
+    recorder->finishedJobs = 0;
+    pthread_cond_broadcast(&recorder->jobsReady);
+
+    drainJobs(recorder, 0);
+    while (recorder->finishedJobs < recorder->jobCount) {
+        pthread_cond_wait(&recorder->jobsFinished, &recorder->mutex);
+    }
+
+    recorder->jobs = NULL;
+    recorder->jobCount = 0;
+    recorder->nextJob = 0;
+    pthread_mutex_unlock(&recorder->mutex);
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "vkrt.h"
+
+void createRecorder(VKRT* vkrt);
+void destroyRecorder(VKRT* vkrt);
+void recordJobs(VKRT* vkrt, RecordJob* jobs, uint32_t jobCount);
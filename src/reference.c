@@ -0,0 +1,322 @@
+#include "reference.h"
+#include "bvh.h"
+#include "device.h"
+#include "environment.h"
+#include "interface.h"
+#include "object.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define REFERENCE_TILE_SIZE 16
+#define REFERENCE_DEFAULT_PATH "reference.pfm"
+
+// Tiles [next, end) still owned by one thread; the owner takes from the front, thieves split off the back
+typedef struct TileQueue {
+    pthread_mutex_t mutex;
+    uint32_t next;
+    uint32_t end;
+} TileQueue;
+
+typedef struct ReferenceScene {
+    BVH bvh;
+    const Vertex* vertices;
+    const uint32_t* indices;
+    const Material* materials;
+    float* environment;
+    uint32_t environmentWidth;
+    uint32_t environmentHeight;
+    mat4 viewInverse;
+    mat4 projInverse;
+    uint32_t width;
+    uint32_t height;
+    uint32_t samples;
+    uint32_t maxDepth;
+    uint32_t rouletteDepth;
+    uint32_t tilesX;
+    float* image;
+    TileQueue* queues;
+    uint32_t threadCount;
+} ReferenceScene;
+
+typedef struct ReferenceThread {
+    pthread_t thread;
+    ReferenceScene* scene;
+    uint32_t index;
+    uint64_t rays;
+} ReferenceThread;
+
+// Same hash and PCG as path.glsl
+static uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float randomFloat(uint32_t* state) {
+    *state = *state * 747796405u + 2891336453u;
+    uint32_t word = ((*state >> ((*state >> 28u) + 4u)) ^ *state) * 277803737u;
+    return (float)((word >> 22u) ^ word) * (1.0f / 4294967296.0f);
+}
+
+static void sampleCosineHemisphere(vec3 normal, uint32_t* state, vec3 direction) {
+    float r = sqrtf(randomFloat(state));
+    float phi = 2.0f * (float)M_PI * randomFloat(state);
+
+    vec3 tangent, bitangent;
+    vec3 reference = {fabsf(normal[0]) > 0.9f ? 0.0f : 1.0f, fabsf(normal[0]) > 0.9f ? 1.0f : 0.0f, 0.0f};
+    glm_vec3_crossn(normal, reference, tangent);
+    glm_vec3_cross(normal, tangent, bitangent);
+
+    glm_vec3_scale(tangent, r * cosf(phi), direction);
+    glm_vec3_muladds(bitangent, r * sinf(phi), direction);
+    glm_vec3_muladds(normal, sqrtf(fmaxf(0.0f, 1.0f - r * r)), direction);
+    glm_vec3_normalize(direction);
+}
+
+// Nearest texel lookup matching environmentTexel in environment.glsl
+static void environmentRadiance(const ReferenceScene* scene, vec3 direction, vec3 radiance) {
+    float u = atan2f(direction[0], -direction[2]) * (0.5f / (float)M_PI) + 0.5f;
+    float v = acosf(glm_clamp(direction[1], -1.0f, 1.0f)) / (float)M_PI;
+    uint32_t x = (uint32_t)(u * scene->environmentWidth);
+    uint32_t y = (uint32_t)(v * scene->environmentHeight);
+    if (x >= scene->environmentWidth) x = scene->environmentWidth - 1;
+    if (y >= scene->environmentHeight) y = scene->environmentHeight - 1;
+    glm_vec3_copy(scene->environment + ((size_t)y * scene->environmentWidth + x) * 3, radiance);
+}
+
+// The megakernel's path without light sampling: emission is gathered wherever a bounce lands, which
+// converges to the same image as the GPU's weighted connections and keeps the estimator easy to trust
+static void tracePath(const ReferenceScene* scene, vec3 origin, vec3 direction, uint32_t* state, vec3 radiance, uint64_t* rays) {
+    vec3 throughput = {1.0f, 1.0f, 1.0f};
+    glm_vec3_zero(radiance);
+
+    for (uint32_t depth = 0; depth < scene->maxDepth; depth++) {
+        BVHHit hit;
+        (*rays)++;
+
+        if (!intersectBVH(&scene->bvh, origin, direction, 0.001f, 10000.0f, &hit)) {
+            vec3 environment;
+            environmentRadiance(scene, direction, environment);
+            glm_vec3_muladd(throughput, environment, radiance);
+            break;
+        }
+
+        const uint32_t* triangle = scene->indices + (size_t)hit.primitive * 3;
+        float u = hit.barycentrics[0];
+        float v = hit.barycentrics[1];
+
+        vec3 normal;
+        glm_vec3_scale((float*)scene->vertices[triangle[0]].normal, 1.0f - u - v, normal);
+        glm_vec3_muladds((float*)scene->vertices[triangle[1]].normal, u, normal);
+        glm_vec3_muladds((float*)scene->vertices[triangle[2]].normal, v, normal);
+        glm_vec3_normalize(normal);
+        if (glm_vec3_dot(normal, direction) >= 0.0f) glm_vec3_negate(normal);
+
+        const Material* material = &scene->materials[scene->vertices[triangle[0]].materialIndex];
+        glm_vec3_muladd(throughput, (float*)material->emission, radiance);
+        glm_vec3_mul(throughput, (float*)material->baseColor, throughput);
+
+        if (depth >= scene->rouletteDepth) {
+            float survival = glm_clamp(glm_vec3_max(throughput), 0.05f, 0.95f);
+            if (randomFloat(state) >= survival) break;
+            glm_vec3_divs(throughput, survival, throughput);
+        }
+
+        glm_vec3_muladds(direction, hit.t, origin);
+        glm_vec3_muladds(normal, 1e-4f, origin);
+        sampleCosineHemisphere(normal, state, direction);
+    }
+}
+
+static void renderTile(ReferenceScene* scene, uint32_t tile, uint64_t* rays) {
+    uint32_t x0 = (tile % scene->tilesX) * REFERENCE_TILE_SIZE;
+    uint32_t y0 = (tile / scene->tilesX) * REFERENCE_TILE_SIZE;
+    uint32_t x1 = x0 + REFERENCE_TILE_SIZE < scene->width ? x0 + REFERENCE_TILE_SIZE : scene->width;
+    uint32_t y1 = y0 + REFERENCE_TILE_SIZE < scene->height ? y0 + REFERENCE_TILE_SIZE : scene->height;
+
+    vec3 cameraOrigin = {scene->viewInverse[3][0], scene->viewInverse[3][1], scene->viewInverse[3][2]};
+
+    for (uint32_t y = y0; y < y1; y++) {
+        for (uint32_t x = x0; x < x1; x++) {
+            uint32_t index = y * scene->width + x;
+            uint32_t state = hash(index + 1);
+            vec3 sum = {0.0f, 0.0f, 0.0f};
+
+            for (uint32_t sample = 0; sample < scene->samples; sample++) {
+                // Camera ray exactly as in main.rgen
+                float dx = ((float)x + randomFloat(&state)) / scene->width * 2.0f - 1.0f;
+                float dy = ((float)y + randomFloat(&state)) / scene->height * 2.0f - 1.0f;
+
+                vec4 viewDirection;
+                glm_mat4_mulv(scene->projInverse, (vec4){dx, dy, 1.0f, 1.0f}, viewDirection);
+                vec3 origin, direction, radiance;
+                glm_vec3_copy(cameraOrigin, origin);
+                glm_mat4_mulv3(scene->viewInverse, viewDirection, 0.0f, direction);
+                glm_vec3_normalize(direction);
+
+                tracePath(scene, origin, direction, &state, radiance, rays);
+                glm_vec3_add(sum, radiance, sum);
+            }
+
+            glm_vec3_divs(sum, (float)scene->samples, scene->image + (size_t)index * 3);
+        }
+    }
+}
+
+// Own queue first, then half of the fullest other queue
+static VkBool32 takeTile(ReferenceScene* scene, uint32_t self, uint32_t* tile) {
+    TileQueue* own = &scene->queues[self];
+
+    pthread_mutex_lock(&own->mutex);
+    VkBool32 found = own->next < own->end;
+    if (found) *tile = own->next++;
+    pthread_mutex_unlock(&own->mutex);
+    if (found) return VK_TRUE;
+
+    for (;;) {
+        uint32_t victim = self;
+        uint32_t most = 0;
+        for (uint32_t i = 0; i < scene->threadCount; i++) {
+            if (i == self) continue;
+            pthread_mutex_lock(&scene->queues[i].mutex);
+            uint32_t remaining = scene->queues[i].end - scene->queues[i].next;
+            pthread_mutex_unlock(&scene->queues[i].mutex);
+            if (remaining > most) {
+                most = remaining;
+                victim = i;
+            }
+        }
+        if (victim == self) return VK_FALSE;
+
+        TileQueue* queue = &scene->queues[victim];
+        pthread_mutex_lock(&queue->mutex);
+        uint32_t remaining = queue->end - queue->next;
+        uint32_t stolen = (remaining + 1) / 2;
+        queue->end -= stolen;
+        uint32_t first = queue->end;
+        pthread_mutex_unlock(&queue->mutex);
+
+        // Emptied between the scan and the lock, look again
+        if (!stolen) continue;
+
+        pthread_mutex_lock(&own->mutex);
+        own->next = first + 1;
+        own->end = first + stolen;
+        pthread_mutex_unlock(&own->mutex);
+
+        *tile = first;
+        return VK_TRUE;
+    }
+}
+
+static void* referenceThreadMain(void* argument) {
+    ReferenceThread* thread = (ReferenceThread*)argument;
+    uint32_t tile;
+    while (takeTile(thread->scene, thread->index, &tile)) {
+        renderTile(thread->scene, tile, &thread->rays);
+    }
+    return NULL;
+}
+
+static void writeImage(const char* path, const float* image, uint32_t width, uint32_t height) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        perror("ERROR: Failed to open reference render output");
+        exit(EXIT_FAILURE);
+    }
+
+    // PFM stores rows bottom to top, negative scale marks little-endian floats
+    fprintf(file, "PF\n%u %u\n-1.0\n", width, height);
+    for (uint32_t y = height; y-- > 0;) {
+        if (fwrite(image + (size_t)y * width * 3, sizeof(float) * 3, width, file) != width) {
+            perror("ERROR: Failed to write reference render output");
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(file);
+}
+
+// Ground truth, and the fallback without a ray tracing GPU: traces the scene on every core and writes a PFM
+// comparable to --render's. Needs no Vulkan device, only the host scene, camera and path settings.
+void renderReference(VKRT* vkrt) {
+    const char* path = vkrt->offlinePath ? vkrt->offlinePath : REFERENCE_DEFAULT_PATH;
+
+    ReferenceScene scene = {0};
+    scene.width = vkrt->offlinePath ? vkrt->offlineWidth : WIDTH;
+    scene.height = vkrt->offlinePath ? vkrt->offlineHeight : HEIGHT;
+    scene.samples = vkrt->offlineSamples;
+    scene.maxDepth = vkrt->pathSettings.maxDepth;
+    scene.rouletteDepth = vkrt->pathSettings.rouletteDepth;
+
+    if (!vkrt->vertices) {
+        SceneData parsed;
+        parseObject(vkrt->scenePath ? vkrt->scenePath : "assets/dragon.glb", &parsed);
+        adoptObject(vkrt, &parsed);
+    }
+    scene.vertices = vkrt->vertices;
+    scene.indices = vkrt->indices;
+    scene.materials = vkrt->materials;
+    scene.environment = loadEnvironmentRadiance(vkrt, &scene.environmentWidth, &scene.environmentHeight);
+    buildBVH(&scene.bvh, vkrt->vertices, vkrt->indices, vkrt->indexCount / 3);
+
+    setupCamera(vkrt);
+    vkrt->camera.width = scene.width;
+    vkrt->camera.height = scene.height;
+    mat4 view, proj;
+    cameraMatrices(&vkrt->camera, view, proj);
+    glm_mat4_inv(view, scene.viewInverse);
+    glm_mat4_inv(proj, scene.projInverse);
+
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    scene.threadCount = processors > 0 ? (uint32_t)processors : 1;
+    scene.tilesX = (scene.width + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE;
+    uint32_t tileCount = scene.tilesX * ((scene.height + REFERENCE_TILE_SIZE - 1) / REFERENCE_TILE_SIZE);
+    scene.image = malloc((size_t)scene.width * scene.height * 3 * sizeof(float));
+    scene.queues = malloc(scene.threadCount * sizeof(TileQueue));
+    ReferenceThread* threads = calloc(scene.threadCount, sizeof(ReferenceThread));
+
+    printf("INFO: CPU reference %ux%u, %u samples, %u tiles on %u threads\n", scene.width, scene.height, scene.samples, tileCount, scene.threadCount);
+    uint64_t start = getTimeNanoSeconds();
+
+    // Contiguous tile ranges keep neighbouring tiles on one core until work runs out and gets stolen
+    for (uint32_t i = 0; i < scene.threadCount; i++) {
+        pthread_mutex_init(&scene.queues[i].mutex, NULL);
+        scene.queues[i].next = tileCount * i / scene.threadCount;
+        scene.queues[i].end = tileCount * (i + 1) / scene.threadCount;
+    }
+    for (uint32_t i = 0; i < scene.threadCount; i++) {
+        threads[i].scene = &scene;
+        threads[i].index = i;
+        if (i > 0 && pthread_create(&threads[i].thread, NULL, referenceThreadMain, &threads[i]) != 0) {
+            perror("ERROR: Failed to create reference render thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    referenceThreadMain(&threads[0]);
+    uint64_t rays = threads[0].rays;
+    for (uint32_t i = 1; i < scene.threadCount; i++) {
+        pthread_join(threads[i].thread, NULL);
+        rays += threads[i].rays;
+    }
+
+    double seconds = (double)(getTimeNanoSeconds() - start) / 1e9;
+    writeImage(path, scene.image, scene.width, scene.height);
+    printf("INFO: Wrote %s in %.1f s, %.2f Mrays/s\n", path, seconds, rays / seconds / 1e6);
+
+    for (uint32_t i = 0; i < scene.threadCount; i++) {
+        pthread_mutex_destroy(&scene.queues[i].mutex);
+    }
+    free(threads);
+    free(scene.queues);
+    free(scene.image);
+    free(scene.environment);
+    destroyBVH(&scene.bvh);
+}
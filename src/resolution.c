@@ -0,0 +1,43 @@
+#include "resolution.h"
+#include "query.h"
+#include "upscale.h"
+
+#include <math.h>
+
+#define RENDER_SCALE_MIN 0.5f
+#define RENDER_SCALE_MAX 1.0f
+#define RENDER_SCALE_STEP 0.05f
+#define RENDER_SCALE_TOLERANCE 0.1f
+// Long enough for the smoothed GPU timers to settle after the previous change
+#define RENDER_SCALE_INTERVAL 30
+
+// Trace cost scales with the pixel count, so the scale follows the square root of budget over measured time.
+// Only the top-left sub-rectangle of the storage image is traced and tone mapping upscales it, so nothing is reallocated.
+void updateRenderScale(VKRT* vkrt) {
+    float scale = vkrt->renderScale;
+
+    if (!vkrt->dynamicResolution) {
+        scale = upscaleActive(vkrt) ? UPSCALE_RENDER_SCALE : RENDER_SCALE_MAX;
+        vkrt->renderScaleFrames = 0;
+    } else if (++vkrt->renderScaleFrames >= RENDER_SCALE_INTERVAL) {
+        vkrt->renderScaleFrames = 0;
+
+        float traceTime = traceGpuTime(vkrt);
+        float ratio = traceTime > 0.0f ? vkrt->traceBudget / traceTime : 1.0f;
+        if (fabsf(ratio - 1.0f) > RENDER_SCALE_TOLERANCE) {
+            scale = roundf(scale * sqrtf(ratio) / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+            scale = fminf(fmaxf(scale, RENDER_SCALE_MIN), RENDER_SCALE_MAX);
+        }
+    }
+
+    // Every pixel maps somewhere new, so accumulation starts over
+    if (scale != vkrt->renderScale) {
+        vkrt->renderScale = scale;
+        vkrt->accumulatedFrames = 0;
+    }
+
+    uint32_t width = (uint32_t)(vkrt->swapChainExtent.width * scale + 0.5f);
+    uint32_t height = (uint32_t)(vkrt->swapChainExtent.height * scale + 0.5f);
+    vkrt->uniformBufferMapped->renderSize[0] = width > 0 ? width : 1;
+    vkrt->uniformBufferMapped->renderSize[1] = height > 0 ? height : 1;
+}
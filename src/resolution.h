@@ -0,0 +1,4 @@
+#pragma once
+#include "vkrt.h"
+
+void updateRenderScale(VKRT* vkrt);
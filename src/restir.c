@@ -0,0 +1,239 @@
+#include "restir.h"
+#include "buffer.h"
+#include "command.h"
+#include "pipeline.h"
+#include "query.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RESTIR_WORKGROUP_SIZE 64
+#define RESTIR_BINDING_COUNT 10
+
+// Mirrors of the std430 layouts in restir.comp
+typedef struct RestirSurface {
+    float position[3];
+    float hitT;
+    float normal[3];
+    uint32_t albedo;
+} RestirSurface;
+
+typedef struct RestirReservoir {
+    float point[3];
+    float weightSum;
+    uint32_t light;
+    float count;
+    float weight;
+    float padding;
+} RestirReservoir;
+
+typedef struct RestirPushConstants {
+    uint32_t accumulate;
+    uint32_t lightSampling;
+    uint32_t sampler;
+} RestirPushConstants;
+
+static const char* restirShaders[RESTIR_STAGE_COUNT] = {
+    "./restir_initial.comp.spv",
+    "./restir_temporal.comp.spv",
+    "./restir_spatial.comp.spv",
+    "./restir_resolve.comp.spv"};
+
+static const GpuTimer restirTimers[RESTIR_STAGE_COUNT] = {
+    GPU_TIMER_INITIAL,
+    GPU_TIMER_TEMPORAL,
+    GPU_TIMER_SPATIAL,
+    GPU_TIMER_RESOLVE};
+
+static const VkDescriptorType restirBindingTypes[RESTIR_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+void createRestirPipeline(VKRT* vkrt) {
+    // Visibility is traced with ray queries and resolve writes the storage image without a format qualifier
+    vkrt->restirSupported = vkrt->rayQuery && vkrt->storageWriteWithoutFormat;
+    if (!vkrt->restirSupported) {
+        printf("INFO: Device lacks ray queries or formatless storage writes, ReSTIR disabled.\n");
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[RESTIR_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < RESTIR_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = restirBindingTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->restirDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create ReSTIR descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPushConstantRange pushConstantRange = {0};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(RestirPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->restirDescriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->restirPipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create ReSTIR pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < RESTIR_STAGE_COUNT; i++) {
+        vkrt->restirPipelines[i] = createComputePipeline(vkrt, restirShaders[i], vkrt->restirPipelineLayout, NULL);
+    }
+}
+
+void destroyRestirPipeline(VKRT* vkrt) {
+    if (!vkrt->restirSupported) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < RESTIR_STAGE_COUNT; i++) {
+        vkrt->vk.DestroyPipeline(vkrt->device, vkrt->restirPipelines[i], NULL);
+    }
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->restirPipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->restirDescriptorSetLayout, NULL);
+}
+
+void createRestirResources(VKRT* vkrt) {
+    VkDeviceSize capacity = (VkDeviceSize)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+
+    createBuffer(vkrt, 2 * capacity * sizeof(RestirSurface), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->restirSurfaceBuffer, &vkrt->restirSurfaceMemory);
+    createBuffer(vkrt, 3 * capacity * sizeof(RestirReservoir), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->restirReservoirBuffer, &vkrt->restirReservoirMemory);
+    createBuffer(vkrt, 2 * capacity * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->restirRadianceBuffer, &vkrt->restirRadianceMemory);
+
+    // Zeroed surfaces and reservoirs read as invalid history for the first temporal pass
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->restirSurfaceBuffer, 0, VK_WHOLE_SIZE, 0);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->restirReservoirBuffer, 0, VK_WHOLE_SIZE, 0);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 7}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = 1;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->restirDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create ReSTIR descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->restirDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = &vkrt->restirDescriptorSetLayout;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->restirDescriptorSet) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate ReSTIR descriptor set");
+        exit(EXIT_FAILURE);
+    }
+
+    VkWriteDescriptorSetAccelerationStructureKHR accelerationStructureInfo = {0};
+    accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+    accelerationStructureInfo.accelerationStructureCount = 1;
+    accelerationStructureInfo.pAccelerationStructures = &vkrt->topLevelAccelerationStructure;
+
+    VkDescriptorImageInfo outputImageInfo = {0};
+    outputImageInfo.imageView = vkrt->storageImageView;
+    outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorBufferInfo bufferInfos[RESTIR_BINDING_COUNT] = {0};
+    bufferInfos[2] = (VkDescriptorBufferInfo){vkrt->uniformBuffer, 0, sizeof(SceneUniform)};
+    bufferInfos[3] = (VkDescriptorBufferInfo){vkrt->pathCounterBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = (VkDescriptorBufferInfo){vkrt->lightBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[5] = (VkDescriptorBufferInfo){vkrt->lightTreeBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[6] = (VkDescriptorBufferInfo){vkrt->restirSurfaceBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[7] = (VkDescriptorBufferInfo){vkrt->restirReservoirBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[8] = (VkDescriptorBufferInfo){vkrt->restirRadianceBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[9] = (VkDescriptorBufferInfo){vkrt->samplerBuffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[RESTIR_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < RESTIR_BINDING_COUNT; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = vkrt->restirDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = restirBindingTypes[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    writes[0].pNext = &accelerationStructureInfo;
+    writes[0].pBufferInfo = NULL;
+    writes[1].pImageInfo = &outputImageInfo;
+    writes[1].pBufferInfo = NULL;
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+}
+
+void destroyRestirResources(VKRT* vkrt) {
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->restirDescriptorPool, NULL);
+    vkrt->restirDescriptorPool = VK_NULL_HANDLE;
+
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->restirSurfaceBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->restirSurfaceMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->restirReservoirBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->restirReservoirMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->restirRadianceBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->restirRadianceMemory, NULL);
+
+    // The ray tracing descriptor set falls back to placeholders for these
+    vkrt->restirSurfaceBuffer = VK_NULL_HANDLE;
+    vkrt->restirRadianceBuffer = VK_NULL_HANDLE;
+}
+
+void recordRestir(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot) {
+    uint32_t pixelGroups = (vkrt->swapChainExtent.width * vkrt->swapChainExtent.height + RESTIR_WORKGROUP_SIZE - 1) / RESTIR_WORKGROUP_SIZE;
+
+    RestirPushConstants pushConstants = {0};
+    pushConstants.accumulate = vkrt->outputPrecision == OUTPUT_PRECISION_RGBA32F;
+    pushConstants.lightSampling = vkrt->pathSettings.lightSampling;
+    pushConstants.sampler = vkrt->pathSettings.sampler;
+
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->restirPipelineLayout, 0, 1, &vkrt->restirDescriptorSet, 0, NULL);
+    vkrt->vk.CmdPushConstants(commandBuffer, vkrt->restirPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+    for (uint32_t stage = 0; stage < RESTIR_STAGE_COUNT; stage++) {
+        beginGpuTimer(vkrt, commandBuffer, timerSlot, restirTimers[stage]);
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->restirPipelines[stage]);
+        vkrt->vk.CmdDispatch(commandBuffer, pixelGroups, 1, 1);
+        endGpuTimer(vkrt, commandBuffer, timerSlot);
+
+        // The last barrier also keeps the next frame's raygen from overwriting buffers still being resolved
+        vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+}
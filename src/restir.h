@@ -0,0 +1,8 @@
+#pragma once
+#include "vkrt.h"
+
+void createRestirPipeline(VKRT* vkrt);
+void createRestirResources(VKRT* vkrt);
+void destroyRestirResources(VKRT* vkrt);
+void destroyRestirPipeline(VKRT* vkrt);
+void recordRestir(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot);
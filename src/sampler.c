@@ -0,0 +1,241 @@
+#include "sampler.h"
+#include "buffer.h"
+#include "device.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLUE_NOISE_PIXELS (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE)
+#define BLUE_NOISE_SIGMA 1.5f
+#define BLUE_NOISE_INITIAL_DENSITY 10
+#define SAMPLER_CACHE_MAGIC 0x52504d53u
+#define SAMPLER_CACHE_VERSION 1
+
+// Uploaded as-is, see SamplerBuffer in sampler.glsl
+typedef struct SamplerTables {
+    uint32_t sobolDirections[SOBOL_DIMENSIONS * SOBOL_BITS];
+    float blueNoise[BLUE_NOISE_LAYERS * BLUE_NOISE_PIXELS];
+} SamplerTables;
+
+typedef struct SamplerCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t layers;
+} SamplerCacheHeader;
+
+typedef struct BlueNoiseThread {
+    pthread_t thread;
+    const float* kernel;
+    float* values;
+    uint32_t seed;
+} BlueNoiseThread;
+
+// Joe-Kuo primitive polynomials (degree s, coefficients a) and initial direction numbers m for dimensions 2-4
+static const uint32_t sobolDegrees[SOBOL_DIMENSIONS] = {0, 1, 2, 3};
+static const uint32_t sobolCoefficients[SOBOL_DIMENSIONS] = {0, 0, 1, 1};
+static const uint32_t sobolInitial[SOBOL_DIMENSIONS][3] = {{0}, {1}, {1, 3}, {1, 3, 1}};
+
+static void computeSobolDirections(uint32_t* directions) {
+    for (uint32_t i = 0; i < SOBOL_BITS; i++) {
+        directions[i] = 1u << (31 - i);
+    }
+
+    for (uint32_t dimension = 1; dimension < SOBOL_DIMENSIONS; dimension++) {
+        uint32_t* v = directions + dimension * SOBOL_BITS;
+        uint32_t s = sobolDegrees[dimension];
+        uint32_t a = sobolCoefficients[dimension];
+
+        for (uint32_t i = 0; i < s; i++) {
+            v[i] = sobolInitial[dimension][i] << (31 - i);
+        }
+        for (uint32_t i = s; i < SOBOL_BITS; i++) {
+            v[i] = v[i - s] ^ (v[i - s] >> s);
+            for (uint32_t k = 1; k < s; k++) {
+                if ((a >> (s - 1 - k)) & 1) v[i] ^= v[i - k];
+            }
+        }
+    }
+}
+
+static uint32_t xorshift(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void splatEnergy(float* energy, const float* kernel, uint32_t pixel, float sign) {
+    uint32_t px = pixel % BLUE_NOISE_SIZE;
+    uint32_t py = pixel / BLUE_NOISE_SIZE;
+    for (uint32_t y = 0; y < BLUE_NOISE_SIZE; y++) {
+        const float* row = kernel + ((y - py) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE;
+        for (uint32_t x = 0; x < BLUE_NOISE_SIZE; x++) {
+            energy[y * BLUE_NOISE_SIZE + x] += sign * row[(x - px) & (BLUE_NOISE_SIZE - 1)];
+        }
+    }
+}
+
+// Highest energy among set pixels (tightest cluster) or lowest among empty ones (largest void)
+static uint32_t findExtreme(const float* energy, const uint8_t* pattern, uint8_t set) {
+    uint32_t best = 0;
+    float bestEnergy = set ? -INFINITY : INFINITY;
+    for (uint32_t i = 0; i < BLUE_NOISE_PIXELS; i++) {
+        if (pattern[i] != set) continue;
+        if (set ? energy[i] > bestEnergy : energy[i] < bestEnergy) {
+            bestEnergy = energy[i];
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Ulichney's void-and-cluster method on a torus, so the result tiles seamlessly
+static void* generateBlueNoise(void* argument) {
+    BlueNoiseThread* job = (BlueNoiseThread*)argument;
+    uint8_t* pattern = calloc(BLUE_NOISE_PIXELS, 1);
+    uint8_t* initial = malloc(BLUE_NOISE_PIXELS);
+    float* energy = calloc(BLUE_NOISE_PIXELS, sizeof(float));
+    float* initialEnergy = malloc(BLUE_NOISE_PIXELS * sizeof(float));
+    uint32_t* ranks = malloc(BLUE_NOISE_PIXELS * sizeof(uint32_t));
+
+    uint32_t seed = job->seed;
+    uint32_t pointCount = 0;
+    while (pointCount < BLUE_NOISE_PIXELS / BLUE_NOISE_INITIAL_DENSITY) {
+        uint32_t pixel = xorshift(&seed) % BLUE_NOISE_PIXELS;
+        if (pattern[pixel]) continue;
+        pattern[pixel] = 1;
+        splatEnergy(energy, job->kernel, pixel, 1.0f);
+        pointCount++;
+    }
+
+    // Move points from the tightest cluster into the largest void until the pattern is stable
+    for (;;) {
+        uint32_t cluster = findExtreme(energy, pattern, 1);
+        pattern[cluster] = 0;
+        splatEnergy(energy, job->kernel, cluster, -1.0f);
+
+        uint32_t hole = findExtreme(energy, pattern, 0);
+        pattern[hole] = 1;
+        splatEnergy(energy, job->kernel, hole, 1.0f);
+        if (hole == cluster) break;
+    }
+    memcpy(initial, pattern, BLUE_NOISE_PIXELS);
+    memcpy(initialEnergy, energy, BLUE_NOISE_PIXELS * sizeof(float));
+
+    // Rank the initial points by removing clusters, then fill the remaining voids in order
+    for (uint32_t rank = pointCount; rank > 0; rank--) {
+        uint32_t cluster = findExtreme(energy, pattern, 1);
+        pattern[cluster] = 0;
+        splatEnergy(energy, job->kernel, cluster, -1.0f);
+        ranks[cluster] = rank - 1;
+    }
+
+    memcpy(pattern, initial, BLUE_NOISE_PIXELS);
+    memcpy(energy, initialEnergy, BLUE_NOISE_PIXELS * sizeof(float));
+    for (uint32_t rank = pointCount; rank < BLUE_NOISE_PIXELS; rank++) {
+        uint32_t hole = findExtreme(energy, pattern, 0);
+        pattern[hole] = 1;
+        splatEnergy(energy, job->kernel, hole, 1.0f);
+        ranks[hole] = rank;
+    }
+
+    for (uint32_t i = 0; i < BLUE_NOISE_PIXELS; i++) {
+        job->values[i] = ((float)ranks[i] + 0.5f) / (float)BLUE_NOISE_PIXELS;
+    }
+
+    free(pattern);
+    free(initial);
+    free(energy);
+    free(initialEnergy);
+    free(ranks);
+    return NULL;
+}
+
+static void computeBlueNoise(float* blueNoise) {
+    float* kernel = malloc(BLUE_NOISE_PIXELS * sizeof(float));
+    for (uint32_t y = 0; y < BLUE_NOISE_SIZE; y++) {
+        for (uint32_t x = 0; x < BLUE_NOISE_SIZE; x++) {
+            float dx = (float)(x < BLUE_NOISE_SIZE / 2 ? x : BLUE_NOISE_SIZE - x);
+            float dy = (float)(y < BLUE_NOISE_SIZE / 2 ? y : BLUE_NOISE_SIZE - y);
+            kernel[y * BLUE_NOISE_SIZE + x] = expf(-(dx * dx + dy * dy) / (2.0f * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+        }
+    }
+
+    // Layers are independent patterns, one thread each
+    BlueNoiseThread threads[BLUE_NOISE_LAYERS];
+    for (uint32_t i = 0; i < BLUE_NOISE_LAYERS; i++) {
+        threads[i] = (BlueNoiseThread){.kernel = kernel, .values = blueNoise + i * BLUE_NOISE_PIXELS, .seed = 0x9e3779b9u * (i + 1)};
+        if (i > 0 && pthread_create(&threads[i].thread, NULL, generateBlueNoise, &threads[i]) != 0) {
+            perror("ERROR: Failed to create blue noise thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    generateBlueNoise(&threads[0]);
+    for (uint32_t i = 1; i < BLUE_NOISE_LAYERS; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    free(kernel);
+}
+
+static int loadSamplerCache(SamplerTables* tables) {
+    FILE* file = fopen(SAMPLER_CACHE_PATH, "rb");
+    if (!file) return 0;
+
+    SamplerCacheHeader header;
+    int valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                header.magic == SAMPLER_CACHE_MAGIC &&
+                header.version == SAMPLER_CACHE_VERSION &&
+                header.size == BLUE_NOISE_SIZE &&
+                header.layers == BLUE_NOISE_LAYERS &&
+                fread(tables, sizeof(*tables), 1, file) == 1;
+
+    fclose(file);
+    return valid;
+}
+
+static void saveSamplerCache(const SamplerTables* tables) {
+    FILE* file = fopen(SAMPLER_CACHE_PATH, "wb");
+    if (!file) {
+        printf("INFO: Could not write sampler cache '%s'\n", SAMPLER_CACHE_PATH);
+        return;
+    }
+
+    SamplerCacheHeader header = {SAMPLER_CACHE_MAGIC, SAMPLER_CACHE_VERSION, BLUE_NOISE_SIZE, BLUE_NOISE_LAYERS};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(tables, sizeof(*tables), 1, file);
+    fclose(file);
+}
+
+void createSamplerBuffer(VKRT* vkrt) {
+    SamplerTables* tables = malloc(sizeof(SamplerTables));
+
+    if (loadSamplerCache(tables)) {
+        printf("INFO: Sampler tables loaded from '%s'\n", SAMPLER_CACHE_PATH);
+    } else {
+        uint64_t start = getTimeNanoSeconds();
+        computeSobolDirections(tables->sobolDirections);
+        computeBlueNoise(tables->blueNoise);
+        printf("INFO: Sampler tables (%u blue noise layers of %ux%u) built in %.2f ms\n", BLUE_NOISE_LAYERS, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, (double)(getTimeNanoSeconds() - start) / 1e6);
+        saveSamplerCache(tables);
+    }
+
+    createBufferFromHostData(
+        vkrt,
+        tables, sizeof(SamplerTables),
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        &vkrt->samplerBuffer,
+        &vkrt->samplerBufferMemory);
+
+    free(tables);
+}
+
+void destroySamplerBuffer(VKRT* vkrt) {
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->samplerBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->samplerBufferMemory, NULL);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "vkrt.h"
+
+// Must match sampler.glsl
+#define SOBOL_DIMENSIONS 4
+#define SOBOL_BITS 32
+#define BLUE_NOISE_SIZE 64
+#define BLUE_NOISE_LAYERS 8
+
+#define SAMPLER_CACHE_PATH "sampler.cache"
+
+void createSamplerBuffer(VKRT* vkrt);
+void destroySamplerBuffer(VKRT* vkrt);
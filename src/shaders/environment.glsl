@@ -0,0 +1,77 @@
+// Equirectangular environment lighting with a 2D alias table (marginal rows, conditional columns).
+// Include after scene.glsl and path.glsl; define ENVIRONMENT_BINDING before including.
+
+#define ENVIRONMENT_SAMPLING_UNIFORM 0
+#define ENVIRONMENT_SAMPLING_IMPORTANCE 1
+
+struct EnvironmentEntry {
+    vec3 radiance;
+    float probability;
+    float threshold;
+    uint alias;
+    uint padding0;
+    uint padding1;
+};
+
+// Texels in row-major order, then one marginal entry per row
+layout(binding = ENVIRONMENT_BINDING, set = 0, std430) readonly buffer EnvironmentBuffer {
+    EnvironmentEntry entries[];
+} environmentBuffer;
+
+uint environmentTexel(vec3 direction) {
+    uvec2 size = uvec2(scene.environmentWidth, scene.environmentHeight);
+    vec2 uv = vec2(atan(direction.x, -direction.z) * (0.5 / PI) + 0.5, acos(clamp(direction.y, -1.0, 1.0)) / PI);
+    uvec2 texel = min(uvec2(uv * vec2(size)), size - 1);
+    return texel.y * size.x + texel.x;
+}
+
+vec3 environmentRadiance(vec3 direction) {
+    return environmentBuffer.entries[environmentTexel(direction)].radiance;
+}
+
+// Converts a texel's discrete probability to a solid angle density
+float environmentTexelPdf(float probability, float sinTheta) {
+    float texelCount = float(scene.environmentWidth * scene.environmentHeight);
+    return sinTheta > 0.0 ? probability * texelCount / (2.0 * PI * PI * sinTheta) : 0.0;
+}
+
+float environmentPdf(vec3 direction, uint sampling) {
+    if (sampling == ENVIRONMENT_SAMPLING_UNIFORM) return 1.0 / (4.0 * PI);
+
+    float sinTheta = sqrt(max(0.0, 1.0 - direction.y * direction.y));
+    return environmentTexelPdf(environmentBuffer.entries[environmentTexel(direction)].probability, sinTheta);
+}
+
+// O(1) draw from `count` alias entries starting at `base`
+uint sampleAlias(uint base, uint count, float u) {
+    float scaled = u * float(count);
+    uint index = min(uint(scaled), count - 1);
+    EnvironmentEntry entry = environmentBuffer.entries[base + index];
+    return scaled - float(index) < entry.threshold ? index : entry.alias;
+}
+
+vec3 sampleEnvironment(uint sampling, inout uint state, out vec3 direction, out float pdf) {
+    if (sampling == ENVIRONMENT_SAMPLING_UNIFORM) {
+        float z = 1.0 - 2.0 * random(state);
+        float r = sqrt(max(0.0, 1.0 - z * z));
+        float phi = 2.0 * PI * random(state);
+        direction = vec3(r * cos(phi), z, r * sin(phi));
+        pdf = 1.0 / (4.0 * PI);
+        return environmentRadiance(direction);
+    }
+
+    uint width = scene.environmentWidth;
+    uint height = scene.environmentHeight;
+    uint row = sampleAlias(width * height, height, random(state));
+    uint column = sampleAlias(row * width, width, random(state));
+
+    vec2 uv = (vec2(column, row) + vec2(random(state), random(state))) / vec2(width, height);
+    float phi = (uv.x - 0.5) * 2.0 * PI;
+    float theta = uv.y * PI;
+    float sinTheta = sin(theta);
+    direction = vec3(sinTheta * sin(phi), cos(theta), -sinTheta * cos(phi));
+
+    EnvironmentEntry texel = environmentBuffer.entries[row * width + column];
+    pdf = environmentTexelPdf(texel.probability, sinTheta);
+    return texel.radiance;
+}
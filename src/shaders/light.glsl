@@ -0,0 +1,196 @@
+// Emissive triangle sampling for next event estimation.
+// Include after scene.glsl and path.glsl; define LIGHT_BINDING and LIGHT_TREE_BINDING before including.
+
+#define LIGHT_SAMPLING_UNIFORM 0
+#define LIGHT_SAMPLING_POWER 1
+#define LIGHT_SAMPLING_TREE 2
+
+#define LIGHT_LEAF_BIT 0x80000000u
+
+struct Light {
+    vec3 v0;
+    float cdf;
+    vec3 v1;
+    float pdf;
+    vec3 v2;
+    float area;
+    vec4 emission;
+};
+
+layout(binding = LIGHT_BINDING, set = 0, std430) readonly buffer LightBuffer {
+    Light lights[];
+} lightBuffer;
+
+// Depth-first light tree, see LightNode in vkrt.h
+struct LightNode {
+    vec3 boundsMin;
+    float power;
+    vec3 boundsMax;
+    float cosTheta;
+    vec3 axis;
+    uint child;
+};
+
+layout(binding = LIGHT_TREE_BINDING, set = 0, std430) readonly buffer LightTreeBuffer {
+    LightNode nodes[];
+} lightTree;
+
+struct LightSample {
+    vec3 direction;
+    float distance;
+    // Incident radiance times the surface cosine, divided by the solid angle pdf
+    vec3 radiance;
+};
+
+uint selectLight(float u) {
+    uint low = 0;
+    uint high = scene.lightCount - 1;
+    while (low < high) {
+        uint middle = (low + high) / 2;
+        if (u < lightBuffer.lights[middle].cdf) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return low;
+}
+
+// cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of a and b
+float cosSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) return 1.0;
+    return cosA * cosB + sinA * sinB;
+}
+
+float sinSubClamped(float sinA, float cosA, float sinB, float cosB) {
+    if (cosA > cosB) return 0.0;
+    return sinA * cosB - cosA * sinB;
+}
+
+// Upper bound on the power a node can deliver toward a receiver, from its bounding sphere and normal cone
+float lightNodeImportance(LightNode node, vec3 position, vec3 normal) {
+    vec3 center = 0.5 * (node.boundsMin + node.boundsMax);
+    vec3 diagonal = node.boundsMax - node.boundsMin;
+    float radiusSquared = 0.25 * dot(diagonal, diagonal);
+
+    vec3 toReceiver = position - center;
+    float distanceSquared = dot(toReceiver, toReceiver);
+    vec3 wi = distanceSquared > 0.0 ? toReceiver * inversesqrt(distanceSquared) : normal;
+
+    // Angle the bounding sphere subtends at the receiver, the whole sphere from inside it
+    float cosBounds = distanceSquared > radiusSquared ? sqrt(1.0 - radiusSquared / distanceSquared) : -1.0;
+    float sinBounds = sqrt(max(0.0, 1.0 - cosBounds * cosBounds));
+
+    // Emitters are two-sided, so the receiver may sit on either side of the cone
+    float cosW = abs(dot(node.axis, wi));
+    float sinW = sqrt(max(0.0, 1.0 - cosW * cosW));
+    float sinO = sqrt(max(0.0, 1.0 - node.cosTheta * node.cosTheta));
+    float cosX = cosSubClamped(sinW, cosW, sinO, node.cosTheta);
+    float sinX = sinSubClamped(sinW, cosW, sinO, node.cosTheta);
+    float cosEmitter = cosSubClamped(sinX, cosX, sinBounds, cosBounds);
+    if (cosEmitter <= 0.0) return 0.0;
+
+    float cosI = dot(normal, -wi);
+    float sinI = sqrt(max(0.0, 1.0 - cosI * cosI));
+    float cosReceiver = cosSubClamped(sinI, cosI, sinBounds, cosBounds);
+    if (cosReceiver <= 0.0) return 0.0;
+
+    return node.power * cosEmitter * cosReceiver / max(distanceSquared, radiusSquared);
+}
+
+// Descends the light tree choosing children in proportion to their importance, reusing u at each level
+bool traverseLightTree(vec3 position, vec3 normal, float u, out uint lightIndex, out float probability) {
+    uint nodeIndex = 0;
+    LightNode node = lightTree.nodes[0];
+    probability = 1.0;
+    lightIndex = 0;
+
+    while ((node.child & LIGHT_LEAF_BIT) == 0) {
+        LightNode left = lightTree.nodes[nodeIndex + 1];
+        LightNode right = lightTree.nodes[node.child];
+        float leftImportance = lightNodeImportance(left, position, normal);
+        float rightImportance = lightNodeImportance(right, position, normal);
+        float total = leftImportance + rightImportance;
+        if (total <= 0.0) return false;
+
+        float leftProbability = leftImportance / total;
+        if (u < leftProbability) {
+            u = min(u / leftProbability, 0.99999994);
+            probability *= leftProbability;
+            nodeIndex = nodeIndex + 1;
+            node = left;
+        } else {
+            u = min((u - leftProbability) / (1.0 - leftProbability), 0.99999994);
+            probability *= 1.0 - leftProbability;
+            nodeIndex = node.child;
+            node = right;
+        }
+    }
+
+    lightIndex = node.child & ~LIGHT_LEAF_BIT;
+    return true;
+}
+
+// Picks a light and a uniform point on it; areaPdf is the probability density of the point per unit light area
+bool sampleLightPoint(vec3 position, vec3 normal, uint sampling, inout uint state, out uint lightIndex, out vec3 point, out float areaPdf) {
+    lightIndex = 0;
+    point = vec3(0.0);
+    areaPdf = 0.0;
+    if (scene.lightCount == 0) return false;
+
+    float selectionPdf;
+    if (sampling == LIGHT_SAMPLING_UNIFORM) {
+        lightIndex = min(uint(random(state) * float(scene.lightCount)), scene.lightCount - 1);
+        selectionPdf = 1.0 / float(scene.lightCount);
+    } else if (sampling == LIGHT_SAMPLING_POWER) {
+        lightIndex = selectLight(random(state));
+        selectionPdf = lightBuffer.lights[lightIndex].pdf;
+    } else if (!traverseLightTree(position, normal, random(state), lightIndex, selectionPdf)) {
+        return false;
+    }
+
+    Light light = lightBuffer.lights[lightIndex];
+    float r1 = sqrt(random(state));
+    float r2 = random(state);
+    point = light.v0 * (1.0 - r1) + light.v1 * (r1 * (1.0 - r2)) + light.v2 * (r1 * r2);
+    areaPdf = selectionPdf / light.area;
+    return true;
+}
+
+// Unoccluded radiance from a point on a light, times both cosines over the squared distance
+vec3 lightContribution(Light light, vec3 point, vec3 position, vec3 normal) {
+    vec3 toLight = point - position;
+    float distanceSquared = dot(toLight, toLight);
+    if (distanceSquared <= 0.0) return vec3(0.0);
+    vec3 direction = toLight * inversesqrt(distanceSquared);
+
+    // Emitters are two-sided, matching what BSDF-sampled rays see
+    vec3 lightNormal = normalize(cross(light.v1 - light.v0, light.v2 - light.v0));
+    float cosLight = abs(dot(lightNormal, direction));
+    float cosSurface = dot(normal, direction);
+    if (cosSurface <= 0.0) return vec3(0.0);
+
+    return light.emission.rgb * cosSurface * cosLight / distanceSquared;
+}
+
+bool sampleLight(vec3 position, vec3 normal, uint sampling, inout uint state, out LightSample lightSample) {
+    lightSample.direction = vec3(0.0);
+    lightSample.distance = 0.0;
+    lightSample.radiance = vec3(0.0);
+
+    uint lightIndex;
+    vec3 point;
+    float areaPdf;
+    if (!sampleLightPoint(position, normal, sampling, state, lightIndex, point, areaPdf)) return false;
+
+    Light light = lightBuffer.lights[lightIndex];
+    vec3 toLight = point - position;
+    lightSample.distance = length(toLight);
+    lightSample.direction = toLight / lightSample.distance;
+
+    vec3 contribution = lightContribution(light, point, position, normal);
+    if (contribution == vec3(0.0)) return false;
+
+    lightSample.radiance = contribution / areaPdf;
+    return true;
+}
@@ -0,0 +1,54 @@
+// Path tracing structures and helpers shared by the raygen loop and the wavefront stages.
+
+#define PI 3.14159265359
+
+// Compact hit record; all shading happens in the caller.
+struct HitRecord {
+    vec3 position;
+    float hitT;
+    vec3 normal;
+    uint materialIndex;
+};
+
+struct Material {
+    vec4 baseColor;
+    vec4 emission;
+};
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+uint pcg(inout uint state) {
+    state = state * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+#ifdef SAMPLER_BINDING
+#include "sampler.glsl"
+#else
+float random(inout uint state) {
+    return float(pcg(state)) * (1.0 / 4294967296.0);
+}
+#endif
+
+float powerHeuristic(float pdf, float otherPdf) {
+    float weight = pdf * pdf;
+    return weight / (weight + otherPdf * otherPdf);
+}
+
+vec3 sampleCosineHemisphere(vec3 normal, inout uint state) {
+    float r = sqrt(random(state));
+    float phi = 2.0 * PI * random(state);
+
+    vec3 tangent = normalize(cross(normal, abs(normal.x) > 0.9 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0)));
+    vec3 bitangent = cross(normal, tangent);
+
+    return normalize(tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + normal * sqrt(max(0.0, 1.0 - r * r)));
+}
@@ -0,0 +1,94 @@
+// Per-pixel sample generation behind random(). Included by path.glsl when SAMPLER_BINDING is defined;
+// call initSampler before drawing samples. The per-path state passed to random() is the PCG state,
+// or the next sample dimension for the low-discrepancy samplers.
+
+#define SAMPLER_PCG 0
+#define SAMPLER_BLUE_NOISE 1
+#define SAMPLER_SOBOL 2
+
+// Must match sampler.h
+#define SOBOL_DIMENSIONS 4
+#define SOBOL_BITS 32
+#define BLUE_NOISE_SIZE 64
+#define BLUE_NOISE_LAYERS 8
+
+layout(binding = SAMPLER_BINDING, set = 0, std430) readonly buffer SamplerBuffer {
+    uint sobolDirections[SOBOL_DIMENSIONS * SOBOL_BITS];
+    float blueNoise[BLUE_NOISE_LAYERS * BLUE_NOISE_SIZE * BLUE_NOISE_SIZE];
+} samplerBuffer;
+
+uint samplerMode;
+uvec2 samplerPixel;
+uint samplerSeed;
+uint samplerStreamSeed;
+uint samplerIndex;
+
+// Sets up the current pixel and returns the initial per-path state for random()
+uint initSampler(uint mode, uvec2 pixel, uvec2 size, uint stream) {
+    samplerMode = mode;
+    samplerPixel = pixel;
+
+    // Sequences restart with accumulation but are reseeded, so a restarted run never repeats an earlier one
+    uint restartFrame = scene.frameIndex - scene.accumulatedFrames;
+    samplerStreamSeed = hash(restartFrame * 0x9e3779b9u + stream);
+    samplerSeed = hash(pixel.x + size.x * pixel.y) ^ samplerStreamSeed;
+    samplerIndex = scene.accumulatedFrames;
+
+    if (mode == SAMPLER_PCG) {
+        return hash(pixel.x + size.x * (pixel.y + size.y * scene.frameIndex) + stream * 0x68bc21ebu);
+    }
+    return stream << 16;
+}
+
+uint sobol(uint index, uint dimension) {
+    uint result = 0;
+    for (uint bit = 0; index != 0; bit++, index >>= 1) {
+        if ((index & 1u) != 0) result ^= samplerBuffer.sobolDirections[dimension * SOBOL_BITS + bit];
+    }
+    return result;
+}
+
+// Hash-based Owen scrambling (Burley 2020): a Laine-Karras permutation applied to the reversed bits
+uint nestedUniformScramble(uint x, uint seed) {
+    x = bitfieldReverse(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return bitfieldReverse(x);
+}
+
+// Dimensions are padded from 4D Sobol: each group of four shares a shuffled index so it stays
+// jointly stratified, and every group and dimension is scrambled independently
+float sobolSample(uint dimension) {
+    uint group = dimension / SOBOL_DIMENSIONS;
+    uint component = dimension % SOBOL_DIMENSIONS;
+    uint groupSeed = hash(samplerSeed ^ hash(group));
+
+    uint index = nestedUniformScramble(samplerIndex, groupSeed);
+    uint x = nestedUniformScramble(sobol(index, component), hash(groupSeed + component + 1u));
+    return float(x >> 8) * (1.0 / 16777216.0);
+}
+
+// Tileable blue noise, decorrelated across dimensions by layer and a per-dimension tile offset,
+// and advanced each frame by the golden ratio so consecutive frames stay well distributed. The
+// Cranley-Patterson shift is shared by every pixel, a per-pixel one would turn the mask into white noise.
+float blueNoiseSample(uint dimension) {
+    uint layer = dimension % BLUE_NOISE_LAYERS;
+    uint offset = hash(dimension / BLUE_NOISE_LAYERS + 1u);
+    uvec2 texel = (samplerPixel + uvec2(offset, offset >> 16)) % BLUE_NOISE_SIZE;
+
+    float value = samplerBuffer.blueNoise[(layer * BLUE_NOISE_SIZE + texel.y) * BLUE_NOISE_SIZE + texel.x];
+    return fract(value + float(samplerIndex) * 0.61803398875 + float(hash(samplerStreamSeed + dimension) >> 8) * (1.0 / 16777216.0));
+}
+
+float random(inout uint state) {
+    if (samplerMode == SAMPLER_SOBOL) {
+        return sobolSample(state++);
+    }
+    if (samplerMode == SAMPLER_BLUE_NOISE) {
+        return blueNoiseSample(state++);
+    }
+    return float(pcg(state)) * (1.0 / 4294967296.0);
+}
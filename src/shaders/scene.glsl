@@ -0,0 +1,18 @@
+// Shared by every stage that reads SceneUniform; define SCENE_BINDING before including.
+layout(binding = SCENE_BINDING, set = 0) uniform SceneUniform {
+    mat4 viewInverse;
+    mat4 projInverse;
+    mat4 previousViewProjection;
+    float exposure;
+    uint tonemapper;
+    uint accumulatedFrames;
+    uint lightCount;
+    uint environmentWidth;
+    uint environmentHeight;
+    uint frameIndex;
+    float adaptiveThreshold;
+    // Traced sub-rectangle of the output image, see resolution.c
+    uvec2 renderSize;
+    // Sub-pixel camera offset in traced pixels while the temporal upscaler is on, see upscale.c
+    vec2 jitter;
+} scene;
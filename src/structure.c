@@ -7,6 +7,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+static VkDeviceSize alignSize(VkDeviceSize size, VkDeviceSize alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+}
+
 void createShaderBindingTable(VKRT* vkrt) {
     VkPhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingPipelineProperties = {0};
     rayTracingPipelineProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
@@ -17,68 +21,51 @@ void createShaderBindingTable(VKRT* vkrt) {
 
     vkGetPhysicalDeviceProperties2(vkrt->physicalDevice, &physicalDeviceProperties2);
 
-    uint32_t groupCount = 3;
+    // Regions are raygen, miss and hit, each starting on the base alignment with records packed at the handle alignment
+    uint32_t regionGroupCounts[3] = {1, vkrt->missGroupCount, vkrt->hitGroupCount};
+    uint32_t groupCount = regionGroupCounts[0] + regionGroupCounts[1] + regionGroupCounts[2];
     VkDeviceSize handleSize = rayTracingPipelineProperties.shaderGroupHandleSize;
-    VkDeviceSize stride = rayTracingPipelineProperties.shaderGroupBaseAlignment;
-    VkDeviceSize sbtSize = groupCount * stride;
-
-    PFN_vkGetRayTracingShaderGroupHandlesKHR pvkGetRayTracingShaderGroupHandlesKHR = (PFN_vkGetRayTracingShaderGroupHandlesKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetRayTracingShaderGroupHandlesKHR");
-    PFN_vkGetBufferDeviceAddressKHR pvkGetBufferDeviceAddressKHR = (PFN_vkGetBufferDeviceAddressKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetBufferDeviceAddressKHR");
-
-    VkBuffer stageBuffer;
-    VkDeviceMemory stageMemory;
-
-    createBuffer(vkrt, sbtSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stageBuffer, &stageMemory);
+    VkDeviceSize baseAlignment = rayTracingPipelineProperties.shaderGroupBaseAlignment;
+    VkDeviceSize recordStride = alignSize(handleSize, rayTracingPipelineProperties.shaderGroupHandleAlignment);
+
+    VkDeviceSize regionOffsets[3];
+    VkDeviceSize regionSizes[3];
+    VkDeviceSize sbtSize = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+        regionOffsets[i] = sbtSize;
+        regionSizes[i] = alignSize(regionGroupCounts[i] * recordStride, baseAlignment);
+        sbtSize += regionSizes[i];
+    }
 
     uint8_t* handles = (uint8_t*)malloc(groupCount * handleSize);
-    pvkGetRayTracingShaderGroupHandlesKHR(vkrt->device, vkrt->rayTracingPipeline, 0, groupCount, groupCount * handleSize, handles);
+    vkrt->vk.GetRayTracingShaderGroupHandlesKHR(vkrt->device, vkrt->rayTracingPipeline, 0, groupCount, groupCount * handleSize, handles);
 
-    void* mapped;
-    vkMapMemory(vkrt->device, stageMemory, 0, sbtSize, 0, &mapped);
-    for (uint32_t i = 0; i < groupCount; i++) {
-        memcpy((uint8_t*)mapped + i * stride, handles + i * handleSize, handleSize);
+    uint8_t* table = (uint8_t*)calloc(1, (size_t)sbtSize);
+    uint32_t group = 0;
+    for (uint32_t region = 0; region < 3; region++) {
+        for (uint32_t i = 0; i < regionGroupCounts[region]; i++, group++) {
+            memcpy(table + regionOffsets[region] + i * recordStride, handles + group * handleSize, handleSize);
+        }
     }
-    vkUnmapMemory(vkrt->device, stageMemory);
     free(handles);
 
-    VkBufferCreateInfo bufferCreateInfo = {0};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = sbtSize;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
-    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    vkCreateBuffer(vkrt->device, &bufferCreateInfo, NULL, &vkrt->shaderBindingTableBuffer);
-
-    VkMemoryRequirements memoryRequirements;
-    vkGetBufferMemoryRequirements(vkrt->device, vkrt->shaderBindingTableBuffer, &memoryRequirements);
-
-    VkMemoryAllocateFlagsInfo memoryAllocateFlagsInfo = {0};
-    memoryAllocateFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
-    memoryAllocateFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
-
-    VkMemoryAllocateInfo memoryAllocateInfo = {0};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.pNext = &memoryAllocateFlagsInfo;
-    memoryAllocateInfo.allocationSize = memoryRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = findMemoryType(vkrt, memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    vkAllocateMemory(vkrt->device, &memoryAllocateInfo, NULL, &vkrt->shaderBindingTableMemory);
-    vkBindBufferMemory(vkrt->device, vkrt->shaderBindingTableBuffer, vkrt->shaderBindingTableMemory, 0);
-
-    copyBuffer(vkrt, stageBuffer, vkrt->shaderBindingTableBuffer, sbtSize);
-    vkDestroyBuffer(vkrt->device, stageBuffer, NULL);
-    vkFreeMemory(vkrt->device, stageMemory, NULL);
-
-    VkBufferDeviceAddressInfo bufferDeviceAddressInfo = {0};
-    bufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
-    bufferDeviceAddressInfo.buffer = vkrt->shaderBindingTableBuffer;
-    VkDeviceAddress base = pvkGetBufferDeviceAddressKHR(vkrt->device, &bufferDeviceAddressInfo);
+    VkDeviceAddress base = createBufferFromHostData(
+        vkrt,
+        table, sbtSize,
+        VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+        &vkrt->shaderBindingTableBuffer,
+        &vkrt->shaderBindingTableMemory);
+    free(table);
 
     for (int i = 0; i < 3; i++) {
-        vkrt->shaderBindingTables[i].deviceAddress = base + i * stride;
-        vkrt->shaderBindingTables[i].stride = stride;
-        vkrt->shaderBindingTables[i].size = stride;
+        vkrt->shaderBindingTables[i].deviceAddress = base + regionOffsets[i];
+        vkrt->shaderBindingTables[i].stride = recordStride;
+        vkrt->shaderBindingTables[i].size = regionSizes[i];
     }
 
+    // The raygen region must have its stride equal to its size
+    vkrt->shaderBindingTables[0].stride = regionSizes[0];
+
     vkrt->shaderBindingTables[3].deviceAddress = 0;
     vkrt->shaderBindingTables[3].stride = 0;
     vkrt->shaderBindingTables[3].size = 0;
@@ -116,8 +103,7 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo = {0};
     accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
 
-    PFN_vkGetAccelerationStructureBuildSizesKHR pvkGetAccelerationStructureBuildSizesKHR = (PFN_vkGetAccelerationStructureBuildSizesKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetAccelerationStructureBuildSizesKHR");
-    pvkGetAccelerationStructureBuildSizesKHR(vkrt->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &accelerationStructureBuildGeometryInfo, &primitiveCount, &accelerationStructureBuildSizesInfo);
+    vkrt->vk.GetAccelerationStructureBuildSizesKHR(vkrt->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &accelerationStructureBuildGeometryInfo, &primitiveCount, &accelerationStructureBuildSizesInfo);
 
     QueueFamily indices = findQueueFamilies(vkrt);
 
@@ -129,13 +115,13 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     blasBufferCreateInfo.queueFamilyIndexCount = 1;
     blasBufferCreateInfo.pQueueFamilyIndices = (uint32_t*)&indices.graphics;
 
-    if (vkCreateBuffer(vkrt->device, &blasBufferCreateInfo, NULL, &vkrt->bottomLevelAccelerationStructureBuffer) != VK_SUCCESS) {
+    if (vkrt->vk.CreateBuffer(vkrt->device, &blasBufferCreateInfo, NULL, &vkrt->bottomLevelAccelerationStructureBuffer) != VK_SUCCESS) {
         perror("ERROR: Failed to create BLAS buffer");
         exit(EXIT_FAILURE);
     }
 
     VkMemoryRequirements memoryRequirements = {0};
-    vkGetBufferMemoryRequirements(vkrt->device, vkrt->bottomLevelAccelerationStructureBuffer, &memoryRequirements);
+    vkrt->vk.GetBufferMemoryRequirements(vkrt->device, vkrt->bottomLevelAccelerationStructureBuffer, &memoryRequirements);
     VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties = {0};
     vkGetPhysicalDeviceMemoryProperties(vkrt->physicalDevice, &physicalDeviceMemoryProperties);
 
@@ -157,12 +143,12 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     memoryAllocateInfo.allocationSize = memoryRequirements.size;
     memoryAllocateInfo.memoryTypeIndex = blasMemoryTypeIndex;
 
-    if (vkAllocateMemory(vkrt->device, &memoryAllocateInfo, NULL, &vkrt->bottomLevelAccelerationStructureMemory) != VK_SUCCESS) {
+    if (vkrt->vk.AllocateMemory(vkrt->device, &memoryAllocateInfo, NULL, &vkrt->bottomLevelAccelerationStructureMemory) != VK_SUCCESS) {
         perror("ERROR: Failed to allocate BLAS memory");
         exit(EXIT_FAILURE);
     }
 
-    vkBindBufferMemory(vkrt->device, vkrt->bottomLevelAccelerationStructureBuffer, vkrt->bottomLevelAccelerationStructureMemory, 0);
+    vkrt->vk.BindBufferMemory(vkrt->device, vkrt->bottomLevelAccelerationStructureBuffer, vkrt->bottomLevelAccelerationStructureMemory, 0);
 
     VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo = {0};
     accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
@@ -171,8 +157,7 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
     accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
 
-    PFN_vkCreateAccelerationStructureKHR pvkCreateAccelerationStructureKHR = (PFN_vkCreateAccelerationStructureKHR)vkGetDeviceProcAddr(vkrt->device, "vkCreateAccelerationStructureKHR");
-    if (pvkCreateAccelerationStructureKHR(vkrt->device, &accelerationStructureCreateInfo, NULL, &vkrt->bottomLevelAccelerationStructure) != VK_SUCCESS) {
+    if (vkrt->vk.CreateAccelerationStructureKHR(vkrt->device, &accelerationStructureCreateInfo, NULL, &vkrt->bottomLevelAccelerationStructure) != VK_SUCCESS) {
         perror("ERROR: Failed to create BLAS");
         exit(EXIT_FAILURE);
     }
@@ -186,13 +171,13 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     scratchBufferCreateInfo.pQueueFamilyIndices = (uint32_t*)&indices.graphics;
 
     VkBuffer scratchBuffer;
-    if (vkCreateBuffer(vkrt->device, &scratchBufferCreateInfo, NULL, &scratchBuffer) != VK_SUCCESS) {
+    if (vkrt->vk.CreateBuffer(vkrt->device, &scratchBufferCreateInfo, NULL, &scratchBuffer) != VK_SUCCESS) {
         perror("ERROR: Failed to create scratch buffer");
         exit(EXIT_FAILURE);
     }
 
     VkMemoryRequirements scratchBufferMemoryRequirements = {0};
-    vkGetBufferMemoryRequirements(vkrt->device, scratchBuffer, &scratchBufferMemoryRequirements);
+    vkrt->vk.GetBufferMemoryRequirements(vkrt->device, scratchBuffer, &scratchBufferMemoryRequirements);
 
     uint32_t scratchMemoryTypeIndex = UINT32_MAX;
     for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; i++) {
@@ -209,18 +194,17 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     scratchMemoryAllocateInfo.memoryTypeIndex = scratchMemoryTypeIndex;
 
     VkDeviceMemory scratchDeviceMemory;
-    if (vkAllocateMemory(vkrt->device, &scratchMemoryAllocateInfo, NULL, &scratchDeviceMemory) != VK_SUCCESS) {
+    if (vkrt->vk.AllocateMemory(vkrt->device, &scratchMemoryAllocateInfo, NULL, &scratchDeviceMemory) != VK_SUCCESS) {
         perror("ERROR: Failed to allocate scratch memory");
         exit(EXIT_FAILURE);
     }
-    vkBindBufferMemory(vkrt->device, scratchBuffer, scratchDeviceMemory, 0);
+    vkrt->vk.BindBufferMemory(vkrt->device, scratchBuffer, scratchDeviceMemory, 0);
 
     VkBufferDeviceAddressInfo scratchBufferDeviceAddressInfo = {0};
     scratchBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
     scratchBufferDeviceAddressInfo.buffer = scratchBuffer;
 
-    PFN_vkGetBufferDeviceAddressKHR pvkGetBufferDeviceAddressKHR = (PFN_vkGetBufferDeviceAddressKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetBufferDeviceAddressKHR");
-    VkDeviceAddress scratchBufferDeviceAddress = pvkGetBufferDeviceAddressKHR(vkrt->device, &scratchBufferDeviceAddressInfo);
+    VkDeviceAddress scratchBufferDeviceAddress = vkrt->vk.GetBufferDeviceAddressKHR(vkrt->device, &scratchBufferDeviceAddressInfo);
 
     accelerationStructureBuildGeometryInfo.dstAccelerationStructure = vkrt->bottomLevelAccelerationStructure;
     accelerationStructureBuildGeometryInfo.scratchData.deviceAddress = scratchBufferDeviceAddress;
@@ -233,14 +217,13 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &accelerationStructureBuildRangeInfo;
 
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
-    PFN_vkCmdBuildAccelerationStructuresKHR pvkCmdBuildAccelerationStructuresKHR = (PFN_vkCmdBuildAccelerationStructuresKHR)vkGetDeviceProcAddr(vkrt->device, "vkCmdBuildAccelerationStructuresKHR");
-    pvkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &accelerationStructureBuildGeometryInfo, &pBuildRangeInfo);
+    vkrt->vk.CmdBuildAccelerationStructuresKHR(commandBuffer, 1, &accelerationStructureBuildGeometryInfo, &pBuildRangeInfo);
 
     VkMemoryBarrier memoryBarrier = {0};
     memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
     memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
     memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
 
     endSingleTimeCommands(vkrt, commandBuffer);
 
@@ -248,11 +231,10 @@ void createBottomLevelAccelerationStructure(VKRT* vkrt) {
     accelerationStructureDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
     accelerationStructureDeviceAddressInfo.accelerationStructure = vkrt->bottomLevelAccelerationStructure;
 
-    PFN_vkGetAccelerationStructureDeviceAddressKHR pvkGetAccelerationStructureDeviceAddressKHR = (PFN_vkGetAccelerationStructureDeviceAddressKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetAccelerationStructureDeviceAddressKHR");
-    vkrt->bottomLevelAccelerationStructureDeviceAddress = pvkGetAccelerationStructureDeviceAddressKHR(vkrt->device, &accelerationStructureDeviceAddressInfo);
+    vkrt->bottomLevelAccelerationStructureDeviceAddress = vkrt->vk.GetAccelerationStructureDeviceAddressKHR(vkrt->device, &accelerationStructureDeviceAddressInfo);
 
-    vkDestroyBuffer(vkrt->device, scratchBuffer, NULL);
-    vkFreeMemory(vkrt->device, scratchDeviceMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, scratchBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, scratchDeviceMemory, NULL);
 }
 
 void createTopLevelAccelerationStructure(VKRT* vkrt) {
@@ -277,13 +259,13 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     instanceBufferCreateInfo.pQueueFamilyIndices = (uint32_t*)&indices.graphics;
 
     VkBuffer instanceBuffer;
-    if (vkCreateBuffer(vkrt->device, &instanceBufferCreateInfo, NULL, &instanceBuffer) != VK_SUCCESS) {
+    if (vkrt->vk.CreateBuffer(vkrt->device, &instanceBufferCreateInfo, NULL, &instanceBuffer) != VK_SUCCESS) {
         perror("ERROR: Failed to create instance buffer");
         exit(EXIT_FAILURE);
     }
 
     VkMemoryRequirements instanceMemoryRequirements = {0};
-    vkGetBufferMemoryRequirements(vkrt->device, instanceBuffer, &instanceMemoryRequirements);
+    vkrt->vk.GetBufferMemoryRequirements(vkrt->device, instanceBuffer, &instanceMemoryRequirements);
     VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties = {0};
     vkGetPhysicalDeviceMemoryProperties(vkrt->physicalDevice, &physicalDeviceMemoryProperties);
 
@@ -306,22 +288,21 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     instanceMemoryAllocateInfo.memoryTypeIndex = instanceMemoryTypeIndex;
 
     VkDeviceMemory instanceMemory;
-    if (vkAllocateMemory(vkrt->device, &instanceMemoryAllocateInfo, NULL, &instanceMemory) != VK_SUCCESS) {
+    if (vkrt->vk.AllocateMemory(vkrt->device, &instanceMemoryAllocateInfo, NULL, &instanceMemory) != VK_SUCCESS) {
         perror("ERROR: allocate instance memory");
         exit(EXIT_FAILURE);
     }
-    vkBindBufferMemory(vkrt->device, instanceBuffer, instanceMemory, 0);
+    vkrt->vk.BindBufferMemory(vkrt->device, instanceBuffer, instanceMemory, 0);
 
     void* mapped;
-    vkMapMemory(vkrt->device, instanceMemory, 0, instanceMemoryRequirements.size, 0, &mapped);
+    vkrt->vk.MapMemory(vkrt->device, instanceMemory, 0, instanceMemoryRequirements.size, 0, &mapped);
     memcpy(mapped, &accelerationStructureInstance, sizeof(accelerationStructureInstance));
-    vkUnmapMemory(vkrt->device, instanceMemory);
+    vkrt->vk.UnmapMemory(vkrt->device, instanceMemory);
 
     VkBufferDeviceAddressInfo instanceBufferDeviceAddressInfo = {0};
     instanceBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
     instanceBufferDeviceAddressInfo.buffer = instanceBuffer;
-    PFN_vkGetBufferDeviceAddressKHR pvkGetBufferDeviceAddressKHR = (PFN_vkGetBufferDeviceAddressKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetBufferDeviceAddressKHR");
-    VkDeviceAddress instanceDeviceAddress = pvkGetBufferDeviceAddressKHR(vkrt->device, &instanceBufferDeviceAddressInfo);
+    VkDeviceAddress instanceDeviceAddress = vkrt->vk.GetBufferDeviceAddressKHR(vkrt->device, &instanceBufferDeviceAddressInfo);
 
     VkAccelerationStructureGeometryInstancesDataKHR accelerationStructureGeometryInstancesData = {0};
     accelerationStructureGeometryInstancesData.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
@@ -348,8 +329,7 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     uint32_t instanceCount = 1;
     VkAccelerationStructureBuildSizesInfoKHR accelerationStructureBuildSizesInfo = {0};
     accelerationStructureBuildSizesInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
-    PFN_vkGetAccelerationStructureBuildSizesKHR pvkGetAccelerationStructureBuildSizesKHR = (PFN_vkGetAccelerationStructureBuildSizesKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetAccelerationStructureBuildSizesKHR");
-    pvkGetAccelerationStructureBuildSizesKHR(vkrt->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &accelerationStructureBuildGeometryInfo, &instanceCount, &accelerationStructureBuildSizesInfo);
+    vkrt->vk.GetAccelerationStructureBuildSizesKHR(vkrt->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &accelerationStructureBuildGeometryInfo, &instanceCount, &accelerationStructureBuildSizesInfo);
 
     VkBufferCreateInfo tlasBufferCreateInfo = {0};
     tlasBufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -359,12 +339,12 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     tlasBufferCreateInfo.queueFamilyIndexCount = 1;
     tlasBufferCreateInfo.pQueueFamilyIndices = (uint32_t*)&indices.graphics;
 
-    if (vkCreateBuffer(vkrt->device, &tlasBufferCreateInfo, NULL, &vkrt->topLevelAccelerationStructureBuffer) != VK_SUCCESS) {
+    if (vkrt->vk.CreateBuffer(vkrt->device, &tlasBufferCreateInfo, NULL, &vkrt->topLevelAccelerationStructureBuffer) != VK_SUCCESS) {
         perror("ERROR: Failed to create TLAS buffer");
         exit(EXIT_FAILURE);
     }
     VkMemoryRequirements bufferMemoryRequirements = {0};
-    vkGetBufferMemoryRequirements(vkrt->device, vkrt->topLevelAccelerationStructureBuffer, &bufferMemoryRequirements);
+    vkrt->vk.GetBufferMemoryRequirements(vkrt->device, vkrt->topLevelAccelerationStructureBuffer, &bufferMemoryRequirements);
 
     uint32_t tlasMemoryTypeIndex = UINT32_MAX;
     for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; i++) {
@@ -380,11 +360,11 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     bufferMemoryAllocateInfo.allocationSize = bufferMemoryRequirements.size;
     bufferMemoryAllocateInfo.memoryTypeIndex = tlasMemoryTypeIndex;
 
-    if (vkAllocateMemory(vkrt->device, &bufferMemoryAllocateInfo, NULL, &vkrt->topLevelAccelerationStructureMemory) != VK_SUCCESS) {
+    if (vkrt->vk.AllocateMemory(vkrt->device, &bufferMemoryAllocateInfo, NULL, &vkrt->topLevelAccelerationStructureMemory) != VK_SUCCESS) {
         perror("ERROR: allocate top level acceleration structure memory");
         exit(EXIT_FAILURE);
     }
-    vkBindBufferMemory(vkrt->device, vkrt->topLevelAccelerationStructureBuffer, vkrt->topLevelAccelerationStructureMemory, 0);
+    vkrt->vk.BindBufferMemory(vkrt->device, vkrt->topLevelAccelerationStructureBuffer, vkrt->topLevelAccelerationStructureMemory, 0);
 
     VkAccelerationStructureCreateInfoKHR accelerationStructureCreateInfo = {0};
     accelerationStructureCreateInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
@@ -393,8 +373,7 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     accelerationStructureCreateInfo.size = accelerationStructureBuildSizesInfo.accelerationStructureSize;
     accelerationStructureCreateInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
 
-    PFN_vkCreateAccelerationStructureKHR pvkCreateAccelerationStructureKHR = (PFN_vkCreateAccelerationStructureKHR)vkGetDeviceProcAddr(vkrt->device, "vkCreateAccelerationStructureKHR");
-    if (pvkCreateAccelerationStructureKHR(vkrt->device, &accelerationStructureCreateInfo, NULL, &vkrt->topLevelAccelerationStructure) != VK_SUCCESS) {
+    if (vkrt->vk.CreateAccelerationStructureKHR(vkrt->device, &accelerationStructureCreateInfo, NULL, &vkrt->topLevelAccelerationStructure) != VK_SUCCESS) {
         perror("ERROR: Failed to create TLAS");
         exit(EXIT_FAILURE);
     };
@@ -408,9 +387,9 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     scratchBufferCreateInfo.pQueueFamilyIndices = (uint32_t*)&indices.graphics;
 
     VkBuffer scratchBuffer;
-    vkCreateBuffer(vkrt->device, &scratchBufferCreateInfo, NULL, &scratchBuffer);
+    vkrt->vk.CreateBuffer(vkrt->device, &scratchBufferCreateInfo, NULL, &scratchBuffer);
     VkMemoryRequirements scratchBufferMemoryRequirements = {0};
-    vkGetBufferMemoryRequirements(vkrt->device, scratchBuffer, &scratchBufferMemoryRequirements);
+    vkrt->vk.GetBufferMemoryRequirements(vkrt->device, scratchBuffer, &scratchBufferMemoryRequirements);
 
     uint32_t scratchMemoryType = UINT32_MAX;
     for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; i++) {
@@ -427,14 +406,14 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     scratchMemoryAllocateInfo.memoryTypeIndex = scratchMemoryType;
 
     VkDeviceMemory scratchDeviceMemory;
-    vkAllocateMemory(vkrt->device, &scratchMemoryAllocateInfo, NULL, &scratchDeviceMemory);
-    vkBindBufferMemory(vkrt->device, scratchBuffer, scratchDeviceMemory, 0);
+    vkrt->vk.AllocateMemory(vkrt->device, &scratchMemoryAllocateInfo, NULL, &scratchDeviceMemory);
+    vkrt->vk.BindBufferMemory(vkrt->device, scratchBuffer, scratchDeviceMemory, 0);
 
     VkBufferDeviceAddressInfo scratchBufferDeviceAddressInfo = {0};
     scratchBufferDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
     scratchBufferDeviceAddressInfo.buffer = scratchBuffer;
 
-    VkDeviceAddress scratchBufferDeviceAddress = pvkGetBufferDeviceAddressKHR(vkrt->device, &scratchBufferDeviceAddressInfo);
+    VkDeviceAddress scratchBufferDeviceAddress = vkrt->vk.GetBufferDeviceAddressKHR(vkrt->device, &scratchBufferDeviceAddressInfo);
     accelerationStructureBuildGeometryInfo.dstAccelerationStructure = vkrt->topLevelAccelerationStructure;
     accelerationStructureBuildGeometryInfo.scratchData.deviceAddress = scratchBufferDeviceAddress;
 
@@ -446,25 +425,33 @@ void createTopLevelAccelerationStructure(VKRT* vkrt) {
     const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &accelerationStructureBuildRangeInfo;
 
     VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
-    PFN_vkCmdBuildAccelerationStructuresKHR pvkCmdBuildAccelerationStructuresKHR = (PFN_vkCmdBuildAccelerationStructuresKHR)vkGetDeviceProcAddr(vkrt->device, "vkCmdBuildAccelerationStructuresKHR");
-    pvkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &accelerationStructureBuildGeometryInfo, &pBuildRangeInfo);
+    vkrt->vk.CmdBuildAccelerationStructuresKHR(commandBuffer, 1, &accelerationStructureBuildGeometryInfo, &pBuildRangeInfo);
 
     VkMemoryBarrier memoryBarrier = {0};
     memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
     memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
     memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
-    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
 
     endSingleTimeCommands(vkrt, commandBuffer);
 
     VkAccelerationStructureDeviceAddressInfoKHR accelerationStructureDeviceAddressInfo = {0};
     accelerationStructureDeviceAddressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
     accelerationStructureDeviceAddressInfo.accelerationStructure = vkrt->topLevelAccelerationStructure;
-    PFN_vkGetAccelerationStructureDeviceAddressKHR fnGetASAddr = (PFN_vkGetAccelerationStructureDeviceAddressKHR)vkGetDeviceProcAddr(vkrt->device, "vkGetAccelerationStructureDeviceAddressKHR");
-    vkrt->topLevelAccelerationStructureDeviceAddress = fnGetASAddr(vkrt->device, &accelerationStructureDeviceAddressInfo);
+    vkrt->topLevelAccelerationStructureDeviceAddress = vkrt->vk.GetAccelerationStructureDeviceAddressKHR(vkrt->device, &accelerationStructureDeviceAddressInfo);
 
-    vkDestroyBuffer(vkrt->device, instanceBuffer, NULL);
-    vkFreeMemory(vkrt->device, instanceMemory, NULL);
-    vkDestroyBuffer(vkrt->device, scratchBuffer, NULL);
-    vkFreeMemory(vkrt->device, scratchDeviceMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, instanceBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, instanceMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, scratchBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, scratchDeviceMemory, NULL);
 }
+
+void destroyAccelerationStructures(VKRT* vkrt) {
+    vkrt->vk.DestroyAccelerationStructureKHR(vkrt->device, vkrt->bottomLevelAccelerationStructure, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->bottomLevelAccelerationStructureBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->bottomLevelAccelerationStructureMemory, NULL);
+
+    vkrt->vk.DestroyAccelerationStructureKHR(vkrt->device, vkrt->topLevelAccelerationStructure, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->topLevelAccelerationStructureBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->topLevelAccelerationStructureMemory, NULL);
+}
\ No newline at end of file
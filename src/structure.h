@@ -3,4 +3,5 @@
 
 void createShaderBindingTable(VKRT* vkrt);
 void createBottomLevelAccelerationStructure(VKRT* vkrt);
-void createTopLevelAccelerationStructure(VKRT* vkrt);
\ No newline at end of file
+void createTopLevelAccelerationStructure(VKRT* vkrt);
+void destroyAccelerationStructures(VKRT* vkrt);
\ No newline at end of file
@@ -1,8 +1,15 @@
 #include "swapchain.h"
+#include "adaptive.h"
 #include "command.h"
+#include "denoise.h"
 #include "descriptor.h"
 #include "device.h"
+#include "image.h"
 #include "interface.h"
+#include "restir.h"
+#include "tonemap.h"
+#include "upscale.h"
+#include "wavefront.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,7 +17,7 @@
 void createSwapChain(VKRT* vkrt) {
     SwapChainSupportDetails supportDetails = querySwapChainSupport(vkrt);
 
-    VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(&supportDetails);
+    VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(vkrt, &supportDetails);
     VkPresentModeKHR presentMode = chooseSwapPresentMode(&supportDetails, vkrt->vsync);
     VkExtent2D extent = chooseSwapExtent(vkrt, &supportDetails);
 
@@ -31,6 +38,9 @@ void createSwapChain(VKRT* vkrt) {
     swapChainCreateInfo.imageExtent = extent;
     swapChainCreateInfo.imageArrayLayers = 1;
     swapChainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (vkrt->swapChainStorage) {
+        swapChainCreateInfo.imageUsage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
 
     QueueFamily indices = findQueueFamilies(vkrt);
     uint32_t queueFamilyIndices[] = {indices.graphics, indices.present};
@@ -51,15 +61,15 @@ void createSwapChain(VKRT* vkrt) {
     swapChainCreateInfo.clipped = VK_TRUE;
     swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
 
-    if (vkCreateSwapchainKHR(vkrt->device, &swapChainCreateInfo, NULL, &vkrt->swapChain) != VK_SUCCESS) {
+    if (vkrt->vk.CreateSwapchainKHR(vkrt->device, &swapChainCreateInfo, NULL, &vkrt->swapChain) != VK_SUCCESS) {
         perror("ERROR: Failed to create swapchain");
         exit(EXIT_FAILURE);
     }
 
-    vkGetSwapchainImagesKHR(vkrt->device, vkrt->swapChain, &imageCount, NULL);
+    vkrt->vk.GetSwapchainImagesKHR(vkrt->device, vkrt->swapChain, &imageCount, NULL);
     vkrt->swapChainImages = (VkImage*)malloc(imageCount * sizeof(VkImage));
     vkrt->swapChainImageCount = imageCount;
-    vkGetSwapchainImagesKHR(vkrt->device, vkrt->swapChain, &imageCount, vkrt->swapChainImages);
+    vkrt->vk.GetSwapchainImagesKHR(vkrt->device, vkrt->swapChain, &imageCount, vkrt->swapChainImages);
 
     vkrt->swapChainImageFormat = surfaceFormat.format;
     vkrt->swapChainExtent = extent;
@@ -77,32 +87,67 @@ void recreateSwapChain(VKRT* vkrt) {
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(vkrt->device);
+    vkrt->vk.DeviceWaitIdle(vkrt->device);
 
     cleanupSwapChain(vkrt);
 
     createSwapChain(vkrt);
     createImageViews(vkrt);
     createStorageImage(vkrt);
+    if (vkrt->pathSettings.restir) {
+        createRestirResources(vkrt);
+    }
+    if (vkrt->pathSettings.adaptive) {
+        createAdaptiveResources(vkrt);
+    }
+    if (vkrt->pathSettings.denoiser) {
+        createDenoiseResources(vkrt);
+    }
+    if (vkrt->pathSettings.upscaler) {
+        createUpscaleResources(vkrt);
+    }
     updateDescriptorSet(vkrt);
+    createTonemapResources(vkrt);
+    if (vkrt->traceMode == TRACE_MODE_WAVEFRONT) {
+        createWavefrontResources(vkrt);
+    }
     createFramebuffers(vkrt);
+    createTraceCommandBuffers(vkrt);
     updateMatricesFromCamera(vkrt);
 }
 
 void cleanupSwapChain(VKRT* vkrt) {
+    freeTraceCommandBuffers(vkrt);
+
+    if (vkrt->traceMode == TRACE_MODE_WAVEFRONT) {
+        destroyWavefrontResources(vkrt);
+    }
+    if (vkrt->pathSettings.restir) {
+        destroyRestirResources(vkrt);
+    }
+    if (vkrt->pathSettings.adaptive) {
+        destroyAdaptiveResources(vkrt);
+    }
+    if (vkrt->pathSettings.denoiser) {
+        destroyDenoiseResources(vkrt);
+    }
+    if (vkrt->pathSettings.upscaler) {
+        destroyUpscaleResources(vkrt);
+    }
+
     for (size_t i = 0; i < vkrt->swapChainImageCount; i++) {
-        vkDestroyFramebuffer(vkrt->device, vkrt->framebuffers[i], NULL);
-        vkDestroyImageView(vkrt->device, vkrt->swapChainImageViews[i], NULL);
+        vkrt->vk.DestroyFramebuffer(vkrt->device, vkrt->framebuffers[i], NULL);
+        vkrt->vk.DestroyImageView(vkrt->device, vkrt->swapChainImageViews[i], NULL);
     }
 
-    vkDestroySwapchainKHR(vkrt->device, vkrt->swapChain, NULL);
+    vkrt->vk.DestroySwapchainKHR(vkrt->device, vkrt->swapChain, NULL);
 
     free(vkrt->swapChainImageViews);
     free(vkrt->swapChainImages);
     
-    vkDestroyImageView(vkrt->device, vkrt->storageImageView, NULL);
-    vkDestroyImage(vkrt->device, vkrt->storageImage, NULL);
-    vkFreeMemory(vkrt->device, vkrt->storageImageMemory, NULL);
+    destroyStorageImage(vkrt);
+
+    destroyTonemapResources(vkrt);
 }
 
 void createImageViews(VKRT* vkrt) {
@@ -124,7 +169,7 @@ void createImageViews(VKRT* vkrt) {
         imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
         imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-        if (vkCreateImageView(vkrt->device, &imageViewCreateInfo, NULL, &vkrt->swapChainImageViews[i]) != VK_SUCCESS) {
+        if (vkrt->vk.CreateImageView(vkrt->device, &imageViewCreateInfo, NULL, &vkrt->swapChainImageViews[i]) != VK_SUCCESS) {
             perror("ERROR: Failed to create swapchain image views");
             exit(EXIT_FAILURE);
         }
@@ -144,7 +189,7 @@ void createFramebuffers(VKRT* vkrt) {
         framebufferCreateInfo.height = vkrt->swapChainExtent.height;
         framebufferCreateInfo.layers = 1;
 
-        if (vkCreateFramebuffer(vkrt->device, &framebufferCreateInfo, NULL, &vkrt->framebuffers[i]) != VK_SUCCESS) {
+        if (vkrt->vk.CreateFramebuffer(vkrt->device, &framebufferCreateInfo, NULL, &vkrt->framebuffers[i]) != VK_SUCCESS) {
             perror("ERROR: Failed to create framebuffer");
             exit(EXIT_FAILURE);
         }
@@ -177,10 +222,36 @@ SwapChainSupportDetails querySwapChainSupport(VKRT* vkrt) {
     return supportDetails;
 }
 
-VkSurfaceFormatKHR chooseSwapSurfaceFormat(SwapChainSupportDetails* supportDetails) {
+VkSurfaceFormatKHR chooseSwapSurfaceFormat(VKRT* vkrt, SwapChainSupportDetails* supportDetails) {
+    // The present pass writes tonemapped, sRGB-encoded pixels straight into the swapchain when it can,
+    // so prefer 4-byte UNORM formats that support storage over the SRGB variants.
+    const VkFormat storageFormats[] = {
+        VK_FORMAT_A2B10G10R10_UNORM_PACK32,
+        VK_FORMAT_A2R10G10B10_UNORM_PACK32,
+        VK_FORMAT_B8G8R8A8_UNORM,
+        VK_FORMAT_R8G8B8A8_UNORM};
+
+    VkBool32 storageUsage = (supportDetails->capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT) && vkrt->storageWriteWithoutFormat;
+
+    for (size_t f = 0; storageUsage && f < COUNT_OF(storageFormats); f++) {
+        if (!formatSupportsFeatures(vkrt, storageFormats[f], VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT)) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < supportDetails->formatCount; i++) {
+            VkSurfaceFormatKHR format = supportDetails->formats[i];
+            if (format.format == storageFormats[f] && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+                vkrt->swapChainStorage = VK_TRUE;
+                return format;
+            }
+        }
+    }
+
+    vkrt->swapChainStorage = VK_FALSE;
+
     for (uint32_t i = 0; i < supportDetails->formatCount; i++) {
         VkSurfaceFormatKHR format = supportDetails->formats[i];
-        if (format.format == VK_FORMAT_R32G32B32A32_SFLOAT && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+        if (format.format == VK_FORMAT_B8G8R8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
             return format;
         }
     }
@@ -15,6 +15,6 @@ void cleanupSwapChain(VKRT* vkrt);
 void createImageViews(VKRT* vkrt);
 void createFramebuffers(VKRT* vkrt);
 SwapChainSupportDetails querySwapChainSupport(VKRT* vkrt);
-VkSurfaceFormatKHR chooseSwapSurfaceFormat(SwapChainSupportDetails* supportDetails);
+VkSurfaceFormatKHR chooseSwapSurfaceFormat(VKRT* vkrt, SwapChainSupportDetails* supportDetails);
 VkPresentModeKHR chooseSwapPresentMode(SwapChainSupportDetails* supportDetails, uint8_t vsync);
 VkExtent2D chooseSwapExtent(VKRT* vkrt, SwapChainSupportDetails* supportDetails);
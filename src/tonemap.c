@@ -0,0 +1,228 @@
+#include "tonemap.h"
+#include "command.h"
+#include "image.h"
+#include "pipeline.h"
+#include "upscale.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct TonemapPushConstants {
+    uint32_t encodeSrgb;
+    uint32_t upscaled;
+} TonemapPushConstants;
+
+static VkBool32 isSrgbFormat(VkFormat format) {
+    return format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_A8B8G8R8_SRGB_PACK32;
+}
+
+void createTonemapPipeline(VKRT* vkrt) {
+    VkDescriptorSetLayoutBinding bindings[3] = {0};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->tonemapDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create tonemap descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPushConstantRange pushConstantRange = {0};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(TonemapPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->tonemapDescriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->tonemapPipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create tonemap pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkSamplerCreateInfo samplerCreateInfo = {0};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.maxLod = 0.0f;
+
+    if (vkrt->vk.CreateSampler(vkrt->device, &samplerCreateInfo, NULL, &vkrt->storageImageSampler) != VK_SUCCESS) {
+        perror("ERROR: Failed to create storage image sampler");
+        exit(EXIT_FAILURE);
+    }
+
+    if (vkrt->storageWriteWithoutFormat) {
+        vkrt->tonemapPipeline = createComputePipeline(vkrt, "./tonemap.comp.spv", vkrt->tonemapPipelineLayout, NULL);
+    }
+    vkrt->tonemapIntermediatePipeline = createComputePipeline(vkrt, "./tonemap_rgba8.comp.spv", vkrt->tonemapPipelineLayout, NULL);
+}
+
+void createTonemapResources(VKRT* vkrt) {
+    uint32_t setCount = (uint32_t)vkrt->swapChainImageCount;
+
+    if (!vkrt->swapChainStorage) {
+        createImage(vkrt, vkrt->swapChainExtent, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, &vkrt->presentIntermediate);
+
+        VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+        transitionImageLayout(vkrt, commandBuffer, vkrt->presentIntermediate.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        endSingleTimeCommands(vkrt, commandBuffer);
+    }
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, setCount},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, setCount},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, setCount}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = setCount;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->tonemapDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create tonemap descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetLayout* layouts = (VkDescriptorSetLayout*)malloc(setCount * sizeof(VkDescriptorSetLayout));
+    for (uint32_t i = 0; i < setCount; i++) {
+        layouts[i] = vkrt->tonemapDescriptorSetLayout;
+    }
+
+    vkrt->tonemapDescriptorSets = (VkDescriptorSet*)malloc(setCount * sizeof(VkDescriptorSet));
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->tonemapDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = setCount;
+    descriptorSetAllocateInfo.pSetLayouts = layouts;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, vkrt->tonemapDescriptorSets) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate tonemap descriptor sets");
+        exit(EXIT_FAILURE);
+    }
+
+    free(layouts);
+
+    for (uint32_t i = 0; i < setCount; i++) {
+        VkDescriptorImageInfo hdrImageInfo = {0};
+        hdrImageInfo.sampler = vkrt->storageImageSampler;
+        hdrImageInfo.imageView = vkrt->storageImageView;
+        hdrImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo outputImageInfo = {0};
+        outputImageInfo.imageView = vkrt->swapChainStorage ? vkrt->swapChainImageViews[i] : vkrt->presentIntermediate.view;
+        outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorBufferInfo sceneUniformInfo = {0};
+        sceneUniformInfo.buffer = vkrt->uniformBuffer;
+        sceneUniformInfo.offset = 0;
+        sceneUniformInfo.range = sizeof(SceneUniform);
+
+        VkWriteDescriptorSet writes[3] = {0};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = vkrt->tonemapDescriptorSets[i];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].descriptorCount = 1;
+        writes[0].pImageInfo = &hdrImageInfo;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = vkrt->tonemapDescriptorSets[i];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].descriptorCount = 1;
+        writes[1].pImageInfo = &outputImageInfo;
+
+        writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[2].dstSet = vkrt->tonemapDescriptorSets[i];
+        writes[2].dstBinding = 2;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writes[2].descriptorCount = 1;
+        writes[2].pBufferInfo = &sceneUniformInfo;
+
+        vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+    }
+}
+
+void destroyTonemapResources(VKRT* vkrt) {
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->tonemapDescriptorPool, NULL);
+    free(vkrt->tonemapDescriptorSets);
+    vkrt->tonemapDescriptorSets = NULL;
+
+    destroyImage(vkrt, &vkrt->presentIntermediate);
+}
+
+void destroyTonemapPipeline(VKRT* vkrt) {
+    vkrt->vk.DestroyPipeline(vkrt->device, vkrt->tonemapPipeline, NULL);
+    vkrt->vk.DestroyPipeline(vkrt->device, vkrt->tonemapIntermediatePipeline, NULL);
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->tonemapPipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->tonemapDescriptorSetLayout, NULL);
+    vkrt->vk.DestroySampler(vkrt->device, vkrt->storageImageSampler, NULL);
+}
+
+void recordTonemap(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+    VkExtent2D extent = vkrt->swapChainExtent;
+    VkImage swapChainImage = vkrt->swapChainImages[imageIndex];
+
+    transitionImageLayout(vkrt, commandBuffer, vkrt->storageImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+
+    // The temporal upscaler already filled the whole image, otherwise only the traced sub-rectangle is valid
+    TonemapPushConstants pushConstants = {0};
+    pushConstants.upscaled = upscaleActive(vkrt);
+    if (vkrt->swapChainStorage) {
+        transitionImageLayout(vkrt, commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->tonemapPipeline);
+        pushConstants.encodeSrgb = 1;
+    } else {
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->tonemapIntermediatePipeline);
+        pushConstants.encodeSrgb = !isSrgbFormat(vkrt->swapChainImageFormat);
+    }
+
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->tonemapPipelineLayout, 0, 1, &vkrt->tonemapDescriptorSets[imageIndex], 0, NULL);
+    vkrt->vk.CmdPushConstants(commandBuffer, vkrt->tonemapPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+    vkrt->vk.CmdDispatch(commandBuffer, (extent.width + 15) / 16, (extent.height + 15) / 16, 1);
+
+    if (vkrt->swapChainStorage) {
+        transitionImageLayout(vkrt, commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+        return;
+    }
+
+    VkImage intermediateImage = vkrt->presentIntermediate.image;
+    transitionImageLayout(vkrt, commandBuffer, intermediateImage, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    transitionImageLayout(vkrt, commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    VkImageBlit blit = {0};
+    blit.srcSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    blit.srcOffsets[1] = (VkOffset3D){(int32_t)extent.width, (int32_t)extent.height, 1};
+    blit.dstSubresource = (VkImageSubresourceLayers){VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    blit.dstOffsets[1] = (VkOffset3D){(int32_t)extent.width, (int32_t)extent.height, 1};
+    vkrt->vk.CmdBlitImage(commandBuffer, intermediateImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_NEAREST);
+
+    transitionImageLayout(vkrt, commandBuffer, swapChainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    transitionImageLayout(vkrt, commandBuffer, intermediateImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+}
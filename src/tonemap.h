@@ -0,0 +1,8 @@
+#pragma once
+#include "vkrt.h"
+
+void createTonemapPipeline(VKRT* vkrt);
+void createTonemapResources(VKRT* vkrt);
+void destroyTonemapResources(VKRT* vkrt);
+void destroyTonemapPipeline(VKRT* vkrt);
+void recordTonemap(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t imageIndex);
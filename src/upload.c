@@ -0,0 +1,134 @@
+#include "upload.h"
+#include "buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UPLOAD_REGION_SIZE (UPLOAD_RING_SIZE / UPLOAD_RING_REGIONS)
+#define UPLOAD_ALIGNMENT 16
+
+void createUploadRing(VKRT* vkrt) {
+    UploadRing* ring = &vkrt->uploadRing;
+    createBuffer(vkrt, UPLOAD_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->buffer, &ring->memory);
+    vkrt->vk.MapMemory(vkrt->device, ring->memory, 0, UPLOAD_RING_SIZE, 0, (void**)&ring->mapped);
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {0};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandPool = vkrt->commandPool;
+    commandBufferAllocateInfo.commandBufferCount = UPLOAD_RING_REGIONS;
+
+    if (vkrt->vk.AllocateCommandBuffers(vkrt->device, &commandBufferAllocateInfo, ring->commandBuffers) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate upload command buffers");
+        exit(EXIT_FAILURE);
+    }
+
+    // Signaled, so the first use of a region waits like every later one
+    VkFenceCreateInfo fenceCreateInfo = {0};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (uint32_t i = 0; i < UPLOAD_RING_REGIONS; i++) {
+        if (vkrt->vk.CreateFence(vkrt->device, &fenceCreateInfo, NULL, &ring->fences[i]) != VK_SUCCESS) {
+            perror("ERROR: Failed to create upload fence");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    ring->region = 0;
+    ring->offset = 0;
+    ring->recording = VK_FALSE;
+}
+
+void destroyUploadRing(VKRT* vkrt) {
+    UploadRing* ring = &vkrt->uploadRing;
+    flushUploads(vkrt);
+
+    for (uint32_t i = 0; i < UPLOAD_RING_REGIONS; i++) {
+        vkrt->vk.DestroyFence(vkrt->device, ring->fences[i], NULL);
+    }
+    vkrt->vk.FreeCommandBuffers(vkrt->device, vkrt->commandPool, UPLOAD_RING_REGIONS, ring->commandBuffers);
+    vkrt->vk.UnmapMemory(vkrt->device, ring->memory);
+    vkrt->vk.DestroyBuffer(vkrt->device, ring->buffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, ring->memory, NULL);
+}
+
+static void beginRegion(VKRT* vkrt) {
+    UploadRing* ring = &vkrt->uploadRing;
+    vkrt->vk.WaitForFences(vkrt->device, 1, &ring->fences[ring->region], VK_TRUE, UINT64_MAX);
+
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {0};
+    commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkrt->vk.BeginCommandBuffer(ring->commandBuffers[ring->region], &commandBufferBeginInfo);
+
+    ring->offset = 0;
+    ring->recording = VK_TRUE;
+}
+
+// Streams host data into a device buffer through the ring, in chunks when it is larger than what is left
+// of the current region. The data is copied before returning, the device copy happens once submitted.
+void uploadToBuffer(VKRT* vkrt, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+    UploadRing* ring = &vkrt->uploadRing;
+    const uint8_t* source = (const uint8_t*)data;
+
+    while (size > 0) {
+        if (!ring->recording) beginRegion(vkrt);
+        if (ring->offset >= UPLOAD_REGION_SIZE) {
+            submitUploads(vkrt);
+            continue;
+        }
+
+        VkDeviceSize chunk = UPLOAD_REGION_SIZE - ring->offset;
+        if (chunk > size) chunk = size;
+
+        VkDeviceSize srcOffset = (VkDeviceSize)ring->region * UPLOAD_REGION_SIZE + ring->offset;
+        memcpy(ring->mapped + srcOffset, source, (size_t)chunk);
+
+        VkBufferCopy copyRegion = {srcOffset, dstOffset, chunk};
+        vkrt->vk.CmdCopyBuffer(ring->commandBuffers[ring->region], ring->buffer, dstBuffer, 1, &copyRegion);
+
+        ring->offset = (ring->offset + chunk + UPLOAD_ALIGNMENT - 1) & ~(VkDeviceSize)(UPLOAD_ALIGNMENT - 1);
+        source += chunk;
+        dstOffset += chunk;
+        size -= chunk;
+    }
+}
+
+// Submits the copies recorded so far without waiting. The closing barrier orders them before any later
+// submission on the graphics queue, so callers only need this before their own QueueSubmit.
+void submitUploads(VKRT* vkrt) {
+    UploadRing* ring = &vkrt->uploadRing;
+    if (!ring->recording) return;
+
+    VkCommandBuffer commandBuffer = ring->commandBuffers[ring->region];
+
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    vkrt->vk.EndCommandBuffer(commandBuffer);
+
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    vkrt->vk.ResetFences(vkrt->device, 1, &ring->fences[ring->region]);
+    if (vkrt->vk.QueueSubmit(vkrt->graphicsQueue, 1, &submitInfo, ring->fences[ring->region]) != VK_SUCCESS) {
+        perror("ERROR: Failed to submit uploads");
+        exit(EXIT_FAILURE);
+    }
+
+    ring->region = (ring->region + 1) % UPLOAD_RING_REGIONS;
+    ring->recording = VK_FALSE;
+}
+
+// Submits what is pending and waits for every region, for callers that reuse or free their destinations
+void flushUploads(VKRT* vkrt) {
+    UploadRing* ring = &vkrt->uploadRing;
+    submitUploads(vkrt);
+    vkrt->vk.WaitForFences(vkrt->device, UPLOAD_RING_REGIONS, ring->fences, VK_TRUE, UINT64_MAX);
+}
\ No newline at end of file
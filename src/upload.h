@@ -0,0 +1,8 @@
+#pragma once
+#include "vkrt.h"
+
+void createUploadRing(VKRT* vkrt);
+void destroyUploadRing(VKRT* vkrt);
+void uploadToBuffer(VKRT* vkrt, VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+void submitUploads(VKRT* vkrt);
+void flushUploads(VKRT* vkrt);
\ No newline at end of file
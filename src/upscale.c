@@ -0,0 +1,214 @@
+#include "upscale.h"
+#include "buffer.h"
+#include "command.h"
+#include "interface.h"
+#include "pipeline.h"
+#include "query.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define UPSCALE_WORKGROUP_SIZE 8
+#define UPSCALE_BINDING_COUNT 5
+// Enough jitter phases for several samples per output pixel at half scale
+#define UPSCALE_JITTER_PHASES 32
+
+static const char* upscaleShaders[UPSCALE_STAGE_COUNT] = {
+    "./upscale_reconstruct.comp.spv",
+    "./upscale_output.comp.spv"};
+
+static const VkDescriptorType upscaleBindingTypes[UPSCALE_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+void createUpscalePipeline(VKRT* vkrt) {
+    // The output stage writes the storage image without a format qualifier
+    vkrt->upscaleSupported = vkrt->storageWriteWithoutFormat;
+    if (!vkrt->upscaleSupported) {
+        printf("INFO: Device lacks formatless storage writes, temporal upscaler disabled.\n");
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[UPSCALE_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < UPSCALE_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = upscaleBindingTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->upscaleDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create upscaler descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->upscaleDescriptorSetLayout;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->upscalePipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create upscaler pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < UPSCALE_STAGE_COUNT; i++) {
+        vkrt->upscalePipelines[i] = createComputePipeline(vkrt, upscaleShaders[i], vkrt->upscalePipelineLayout, NULL);
+    }
+}
+
+void destroyUpscalePipeline(VKRT* vkrt) {
+    if (!vkrt->upscaleSupported) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < UPSCALE_STAGE_COUNT; i++) {
+        vkrt->vk.DestroyPipeline(vkrt->device, vkrt->upscalePipelines[i], NULL);
+    }
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->upscalePipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->upscaleDescriptorSetLayout, NULL);
+}
+
+void createUpscaleResources(VKRT* vkrt) {
+    VkDeviceSize capacity = (VkDeviceSize)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+
+    // Motion is per traced pixel, which never exceeds the output; history is per output pixel, two frames
+    createBuffer(vkrt, capacity * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->upscaleMotionBuffer, &vkrt->upscaleMotionMemory);
+    createBuffer(vkrt, 2 * capacity * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->upscaleHistoryBuffer, &vkrt->upscaleHistoryMemory);
+
+    // Zero history length marks every pixel as having nothing to reproject
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands(vkrt);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->upscaleHistoryBuffer, 0, VK_WHOLE_SIZE, 0);
+    endSingleTimeCommands(vkrt, commandBuffer);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = 1;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->upscaleDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create upscaler descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->upscaleDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = &vkrt->upscaleDescriptorSetLayout;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->upscaleDescriptorSet) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate upscaler descriptor set");
+        exit(EXIT_FAILURE);
+    }
+
+    // Low resolution samples are read from the traced sub-rectangle, the output fills the whole image
+    VkDescriptorImageInfo imageInfos[UPSCALE_BINDING_COUNT] = {0};
+    imageInfos[1] = (VkDescriptorImageInfo){vkrt->storageImageSampler, vkrt->storageImageView, VK_IMAGE_LAYOUT_GENERAL};
+    imageInfos[2] = (VkDescriptorImageInfo){VK_NULL_HANDLE, vkrt->storageImageView, VK_IMAGE_LAYOUT_GENERAL};
+
+    VkDescriptorBufferInfo bufferInfos[UPSCALE_BINDING_COUNT] = {0};
+    bufferInfos[0] = (VkDescriptorBufferInfo){vkrt->uniformBuffer, 0, sizeof(SceneUniform)};
+    bufferInfos[3] = (VkDescriptorBufferInfo){vkrt->upscaleMotionBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = (VkDescriptorBufferInfo){vkrt->upscaleHistoryBuffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[UPSCALE_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < UPSCALE_BINDING_COUNT; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = vkrt->upscaleDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = upscaleBindingTypes[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    for (uint32_t i = 1; i <= 2; i++) {
+        writes[i].pImageInfo = &imageInfos[i];
+        writes[i].pBufferInfo = NULL;
+    }
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+}
+
+void destroyUpscaleResources(VKRT* vkrt) {
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->upscaleDescriptorPool, NULL);
+    vkrt->upscaleDescriptorPool = VK_NULL_HANDLE;
+
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->upscaleMotionBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->upscaleMotionMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->upscaleHistoryBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->upscaleHistoryMemory, NULL);
+
+    // The ray tracing descriptor set falls back to a placeholder for the motion buffer
+    vkrt->upscaleMotionBuffer = VK_NULL_HANDLE;
+}
+
+// Like the denoiser, this needs a fresh frame every launch and the megakernel raygen's motion vectors
+VkBool32 upscaleActive(VKRT* vkrt) {
+    return vkrt->pathSettings.upscaler && vkrt->outputPrecision != OUTPUT_PRECISION_RGBA32F && vkrt->traceMode == TRACE_MODE_MEGAKERNEL;
+}
+
+static float halton(uint32_t index, uint32_t base) {
+    float result = 0.0f;
+    float fraction = 1.0f / base;
+    while (index > 0) {
+        result += fraction * (index % base);
+        index /= base;
+        fraction /= base;
+    }
+    return result;
+}
+
+// Picks this frame's Halton(2, 3) offset, or none while the upscaler is off, and rebuilds the projection around it.
+// Call after the render size for the frame is known.
+void updateUpscaleJitter(VKRT* vkrt) {
+    float jitter[2] = {0.0f, 0.0f};
+    if (upscaleActive(vkrt)) {
+        uint32_t index = vkrt->frameIndex % UPSCALE_JITTER_PHASES + 1;
+        jitter[0] = halton(index, 2) - 0.5f;
+        jitter[1] = halton(index, 3) - 0.5f;
+    }
+
+    vkrt->uniformBufferMapped->jitter[0] = jitter[0];
+    vkrt->uniformBufferMapped->jitter[1] = jitter[1];
+    jitterProjection(vkrt);
+}
+
+// Reconstructs the output-resolution image into history, then copies it into the storage image.
+// Runs after the trace, ReSTIR and the denoiser, before tone mapping.
+void recordUpscale(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot) {
+    uint32_t groupsX = (vkrt->swapChainExtent.width + UPSCALE_WORKGROUP_SIZE - 1) / UPSCALE_WORKGROUP_SIZE;
+    uint32_t groupsY = (vkrt->swapChainExtent.height + UPSCALE_WORKGROUP_SIZE - 1) / UPSCALE_WORKGROUP_SIZE;
+
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_UPSCALE);
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->upscalePipelineLayout, 0, 1, &vkrt->upscaleDescriptorSet, 0, NULL);
+
+    for (uint32_t stage = 0; stage < UPSCALE_STAGE_COUNT; stage++) {
+        vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->upscalePipelines[stage]);
+        vkrt->vk.CmdDispatch(commandBuffer, groupsX, groupsY, 1);
+
+        // The last barrier also keeps the next frame's raygen from overwriting samples still being read
+        vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 1, &barrier, 0, NULL, 0, NULL);
+    }
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include "vkrt.h"
+
+// Fixed render scale while upscaling without dynamic resolution, a quarter of the output pixels
+#define UPSCALE_RENDER_SCALE 0.5f
+
+void createUpscalePipeline(VKRT* vkrt);
+void createUpscaleResources(VKRT* vkrt);
+void destroyUpscaleResources(VKRT* vkrt);
+void destroyUpscalePipeline(VKRT* vkrt);
+VkBool32 upscaleActive(VKRT* vkrt);
+void updateUpscaleJitter(VKRT* vkrt);
+void recordUpscale(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot);
@@ -41,8 +41,13 @@ int checkValidationLayerSupport() {
     return VK_TRUE;
 }
 
-const char** getRequiredExtensions(uint32_t* extensionCount) {
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(extensionCount);
+// Surface extensions come from GLFW and are left out when nothing is presented
+const char** getRequiredExtensions(VkBool32 presentation, uint32_t* extensionCount) {
+    const char** glfwExtensions = NULL;
+    *extensionCount = 0;
+    if (presentation) {
+        glfwExtensions = glfwGetRequiredInstanceExtensions(extensionCount);
+    }
 
     uint32_t count = *extensionCount;
 
@@ -6,7 +6,7 @@ extern const uint32_t numValidationLayers;
 extern const VkBool32 enableValidationLayers;
 
 int checkValidationLayerSupport();
-const char** getRequiredExtensions(uint32_t* extensionCount);
+const char** getRequiredExtensions(VkBool32 presentation, uint32_t* extensionCount);
 
 void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT* createInfo);
 void setupDebugMessenger(VKRT* vkrt);
@@ -5,30 +5,335 @@
 
 #include "cglm.h"
 #include "dcimgui.h"
+#include "dispatch.h"
+
+#include <pthread.h>
 
 #define WIDTH 800
 #define HEIGHT 600
 
 #define MAX_FRAMES_IN_FLIGHT 2
+#define MAX_RECORD_THREADS 8
+#define RAYCAST_SLOT_COUNT 2
+#define UPLOAD_RING_SIZE (32u << 20)
+#define UPLOAD_RING_REGIONS 4
+
+#define MAX_TIMESTAMP_SLOTS 8
+#define MAX_TIMESTAMPS_PER_SLOT 256
+
+typedef enum Tonemapper {
+    TONEMAPPER_CLAMP,
+    TONEMAPPER_REINHARD,
+    TONEMAPPER_ACES,
+    TONEMAPPER_COUNT
+} Tonemapper;
+
+typedef enum OutputPrecision {
+    OUTPUT_PRECISION_RGBA16F,
+    OUTPUT_PRECISION_R11G11B10F,
+    OUTPUT_PRECISION_RGBA32F,
+    OUTPUT_PRECISION_COUNT
+} OutputPrecision;
+
+typedef struct OutputPrecisionInfo {
+    const char* name;
+    VkFormat format;
+    uint32_t bytesPerPixel;
+    const char* rayGenShader;
+} OutputPrecisionInfo;
+
+typedef enum TraceMode {
+    TRACE_MODE_MEGAKERNEL,
+    TRACE_MODE_WAVEFRONT,
+    TRACE_MODE_COUNT
+} TraceMode;
+
+typedef enum WavefrontStage {
+    WAVEFRONT_STAGE_GENERATE,
+    WAVEFRONT_STAGE_COUNT_OCTANT,
+    WAVEFRONT_STAGE_SCATTER_OCTANT,
+    WAVEFRONT_STAGE_COUNT_MATERIAL,
+    WAVEFRONT_STAGE_SCATTER_MATERIAL,
+    WAVEFRONT_STAGE_SCAN,
+    WAVEFRONT_STAGE_EXTEND,
+    WAVEFRONT_STAGE_SHADE,
+    WAVEFRONT_STAGE_PREPARE,
+    WAVEFRONT_STAGE_CONNECT,
+    WAVEFRONT_STAGE_COUNT
+} WavefrontStage;
+
+typedef enum RestirStage {
+    RESTIR_STAGE_INITIAL,
+    RESTIR_STAGE_TEMPORAL,
+    RESTIR_STAGE_SPATIAL,
+    RESTIR_STAGE_RESOLVE,
+    RESTIR_STAGE_COUNT
+} RestirStage;
+
+typedef enum AdaptiveStage {
+    ADAPTIVE_STAGE_REDUCE,
+    ADAPTIVE_STAGE_PREPARE,
+    ADAPTIVE_STAGE_COUNT
+} AdaptiveStage;
+
+typedef enum DenoiseStage {
+    DENOISE_STAGE_HISTORY,
+    DENOISE_STAGE_MOMENTS,
+    DENOISE_STAGE_FILTER,
+    DENOISE_STAGE_COUNT
+} DenoiseStage;
+
+typedef enum UpscaleStage {
+    UPSCALE_STAGE_RECONSTRUCT,
+    UPSCALE_STAGE_OUTPUT,
+    UPSCALE_STAGE_COUNT
+} UpscaleStage;
+
+typedef enum GpuTimer {
+    GPU_TIMER_TRACE,
+    GPU_TIMER_GENERATE,
+    GPU_TIMER_EXTEND,
+    GPU_TIMER_SHADE,
+    GPU_TIMER_CONNECT,
+    GPU_TIMER_INITIAL,
+    GPU_TIMER_TEMPORAL,
+    GPU_TIMER_SPATIAL,
+    GPU_TIMER_RESOLVE,
+    GPU_TIMER_ADAPTIVE,
+    GPU_TIMER_HISTORY,
+    GPU_TIMER_MOMENTS,
+    GPU_TIMER_FILTER,
+    GPU_TIMER_UPSCALE,
+    GPU_TIMER_PRESENT,
+    GPU_TIMER_COUNT
+} GpuTimer;
+
+typedef enum EnvironmentSampling {
+    ENVIRONMENT_SAMPLING_UNIFORM,
+    ENVIRONMENT_SAMPLING_IMPORTANCE,
+    ENVIRONMENT_SAMPLING_COUNT
+} EnvironmentSampling;
+
+typedef enum LightSampling {
+    LIGHT_SAMPLING_UNIFORM,
+    LIGHT_SAMPLING_POWER,
+    LIGHT_SAMPLING_TREE,
+    LIGHT_SAMPLING_COUNT
+} LightSampling;
+
+typedef enum Sampler {
+    SAMPLER_PCG,
+    SAMPLER_BLUE_NOISE,
+    SAMPLER_SOBOL,
+    SAMPLER_COUNT
+} Sampler;
+
+typedef enum Denoiser {
+    DENOISER_OFF,
+    DENOISER_FAST,
+    DENOISER_QUALITY,
+    DENOISER_COUNT
+} Denoiser;
+
+typedef struct PathSettings {
+    uint32_t maxDepth;
+    uint32_t rouletteDepth;
+    uint32_t nextEventEstimation;
+    uint32_t environmentSampling;
+    uint32_t lightSampling;
+    uint32_t restir;
+    uint32_t sampler;
+    uint32_t adaptive;
+    uint32_t denoiser;
+    uint32_t upscaler;
+} PathSettings;
+
+typedef struct PathCounters {
+    uint32_t rays;
+    uint32_t shadowRays;
+    uint32_t activePixels;
+} PathCounters;
 
 typedef struct SceneUniform {
     mat4 viewInverse;
     mat4 projInverse;
+    mat4 previousViewProjection;
+    float exposure;
+    uint32_t tonemapper;
+    uint32_t accumulatedFrames;
+    uint32_t lightCount;
+    uint32_t environmentWidth;
+    uint32_t environmentHeight;
+    uint32_t frameIndex;
+    float adaptiveThreshold;
+    uint32_t renderSize[2];
+    float jitter[2];
 } SceneUniform;
 
+// Raygen push constants: position of the launch inside the traced image, nonzero only for offline tiles,
+// and the first view of a multi-view launch
+typedef struct TracePushConstants {
+    uint32_t tileOffset[2];
+    uint32_t viewIndex;
+} TracePushConstants;
+
+// One ray of a batch query, std430 layout of raycast.comp
+typedef struct CastRay {
+    float origin[3];
+    float tMin;
+    float direction[3];
+    float tMax;
+} CastRay;
+
+// Result of a batch query ray; misses have a negative hitT and RAYCAST_MISS ids
+typedef struct CastHit {
+    float hitT;
+    uint32_t primitiveIndex;
+    uint32_t instanceIndex;
+    uint32_t padding;
+    float barycentrics[2];
+} CastHit;
+
+// One of the two in-flight batches of the ray-cast API, filled on the host while the other one traces
+typedef struct RayCastSlot {
+    VkBuffer stagingRayBuffer;
+    VkDeviceMemory stagingRayMemory;
+    CastRay* stagingRays;
+    VkBuffer stagingHitBuffer;
+    VkDeviceMemory stagingHitMemory;
+    CastHit* stagingHits;
+    VkBuffer rayBuffer;
+    VkDeviceMemory rayMemory;
+    VkBuffer hitBuffer;
+    VkDeviceMemory hitMemory;
+    VkDescriptorSet descriptorSet;
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    CastHit* destination;
+    uint32_t count;
+    VkBool32 pending;
+} RayCastSlot;
+
+typedef struct Image {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkFormat format;
+    VkExtent2D extent;
+} Image;
+
+typedef struct Vertex {
+    float position[3];
+    uint32_t materialIndex;
+    float normal[4];
+} Vertex;
+
+typedef struct Material {
+    float baseColor[4];
+    float emission[4];
+} Material;
+
+// Host copy of a parsed scene, with the wide BVH over it once built
+typedef struct SceneData {
+    Vertex* vertices;
+    uint32_t vertexCount;
+    uint32_t* indices;
+    uint32_t indexCount;
+    Material* materials;
+    uint32_t materialCount;
+    struct WideBVH* bvh;
+} SceneData;
+
+// Scene geometry in one host-visible buffer, laid out as vertices, indices, then materials
+typedef struct SceneStaging {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize vertexSize;
+    VkDeviceSize indexSize;
+    VkDeviceSize materialSize;
+} SceneStaging;
+
+typedef enum SceneLoadStage {
+    SCENE_LOAD_PARSING,
+    SCENE_LOAD_BUILDING,
+    SCENE_LOAD_STAGING,
+    SCENE_LOAD_READY,
+    SCENE_LOAD_DONE,
+    SCENE_LOAD_STAGE_COUNT
+} SceneLoadStage;
+
+// Background load of the requested scene while an empty proxy renders; the loader thread owns scene and
+// staging until it reaches SCENE_LOAD_READY, then the render loop swaps them in
+typedef struct SceneLoader {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    const char* path;
+    SceneLoadStage stage;
+    VkBool32 started;
+    SceneData scene;
+    SceneStaging staging;
+    uint64_t startTime;
+    uint64_t firstPixelTime;
+    uint64_t loadedTime;
+} SceneLoader;
+
+typedef struct VKRT VKRT;
+
+typedef void (*RecordFunction)(VKRT* vkrt, VkCommandBuffer commandBuffer, void* data);
+
+// A command buffer to record on any recorder thread. Jobs recorded together must not share a command pool.
+typedef struct RecordJob {
+    RecordFunction record;
+    void* data;
+    VkCommandBuffer commandBuffer;
+} RecordJob;
+
+typedef struct RecordThread {
+    VKRT* vkrt;
+    uint32_t index;
+    pthread_t thread;
+} RecordThread;
+
+typedef struct Recorder {
+    RecordThread threads[MAX_RECORD_THREADS];
+    uint32_t threadCount;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobsReady;
+    pthread_cond_t jobsFinished;
+    RecordJob* jobs;
+    uint32_t jobCount;
+    uint32_t nextJob;
+    uint32_t finishedJobs;
+    VkBool32 shutdown;
+} Recorder;
+
+// Persistent host-visible staging split into regions that are recorded and submitted in turn, each reused
+// only once its fence signals. Copies batch into the current region until it fills or is submitted.
+typedef struct UploadRing {
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    uint8_t* mapped;
+    VkCommandBuffer commandBuffers[UPLOAD_RING_REGIONS];
+    VkFence fences[UPLOAD_RING_REGIONS];
+    uint32_t region;
+    VkDeviceSize offset;
+    VkBool32 recording;
+} UploadRing;
+
 typedef struct Camera {
     vec3 pos, target, up;
     uint32_t width, height;
     float nearZ, farZ, vfov;
 } Camera;
 
-typedef struct VKRT {
+struct VKRT {
     GLFWwindow* window;
     ImGuiContext* imguiContext;
     VkInstance instance;
     VkDebugUtilsMessengerEXT debugMessenger;
     VkPhysicalDevice physicalDevice;
     VkDevice device;
+    DeviceDispatch vk;
     char deviceName[256];
     VkQueue graphicsQueue;
     VkQueue presentQueue;
@@ -39,6 +344,11 @@ typedef struct VKRT {
     size_t swapChainImageCount;
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
+    VkBool32 swapChainStorage;
+    VkBool32 storageWriteWithoutFormat;
+    VkBool32 synchronization2;
+    VkBool32 rayQuery;
+    VkBool32 traceRaysIndirect;
     VkRenderPass renderPass;
     VkFramebuffer* framebuffers;
     VkDescriptorSetLayout descriptorSetLayout;
@@ -47,7 +357,14 @@ typedef struct VKRT {
     VkPipelineLayout pipelineLayout;
     VkPipeline rayTracingPipeline;
     VkCommandPool commandPool;
-    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
+    VkCommandPool frameCommandPools[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer frameCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+    Recorder recorder;
+    UploadRing uploadRing;
+    VkCommandPool* traceCommandPools;
+    VkCommandBuffer* traceCommandBuffers;
+    VkBool32 traceCommandBuffersDirty;
+    uint32_t frameImageIndices[MAX_FRAMES_IN_FLIGHT];
     VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
     VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
     VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT];
@@ -56,13 +373,118 @@ typedef struct VKRT {
     VkBuffer shaderBindingTableBuffer;
     VkDeviceMemory shaderBindingTableMemory;
     VkStridedDeviceAddressRegionKHR shaderBindingTables[4];
+    uint32_t missGroupCount;
+    uint32_t hitGroupCount;
     VkBuffer uniformBuffer;
     VkDeviceMemory uniformBufferMemory;
     SceneUniform* uniformBufferMapped;
     Camera camera;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 previousViewProjection;
     VkImage storageImage;
     VkImageView storageImageView;
     VkDeviceMemory storageImageMemory;
+    VkDeviceSize storageImageSize;
+    OutputPrecision outputPrecision;
+    OutputPrecision requestedOutputPrecision;
+    VkBool32 storageExtendedFormats;
+    float precisionTraceTimes[OUTPUT_PRECISION_COUNT];
+    uint32_t accumulatedFrames;
+    uint32_t frameIndex;
+    PathSettings pathSettings;
+    PathSettings requestedPathSettings;
+    VkBuffer pathCounterBuffer;
+    VkDeviceMemory pathCounterMemory;
+    PathCounters* pathCounterMapped;
+    float raysPerSecond;
+    float averagePathLength;
+    float shadowRaysPerPixel;
+    float activePixelFraction;
+    TraceMode traceMode;
+    TraceMode requestedTraceMode;
+    VkBool32 wavefrontSupported;
+    VkDescriptorSetLayout wavefrontDescriptorSetLayout;
+    VkPipelineLayout wavefrontPipelineLayout;
+    VkPipeline wavefrontPipelines[WAVEFRONT_STAGE_COUNT];
+    VkDescriptorPool wavefrontDescriptorPool;
+    VkDescriptorSet wavefrontDescriptorSet;
+    VkBuffer wavefrontRayBuffer;
+    VkDeviceMemory wavefrontRayMemory;
+    VkBuffer wavefrontHitBuffer;
+    VkDeviceMemory wavefrontHitMemory;
+    VkBuffer wavefrontRadianceBuffer;
+    VkDeviceMemory wavefrontRadianceMemory;
+    VkBuffer wavefrontStateBuffer;
+    VkDeviceMemory wavefrontStateMemory;
+    VkBool32 restirSupported;
+    VkDescriptorSetLayout restirDescriptorSetLayout;
+    VkPipelineLayout restirPipelineLayout;
+    VkPipeline restirPipelines[RESTIR_STAGE_COUNT];
+    VkDescriptorPool restirDescriptorPool;
+    VkDescriptorSet restirDescriptorSet;
+    VkBuffer restirSurfaceBuffer;
+    VkDeviceMemory restirSurfaceMemory;
+    VkBuffer restirReservoirBuffer;
+    VkDeviceMemory restirReservoirMemory;
+    VkBuffer restirRadianceBuffer;
+    VkDeviceMemory restirRadianceMemory;
+    VkDescriptorSetLayout adaptiveDescriptorSetLayout;
+    VkPipelineLayout adaptivePipelineLayout;
+    VkPipeline adaptivePipelines[ADAPTIVE_STAGE_COUNT];
+    VkDescriptorPool adaptiveDescriptorPool;
+    VkDescriptorSet adaptiveDescriptorSet;
+    VkBuffer adaptiveStatsBuffer;
+    VkDeviceMemory adaptiveStatsMemory;
+    VkBuffer adaptiveTileBuffer;
+    VkDeviceMemory adaptiveTileMemory;
+    VkDeviceAddress adaptiveTraceArgsAddress;
+    VkBool32 denoiseSupported;
+    VkDescriptorSetLayout denoiseDescriptorSetLayout;
+    VkPipelineLayout denoisePipelineLayout;
+    VkPipeline denoisePipelines[DENOISE_STAGE_COUNT];
+    VkDescriptorPool denoiseDescriptorPool;
+    VkDescriptorSet denoiseDescriptorSet;
+    VkBuffer denoiseGuideBuffer;
+    VkDeviceMemory denoiseGuideMemory;
+    VkBuffer denoiseHistoryBuffer;
+    VkDeviceMemory denoiseHistoryMemory;
+    VkBuffer denoiseIlluminationBuffer;
+    VkDeviceMemory denoiseIlluminationMemory;
+    VkBool32 upscaleSupported;
+    VkDescriptorSetLayout upscaleDescriptorSetLayout;
+    VkPipelineLayout upscalePipelineLayout;
+    VkPipeline upscalePipelines[UPSCALE_STAGE_COUNT];
+    VkDescriptorPool upscaleDescriptorPool;
+    VkDescriptorSet upscaleDescriptorSet;
+    VkBuffer upscaleMotionBuffer;
+    VkDeviceMemory upscaleMotionMemory;
+    VkBuffer upscaleHistoryBuffer;
+    VkDeviceMemory upscaleHistoryMemory;
+    uint32_t viewCount;
+    Image viewImage;
+    VkBuffer viewCameraBuffer;
+    VkDeviceMemory viewCameraMemory;
+    VkBool32 rayCastSupported;
+    VkDescriptorSetLayout rayCastDescriptorSetLayout;
+    VkPipelineLayout rayCastPipelineLayout;
+    VkPipeline rayCastPipeline;
+    VkDescriptorPool rayCastDescriptorPool;
+    RayCastSlot rayCastSlots[RAYCAST_SLOT_COUNT];
+    uint32_t rayCastSlot;
+    VkSampler storageImageSampler;
+    VkDescriptorSetLayout tonemapDescriptorSetLayout;
+    VkDescriptorPool tonemapDescriptorPool;
+    VkDescriptorSet* tonemapDescriptorSets;
+    VkPipelineLayout tonemapPipelineLayout;
+    VkPipeline tonemapPipeline;
+    VkPipeline tonemapIntermediatePipeline;
+    Image presentIntermediate;
+    VkQueryPool timestampQueryPool;
+    float timestampPeriod;
+    uint32_t timestampCounts[MAX_TIMESTAMP_SLOTS];
+    uint8_t timestampTimers[MAX_TIMESTAMP_SLOTS][MAX_TIMESTAMPS_PER_SLOT / 2];
+    float gpuTimes[GPU_TIMER_COUNT];
     VkAccelerationStructureKHR topLevelAccelerationStructure;
     VkDeviceMemory topLevelAccelerationStructureMemory;
     VkBuffer topLevelAccelerationStructureBuffer;
@@ -79,6 +501,27 @@ typedef struct VKRT {
     VkDeviceMemory indexBufferMemory;
     VkDeviceAddress indexBufferDeviceAddress;
     uint32_t indexCount;
+    VkBuffer materialBuffer;
+    VkDeviceMemory materialBufferMemory;
+    uint32_t materialCount;
+    // Host copies of the scene, kept for CPU-side queries
+    Vertex* vertices;
+    uint32_t* indices;
+    Material* materials;
+    // Wide BVH over the host copies for picking, built with the scene
+    struct WideBVH* sceneBVH;
+    SceneLoader sceneLoader;
+    VkBuffer lightBuffer;
+    VkDeviceMemory lightBufferMemory;
+    VkBuffer lightTreeBuffer;
+    VkDeviceMemory lightTreeBufferMemory;
+    uint32_t lightCount;
+    VkBuffer environmentBuffer;
+    VkDeviceMemory environmentBufferMemory;
+    uint32_t environmentWidth;
+    uint32_t environmentHeight;
+    VkBuffer samplerBuffer;
+    VkDeviceMemory samplerBufferMemory;
     uint32_t frameCount;
     uint32_t tempFrameCount;
     uint64_t previousTime;
@@ -86,12 +529,61 @@ typedef struct VKRT {
     uint64_t lastFrameTimeReported;
     uint32_t averageFPS;
     float averageFrametime;
+    uint64_t tempSubmitTime;
+    float averageSubmitTime;
     uint8_t vsync;
-} VKRT;
+    uint8_t dynamicResolution;
+    float traceBudget;
+    float renderScale;
+    uint32_t renderScaleFrames;
+    const char* benchmarkName;
+    const char* offlinePath;
+    uint32_t offlineWidth;
+    uint32_t offlineHeight;
+    uint32_t offlineSamples;
+    const char* multiViewPath;
+    uint32_t multiViewCount;
+    const char* castRayPath;
+    const char* castHitPath;
+    VkBool32 headless;
+    VkBool32 cpuReference;
+    const char* scenePath;
+    const char* environmentPath;
+};
 
-typedef struct Vertex {
-    float position[4];
-    float normal[4];
-} Vertex;
+// Emissive triangle, selected with probability proportional to its power
+typedef struct Light {
+    float v0[3];
+    float cdf;
+    float v1[3];
+    float pdf;
+    float v2[3];
+    float area;
+    float emission[4];
+} Light;
+
+#define LIGHT_LEAF_BIT 0x80000000u
+
+// Light tree node in depth-first order: an interior node's first child follows it and `child`
+// holds the second, a leaf has LIGHT_LEAF_BIT set and `child` holds its light index.
+// Bounds, normal cone and power cover every light below the node.
+typedef struct LightNode {
+    float boundsMin[3];
+    float power;
+    float boundsMax[3];
+    float cosTheta;
+    float axis[3];
+    uint32_t child;
+} LightNode;
+
+// Environment texels in row-major order followed by one entry per row for the marginal distribution.
+// Probability is the discrete probability of the texel or row; threshold and alias form its alias table.
+typedef struct EnvironmentEntry {
+    float radiance[3];
+    float probability;
+    float threshold;
+    uint32_t alias;
+    uint32_t padding[2];
+} EnvironmentEntry;
 
 #define COUNT_OF(x) ((sizeof(x) / sizeof(0 [x])) / ((size_t)(!(sizeof(x) % sizeof(0 [x])))))
\ No newline at end of file
@@ -0,0 +1,298 @@
+#include "wavefront.h"
+#include "buffer.h"
+#include "pipeline.h"
+#include "query.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WAVEFRONT_WORKGROUP_SIZE 64
+#define WAVEFRONT_BIN_COUNT 256
+#define WAVEFRONT_BINDING_COUNT 15
+
+// Mirrors of the std430 layouts in wavefront.comp
+typedef struct WavefrontRay {
+    float origin[3];
+    uint32_t pixel;
+    float direction[3];
+    uint32_t rng;
+    float throughput[3];
+    float pdf;
+} WavefrontRay;
+
+typedef struct WavefrontHit {
+    float position[3];
+    float hitT;
+    float normal[3];
+    uint32_t materialIndex;
+} WavefrontHit;
+
+typedef struct WavefrontState {
+    uint32_t queueCounts[2];
+    uint32_t padding[2];
+    VkDispatchIndirectCommand dispatchArgs;
+    uint32_t dispatchPadding;
+    uint32_t binCounts[WAVEFRONT_BIN_COUNT];
+    uint32_t binOffsets[WAVEFRONT_BIN_COUNT];
+} WavefrontState;
+
+typedef struct WavefrontPushConstants {
+    uint32_t parity;
+    uint32_t depth;
+    uint32_t maxDepth;
+    uint32_t rouletteDepth;
+    uint32_t accumulate;
+    uint32_t nextEventEstimation;
+    uint32_t environmentSampling;
+    uint32_t lightSampling;
+    uint32_t sampler;
+} WavefrontPushConstants;
+
+static const char* wavefrontShaders[WAVEFRONT_STAGE_COUNT] = {
+    "./wavefront_generate.comp.spv",
+    "./wavefront_count_octant.comp.spv",
+    "./wavefront_scatter_octant.comp.spv",
+    "./wavefront_count_material.comp.spv",
+    "./wavefront_scatter_material.comp.spv",
+    "./wavefront_scan.comp.spv",
+    "./wavefront_extend.comp.spv",
+    "./wavefront_shade.comp.spv",
+    "./wavefront_prepare.comp.spv",
+    "./wavefront_connect.comp.spv"};
+
+static const VkDescriptorType wavefrontBindingTypes[WAVEFRONT_BINDING_COUNT] = {
+    VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+    VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER};
+
+void createWavefrontPipeline(VKRT* vkrt) {
+    // Ray queries drive the extend stage and connect writes the storage image without a format qualifier
+    vkrt->wavefrontSupported = vkrt->rayQuery && vkrt->storageWriteWithoutFormat;
+    if (!vkrt->wavefrontSupported) {
+        printf("INFO: Device lacks ray queries or formatless storage writes, wavefront mode disabled.\n");
+        return;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[WAVEFRONT_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < WAVEFRONT_BINDING_COUNT; i++) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = wavefrontBindingTypes[i];
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {0};
+    descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptorSetLayoutCreateInfo.bindingCount = COUNT_OF(bindings);
+    descriptorSetLayoutCreateInfo.pBindings = bindings;
+
+    if (vkrt->vk.CreateDescriptorSetLayout(vkrt->device, &descriptorSetLayoutCreateInfo, NULL, &vkrt->wavefrontDescriptorSetLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create wavefront descriptor set layout");
+        exit(EXIT_FAILURE);
+    }
+
+    VkPushConstantRange pushConstantRange = {0};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(WavefrontPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {0};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &vkrt->wavefrontDescriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkrt->vk.CreatePipelineLayout(vkrt->device, &pipelineLayoutCreateInfo, NULL, &vkrt->wavefrontPipelineLayout) != VK_SUCCESS) {
+        perror("ERROR: Failed to create wavefront pipeline layout");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < WAVEFRONT_STAGE_COUNT; i++) {
+        vkrt->wavefrontPipelines[i] = createComputePipeline(vkrt, wavefrontShaders[i], vkrt->wavefrontPipelineLayout, NULL);
+    }
+}
+
+void destroyWavefrontPipeline(VKRT* vkrt) {
+    if (!vkrt->wavefrontSupported) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < WAVEFRONT_STAGE_COUNT; i++) {
+        vkrt->vk.DestroyPipeline(vkrt->device, vkrt->wavefrontPipelines[i], NULL);
+    }
+    vkrt->vk.DestroyPipelineLayout(vkrt->device, vkrt->wavefrontPipelineLayout, NULL);
+    vkrt->vk.DestroyDescriptorSetLayout(vkrt->device, vkrt->wavefrontDescriptorSetLayout, NULL);
+}
+
+void createWavefrontResources(VKRT* vkrt) {
+    VkDeviceSize capacity = (VkDeviceSize)vkrt->swapChainExtent.width * vkrt->swapChainExtent.height;
+
+    createBuffer(vkrt, 2 * capacity * sizeof(WavefrontRay), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->wavefrontRayBuffer, &vkrt->wavefrontRayMemory);
+    createBuffer(vkrt, 2 * capacity * sizeof(WavefrontHit), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->wavefrontHitBuffer, &vkrt->wavefrontHitMemory);
+    createBuffer(vkrt, 2 * capacity * 4 * sizeof(float), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->wavefrontRadianceBuffer, &vkrt->wavefrontRadianceMemory);
+    createBuffer(vkrt, sizeof(WavefrontState), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vkrt->wavefrontStateBuffer, &vkrt->wavefrontStateMemory);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        {VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 12}};
+
+    VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {0};
+    descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptorPoolCreateInfo.poolSizeCount = COUNT_OF(poolSizes);
+    descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+    descriptorPoolCreateInfo.maxSets = 1;
+
+    if (vkrt->vk.CreateDescriptorPool(vkrt->device, &descriptorPoolCreateInfo, NULL, &vkrt->wavefrontDescriptorPool) != VK_SUCCESS) {
+        perror("ERROR: Failed to create wavefront descriptor pool");
+        exit(EXIT_FAILURE);
+    }
+
+    VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {0};
+    descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptorSetAllocateInfo.descriptorPool = vkrt->wavefrontDescriptorPool;
+    descriptorSetAllocateInfo.descriptorSetCount = 1;
+    descriptorSetAllocateInfo.pSetLayouts = &vkrt->wavefrontDescriptorSetLayout;
+
+    if (vkrt->vk.AllocateDescriptorSets(vkrt->device, &descriptorSetAllocateInfo, &vkrt->wavefrontDescriptorSet) != VK_SUCCESS) {
+        perror("ERROR: Failed to allocate wavefront descriptor set");
+        exit(EXIT_FAILURE);
+    }
+
+    VkWriteDescriptorSetAccelerationStructureKHR accelerationStructureInfo = {0};
+    accelerationStructureInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR;
+    accelerationStructureInfo.accelerationStructureCount = 1;
+    accelerationStructureInfo.pAccelerationStructures = &vkrt->topLevelAccelerationStructure;
+
+    VkDescriptorImageInfo outputImageInfo = {0};
+    outputImageInfo.imageView = vkrt->storageImageView;
+    outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorBufferInfo bufferInfos[WAVEFRONT_BINDING_COUNT] = {0};
+    bufferInfos[2] = (VkDescriptorBufferInfo){vkrt->vertexBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[3] = (VkDescriptorBufferInfo){vkrt->indexBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[4] = (VkDescriptorBufferInfo){vkrt->uniformBuffer, 0, sizeof(SceneUniform)};
+    bufferInfos[5] = (VkDescriptorBufferInfo){vkrt->materialBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[6] = (VkDescriptorBufferInfo){vkrt->pathCounterBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[7] = (VkDescriptorBufferInfo){vkrt->wavefrontRayBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[8] = (VkDescriptorBufferInfo){vkrt->wavefrontHitBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[9] = (VkDescriptorBufferInfo){vkrt->wavefrontRadianceBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[10] = (VkDescriptorBufferInfo){vkrt->wavefrontStateBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[11] = (VkDescriptorBufferInfo){vkrt->lightBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[12] = (VkDescriptorBufferInfo){vkrt->environmentBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[13] = (VkDescriptorBufferInfo){vkrt->lightTreeBuffer, 0, VK_WHOLE_SIZE};
+    bufferInfos[14] = (VkDescriptorBufferInfo){vkrt->samplerBuffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[WAVEFRONT_BINDING_COUNT] = {0};
+    for (uint32_t i = 0; i < WAVEFRONT_BINDING_COUNT; i++) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = vkrt->wavefrontDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = wavefrontBindingTypes[i];
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    writes[0].pNext = &accelerationStructureInfo;
+    writes[0].pBufferInfo = NULL;
+    writes[1].pImageInfo = &outputImageInfo;
+    writes[1].pBufferInfo = NULL;
+
+    vkrt->vk.UpdateDescriptorSets(vkrt->device, COUNT_OF(writes), writes, 0, NULL);
+}
+
+void destroyWavefrontResources(VKRT* vkrt) {
+    vkrt->vk.DestroyDescriptorPool(vkrt->device, vkrt->wavefrontDescriptorPool, NULL);
+    vkrt->wavefrontDescriptorPool = VK_NULL_HANDLE;
+
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->wavefrontRayBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->wavefrontRayMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->wavefrontHitBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->wavefrontHitMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->wavefrontRadianceBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->wavefrontRadianceMemory, NULL);
+    vkrt->vk.DestroyBuffer(vkrt->device, vkrt->wavefrontStateBuffer, NULL);
+    vkrt->vk.FreeMemory(vkrt->device, vkrt->wavefrontStateMemory, NULL);
+}
+
+static void wavefrontBarrier(VKRT* vkrt, VkCommandBuffer commandBuffer) {
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+    vkrt->vk.CmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+static void dispatchStage(VKRT* vkrt, VkCommandBuffer commandBuffer, WavefrontStage stage, const WavefrontPushConstants* pushConstants, uint32_t groupCount) {
+    vkrt->vk.CmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->wavefrontPipelines[stage]);
+    vkrt->vk.CmdPushConstants(commandBuffer, vkrt->wavefrontPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(*pushConstants), pushConstants);
+
+    // A group count of zero dispatches over the current ray queue
+    if (groupCount) {
+        vkrt->vk.CmdDispatch(commandBuffer, groupCount, 1, 1);
+    } else {
+        vkrt->vk.CmdDispatchIndirect(commandBuffer, vkrt->wavefrontStateBuffer, offsetof(WavefrontState, dispatchArgs));
+    }
+
+    wavefrontBarrier(vkrt, commandBuffer);
+}
+
+void recordWavefront(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot) {
+    uint32_t pixelGroups = (vkrt->swapChainExtent.width * vkrt->swapChainExtent.height + WAVEFRONT_WORKGROUP_SIZE - 1) / WAVEFRONT_WORKGROUP_SIZE;
+
+    WavefrontPushConstants pushConstants = {0};
+    pushConstants.maxDepth = vkrt->pathSettings.maxDepth;
+    pushConstants.rouletteDepth = vkrt->pathSettings.rouletteDepth;
+    pushConstants.accumulate = vkrt->outputPrecision == OUTPUT_PRECISION_RGBA32F;
+    pushConstants.nextEventEstimation = vkrt->pathSettings.nextEventEstimation;
+    pushConstants.environmentSampling = vkrt->pathSettings.environmentSampling;
+    pushConstants.lightSampling = vkrt->pathSettings.lightSampling;
+    pushConstants.sampler = vkrt->pathSettings.sampler;
+
+    vkrt->vk.CmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, vkrt->wavefrontPipelineLayout, 0, 1, &vkrt->wavefrontDescriptorSet, 0, NULL);
+    vkrt->vk.CmdFillBuffer(commandBuffer, vkrt->wavefrontStateBuffer, 0, VK_WHOLE_SIZE, 0);
+    wavefrontBarrier(vkrt, commandBuffer);
+
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_GENERATE);
+    dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_GENERATE, &pushConstants, pixelGroups);
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+
+    for (uint32_t depth = 0; depth < vkrt->pathSettings.maxDepth; depth++) {
+        pushConstants.depth = depth;
+        pushConstants.parity = depth & 1;
+
+        beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_EXTEND);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_COUNT_OCTANT, &pushConstants, 0);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_SCAN, &pushConstants, 1);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_SCATTER_OCTANT, &pushConstants, 0);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_EXTEND, &pushConstants, 0);
+        endGpuTimer(vkrt, commandBuffer, timerSlot);
+
+        beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_SHADE);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_COUNT_MATERIAL, &pushConstants, 0);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_SCAN, &pushConstants, 1);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_SCATTER_MATERIAL, &pushConstants, 0);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_SHADE, &pushConstants, 0);
+        dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_PREPARE, &pushConstants, 1);
+        endGpuTimer(vkrt, commandBuffer, timerSlot);
+    }
+
+    beginGpuTimer(vkrt, commandBuffer, timerSlot, GPU_TIMER_CONNECT);
+    dispatchStage(vkrt, commandBuffer, WAVEFRONT_STAGE_CONNECT, &pushConstants, pixelGroups);
+    endGpuTimer(vkrt, commandBuffer, timerSlot);
+}
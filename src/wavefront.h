@@ -0,0 +1,8 @@
+#pragma once
+#include "vkrt.h"
+
+void createWavefrontPipeline(VKRT* vkrt);
+void createWavefrontResources(VKRT* vkrt);
+void destroyWavefrontResources(VKRT* vkrt);
+void destroyWavefrontPipeline(VKRT* vkrt);
+void recordWavefront(VKRT* vkrt, VkCommandBuffer commandBuffer, uint32_t timerSlot);
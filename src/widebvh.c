@@ -0,0 +1,448 @@
+#include "widebvh.h"
+#include "raycast.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__AVX__)
+#include <immintrin.h>
+
+typedef __m256 WideFloat;
+#define wideLoad(pointer) _mm256_loadu_ps(pointer)
+#define wideStore(pointer, value) _mm256_storeu_ps(pointer, value)
+#define wideSplat(value) _mm256_set1_ps(value)
+#define wideAdd(a, b) _mm256_add_ps(a, b)
+#define wideSub(a, b) _mm256_sub_ps(a, b)
+#define wideMul(a, b) _mm256_mul_ps(a, b)
+#define wideMin(a, b) _mm256_min_ps(a, b)
+#define wideMax(a, b) _mm256_max_ps(a, b)
+#define wideLessEqual(a, b) ((uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)))
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+
+typedef __m128 WideFloat;
+#define wideLoad(pointer) _mm_loadu_ps(pointer)
+#define wideStore(pointer, value) _mm_storeu_ps(pointer, value)
+#define wideSplat(value) _mm_set1_ps(value)
+#define wideAdd(a, b) _mm_add_ps(a, b)
+#define wideSub(a, b) _mm_sub_ps(a, b)
+#define wideMul(a, b) _mm_mul_ps(a, b)
+#define wideMin(a, b) _mm_min_ps(a, b)
+#define wideMax(a, b) _mm_max_ps(a, b)
+#define wideLessEqual(a, b) ((uint32_t)_mm_movemask_ps(_mm_cmple_ps(a, b)))
+#else
+// Lane loops with the same NaN behaviour as the SSE min and max, which return their second operand
+typedef struct WideFloat {
+    float lane[WIDE_BVH_WIDTH];
+} WideFloat;
+
+static WideFloat wideLoad(const float* pointer) {
+    WideFloat result;
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) result.lane[i] = pointer[i];
+    return result;
+}
+
+static void wideStore(float* pointer, WideFloat value) {
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) pointer[i] = value.lane[i];
+}
+
+static WideFloat wideSplat(float value) {
+    WideFloat result;
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) result.lane[i] = value;
+    return result;
+}
+
+#define WIDE_LANE_OPERATION(name, expression)                                                \
+    static WideFloat name(WideFloat a, WideFloat b) {                                        \
+        WideFloat result;                                                                    \
+        for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) {                                      \
+            float x = a.lane[i], y = b.lane[i];                                              \
+            result.lane[i] = expression;                                                     \
+        }                                                                                    \
+        return result;                                                                       \
+    }
+
+WIDE_LANE_OPERATION(wideAdd, x + y)
+WIDE_LANE_OPERATION(wideSub, x - y)
+WIDE_LANE_OPERATION(wideMul, x * y)
+WIDE_LANE_OPERATION(wideMin, x < y ? x : y)
+WIDE_LANE_OPERATION(wideMax, x > y ? x : y)
+
+static uint32_t wideLessEqual(WideFloat a, WideFloat b) {
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < WIDE_BVH_WIDTH; i++) mask |= (uint32_t)(a.lane[i] <= b.lane[i]) << i;
+    return mask;
+}
+#endif
+
+static uint32_t lowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+// A ray broadcast to every lane, with the scalar copy the triangle tests use
+typedef struct WideRay {
+    WideFloat originX, originY, originZ;
+    WideFloat inverseX, inverseY, inverseZ;
+    WideFloat tMin;
+    vec3 origin;
+    vec3 direction;
+} WideRay;
+
+// Pending child: a node when count is zero, otherwise a leaf. The packet traversal keeps the rays that
+// entered it in `rays` and the nearest of their entry distances.
+typedef struct WideStackEntry {
+    uint32_t child;
+    uint32_t count;
+    float distance;
+    uint32_t rays;
+} WideStackEntry;
+
+static float boxArea(const BVHNode* node) {
+    vec3 extent;
+    glm_vec3_sub((float*)node->max, (float*)node->min, extent);
+    return extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0];
+}
+
+// Opens the interior child with the largest surface area until the node is full, since the largest
+// boxes are the ones rays are likeliest to enter together
+static uint32_t collapseNode(WideBVH* wide, const BVH* bvh, uint32_t binaryIndex) {
+    uint32_t children[WIDE_BVH_WIDTH] = {binaryIndex};
+    uint32_t childCount = 1;
+
+    while (childCount < WIDE_BVH_WIDTH) {
+        uint32_t opened = childCount;
+        float openedArea = -1.0f;
+        for (uint32_t i = 0; i < childCount; i++) {
+            const BVHNode* child = &bvh->nodes[children[i]];
+            if (!child->count && boxArea(child) > openedArea) {
+                opened = i;
+                openedArea = boxArea(child);
+            }
+        }
+        if (opened == childCount) break;
+
+        uint32_t index = children[opened];
+        children[opened] = index + 1;
+        children[childCount++] = bvh->nodes[index].offset;
+    }
+
+    uint32_t wideIndex = wide->nodeCount++;
+    WideBVHNode* node = &wide->nodes[wideIndex];
+    *node = (WideBVHNode){0};
+    node->childCount = childCount;
+
+    for (uint32_t i = 0; i < childCount; i++) {
+        const BVHNode* child = &bvh->nodes[children[i]];
+        node->minX[i] = child->min[0];
+        node->minY[i] = child->min[1];
+        node->minZ[i] = child->min[2];
+        node->maxX[i] = child->max[0];
+        node->maxY[i] = child->max[1];
+        node->maxZ[i] = child->max[2];
+        node->count[i] = child->count;
+        node->child[i] = child->count ? child->offset : collapseNode(wide, bvh, children[i]);
+    }
+
+    return wideIndex;
+}
+
+void buildWideBVH(WideBVH* wide, const Vertex* vertices, const uint32_t* indices, uint32_t triangleCount) {
+    *wide = (WideBVH){0};
+
+    BVH bvh;
+    buildBVH(&bvh, vertices, indices, triangleCount);
+    if (!bvh.nodeCount) return;
+
+    // Every wide node absorbs at least one binary interior node, so the binary count bounds the wide one
+    wide->nodes = malloc(bvh.nodeCount * sizeof(WideBVHNode));
+    if (!wide->nodes) {
+        perror("ERROR: Failed to allocate wide BVH nodes");
+        exit(EXIT_FAILURE);
+    }
+    collapseNode(wide, &bvh, 0);
+    wide->nodes = realloc(wide->nodes, wide->nodeCount * sizeof(WideBVHNode));
+
+    // The leaves keep the binary ones' triangle ranges, so the triangles are taken over as they are
+    wide->triangles = bvh.triangles;
+    wide->triangleCount = bvh.triangleCount;
+    free(bvh.nodes);
+
+    printf("INFO: Collapsed %u BVH nodes into %u nodes of width %d\n", bvh.nodeCount, wide->nodeCount, WIDE_BVH_WIDTH);
+}
+
+void destroyWideBVH(WideBVH* wide) {
+    free(wide->nodes);
+    free(wide->triangles);
+    *wide = (WideBVH){0};
+}
+
+static void setupWideRay(WideRay* ray, const float* origin, const float* direction, float tMin) {
+    glm_vec3_copy((float*)origin, ray->origin);
+    glm_vec3_copy((float*)direction, ray->direction);
+    ray->originX = wideSplat(origin[0]);
+    ray->originY = wideSplat(origin[1]);
+    ray->originZ = wideSplat(origin[2]);
+    ray->inverseX = wideSplat(slabInverse(direction[0]));
+    ray->inverseY = wideSplat(slabInverse(direction[1]));
+    ray->inverseZ = wideSplat(slabInverse(direction[2]));
+    ray->tMin = wideSplat(tMin);
+}
+
+// Slab test against every child box at once; returns the lanes entered before tMax and their entry
+// distances. The inverse direction is always finite (see slabInverse), so no NaN reaches min and max and
+// an axis-parallel ray lying in a slab plane touches the box, as in the binary BVH.
+static uint32_t intersectBoxes(const WideBVHNode* node, const WideRay* ray, float tMax, float* distances) {
+    WideFloat x0 = wideMul(wideSub(wideLoad(node->minX), ray->originX), ray->inverseX);
+    WideFloat x1 = wideMul(wideSub(wideLoad(node->maxX), ray->originX), ray->inverseX);
+    WideFloat y0 = wideMul(wideSub(wideLoad(node->minY), ray->originY), ray->inverseY);
+    WideFloat y1 = wideMul(wideSub(wideLoad(node->maxY), ray->originY), ray->inverseY);
+    WideFloat z0 = wideMul(wideSub(wideLoad(node->minZ), ray->originZ), ray->inverseZ);
+    WideFloat z1 = wideMul(wideSub(wideLoad(node->maxZ), ray->originZ), ray->inverseZ);
+
+    WideFloat entry = wideMax(wideMin(x0, x1), ray->tMin);
+    entry = wideMax(wideMin(y0, y1), entry);
+    entry = wideMax(wideMin(z0, z1), entry);
+    WideFloat exit = wideMin(wideMax(x0, x1), wideSplat(tMax));
+    exit = wideMin(wideMax(y0, y1), exit);
+    exit = wideMin(wideMax(z0, z1), exit);
+
+    wideStore(distances, entry);
+    return wideLessEqual(entry, exit) & ((1u << node->childCount) - 1);
+}
+
+// Pushes the selected children farthest first, so the nearest one is popped next
+static uint32_t pushChildren(const WideBVHNode* node, uint32_t mask, const float* distances, const uint32_t* rays, WideStackEntry* stack, uint32_t stackSize) {
+    uint32_t first = stackSize;
+    for (uint32_t lane = 0; lane < node->childCount; lane++) {
+        if (!(mask & (1u << lane))) continue;
+
+        WideStackEntry entry = {node->child[lane], node->count[lane], distances[lane], rays ? rays[lane] : 0};
+        uint32_t i = stackSize++;
+        for (; i > first && stack[i - 1].distance < entry.distance; i--) {
+            stack[i] = stack[i - 1];
+        }
+        stack[i] = entry;
+    }
+    return stackSize;
+}
+
+VkBool32 intersectWideBVH(const WideBVH* wide, const vec3 origin, const vec3 direction, float tMin, float tMax, BVHHit* hit) {
+    if (!wide->nodeCount) return VK_FALSE;
+
+    WideRay ray;
+    setupWideRay(&ray, origin, direction, tMin);
+
+    WideStackEntry stack[WIDE_BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = (WideStackEntry){0, 0, tMin, 0};
+    VkBool32 found = VK_FALSE;
+
+    while (stackSize) {
+        WideStackEntry entry = stack[--stackSize];
+        if (entry.distance > tMax) continue;
+
+        if (entry.count) {
+            for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+                float t, u, v;
+                if (intersectBVHTriangle(&wide->triangles[i], ray.origin, ray.direction, tMin, tMax, &t, &u, &v)) {
+                    tMax = t;
+                    hit->t = t;
+                    hit->primitive = wide->triangles[i].primitive;
+                    hit->barycentrics[0] = u;
+                    hit->barycentrics[1] = v;
+                    found = VK_TRUE;
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode* node = &wide->nodes[entry.child];
+        float distances[WIDE_BVH_WIDTH];
+        uint32_t mask = intersectBoxes(node, &ray, tMax, distances);
+        stackSize = pushChildren(node, mask, distances, NULL, stack, stackSize);
+    }
+
+    return found;
+}
+
+// One packet shares the node loads and the stack: a child is visited once for all the rays that enter it
+static void tracePacket(const WideBVH* wide, const CastRay* rays, CastHit* hits, uint32_t count) {
+    WideRay packet[WIDE_BVH_PACKET_SIZE];
+    float tMax[WIDE_BVH_PACKET_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        setupWideRay(&packet[i], rays[i].origin, rays[i].direction, rays[i].tMin);
+        tMax[i] = rays[i].tMax;
+        hits[i] = (CastHit){-1.0f, RAYCAST_MISS, RAYCAST_MISS, 0, {0.0f, 0.0f}};
+    }
+    if (!wide->nodeCount) return;
+
+    WideStackEntry stack[WIDE_BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    uint32_t allRays = count < 32 ? (1u << count) - 1 : 0xFFFFFFFFu;
+    stack[stackSize++] = (WideStackEntry){0, 0, -INFINITY, allRays};
+
+    while (stackSize) {
+        WideStackEntry entry = stack[--stackSize];
+
+        if (entry.count) {
+            for (uint32_t remaining = entry.rays; remaining; remaining &= remaining - 1) {
+                uint32_t r = lowestBit(remaining);
+                for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+                    float t, u, v;
+                    if (intersectBVHTriangle(&wide->triangles[i], packet[r].origin, packet[r].direction, rays[r].tMin, tMax[r], &t, &u, &v)) {
+                        tMax[r] = t;
+                        hits[r] = (CastHit){t, wide->triangles[i].primitive, 0, 0, {u, v}};
+                    }
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode* node = &wide->nodes[entry.child];
+        uint32_t childRays[WIDE_BVH_WIDTH] = {0};
+        float childDistances[WIDE_BVH_WIDTH];
+        for (uint32_t lane = 0; lane < WIDE_BVH_WIDTH; lane++) childDistances[lane] = INFINITY;
+
+        uint32_t mask = 0;
+        for (uint32_t remaining = entry.rays; remaining; remaining &= remaining - 1) {
+            uint32_t r = lowestBit(remaining);
+            float distances[WIDE_BVH_WIDTH];
+            uint32_t rayMask = intersectBoxes(node, &packet[r], tMax[r], distances);
+            mask |= rayMask;
+            for (; rayMask; rayMask &= rayMask - 1) {
+                uint32_t lane = lowestBit(rayMask);
+                childRays[lane] |= 1u << r;
+                if (distances[lane] < childDistances[lane]) childDistances[lane] = distances[lane];
+            }
+        }
+        stackSize = pushChildren(node, mask, childDistances, childRays, stack, stackSize);
+    }
+}
+
+void intersectWideBVHPacket(const WideBVH* wide, const CastRay* rays, CastHit* hits, uint32_t count) {
+    for (uint32_t first = 0; first < count; first += WIDE_BVH_PACKET_SIZE) {
+        uint32_t packetSize = count - first < WIDE_BVH_PACKET_SIZE ? count - first : WIDE_BVH_PACKET_SIZE;
+        tracePacket(wide, rays + first, hits + first, packetSize);
+    }
+}
+
+// Squared distances from the point to every child box; returns the lanes no farther than the bound
+static uint32_t distanceToBoxes(const WideBVHNode* node, const WideFloat* point, float bound, float* distances) {
+    WideFloat zero = wideSplat(0.0f);
+    WideFloat dx = wideMax(wideMax(wideSub(wideLoad(node->minX), point[0]), wideSub(point[0], wideLoad(node->maxX))), zero);
+    WideFloat dy = wideMax(wideMax(wideSub(wideLoad(node->minY), point[1]), wideSub(point[1], wideLoad(node->maxY))), zero);
+    WideFloat dz = wideMax(wideMax(wideSub(wideLoad(node->minZ), point[2]), wideSub(point[2], wideLoad(node->maxZ))), zero);
+    WideFloat distance = wideAdd(wideAdd(wideMul(dx, dx), wideMul(dy, dy)), wideMul(dz, dz));
+
+    wideStore(distances, distance);
+    return wideLessEqual(distance, wideSplat(bound)) & ((1u << node->childCount) - 1);
+}
+
+// Closest point on a triangle by its Voronoi regions (Ericson, Real-Time Collision Detection 5.1.5);
+// u and v weight the second and third vertex as for the ray hits
+static void closestTrianglePoint(const BVHTriangle* triangle, const float* point, float* u, float* v) {
+    const float* ab = triangle->edge1;
+    const float* ac = triangle->edge2;
+    vec3 ap, bp, cp;
+    glm_vec3_sub((float*)point, (float*)triangle->v0, ap);
+    glm_vec3_sub(ap, (float*)ab, bp);
+    glm_vec3_sub(ap, (float*)ac, cp);
+
+    float d1 = glm_vec3_dot((float*)ab, ap), d2 = glm_vec3_dot((float*)ac, ap);
+    float d3 = glm_vec3_dot((float*)ab, bp), d4 = glm_vec3_dot((float*)ac, bp);
+    float d5 = glm_vec3_dot((float*)ab, cp), d6 = glm_vec3_dot((float*)ac, cp);
+    *u = 0.0f;
+    *v = 0.0f;
+
+    if (d1 <= 0.0f && d2 <= 0.0f) return;
+    if (d3 >= 0.0f && d4 <= d3) {
+        *u = 1.0f;
+        return;
+    }
+    if (d6 >= 0.0f && d5 <= d6) {
+        *v = 1.0f;
+        return;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        *u = d1 / (d1 - d3);
+        return;
+    }
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        *v = d2 / (d2 - d6);
+        return;
+    }
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        *v = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        *u = 1.0f - *v;
+        return;
+    }
+
+    // Degenerate triangles have no interior and keep the first vertex
+    float sum = va + vb + vc;
+    if (sum <= 0.0f) return;
+    *u = vb / sum;
+    *v = vc / sum;
+}
+
+VkBool32 closestPointWideBVH(const WideBVH* wide, const vec3 point, float maxDistance, BVHHit* hit) {
+    if (!wide->nodeCount) return VK_FALSE;
+
+    WideFloat widePoint[3] = {wideSplat(point[0]), wideSplat(point[1]), wideSplat(point[2])};
+    float bound = maxDistance * maxDistance;
+
+    WideStackEntry stack[WIDE_BVH_STACK_SIZE];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = (WideStackEntry){0, 0, 0.0f, 0};
+    VkBool32 found = VK_FALSE;
+
+    while (stackSize) {
+        WideStackEntry entry = stack[--stackSize];
+        if (entry.distance > bound) continue;
+
+        if (entry.count) {
+            for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+                const BVHTriangle* triangle = &wide->triangles[i];
+                float u, v;
+                closestTrianglePoint(triangle, point, &u, &v);
+
+                vec3 closest, offset;
+                glm_vec3_copy((float*)triangle->v0, closest);
+                glm_vec3_muladds((float*)triangle->edge1, u, closest);
+                glm_vec3_muladds((float*)triangle->edge2, v, closest);
+                glm_vec3_sub(closest, (float*)point, offset);
+                float distance = glm_vec3_norm2(offset);
+                if (distance <= bound) {
+                    bound = distance;
+                    hit->t = sqrtf(distance);
+                    hit->primitive = triangle->primitive;
+                    hit->barycentrics[0] = u;
+                    hit->barycentrics[1] = v;
+                    found = VK_TRUE;
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode* node = &wide->nodes[entry.child];
+        float distances[WIDE_BVH_WIDTH];
+        uint32_t mask = distanceToBoxes(node, widePoint, bound, distances);
+        stackSize = pushChildren(node, mask, distances, NULL, stack, stackSize);
+    }
+
+    return found;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "bvh.h"
+
+// Children per node, one per SIMD lane: eight with AVX, four with SSE or the scalar fallback
+#if defined(__AVX__)
+#define WIDE_BVH_WIDTH 8
+#else
+#define WIDE_BVH_WIDTH 4
+#endif
+
+// Rays traced together by intersectWideBVHPacket, one bit each in the traversal masks
+#define WIDE_BVH_PACKET_SIZE 32
+
+// A node may push every child but one it descends into on each level
+#define WIDE_BVH_STACK_SIZE (BVH_MAX_DEPTH * WIDE_BVH_WIDTH)
+
+// Binary BVH collapsed into wide nodes with structure-of-arrays child boxes, so one SIMD test covers
+// every child. Interior children have a zero count and `child` is a node index, leaves have a nonzero
+// count and `child` is their first triangle. Lanes past childCount are unused.
+typedef struct WideBVHNode {
+    float minX[WIDE_BVH_WIDTH];
+    float minY[WIDE_BVH_WIDTH];
+    float minZ[WIDE_BVH_WIDTH];
+    float maxX[WIDE_BVH_WIDTH];
+    float maxY[WIDE_BVH_WIDTH];
+    float maxZ[WIDE_BVH_WIDTH];
+    uint32_t child[WIDE_BVH_WIDTH];
+    uint32_t count[WIDE_BVH_WIDTH];
+    uint32_t childCount;
+} WideBVHNode;
+
+typedef struct WideBVH {
+    WideBVHNode* nodes;
+    uint32_t nodeCount;
+    BVHTriangle* triangles;
+    uint32_t triangleCount;
+} WideBVH;
+
+void buildWideBVH(WideBVH* wide, const Vertex* vertices, const uint32_t* indices, uint32_t triangleCount);
+void destroyWideBVH(WideBVH* wide);
+VkBool32 intersectWideBVH(const WideBVH* wide, const vec3 origin, const vec3 direction, float tMin, float tMax, BVHHit* hit);
+void intersectWideBVHPacket(const WideBVH* wide, const CastRay* rays, CastHit* hits, uint32_t count);
+VkBool32 closestPointWideBVH(const WideBVH* wide, const vec3 point, float maxDistance, BVHHit* hit);